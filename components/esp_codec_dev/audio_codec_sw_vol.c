@@ -3,12 +3,25 @@
  *
  * SPDX-License-Identifier: Apache-2.0
  */
-#include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include "sdkconfig.h"
 #include "audio_codec_sw_vol.h"
 
-#define GAIN_0DB_SHIFT (15)
+#define GAIN_0DB_SHIFT  (15)
+#define GAIN_0DB        (1 << GAIN_0DB_SHIFT)
+#define GAIN_MAX        (0xFFFF)
+/* Gain is constant within a ramp block, so every block can be vectorized */
+#define RAMP_BLOCK_SIZE (32)
+/* PIE processes 8 lanes of 16 bits from 16 bytes aligned addresses */
+#define SIMD_ALIGN      (16)
+#define SIMD_LANES      (8)
+/* Gain table covers -96dB to +7dB, each dB is split into 64 steps and linear interpolated in 256 sub steps */
+#define GAIN_TABLE_MIN_DB  (-96)
+#define GAIN_TABLE_MAX_DB  (7)
+#define GAIN_TABLE_SHIFT   (30)
+#define GAIN_FRAC_BITS     (6)
+#define GAIN_INTERP_BITS   (8)
 
 typedef struct {
     audio_codec_vol_if_t        base;
@@ -16,11 +29,163 @@ typedef struct {
     uint16_t                    gain;
     bool                        is_open;
     int                         cur;
-    int                         step;
+    int                         step;       /* Gain change per ramp block */
+    int                         ramp_left;  /* Frames left at current gain before next step */
     int                         block_size;
     int                         duration;
 } audio_vol_t;
 
+/* round(10^(db/20) * 2^30) for db from GAIN_TABLE_MIN_DB to GAIN_TABLE_MAX_DB */
+static const uint32_t gain_db_table[] = {
+    0x0000427A, 0x00004A96, 0x000053B0, 0x00005DE6, 0x0000695B, 0x00007636, 0x000084A3, 0x000094D2,
+    0x0000A6FA, 0x0000BB5A, 0x0000D237, 0x0000EBDD, 0x000108A5, 0x000128EF, 0x00014D2A, 0x000175D1,
+    0x0001A36E, 0x0001D69C, 0x00021008, 0x00025076, 0x000298C1, 0x0002E9DD, 0x000344E0, 0x0003AAFD,
+    0x00041D90, 0x00049E1E, 0x00052E5B, 0x0005D032, 0x000685C8, 0x00075187, 0x00083622, 0x000936A1,
+    0x000A566D, 0x000B9957, 0x000D03A7, 0x000E9A2D, 0x0010624E, 0x00126216, 0x0014A051, 0x0017249D,
+    0x0019F786, 0x001D22A5, 0x0020B0BD, 0x0024ADE1, 0x0029279E, 0x002E2D28, 0x0033CF8E, 0x003A21F4,
+    0x004139D3, 0x00492F45, 0x00521D51, 0x005C224E, 0x00676045, 0x0073FD66, 0x0082248A, 0x009205C6,
+    0x00A3D70A, 0x00B7D4DD, 0x00CE4329, 0x00E76E1E, 0x0103AB3D, 0x01235A72, 0x0146E75E, 0x016ECAC5,
+    0x019B8C27, 0x01CDC38C, 0x02061B8A, 0x02455386, 0x028C4240, 0x02DBD8AD, 0x03352529, 0x0399570C,
+    0x0409C2B1, 0x0487E5FC, 0x05156D69, 0x05B439BD, 0x06666666, 0x072E50A6, 0x080E9F97, 0x090A4D30,
+    0x0A24B063, 0x0B618872, 0x0CC509AC, 0x0E53EBB4, 0x10137988, 0x1209A37B, 0x143D1362, 0x16B54338,
+    0x197A967F, 0x1C9676C7, 0x2013739E, 0x23FD6678, 0x28619AEA, 0x2D4EFBD6, 0x32D64618, 0x390A4160,
+    0x40000000, 0x47CF267E, 0x50923BE4, 0x5A6703E0, 0x656EE3DB, 0x71CF5471, 0x7FB260B5, 0x8F473507,
+};
+
+/* round(10^(k/64/20) * 2^30) for k from 0 to 64 */
+static const uint32_t gain_frac_table[] = {
+    0x40000000, 0x401D7FE7, 0x403B0D66, 0x4058A885, 0x4076514A, 0x409407BA, 0x40B1CBDC, 0x40CF9DB6,
+    0x40ED7D4F, 0x410B6AAD, 0x412965D7, 0x41476ED2, 0x416585A5, 0x4183AA57, 0x41A1DCEE, 0x41C01D70,
+    0x41DE6BE3, 0x41FCC84F, 0x421B32B9, 0x4239AB29, 0x425831A3, 0x4276C630, 0x429568D5, 0x42B41999,
+    0x42D2D883, 0x42F1A598, 0x431080E0, 0x432F6A61, 0x434E6222, 0x436D6828, 0x438C7C7C, 0x43AB9F22,
+    0x43CAD023, 0x43EA0F84, 0x44095D4C, 0x4428B983, 0x4448242D, 0x44679D53, 0x448724FA, 0x44A6BB2A,
+    0x44C65FEA, 0x44E6133F, 0x4505D530, 0x4525A5C5, 0x45458505, 0x456572F5, 0x45856F9C, 0x45A57B02,
+    0x45C5952D, 0x45E5BE25, 0x4605F5EF, 0x46263C92, 0x46469217, 0x4666F682, 0x468769DC, 0x46A7EC2B,
+    0x46C87D76, 0x46E91DC4, 0x4709CD1C, 0x472A8B84, 0x474B5904, 0x476C35A3, 0x478D2168, 0x47AE1C59,
+    0x47CF267E,
+};
+
+static int db_to_gain(float db_value)
+{
+    if (db_value <= GAIN_TABLE_MIN_DB) {
+        return 0;
+    }
+    if (db_value >= GAIN_TABLE_MAX_DB) {
+        return GAIN_MAX;
+    }
+    uint32_t pos = (uint32_t) ((db_value - GAIN_TABLE_MIN_DB) * (1 << (GAIN_FRAC_BITS + GAIN_INTERP_BITS)));
+    uint32_t idx = pos >> (GAIN_FRAC_BITS + GAIN_INTERP_BITS);
+    uint32_t frac = (pos >> GAIN_INTERP_BITS) & ((1 << GAIN_FRAC_BITS) - 1);
+    uint32_t t = pos & ((1 << GAIN_INTERP_BITS) - 1);
+    uint32_t lo = gain_frac_table[frac];
+    uint32_t f = lo + (uint32_t) (((uint64_t) (gain_frac_table[frac + 1] - lo) * t) >> GAIN_INTERP_BITS);
+    uint64_t gain = ((uint64_t) gain_db_table[idx] * f) >> GAIN_TABLE_SHIFT;
+    gain >>= GAIN_TABLE_SHIFT - GAIN_0DB_SHIFT;
+    return gain > GAIN_MAX ? GAIN_MAX : (int) gain;
+}
+
+static inline int32_t clamp_s32(int64_t v, int32_t max)
+{
+    return v > max ? max : (v < -max - 1 ? -max - 1 : (int32_t) v);
+}
+
+#if CONFIG_CODEC_SW_VOL_SIMD
+/* count is multiple of SIMD_LANES and both pointers are 16 bytes aligned, gain below 0dB so no saturation needed */
+static void scale_s16_simd(int16_t *out, const int16_t *in, int count, int16_t gain)
+{
+    __asm__ volatile(
+        "wsr.sar        %[shift]\n"
+        "ee.vldbc.16    q1, %[gain]\n"
+        "loopgtz        %[loops], 1f\n"
+        "ee.vld.128.ip  q0, %[in], 16\n"
+        "ee.vmul.s16    q2, q0, q1\n"
+        "ee.vst.128.ip  q2, %[out], 16\n"
+        "1:\n"
+        : [in] "+r"(in), [out] "+r"(out)
+        : [gain] "r"(&gain), [loops] "r"(count / SIMD_LANES), [shift] "r"(GAIN_0DB_SHIFT)
+        : "memory");
+}
+#endif
+
+static void scale_s16(int16_t *out, const int16_t *in, int count, int gain)
+{
+#if CONFIG_CODEC_SW_VOL_SIMD
+    if (gain < GAIN_0DB && (((uintptr_t) in ^ (uintptr_t) out) & (SIMD_ALIGN - 1)) == 0) {
+        /* Scalar head until aligned, vector body, scalar tail */
+        int head = ((SIMD_ALIGN - ((uintptr_t) in & (SIMD_ALIGN - 1))) & (SIMD_ALIGN - 1)) / sizeof(int16_t);
+        if (((uintptr_t) in & 1) == 0 && head < count) {
+            for (int i = 0; i < head; i++) {
+                out[i] = (in[i] * gain) >> GAIN_0DB_SHIFT;
+            }
+            int body = (count - head) & ~(SIMD_LANES - 1);
+            scale_s16_simd(out + head, in + head, body, (int16_t) gain);
+            in += head + body;
+            out += head + body;
+            count -= head + body;
+        }
+    }
+#endif
+    if (gain < GAIN_0DB) {
+        /* Cannot overflow, kept free of branches so the compiler can vectorize it */
+        for (int i = 0; i < count; i++) {
+            out[i] = (in[i] * gain) >> GAIN_0DB_SHIFT;
+        }
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        out[i] = (int16_t) clamp_s32((in[i] * gain) >> GAIN_0DB_SHIFT, INT16_MAX);
+    }
+}
+
+static void scale_s24(uint8_t *out, const uint8_t *in, int count, int gain)
+{
+    for (int i = 0; i < count; i++) {
+        int32_t v = (int32_t) ((uint32_t) in[0] << 8 | (uint32_t) in[1] << 16 | (uint32_t) in[2] << 24) >> 8;
+        v = clamp_s32(((int64_t) v * gain) >> GAIN_0DB_SHIFT, 0x7FFFFF);
+        out[0] = (uint8_t) v;
+        out[1] = (uint8_t) (v >> 8);
+        out[2] = (uint8_t) (v >> 16);
+        in += 3;
+        out += 3;
+    }
+}
+
+static void scale_s32(int32_t *out, const int32_t *in, int count, int gain)
+{
+    for (int i = 0; i < count; i++) {
+        out[i] = clamp_s32(((int64_t) in[i] * gain) >> GAIN_0DB_SHIFT, INT32_MAX);
+    }
+}
+
+static void scale_frames(audio_vol_t *vol, uint8_t *out, const uint8_t *in, int frames, int gain)
+{
+    int count = frames * vol->fs.channel;
+    int bytes = frames * vol->block_size;
+    if (gain == 0) {
+        memset(out, 0, bytes);
+        return;
+    }
+    if (gain == GAIN_0DB) {
+        if (out != in) {
+            memmove(out, in, bytes);
+        }
+        return;
+    }
+    switch (vol->fs.bits_per_sample) {
+        case 16:
+            scale_s16((int16_t *) out, (const int16_t *) in, count, gain);
+            break;
+        case 24:
+            scale_s24(out, in, count, gain);
+            break;
+        case 32:
+            scale_s32((int32_t *) out, (const int32_t *) in, count, gain);
+            break;
+        default:
+            break;
+    }
+}
+
 static int _sw_vol_close(const audio_codec_vol_if_t *h)
 {
     audio_vol_t *vol = (audio_vol_t *)h;
@@ -37,12 +202,13 @@ static int _sw_vol_open(const audio_codec_vol_if_t *h, esp_codec_dev_sample_info
     if (vol == NULL || fs == NULL) {
         return ESP_CODEC_DEV_INVALID_ARG;
     }
-    if (fs->bits_per_sample != 16) {
+    if (fs->bits_per_sample != 16 && fs->bits_per_sample != 24 && fs->bits_per_sample != 32) {
         return ESP_CODEC_DEV_NOT_SUPPORT;
     }
     vol->fs = *fs;
     vol->block_size = (vol->fs.bits_per_sample * vol->fs.channel) >> 3;
     vol->duration = duration;
+    vol->ramp_left = RAMP_BLOCK_SIZE;
     vol->is_open = true;
     return ESP_CODEC_DEV_OK;
 }
@@ -57,40 +223,24 @@ static int _sw_vol_process(const audio_codec_vol_if_t *h, uint8_t *in, int len,
     if (vol->is_open == false) {
         return ESP_CODEC_DEV_WRONG_STATE;
     }
-    int sample = len / vol->block_size;
-    if (vol->fs.bits_per_sample == 16) {
-        int16_t *v_in = (int16_t *) in;
-        int16_t *v_out = (int16_t *) out;
-        if (vol->cur == vol->gain) {
-            if (vol->gain == 0) {
-                memset(out, 0, len);
-                return 0;
-            } else {
-                for (int i = 0; i < sample; i++) {
-                    for (int j = 0; j < vol->fs.channel; j++) {
-                        *(v_out++) = ((*v_in++) * vol->cur) >> GAIN_0DB_SHIFT;
-                    }
-                }
-                return 0;
-            }
+    int frames = len / vol->block_size;
+    while (frames > 0) {
+        if (vol->step == 0) {
+            scale_frames(vol, out, in, frames, vol->cur);
+            break;
         }
-        for (int i = 0; i < sample; i++) {
-            for (int j = 0; j < vol->fs.channel; j++) {
-                *(v_out++) = ((*v_in++) * vol->cur) >> GAIN_0DB_SHIFT;
-            }
-            if (vol->step) {
-                vol->cur += vol->step;
-                if (vol->step > 0) {
-                    if (vol->cur > vol->gain) {
-                        vol->cur = vol->gain;
-                        vol->step = 0;
-                    }
-                } else {
-                    if (vol->cur < vol->gain) {
-                        vol->cur = vol->gain;
-                        vol->step = 0;
-                    }
-                }
+        int n = frames < vol->ramp_left ? frames : vol->ramp_left;
+        scale_frames(vol, out, in, n, vol->cur);
+        in += n * vol->block_size;
+        out += n * vol->block_size;
+        frames -= n;
+        vol->ramp_left -= n;
+        if (vol->ramp_left == 0) {
+            vol->ramp_left = RAMP_BLOCK_SIZE;
+            vol->cur += vol->step;
+            if ((vol->step > 0 && vol->cur >= vol->gain) || (vol->step < 0 && vol->cur <= vol->gain)) {
+                vol->cur = vol->gain;
+                vol->step = 0;
             }
         }
     }
@@ -104,21 +254,13 @@ static int _sw_vol_set(const audio_codec_vol_if_t *h, float db_value)
         return ESP_CODEC_DEV_INVALID_ARG;
     }
     // Support set volume when not opened
-    int gain;
-    if (db_value <= -96.0) {
-        gain = 0;
-    } else {
-        gain = (int) (exp(db_value / 20 * log(10)) * (1 << GAIN_0DB_SHIFT));
-    }
-    vol->gain = gain;
+    vol->gain = db_to_gain(db_value);
+    int blocks = 0;
     if (vol->is_open) {
-        float step = (float) (vol->gain - vol->cur) * 1000 / vol->duration / vol->fs.sample_rate;
-        vol->step = (int) step;
-        if (step == 0) {
-            vol->cur = vol->gain;
-        }
-    } else {
-        vol->step = 0;
+        blocks = (int) ((int64_t) vol->duration * vol->fs.sample_rate / 1000 / RAMP_BLOCK_SIZE);
+    }
+    vol->step = blocks > 0 ? (vol->gain - vol->cur) / blocks : 0;
+    if (vol->step == 0) {
         vol->cur = vol->gain;
     }
     return ESP_CODEC_DEV_OK;
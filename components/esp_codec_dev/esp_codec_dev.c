@@ -14,6 +14,8 @@
 #define TAG                 "Adev_Codec"
 
 #define VOL_TRANSITION_TIME (50)
+/* Curves reaching beyond this volume fall back to walking the curve points */
+#define VOL_TABLE_MAX_SIZE  (1024)
 
 typedef struct {
     const audio_codec_if_t      *codec_if;
@@ -28,6 +30,8 @@ typedef struct {
     bool                         mic_muted;
     bool                         sw_vol_alloced;
     esp_codec_dev_vol_curve_t    vol_curve;
+    float                       *vol_db_table;
+    int                          vol_table_size;
     bool                         disable_when_closed;
 } codec_dev_t;
 
@@ -112,6 +116,46 @@ static float _get_vol_db(esp_codec_dev_vol_curve_t *curve, int vol)
     return 0.0;
 }
 
+static void _build_vol_table(codec_dev_t *dev)
+{
+    esp_codec_dev_vol_curve_t *curve = &dev->vol_curve;
+    int size = 0;
+    if (curve->vol_map && curve->count > 0) {
+        size = curve->vol_map[curve->count - 1].vol + 1;
+    }
+    if (size <= 0 || size > VOL_TABLE_MAX_SIZE) {
+        free(dev->vol_db_table);
+        dev->vol_db_table = NULL;
+        dev->vol_table_size = 0;
+        return;
+    }
+    float *table = (float *) realloc(dev->vol_db_table, size * sizeof(float));
+    if (table == NULL) {
+        // Keep working by walking the curve
+        free(dev->vol_db_table);
+        dev->vol_db_table = NULL;
+        dev->vol_table_size = 0;
+        return;
+    }
+    for (int i = 0; i < size; i++) {
+        table[i] = _get_vol_db(curve, i);
+    }
+    dev->vol_db_table = table;
+    dev->vol_table_size = size;
+}
+
+static float _lookup_vol_db(codec_dev_t *dev, int vol)
+{
+    if (vol >= 0 && vol < dev->vol_table_size) {
+        return dev->vol_db_table[vol];
+    }
+    if (vol >= dev->vol_table_size && dev->vol_table_size > 0) {
+        // Table ends at the last curve point
+        return dev->vol_curve.vol_map[dev->vol_curve.count - 1].db_value;
+    }
+    return _get_vol_db(&dev->vol_curve, vol);
+}
+
 static void _update_codec_setting(codec_dev_t *dev)
 {
     esp_codec_dev_handle_t h = (esp_codec_dev_handle_t) dev;
@@ -139,6 +183,7 @@ esp_codec_dev_handle_t esp_codec_dev_new(esp_codec_dev_cfg_t *cfg)
     dev->data_if = cfg->data_if;
     if (cfg->dev_type & ESP_CODEC_DEV_TYPE_OUT) {
         _get_default_vol_curve(&dev->vol_curve);
+        _build_vol_table(dev);
     }
     dev->disable_when_closed = true;
     return (esp_codec_dev_handle_t) dev;
@@ -303,6 +348,7 @@ int esp_codec_dev_set_vol_curve(esp_codec_dev_handle_t handle, esp_codec_dev_vol
     dev->vol_curve.vol_map = new_map;
     memcpy(dev->vol_curve.vol_map, curve->vol_map, size);
     dev->vol_curve.count = curve->count;
+    _build_vol_table(dev);
     return ESP_CODEC_DEV_OK;
 }
 
@@ -317,7 +363,7 @@ int esp_codec_dev_set_out_vol(esp_codec_dev_handle_t handle, int volume)
         return ret;
     }
     const audio_codec_if_t *codec = dev->codec_if;
-    float db_value = _get_vol_db(&dev->vol_curve, volume);
+    float db_value = _lookup_vol_db(dev, volume);
     dev->volume = volume;
     // Prefer to use software volume setting
     if (dev->sw_vol) {
@@ -386,7 +432,7 @@ int esp_codec_dev_set_out_mute(esp_codec_dev_handle_t handle, bool mute)
     }
     // When codec not support mute set volume instead
     if (dev->sw_vol) {
-        float db_value = mute ? -100.0 : _get_vol_db(&dev->vol_curve, dev->volume);
+        float db_value = mute ? -100.0 : _lookup_vol_db(dev, dev->volume);
         dev->sw_vol->set_vol(dev->sw_vol, db_value);
     }
     return ESP_CODEC_DEV_NOT_SUPPORT;
@@ -534,6 +580,7 @@ void esp_codec_dev_delete(esp_codec_dev_handle_t handle)
         if (dev->vol_curve.vol_map) {
             free(dev->vol_curve.vol_map);
         }
+        free(dev->vol_db_table);
         // Only delete software vol when alloced internally
         if (dev->sw_vol && dev->sw_vol_alloced) {
             audio_codec_delete_vol_if(dev->sw_vol);
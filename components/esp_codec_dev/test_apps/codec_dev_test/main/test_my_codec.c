@@ -19,6 +19,27 @@ static esp_codec_dev_vol_map_t volume_maps[] = {
     {.vol = 100, .db_value = 0.0},
 };
 
+// Curve walk used before volume table is introduced
+static float ref_vol_db(esp_codec_dev_vol_map_t *map, int n, int vol)
+{
+    if (vol == 0) {
+        return -96.0;
+    }
+    if (vol >= map[n - 1].vol) {
+        return map[n - 1].db_value;
+    }
+    for (int i = 0; i < n - 1; i++) {
+        if (vol < map[i + 1].vol) {
+            if (map[i].vol != map[i + 1].vol) {
+                float ratio = (map[i + 1].db_value - map[i].db_value) / (map[i + 1].vol - map[i].vol);
+                return map[i].db_value + (vol - map[i].vol) * ratio;
+            }
+            break;
+        }
+    }
+    return 0.0;
+}
+
 /*
  * Test case for esp_codec_dev API using customized interface
  */
@@ -348,3 +369,55 @@ TEST_CASE("esp codec dev feature should not support", "[esp_codec_dev]")
     // Delete GPIO interface
     audio_codec_delete_gpio_if(gpio_if);
 }
+
+TEST_CASE("esp codec dev volume table match curve", "[esp_codec_dev]")
+{
+    const audio_codec_data_if_t *data_if = my_codec_data_new();
+    TEST_ASSERT_NOT_NULL(data_if);
+    const audio_codec_vol_if_t *vol_if = my_codec_vol_new();
+    TEST_ASSERT_NOT_NULL(vol_if);
+    my_codec_vol_t *codec_vol = (my_codec_vol_t *) vol_if;
+    esp_codec_dev_cfg_t dev_cfg = {
+        .dev_type = ESP_CODEC_DEV_TYPE_OUT,
+        .data_if = data_if,
+    };
+    esp_codec_dev_handle_t dev = esp_codec_dev_new(&dev_cfg);
+    TEST_ASSERT_NOT_NULL(dev);
+    TEST_ESP_OK(esp_codec_dev_set_vol_handler(dev, vol_if));
+
+    // Default curve
+    esp_codec_dev_vol_map_t default_maps[] = {
+        {.vol = 0, .db_value = -50.0},
+        {.vol = 100, .db_value = 0.0},
+    };
+    for (int vol = -10; vol <= 120; vol++) {
+        TEST_ESP_OK(esp_codec_dev_set_out_vol(dev, vol));
+        TEST_ASSERT_TRUE(ref_vol_db(default_maps, 2, vol) == codec_vol->vol_db);
+    }
+    // Customized curve is compiled into table when set
+    esp_codec_dev_vol_curve_t vol_curve = {
+        .count = sizeof(volume_maps) / sizeof(esp_codec_dev_vol_map_t),
+        .vol_map = volume_maps,
+    };
+    TEST_ESP_OK(esp_codec_dev_set_vol_curve(dev, &vol_curve));
+    for (int vol = -10; vol <= 120; vol++) {
+        TEST_ESP_OK(esp_codec_dev_set_out_vol(dev, vol));
+        TEST_ASSERT_TRUE(ref_vol_db(volume_maps, vol_curve.count, vol) == codec_vol->vol_db);
+    }
+    // Curve too large for table still works
+    esp_codec_dev_vol_map_t large_maps[] = {
+        {.vol = 0, .db_value = -80.0},
+        {.vol = 1000, .db_value = -20.0},
+        {.vol = 4000, .db_value = 0.0},
+    };
+    vol_curve.vol_map = large_maps;
+    vol_curve.count = sizeof(large_maps) / sizeof(esp_codec_dev_vol_map_t);
+    TEST_ESP_OK(esp_codec_dev_set_vol_curve(dev, &vol_curve));
+    for (int vol = 0; vol <= 4200; vol += 7) {
+        TEST_ESP_OK(esp_codec_dev_set_out_vol(dev, vol));
+        TEST_ASSERT_TRUE(ref_vol_db(large_maps, vol_curve.count, vol) == codec_vol->vol_db);
+    }
+    esp_codec_dev_delete(dev);
+    audio_codec_delete_data_if(data_if);
+    audio_codec_delete_vol_if(vol_if);
+}
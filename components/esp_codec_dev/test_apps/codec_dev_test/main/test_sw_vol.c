@@ -0,0 +1,217 @@
+/*
+ * SPDX-FileCopyrightText: 2025 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "unity.h"
+#include "esp_cpu.h"
+#include "esp_codec_dev_types.h"
+#include "../../../audio_codec_sw_vol.h"
+
+#define TEST_FRAMES     (1152)
+#define TEST_RATE       (48000)
+#define TEST_FADE_MS    (50)
+#define PERF_LOOPS      (20)
+
+static int16_t src_buf[TEST_FRAMES * 2 + 8] __attribute__((aligned(16)));
+static int16_t dst_buf[TEST_FRAMES * 2 + 8] __attribute__((aligned(16)));
+static int16_t ref_buf[TEST_FRAMES * 2 + 8] __attribute__((aligned(16)));
+
+static int db_to_gain(float db)
+{
+    return db <= -96.0 ? 0 : (int) (exp(db / 20 * log(10)) * (1 << 15));
+}
+
+/* Steady state of the original per sample implementation */
+static void ref_vol_s16(const int16_t *in, int16_t *out, int frames, int channel, int gain)
+{
+    for (int i = 0; i < frames; i++) {
+        for (int j = 0; j < channel; j++) {
+            *(out++) = ((*in++) * gain) >> 15;
+        }
+    }
+}
+
+static void fill_random(void *buf, int size)
+{
+    uint8_t *p = (uint8_t *) buf;
+    for (int i = 0; i < size; i++) {
+        p[i] = (uint8_t) rand();
+    }
+}
+
+static const audio_codec_vol_if_t *open_vol(float db, int bits, int channel)
+{
+    const audio_codec_vol_if_t *vol = audio_codec_new_sw_vol();
+    TEST_ASSERT_NOT_NULL(vol);
+    // Set before open so gain is applied at once without fade
+    TEST_ESP_OK(vol->set_vol(vol, db));
+    esp_codec_dev_sample_info_t fs = {
+        .bits_per_sample = bits,
+        .channel = channel,
+        .sample_rate = TEST_RATE,
+    };
+    TEST_ESP_OK(vol->open(vol, &fs, TEST_FADE_MS));
+    return vol;
+}
+
+static void close_vol(const audio_codec_vol_if_t *vol)
+{
+    vol->close(vol);
+    audio_codec_delete_vol_if(vol);
+}
+
+TEST_CASE("sw volume 16 bits bit exact with reference", "[esp_codec_dev][sw_vol]")
+{
+    const float db_list[] = {-96.0, -60.0, -33.5, -17.0, -6.0, -0.5, 0.0};
+    srand(1);
+    fill_random(src_buf, sizeof(src_buf));
+    for (int d = 0; d < sizeof(db_list) / sizeof(db_list[0]); d++) {
+        for (int channel = 1; channel <= 2; channel++) {
+            const audio_codec_vol_if_t *vol = open_vol(db_list[d], 16, channel);
+            int gain = db_to_gain(db_list[d]);
+            // Cover unaligned head, odd tail and different input output alignment
+            for (int offset = 0; offset < 8; offset++) {
+                int frames = TEST_FRAMES - offset * 3;
+                int samples = frames * channel;
+                ref_vol_s16(src_buf + offset, ref_buf, frames, channel, gain);
+                memset(dst_buf, 0, sizeof(dst_buf));
+                vol->process(vol, (uint8_t *) (src_buf + offset), samples * 2, (uint8_t *) dst_buf, samples * 2);
+                TEST_ASSERT_EQUAL_INT16_ARRAY(ref_buf, dst_buf, samples);
+                // In place
+                memcpy(dst_buf + offset, src_buf + offset, samples * 2);
+                vol->process(vol, (uint8_t *) (dst_buf + offset), samples * 2, (uint8_t *) (dst_buf + offset), samples * 2);
+                TEST_ASSERT_EQUAL_INT16_ARRAY(ref_buf, dst_buf + offset, samples);
+            }
+            close_vol(vol);
+        }
+    }
+}
+
+TEST_CASE("sw volume 24 and 32 bits", "[esp_codec_dev][sw_vol]")
+{
+    const float db_list[] = {-40.0, -6.0, 0.0, 6.0};
+    srand(2);
+    for (int d = 0; d < sizeof(db_list) / sizeof(db_list[0]); d++) {
+        int gain = db_to_gain(db_list[d]);
+        const audio_codec_vol_if_t *vol = open_vol(db_list[d], 24, 2);
+        uint8_t *in = (uint8_t *) src_buf;
+        uint8_t *out = (uint8_t *) dst_buf;
+        int samples = TEST_FRAMES;
+        fill_random(in, samples * 3);
+        vol->process(vol, in, samples * 3, out, samples * 3);
+        for (int i = 0; i < samples; i++) {
+            int32_t v = (int32_t) ((uint32_t) in[i * 3] << 8 | (uint32_t) in[i * 3 + 1] << 16 | (uint32_t) in[i * 3 + 2] << 24) >> 8;
+            int64_t expect = ((int64_t) v * gain) >> 15;
+            expect = expect > 0x7FFFFF ? 0x7FFFFF : (expect < -0x800000 ? -0x800000 : expect);
+            int32_t got = (int32_t) ((uint32_t) out[i * 3] << 8 | (uint32_t) out[i * 3 + 1] << 16 | (uint32_t) out[i * 3 + 2] << 24) >> 8;
+            TEST_ASSERT_EQUAL_INT32(expect, got);
+        }
+        close_vol(vol);
+
+        vol = open_vol(db_list[d], 32, 2);
+        int32_t *in32 = (int32_t *) src_buf;
+        int32_t *out32 = (int32_t *) dst_buf;
+        samples = TEST_FRAMES;
+        fill_random(in32, samples * 4);
+        vol->process(vol, (uint8_t *) in32, samples * 4, (uint8_t *) out32, samples * 4);
+        for (int i = 0; i < samples; i++) {
+            int64_t expect = ((int64_t) in32[i] * gain) >> 15;
+            expect = expect > INT32_MAX ? INT32_MAX : (expect < INT32_MIN ? INT32_MIN : expect);
+            TEST_ASSERT_EQUAL_INT32(expect, out32[i]);
+        }
+        close_vol(vol);
+    }
+}
+
+TEST_CASE("sw volume gain table matches exp", "[esp_codec_dev][sw_vol]")
+{
+    const audio_codec_vol_if_t *vol = audio_codec_new_sw_vol();
+    TEST_ASSERT_NOT_NULL(vol);
+    esp_codec_dev_sample_info_t fs = {
+        .bits_per_sample = 32,
+        .channel = 1,
+        .sample_rate = TEST_RATE,
+    };
+    int exact = 0;
+    int total = 0;
+    // 0dB input on 32 bits output the Q15 gain directly
+    for (int i = -9700; i <= 800; i++) {
+        float db = i / 100.0;
+        int expect = db_to_gain(db);
+        expect = expect > 0xFFFF ? 0xFFFF : expect;
+        int32_t sample = 1 << 15;
+        int32_t gain = 0;
+        // Set while closed so no fade is applied
+        TEST_ESP_OK(vol->set_vol(vol, db));
+        TEST_ESP_OK(vol->open(vol, &fs, TEST_FADE_MS));
+        vol->process(vol, (uint8_t *) &sample, sizeof(sample), (uint8_t *) &gain, sizeof(gain));
+        vol->close(vol);
+        TEST_ASSERT_INT_WITHIN(1, expect, gain);
+        exact += (gain == expect);
+        total++;
+    }
+    printf("sw volume gain table: %d of %d gains bit exact, others within 1\n", exact, total);
+    TEST_ASSERT_TRUE(exact * 100 >= total * 95);
+    audio_codec_delete_vol_if(vol);
+}
+
+TEST_CASE("sw volume ramp in blocks", "[esp_codec_dev][sw_vol]")
+{
+    const audio_codec_vol_if_t *vol = open_vol(-96.0, 16, 2);
+    // Constant input makes the applied gain visible in the output
+    int fade_frames = TEST_RATE * TEST_FADE_MS / 1000;
+    int total = fade_frames + 256;
+    int16_t *buf = (int16_t *) malloc(total * 2 * sizeof(int16_t));
+    TEST_ASSERT_NOT_NULL(buf);
+    for (int i = 0; i < total * 2; i++) {
+        buf[i] = 16384;
+    }
+    TEST_ESP_OK(vol->set_vol(vol, 0.0));
+    // Odd chunk size so ramp blocks straddle process calls
+    for (int pos = 0; pos < total; pos += 101) {
+        int n = total - pos < 101 ? total - pos : 101;
+        vol->process(vol, (uint8_t *) (buf + pos * 2), n * 4, (uint8_t *) (buf + pos * 2), n * 4);
+    }
+    for (int i = 1; i < total; i++) {
+        TEST_ASSERT_EQUAL_INT16(buf[i * 2], buf[i * 2 + 1]);
+        TEST_ASSERT_TRUE(buf[i * 2] >= buf[(i - 1) * 2]);
+        if (i % 32) {
+            // Gain only changes on block boundary
+            TEST_ASSERT_EQUAL_INT16(buf[(i - 1) * 2], buf[i * 2]);
+        }
+    }
+    TEST_ASSERT_TRUE(buf[0] < 1024);
+    TEST_ASSERT_EQUAL_INT16(16384, buf[(total - 1) * 2]);
+    free(buf);
+    close_vol(vol);
+}
+
+TEST_CASE("sw volume performance", "[esp_codec_dev][sw_vol]")
+{
+    const audio_codec_vol_if_t *vol = open_vol(-6.0, 16, 2);
+    int gain = db_to_gain(-6.0);
+    int samples = TEST_FRAMES * 2;
+    fill_random(src_buf, sizeof(src_buf));
+    uint32_t best_ref = UINT32_MAX;
+    uint32_t best_new = UINT32_MAX;
+    for (int i = 0; i < PERF_LOOPS; i++) {
+        uint32_t start = esp_cpu_get_cycle_count();
+        ref_vol_s16(src_buf, ref_buf, TEST_FRAMES, 2, gain);
+        uint32_t ref_cycles = esp_cpu_get_cycle_count() - start;
+        start = esp_cpu_get_cycle_count();
+        vol->process(vol, (uint8_t *) src_buf, samples * 2, (uint8_t *) dst_buf, samples * 2);
+        uint32_t new_cycles = esp_cpu_get_cycle_count() - start;
+        best_ref = ref_cycles < best_ref ? ref_cycles : best_ref;
+        best_new = new_cycles < best_new ? new_cycles : best_new;
+    }
+    TEST_ASSERT_EQUAL_INT16_ARRAY(ref_buf, dst_buf, samples);
+    printf("sw volume 16 bits stereo: reference %.2f cycles/sample, current %.2f cycles/sample\n",
+           (float) best_ref / samples, (float) best_new / samples);
+    close_vol(vol);
+}
@@ -0,0 +1,213 @@
+// Simulates main/clock_drift.c against a stream whose sample clock is skewed
+// from the local crystal, a second per step.
+//
+//   sim_clock_drift [--skew ppm] [--wander ppm] [--days n | --weeks n]
+//                   [--stalls per_day]
+//
+// With no options it runs the sweep ctest uses. The first tune, before the
+// skew is learned, is run on a steady network to show the transient and the
+// time to learn it. Then four weeks are run at each skew, both on a steady
+// network and with a 20 ppm daily wander and 24 outages a day. Every second
+// has a 10% chance of delivering nothing, and an outage delivers nothing for
+// 2 to 10 s before the backlog arrives at once. The measured depth carries
+// 2% of VBR noise.
+//
+// Once the first day and an hour after each rebuffer are over, the 10 minute
+// average depth has to stay within 250 ms of the setpoint, and the learned
+// skew within 20 ppm of the true one. The first tune has to learn the skew to
+// 2 ppm within 12 hours. Open loop runs show what the loop corrects.
+// Underruns come from the network model, not the loop, so they are only
+// reported.
+
+#include "clock_drift.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PREBUFFER_MS 5000.0
+#define DAY_S 86400L
+#define MAX_LEVEL_ERROR_MS 250.0
+#define MAX_LEARN_ERROR_PPM 20.0
+#define LEARNED_PPM 2.0
+#define MAX_LEARN_HOURS 12.0
+
+typedef struct {
+  double skew_ppm;
+  double wander_ppm; // amplitude of a daily sine on top of the skew
+  int days;
+  double stalls_per_day;
+} scenario_t;
+
+static unsigned s_net_seed, s_noise_seed;
+
+static double net_rand(void) {
+  s_net_seed = s_net_seed * 1103515245u + 12345u;
+  return (s_net_seed >> 8) / 16777216.0;
+}
+
+static double noise_rand(void) {
+  s_noise_seed = s_noise_seed * 1664525u + 1013904223u;
+  return (s_noise_seed >> 8) / 16777216.0;
+}
+
+// @return true if the loop held the level, always true open loop
+static bool run(const scenario_t *sc, bool closed) {
+  s_net_seed = 1;
+  s_noise_seed = 1;
+  clock_drift_t cd;
+  clock_drift_init(&cd);
+  double depth = 0;   // ms of audio in the buffer
+  double backlog = 0; // produced by the server, not yet delivered
+  bool buffering = true;
+  int underruns = 0, stall_left = 0;
+  double min_err = 0, max_err = 0, max_ppm = 0, worst_learn = 0;
+  double avg = 0, min_depth = INFINITY;
+  long settled_at = -1;
+  for (long t = 0; t < sc->days * DAY_S; t++) {
+    double skew = sc->skew_ppm + sc->wander_ppm * sin(2 * M_PI * t / DAY_S);
+    backlog += 1000 * (1 + skew * 1e-6);
+    if (stall_left == 0 && net_rand() < sc->stalls_per_day / DAY_S) {
+      stall_left = 2 + (int)(net_rand() * 9);
+    }
+    if (stall_left > 0) {
+      stall_left--;
+    } else if (net_rand() < 0.9) {
+      depth += backlog;
+      backlog = 0;
+    }
+    if (!buffering) {
+      depth -= 1000 * (1 + cd.ppm * 1e-6);
+      if (depth < 0) {
+        depth = 0;
+        buffering = true;
+        underruns++;
+        settled_at = -1;
+        clock_drift_restart(&cd);
+      }
+    } else if (depth >= PREBUFFER_MS) {
+      buffering = false;
+    }
+    if (buffering || !closed) {
+      continue;
+    }
+    // the firmware measures whole ms from a byte rate
+    float measured = (float)(unsigned)(depth * (1 + 0.02 * (noise_rand() - 0.5)));
+    clock_drift_update(&cd, measured, 1.0f);
+    if (cd.warmup_s > 0) {
+      continue;
+    }
+    if (settled_at < 0) {
+      settled_at = t;
+      avg = depth;
+    }
+    avg += (depth - avg) / 600; // 10 minute average of the true depth
+    if (t > DAY_S && t - settled_at > 3600) {
+      double err = avg - cd.setpoint_ms;
+      min_err = fmin(min_err, err);
+      max_err = fmax(max_err, err);
+      max_ppm = fmax(max_ppm, fabs((double)cd.ppm));
+      worst_learn = fmax(worst_learn, fabs(cd.skew_ppm - skew));
+      min_depth = fmin(min_depth, depth);
+    }
+  }
+  if (!closed) {
+    printf("skew %+4.0f ppm, %2d days open loop: depth ends at %6.0f ms, "
+           "%d underruns\n",
+           sc->skew_ppm, sc->days, depth, underruns);
+    return true;
+  }
+  bool ok = fmax(-min_err, max_err) <= MAX_LEVEL_ERROR_MS &&
+            worst_learn <= MAX_LEARN_ERROR_PPM;
+  printf("skew %+4.0f ppm, wander %2.0f ppm, %2.0f stalls/day, %2d days: "
+         "level - setpoint [%+4.0f, %+4.0f] ms, min depth %4.0f ms, "
+         "max |ppm| %3.0f, max |learned - true| %4.1f ppm, %d underruns%s\n",
+         sc->skew_ppm, sc->wander_ppm, sc->stalls_per_day, sc->days, min_err,
+         max_err, min_depth, max_ppm, worst_learn, underruns,
+         ok ? "" : "  FAIL");
+  return ok;
+}
+
+// The first tune on a steady network
+static bool first_tune(double skew_ppm) {
+  clock_drift_t cd;
+  clock_drift_init(&cd);
+  double depth = PREBUFFER_MS, worst = 0;
+  long learned_at = -1;
+  for (long t = 0; t < 2 * DAY_S; t++) {
+    depth += 1000 * skew_ppm * 1e-6 - cd.ppm * 1e-3;
+    clock_drift_update(&cd, (float)depth, 1.0f);
+    if (cd.warmup_s > 0) {
+      continue;
+    }
+    worst = fmax(worst, fabs(depth - cd.setpoint_ms));
+    if (fabs(cd.skew_ppm - skew_ppm) > LEARNED_PPM) {
+      learned_at = -1;
+    } else if (learned_at < 0) {
+      learned_at = t;
+    }
+  }
+  bool ok = learned_at >= 0 && learned_at <= MAX_LEARN_HOURS * 3600;
+  printf("first tune, skew %+4.0f ppm: peak excursion %4.0f ms, learned to "
+         "%.0f ppm after %.1f h%s\n",
+         skew_ppm, worst, LEARNED_PPM, learned_at / 3600.0, ok ? "" : "  FAIL");
+  return ok;
+}
+
+static int sweep(void) {
+  static const double skews[] = {-300, -100, -20, 0, 20, 100, 300};
+  int n = sizeof(skews) / sizeof(skews[0]);
+  int fails = 0;
+  for (int i = 0; i < n; i++) {
+    if (skews[i] != 0) {
+      fails += !first_tune(skews[i]);
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    fails += !run(&(scenario_t){skews[i], 0, 28, 0}, true);
+  }
+  for (int i = 0; i < n; i++) {
+    fails += !run(&(scenario_t){skews[i], 20, 28, 24}, true);
+  }
+  run(&(scenario_t){0, 0, 28, 24}, false);
+  run(&(scenario_t){100, 0, 1, 0}, false);
+  run(&(scenario_t){-100, 0, 1, 0}, false);
+  printf("%s\n", fails ? "FAIL" : "all ok");
+  return fails != 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc == 1) {
+    return sweep();
+  }
+  scenario_t sc = {0, 0, 28, 0};
+  for (int i = 1; i < argc; i++) {
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (value == NULL) {
+      fprintf(stderr, "%s needs a value\n", argv[i]);
+      return 2;
+    }
+    if (strcmp(argv[i], "--skew") == 0) {
+      sc.skew_ppm = atof(value);
+    } else if (strcmp(argv[i], "--wander") == 0) {
+      sc.wander_ppm = atof(value);
+    } else if (strcmp(argv[i], "--days") == 0) {
+      sc.days = atoi(value);
+    } else if (strcmp(argv[i], "--weeks") == 0) {
+      sc.days = 7 * atoi(value);
+    } else if (strcmp(argv[i], "--stalls") == 0) {
+      sc.stalls_per_day = atof(value);
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+    i++;
+  }
+  if (sc.days < 2) {
+    fprintf(stderr, "simulate two days or more, the first is not checked\n");
+    return 2;
+  }
+  bool ok = first_tune(sc.skew_ppm) & run(&sc, true);
+  run(&sc, false);
+  return !ok;
+}
@@ -0,0 +1,272 @@
+// Replays synthetic ICY streams through main/icy_demux.c.
+//
+// Each stream interleaves pseudo-random audio with metadata blocks every
+// metaint bytes: title blocks, empty blocks (a single zero length byte) and
+// blocks of the maximum 255 * 16 bytes. Some streams open with empty blocks
+// before the first title, and some carry a false "StreamTitle='" in the
+// audio. The network hands the demuxer reads of random length.
+//
+// Until the interval is locked, metadata can reach the decoder: empty blocks
+// pass as one byte each and a title block split across reads leaves up to
+// 13 bytes behind. Once it is locked, the interval has to be the true one,
+// the output exactly the audio of the stream from the lock on, and the last
+// title shown. A false title before the lock may instead make the demuxer
+// give up; the connection then has to fail, and the reconnect without
+// metadata has to pass the audio through untouched.
+
+#include "icy_demux.c" // the demuxer state is checked directly
+#include "host_stubs.h"
+#include <stdio.h>
+
+#define STREAM_AUDIO (1536 * 1024)
+#define READ_LEN 4096 // the HTTP reader's buffer
+#define URI "http://radio.example.org/live"
+
+typedef struct {
+  const char *name;
+  int metaint;
+  int empty_before;  // empty blocks before the first title
+  int empty_percent; // later blocks that are empty
+  int max_percent;   // later blocks of the maximum length
+  int false_titles;  // false StreamTitle=' in the audio before the first block
+  int false_later;   // and in the second half, long after the lock
+  int max_read;      // reads return 1 to max_read bytes
+  bool may_give_up;  // instead of locking, as a false title may make it
+} scenario_t;
+
+static const scenario_t s_scenarios[] = {
+    {"8000 titles only", 8000, 0, 0, 0, 0, 0, READ_LEN, false},
+    {"16000 empty blocks first", 16000, 3, 50, 0, 0, 0, READ_LEN, false},
+    {"8192 maximum length blocks", 8192, 1, 30, 30, 0, 0, READ_LEN, false},
+    {"32768 short reads", 32768, 2, 40, 20, 0, 0, 17, false},
+    {"1000 small interval", 1000, 0, 60, 10, 0, 0, 700, false},
+    {"16000 false titles after lock", 16000, 0, 30, 10, 0, 40, READ_LEN, false},
+    {"45000 false title first", 45000, 0, 20, 0, 1, 20, READ_LEN, true},
+    {"8000 false titles first", 8000, 0, 0, 0, 6, 0, READ_LEN, true},
+};
+
+typedef struct {
+  char *body;
+  int body_len;
+  int pos;
+  unsigned seed;
+  int max_read;
+} network_t;
+
+static network_t s_net;
+static char s_shown[ICY_TITLE_MAX];
+static bool s_icy_requested;
+
+void update_now_playing(const char *title) {
+  snprintf(s_shown, sizeof(s_shown), "%s", title);
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client,
+                                     const char *key, const char *value) {
+  s_icy_requested = strcmp(key, "Icy-MetaData") == 0;
+  return ESP_OK;
+}
+
+static unsigned next_rand(unsigned *seed) {
+  *seed = *seed * 1103515245u + 12345u;
+  return *seed >> 8;
+}
+
+// the HTTP reader: what the server sent, in reads of random length
+static int network_read(audio_element_handle_t self, char *buffer, int len,
+                        TickType_t ticks_to_wait, void *context) {
+  int left = s_net.body_len - s_net.pos;
+  if (left == 0) {
+    return AEL_IO_DONE;
+  }
+  int n = 1 + (int)(next_rand(&s_net.seed) % (unsigned)s_net.max_read);
+  n = n < len ? n : len;
+  n = n < left ? n : left;
+  memcpy(buffer, s_net.body + s_net.pos, n);
+  s_net.pos += n;
+  return n;
+}
+
+// Audio is random bytes with a false title block put in here and there
+static void make_audio(char *audio, int len, unsigned seed,
+                       const scenario_t *sc) {
+  int first_block = sc->metaint;
+  for (int i = 0; i < len; i++) {
+    audio[i] = (char)next_rand(&seed);
+  }
+  static const char fake[] = "\x02StreamTitle='Not a title';";
+  for (int i = 0; i < sc->false_titles; i++) {
+    // at random, evenly spaced ones would be a consistent ICY stream
+    int at = (int)(next_rand(&seed) % (unsigned)(first_block - 64));
+    memcpy(audio + at, fake, sizeof(fake) - 1);
+  }
+  for (int i = 0; i < sc->false_later; i++) {
+    int at = len / 2 + (int)(next_rand(&seed) % (unsigned)(len / 2 - 64));
+    memcpy(audio + at, fake, sizeof(fake) - 1);
+  }
+}
+
+// Interleaves audio with metadata blocks; returns the body length
+static int make_body(char *body, const char *audio, int audio_len,
+                     const scenario_t *sc, unsigned seed, char *last_title) {
+  int n = 0, block = 0;
+  for (int a = 0; a < audio_len; a += sc->metaint, block++) {
+    int chunk = audio_len - a < sc->metaint ? audio_len - a : sc->metaint;
+    memcpy(body + n, audio + a, chunk);
+    n += chunk;
+    if (chunk < sc->metaint) {
+      break;
+    }
+    unsigned r = next_rand(&seed) % 100;
+    bool empty = block < sc->empty_before ||
+                 (block > sc->empty_before && (int)r < sc->empty_percent);
+    if (empty) {
+      body[n++] = 0;
+      continue;
+    }
+    char text[ICY_META_MAX + 1] = {0};
+    snprintf(last_title, ICY_TITLE_MAX, "Artist %d - Song's %d", block, block);
+    int len = snprintf(text, sizeof(text), "StreamTitle='%s';StreamUrl='';",
+                       last_title);
+    int blocks = (len + 15) / 16;
+    if ((int)r >= 100 - sc->max_percent) {
+      // pad with a long StreamUrl up to the largest block there is
+      int at = len - 2;
+      len = snprintf(text + at, sizeof(text) - at, "http://example.org/") + at;
+      while (len < ICY_META_MAX - 2) {
+        text[len++] = 'x';
+      }
+      memcpy(text + len, "';", 2);
+      blocks = 255;
+    }
+    body[n++] = (char)blocks;
+    memcpy(body + n, text, blocks * 16);
+    n += blocks * 16;
+  }
+  return n;
+}
+
+// Pulls the whole body through the demuxer. Output from the read after the
+// interval locked on goes to locked_out; lock_at is set to the body offset
+// the network had reached then, or -1.
+static int pull(audio_element_handle_t el, char *locked_out, int *locked_len,
+                int *lock_at) {
+  stream_func read = audio_element_get_read_cb(el);
+  icy_demux_t *d = find_demux(el);
+  char buf[READ_LEN];
+  *locked_len = 0;
+  *lock_at = -1;
+  for (;;) {
+    bool locked = d->state == ICY_LOCKED;
+    int r = read(el, buf, sizeof(buf), 0, NULL);
+    if (r == AEL_IO_DONE) {
+      return 0;
+    }
+    if (r < 0) {
+      return r;
+    }
+    if (locked) {
+      memcpy(locked_out + *locked_len, buf, r);
+      *locked_len += r;
+    } else if (d->state == ICY_LOCKED) {
+      *lock_at = s_net.pos;
+    }
+  }
+}
+
+// audio bytes of the body before body offset pos
+static int audio_before(const scenario_t *sc, const char *body, int pos) {
+  int b = 0, a = 0;
+  while (b < pos) {
+    int chunk = pos - b < sc->metaint ? pos - b : sc->metaint;
+    a += chunk;
+    b += chunk;
+    if (b >= pos) {
+      break;
+    }
+    int meta = 1 + (uint8_t)body[b] * 16;
+    if (b + meta > pos) {
+      break;
+    }
+    b += meta;
+  }
+  return a;
+}
+
+// Reconnects the way the event loop does after a failed source and checks
+// that the stream, asked for without metadata, passes through untouched
+static bool reconnect_plain(audio_element_handle_t el, const char *audio,
+                            const scenario_t *sc, unsigned seed, char *out) {
+  s_net = (network_t){(char *)audio, STREAM_AUDIO, 0, seed, sc->max_read};
+  s_icy_requested = false;
+  icy_demux_request(el, NULL);
+  stream_func read = audio_element_get_read_cb(el);
+  int len = 0, r;
+  while ((r = read(el, out + len, READ_LEN, 0, NULL)) > 0) {
+    len += r;
+  }
+  return !s_icy_requested && len == STREAM_AUDIO &&
+         memcmp(out, audio, STREAM_AUDIO) == 0;
+}
+
+static bool run(const scenario_t *sc, unsigned seed) {
+  char *audio = malloc(STREAM_AUDIO);
+  char *body = malloc(STREAM_AUDIO * 2);
+  char *out = malloc(STREAM_AUDIO * 2);
+  char last_title[ICY_TITLE_MAX];
+  make_audio(audio, STREAM_AUDIO, seed, sc);
+  int body_len = make_body(body, audio, STREAM_AUDIO, sc, seed, last_title);
+
+  audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+  audio_element_handle_t el = audio_element_init(&cfg);
+  audio_element_set_tag(el, "http");
+  audio_element_set_uri(el, URI);
+  audio_element_set_read_cb(el, network_read, NULL);
+  icy_demux_attach(el);
+  icy_demux_set_active(el);
+  s_shown[0] = '\0';
+  s_net = (network_t){body, body_len, 0, seed, sc->max_read};
+  s_icy_requested = false;
+  icy_demux_request(el, NULL);
+  bool asked = s_icy_requested;
+
+  int out_len, lock_at;
+  int r = pull(el, out, &out_len, &lock_at);
+  icy_demux_t *d = find_demux(el);
+  bool ok = asked;
+  if (lock_at >= 0) {
+    int from = audio_before(sc, body, lock_at);
+    bool exact = out_len == STREAM_AUDIO - from &&
+                 memcmp(out, audio + from, out_len) == 0;
+    ok &= r == 0 && d->metaint == sc->metaint && exact &&
+          strcmp(s_shown, last_title) == 0;
+    printf("%-32s %u: locked on %5d after %6d bytes, %s%s\n", sc->name, seed,
+           d->metaint, lock_at, exact ? "audio exact" : "METADATA IN AUDIO",
+           ok ? "" : "  FAIL");
+  } else if (r == AEL_IO_FAIL) {
+    ok &= sc->may_give_up && reconnect_plain(el, audio, sc, seed, out);
+    printf("%-32s %u: gave up, reconnected without metadata%s\n", sc->name,
+           seed, ok ? "" : "  FAIL");
+  } else {
+    ok = false;
+    printf("%-32s %u: never locked  FAIL\n", sc->name, seed);
+  }
+
+  icy_demux_detach(el);
+  audio_element_deinit(el);
+  free(audio);
+  free(body);
+  free(out);
+  return ok;
+}
+
+int main(void) {
+  int fails = 0;
+  for (size_t i = 0; i < sizeof(s_scenarios) / sizeof(s_scenarios[0]); i++) {
+    for (unsigned seed = 1; seed <= 4; seed++) {
+      fails += !run(&s_scenarios[i], seed);
+    }
+  }
+  printf("\n%s\n", fails ? "FAIL" : "all ok");
+  return fails != 0;
+}
@@ -0,0 +1,463 @@
+// Checks main/json_sax.c and the station list import built on it.
+//
+// Each document is fed to the parser whole, a byte at a time and split in
+// two at every byte boundary, and every way has to give the tokens cJSON
+// finds in it. Every proper prefix of a document has to be rejected as cut
+// short, malformed documents as malformed however they are split, and
+// strings and nesting past the limits as too large.
+//
+// read_stations_json() then has to build, from a station list with every
+// kind of entry it skips or clamps, the list the cJSON import it replaced
+// built, again for reads split at every boundary. Truncated lists and lists
+// past CONFIG_RADIO_STATION_LIST_MAX_KB have to leave the list as it was, the
+// latter without reading much past the limit.
+
+#include "json_sax.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "station_data.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_MAX 8192
+
+// a station list with entries that are skipped, fields of the wrong type,
+// unknown members holding containers, and settings that are clamped
+static const char s_stations[] =
+    "[\n"
+    " {\"call_sign\": \"KEXP\", \"origin\": \"Seattle\",\n"
+    "  \"uri\": \"https://kexp.streamguys1.com/kexp160.aac\", \"codec\": 1,\n"
+    "  \"meta_driver\": 1, \"meta_uri\": \"https://api.kexp.org/v2/plays/\"},\n"
+    " {\"CALL_SIGN\": \"K\\u00e9\\\"\\\\\\/\\t\\ud83c\\udfb5\", "
+    "\"Origin\": \"Seattle\", \"URI\": \"http://a/\\u20ac\", \"codec\": 2.9,\n"
+    "  \"meta_driver\": 7, \"meta_uri\": \"\", \"fallback_uri\": "
+    "\"http://relay.example.org/b\",\n"
+    "  \"extra\": {\"a\": [1, {\"b\": [true, null]}], \"dsp\": {\"bands\": 1}}},\n"
+    " {\"call_sign\": \"NOURI\", \"origin\": \"x\", \"codec\": 0},\n"
+    " {\"call_sign\": 5, \"origin\": \"x\", \"uri\": \"u\", \"codec\": 0},\n"
+    " {\"call_sign\": \"STRCODEC\", \"origin\": \"x\", \"uri\": \"u\", "
+    "\"codec\": \"1\"},\n"
+    " [\"not\", \"a\", \"station\"], 42, null,\n"
+    " {\"call_sign\": \"DSP\", \"origin\": \"Durango\", \"uri\": \"u\", "
+    "\"codec\": 3e0,\n"
+    "  \"meta_driver\": -1, \"fallback_uri\": \"http://relay.example.org/b\",\n"
+    "  \"dsp\": {\"bands\": [{\"type\": 1, \"freq\": 120, \"gain\": 3.5},\n"
+    "   {\"type\": 0, \"freq\": 30000, \"gain\": -40, \"q\": 0.01},\n"
+    "   {\"freq\": 1000}, {\"type\": 2, \"freq\": 8e3, \"q\": 1.41, \"x\": {}},\n"
+    "   {\"type\": 3, \"freq\": 40, \"gain\": true}, {\"type\": 4, \"freq\": 50},\n"
+    "   {\"type\": 0, \"freq\": 60}, 7, [1]],\n"
+    "   \"limiter\": false, \"ceiling\": 2, \"release\": 1e9, "
+    "\"other\": [[[]]]}},\n"
+    " {\"call_sign\": \"NODSP\", \"origin\": \"Durango\", \"uri\": \"u2\", "
+    "\"codec\": 1,\n"
+    "  \"dsp\": null, \"fallback_uri\": null, \"meta_driver\": 2.5},\n"
+    " {\"call_sign\": \"BIG\", \"origin\": \"x\", \"uri\": \"u3\", "
+    "\"codec\": 12345678901234,\n"
+    "  \"dsp\": \"flat\"}\n"
+    "]";
+
+static const char *s_tokens[] = {
+    "{\"a\":[1,-0.5,2.5e3,1E-2,0,-0,1e+2],\"b\\u00e9\\ud83c\\udfb5\":"
+    "\"x\\ty\\n\\\"q\\\"\\\\/\\/\\b\\f\\r\",\"c\":{\"d\":[[],{}],\"e\":null,"
+    "\"f\":true,\"g\":false},\"\":\"\"}",
+    " [ \"\\u20ac\" , 123456789012 ,\t1.7976931348623157e308,\r\n-1e-300 ] ",
+    "\"top\"",
+    "-12.5e-1",
+    "true",
+    s_stations,
+};
+
+static const char *s_malformed[] = {
+    "[1,]", "{\"a\" 1}", "{\"a\":tru}", "[01]", "[\"\x01\"]",
+    "[\"\\uZZZZ\"]", "[1] [2]", "{\"a\":1,}", "[-]", "[1.]", "[.5]",
+    "{1:2}", "]", "[\"\\ud83c\"]", "[\"\\udfb5\"]", "[\"\\u0000\"]",
+    "[\"\\x\"]", "{\"a\":1]", "[1}", "nul", "[+1]", "[1e]", "",
+};
+
+static int check(const char *what, bool ok) {
+  printf("%-50s %s\n", what, ok ? "ok" : "FAIL");
+  return !ok;
+}
+
+typedef struct {
+  char text[TRACE_MAX];
+  size_t len;
+} trace_t;
+
+static void trace_add(trace_t *t, const char *s, size_t n) {
+  if (t->len + n < TRACE_MAX) {
+    memcpy(t->text + t->len, s, n);
+    t->len += n;
+  }
+}
+
+static void trace_token(trace_t *t, char kind, const char *s, size_t n) {
+  char head[24];
+  trace_add(t, head, snprintf(head, sizeof(head), "%c%zu:", kind, n));
+  trace_add(t, s, n);
+  trace_add(t, "\n", 1);
+}
+
+static void trace_number(trace_t *t, double d) {
+  char num[40];
+  trace_add(t, num, snprintf(num, sizeof(num), "N%.17g\n", d));
+}
+
+static esp_err_t trace_event(json_sax_event_t event,
+                             const json_sax_value_t *v, void *ctx) {
+  trace_t *t = ctx;
+  switch (event) {
+  case JSON_SAX_OBJECT_START: trace_add(t, "{\n", 2); break;
+  case JSON_SAX_OBJECT_END: trace_add(t, "}\n", 2); break;
+  case JSON_SAX_ARRAY_START: trace_add(t, "[\n", 2); break;
+  case JSON_SAX_ARRAY_END: trace_add(t, "]\n", 2); break;
+  case JSON_SAX_KEY: trace_token(t, 'K', v->str, v->len); break;
+  case JSON_SAX_STRING: trace_token(t, 'S', v->str, v->len); break;
+  case JSON_SAX_NUMBER: trace_number(t, v->number); break;
+  case JSON_SAX_BOOL: trace_add(t, v->boolean ? "T\n" : "F\n", 2); break;
+  case JSON_SAX_NULL: trace_add(t, "Z\n", 2); break;
+  }
+  return ESP_OK;
+}
+
+// the same trace from the cJSON tree
+static void trace_tree(trace_t *t, const cJSON *item) {
+  if (item->string) {
+    trace_token(t, 'K', item->string, strlen(item->string));
+  }
+  if (cJSON_IsObject(item) || cJSON_IsArray(item)) {
+    bool object = cJSON_IsObject(item);
+    trace_add(t, object ? "{\n" : "[\n", 2);
+    for (const cJSON *c = item->child; c; c = c->next) {
+      trace_tree(t, c);
+    }
+    trace_add(t, object ? "}\n" : "]\n", 2);
+  } else if (cJSON_IsString(item)) {
+    trace_token(t, 'S', item->valuestring, strlen(item->valuestring));
+  } else if (cJSON_IsNumber(item)) {
+    trace_number(t, item->valuedouble);
+  } else if (cJSON_IsBool(item)) {
+    trace_add(t, cJSON_IsTrue(item) ? "T\n" : "F\n", 2);
+  } else {
+    trace_add(t, "Z\n", 2);
+  }
+}
+
+// parses doc in pieces of step bytes, the first one first bytes long
+static esp_err_t parse(const char *doc, size_t len, size_t first,
+                       size_t step, trace_t *t) {
+  static json_sax_t p;
+  t->len = 0;
+  json_sax_init(&p, trace_event, t);
+  size_t at = 0, n = first;
+  while (at < len) {
+    n = n < len - at ? n : len - at;
+    esp_err_t err = json_sax_feed(&p, doc + at, n);
+    if (err != ESP_OK) {
+      return err;
+    }
+    at += n;
+    n = step;
+  }
+  return json_sax_finish(&p);
+}
+
+static bool same_trace(const trace_t *a, const trace_t *b) {
+  return a->len == b->len && memcmp(a->text, b->text, a->len) == 0;
+}
+
+static int check_tokens(void) {
+  static trace_t expected, got;
+  int fails = 0;
+  for (size_t i = 0; i < sizeof(s_tokens) / sizeof(s_tokens[0]); i++) {
+    const char *doc = s_tokens[i];
+    size_t len = strlen(doc);
+    cJSON *tree = cJSON_Parse(doc);
+    expected.len = 0;
+    trace_tree(&expected, tree);
+    cJSON_Delete(tree);
+
+    bool whole = parse(doc, len, len, len, &got) == ESP_OK &&
+                 same_trace(&expected, &got);
+    bool bytes = parse(doc, len, 1, 1, &got) == ESP_OK &&
+                 same_trace(&expected, &got);
+    bool splits = true;
+    for (size_t k = 1; k < len; k++) {
+      splits &= parse(doc, len, k, len, &got) == ESP_OK &&
+                same_trace(&expected, &got);
+    }
+    // trailing white space is not needed, anything less is cut short
+    size_t end = len;
+    while (end > 0 && strchr(" \t\r\n", doc[end - 1])) {
+      end--;
+    }
+    bool prefixes = true;
+    for (size_t k = 0; k < end; k++) {
+      esp_err_t err = parse(doc, k, k, k, &got);
+      // a number is complete at any of its digits
+      prefixes &= err == ESP_ERR_INVALID_ARG ||
+                  (err == ESP_OK && doc[0] == '-');
+    }
+    char what[64];
+    snprintf(what, sizeof(what), "document %zu: whole, bytes, splits, prefixes",
+             i + 1);
+    fails += check(what, whole && bytes && splits && prefixes);
+  }
+  return fails;
+}
+
+static int check_malformed(void) {
+  static trace_t got;
+  bool all = true;
+  for (size_t i = 0; i < sizeof(s_malformed) / sizeof(s_malformed[0]); i++) {
+    const char *doc = s_malformed[i];
+    size_t len = strlen(doc);
+    bool ok = parse(doc, len, len, len, &got) == ESP_ERR_INVALID_ARG;
+    for (size_t k = 1; k < len; k++) {
+      ok &= parse(doc, len, k, 1, &got) == ESP_ERR_INVALID_ARG;
+    }
+    if (!ok) {
+      printf("  accepted \"%s\"\n", doc);
+    }
+    all &= ok;
+  }
+  return check("malformed documents rejected however split", all);
+}
+
+static int check_limits(void) {
+  static trace_t got;
+  static char doc[JSON_SAX_TOKEN_MAX + 8];
+  int fails = 0;
+  for (int len = JSON_SAX_TOKEN_MAX; len <= JSON_SAX_TOKEN_MAX + 1; len++) {
+    doc[0] = '"';
+    memset(doc + 1, 'a', len);
+    strcpy(doc + 1 + len, "\"");
+    esp_err_t err = parse(doc, len + 2, 100, 100, &got);
+    fails += check(len == JSON_SAX_TOKEN_MAX ? "longest string accepted"
+                                             : "longer string too large",
+                   err == (len == JSON_SAX_TOKEN_MAX ? ESP_OK
+                                                     : ESP_ERR_INVALID_SIZE));
+  }
+  for (int depth = JSON_SAX_DEPTH_MAX; depth <= JSON_SAX_DEPTH_MAX + 1;
+       depth++) {
+    memset(doc, '[', depth);
+    memset(doc + depth, ']', depth);
+    esp_err_t err = parse(doc, 2 * depth, 1, 1, &got);
+    fails += check(depth == JSON_SAX_DEPTH_MAX ? "deepest nesting accepted"
+                                               : "deeper nesting too large",
+                   err == (depth == JSON_SAX_DEPTH_MAX ? ESP_OK
+                                                       : ESP_ERR_INVALID_SIZE));
+  }
+  return fails;
+}
+
+// The cJSON import read_stations_json() replaced, as it was
+static void reference_dsp(const cJSON *obj, dsp_settings_t *dsp) {
+  *dsp = (dsp_settings_t)DSP_SETTINGS_DEFAULT();
+  cJSON *band = NULL;
+  cJSON_ArrayForEach(band, cJSON_GetObjectItem(obj, "bands")) {
+    if (dsp->band_count == DSP_MAX_BANDS) {
+      break;
+    }
+    cJSON *type = cJSON_GetObjectItem(band, "type");
+    cJSON *freq = cJSON_GetObjectItem(band, "freq");
+    cJSON *gain = cJSON_GetObjectItem(band, "gain");
+    cJSON *q = cJSON_GetObjectItem(band, "q");
+    if (!cJSON_IsNumber(type) || !cJSON_IsNumber(freq)) {
+      continue;
+    }
+    dsp_band_t *b = &dsp->bands[dsp->band_count++];
+    b->type = (dsp_band_type_t)type->valueint;
+    b->freq = (float)freq->valuedouble;
+    b->gain_db = cJSON_IsNumber(gain) ? (float)gain->valuedouble : 0.0f;
+    b->q = cJSON_IsNumber(q) ? (float)q->valuedouble : 0.707f;
+  }
+  cJSON *limiter = cJSON_GetObjectItem(obj, "limiter");
+  cJSON *ceiling = cJSON_GetObjectItem(obj, "ceiling");
+  cJSON *release = cJSON_GetObjectItem(obj, "release");
+  if (cJSON_IsBool(limiter)) {
+    dsp->limiter = cJSON_IsTrue(limiter);
+  }
+  if (cJSON_IsNumber(ceiling)) {
+    dsp->ceiling_db = (float)ceiling->valuedouble;
+  }
+  if (cJSON_IsNumber(release)) {
+    dsp->release_ms = (float)release->valuedouble;
+  }
+  dsp_clamp_settings(dsp);
+}
+
+static char *reference_string(const cJSON *item) {
+  return cJSON_IsString(item) && item->valuestring[0]
+             ? strdup(item->valuestring)
+             : NULL;
+}
+
+static int reference_list(cJSON *json, station_t *out, int max) {
+  int n = 0;
+  cJSON *item = NULL;
+  cJSON_ArrayForEach(item, json) {
+    cJSON *call_sign = cJSON_GetObjectItem(item, "call_sign");
+    cJSON *origin = cJSON_GetObjectItem(item, "origin");
+    cJSON *uri = cJSON_GetObjectItem(item, "uri");
+    cJSON *codec = cJSON_GetObjectItem(item, "codec");
+    cJSON *meta_driver = cJSON_GetObjectItem(item, "meta_driver");
+    cJSON *dsp = cJSON_GetObjectItem(item, "dsp");
+    if (n == max || !cJSON_IsString(call_sign) || !cJSON_IsString(origin) ||
+        !cJSON_IsString(uri) || !cJSON_IsNumber(codec)) {
+      continue;
+    }
+    station_t *st = &out[n++];
+    st->call_sign = strdup(call_sign->valuestring);
+    st->origin = strdup(origin->valuestring);
+    st->uri = strdup(uri->valuestring);
+    st->codec = (codec_type_t)codec->valueint;
+    st->meta_driver = META_DRIVER_ICECAST_JSON;
+    if (cJSON_IsNumber(meta_driver) && meta_driver->valueint >= 0 &&
+        meta_driver->valueint <= META_DRIVER_NONE) {
+      st->meta_driver = (metadata_driver_t)meta_driver->valueint;
+    }
+    st->meta_uri = reference_string(cJSON_GetObjectItem(item, "meta_uri"));
+    st->fallback_uri =
+        reference_string(cJSON_GetObjectItem(item, "fallback_uri"));
+    st->has_dsp = cJSON_IsObject(dsp);
+    reference_dsp(dsp, &st->dsp);
+  }
+  return n;
+}
+
+static bool same_string(const char *a, const char *b) {
+  return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+static bool same_station(const station_t *a, const station_t *b) {
+  const dsp_settings_t *x = &a->dsp, *y = &b->dsp;
+  bool same = same_string(a->call_sign, b->call_sign) &&
+              same_string(a->origin, b->origin) &&
+              same_string(a->uri, b->uri) && a->codec == b->codec &&
+              a->meta_driver == b->meta_driver &&
+              same_string(a->meta_uri, b->meta_uri) &&
+              same_string(a->fallback_uri, b->fallback_uri) &&
+              a->has_dsp == b->has_dsp && x->band_count == y->band_count &&
+              x->limiter == y->limiter && x->ceiling_db == y->ceiling_db &&
+              x->release_ms == y->release_ms;
+  for (int i = 0; same && i < x->band_count; i++) {
+    same = memcmp(&x->bands[i], &y->bands[i], sizeof(dsp_band_t)) == 0;
+  }
+  return same;
+}
+
+static bool same_list(const station_t *list, int count) {
+  bool same = station_count == count;
+  for (int i = 0; same && i < count; i++) {
+    same = same_station(&radio_stations[i], &list[i]);
+  }
+  return same;
+}
+
+// hands over doc in reads that never cross split; *read counts the bytes
+typedef struct {
+  const char *doc;
+  size_t len, pos, split;
+  size_t read;
+} reader_t;
+
+static int read_doc(char *buf, size_t len, void *ctx) {
+  reader_t *r = ctx;
+  size_t end = r->pos < r->split ? r->split : r->len;
+  size_t n = end - r->pos < len ? end - r->pos : len;
+  memcpy(buf, r->doc + r->pos, n);
+  r->pos += n;
+  r->read += n;
+  return (int)n;
+}
+
+static esp_err_t import(const char *doc, size_t len, size_t split,
+                        size_t *read) {
+  reader_t r = {doc, len, 0, split, 0};
+  esp_err_t err = read_stations_json(read_doc, &r);
+  if (read) {
+    *read = r.read;
+  }
+  return err;
+}
+
+static int check_stations(void) {
+  static station_t expected[16];
+  cJSON *json = cJSON_Parse(s_stations);
+  int count = reference_list(json, expected, 16);
+  cJSON_Delete(json);
+  size_t len = strlen(s_stations);
+  int fails = check("cJSON import keeps 5 of the 11 entries", count == 5);
+
+  fails += check("station list imports as cJSON imported it",
+                 import(s_stations, len, len, NULL) == ESP_OK &&
+                     same_list(expected, count));
+  bool splits = true;
+  for (size_t k = 1; k < len; k++) {
+    free_station_data();
+    splits &= import(s_stations, len, k, NULL) == ESP_OK &&
+              same_list(expected, count);
+  }
+  fails += check("and so when split at every byte", splits);
+
+  // errors are logged once per import, and these are expected
+  esp_log_level_set("STATION_DATA", ESP_LOG_NONE);
+  const station_t *before = radio_stations;
+  bool kept = true;
+  for (size_t k = 0; k < len; k++) {
+    kept &= import(s_stations, k, k, NULL) == ESP_ERR_INVALID_ARG &&
+            radio_stations == before && same_list(expected, count);
+  }
+  fails += check("truncated lists change nothing", kept);
+
+  static const char *empty[] = {"[]", "[{\"call_sign\":\"K\"}, 1]", "{}"};
+  kept = true;
+  for (size_t i = 0; i < sizeof(empty) / sizeof(empty[0]); i++) {
+    kept &= import(empty[i], strlen(empty[i]), 1, NULL) ==
+                ESP_ERR_INVALID_ARG &&
+            radio_stations == before;
+  }
+  fails += check("lists without a station change nothing", kept);
+
+  // the list padded with white space to the limit, and 64 KB past it
+  size_t big_len = STATION_LIST_MAX_SIZE + 64 * 1024;
+  char *big = malloc(big_len);
+  memset(big, ' ', big_len);
+  memcpy(big, s_stations, len);
+  size_t read;
+  bool at_limit = import(big, STATION_LIST_MAX_SIZE, 1000, NULL) == ESP_OK &&
+                  same_list(expected, count);
+  before = radio_stations;
+  esp_err_t err = import(big, big_len, 1000, &read);
+  fails += check("list at CONFIG_RADIO_STATION_LIST_MAX_KB accepted",
+                 at_limit);
+  fails += check("a longer one rejected, nothing changed",
+                 err == ESP_ERR_INVALID_SIZE && radio_stations == before &&
+                     same_list(expected, count));
+  // the import reads 256 bytes at a time
+  fails += check("without reading on", read <= STATION_LIST_MAX_SIZE + 256);
+  esp_log_level_set("STATION_DATA", ESP_LOG_INFO);
+
+  free(big);
+  for (int i = 0; i < count; i++) {
+    free(expected[i].call_sign);
+    free(expected[i].origin);
+    free(expected[i].uri);
+    free(expected[i].meta_uri);
+    free(expected[i].fallback_uri);
+  }
+  free_station_data();
+  return fails;
+}
+
+int main(void) {
+  int fails = check_tokens();
+  fails += check_malformed();
+  fails += check_limits();
+  printf("\n");
+  fails += check_stations();
+  printf("\n%s\n", fails ? "FAIL" : "all ok");
+  return fails != 0;
+}
@@ -0,0 +1,290 @@
+// Learned level benchmark for main/loudness.c.
+//
+// Plays several minutes of programme through the element and compares the
+// level it learns with a double precision reference that meters the same
+// audio (BS.1770 K-weighting, 3 s short-term window, 100 ms blocks) and runs
+// the same gated running mean. Two cases: a station heard for the first time,
+// and one whose level restored from NVS is 2.5 LU off, which a mean kept in
+// whole cLU never corrects.
+//
+//   test_loudness [pcm [rate]]
+//
+// pcm is a recording as raw 16-bit little-endian stereo, at least three
+// minutes of it, such as a station captured with
+//   ffmpeg -i <stream url> -t 360 -f s16le -ac 2 -ar 44100 station.pcm
+// Without it a programme is synthesised: pink noise songs with a beat, at
+// different levels, with silent gaps between them.
+
+#include "host_stubs.h"
+#include "loudness.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_MS 100
+#define WINDOW_BLOCKS 30
+#define MIN_WINDOW_BLOCKS 10
+#define TAU_BLOCKS 600
+#define PRIOR_BLOCKS 300
+#define GATE_ABS (-70.0)
+#define GATE_REL (-10.0)
+#define TARGET_LUFS (-18)
+#define STALE_LU 2.5
+#define TOLERANCE_LU 0.1
+
+typedef struct {
+  double b[3], a[3];
+} biquad_t;
+
+typedef struct {
+  biquad_t shelf, hp;
+  double z[2][2][4]; // per channel, per filter: x1, x2, y1, y2
+  int block_frames;
+  double block_energy;
+  int block_pos;
+  double window[WINDOW_BLOCKS];
+  int window_len, window_next;
+  double est;
+  int est_blocks;
+} reference_t;
+
+static double run_biquad(const biquad_t *f, double *z, double x) {
+  double y = f->b[0] * x + f->b[1] * z[0] + f->b[2] * z[1] - f->a[1] * z[2] -
+             f->a[2] * z[3];
+  z[1] = z[0];
+  z[0] = x;
+  z[3] = z[2];
+  z[2] = y;
+  return y;
+}
+
+// BS.1770 K-weighting at any rate from the analogue prototypes
+static void reference_init(reference_t *r, int rate) {
+  memset(r, 0, sizeof(*r));
+  double k = tan(M_PI * 1681.974450955533 / rate);
+  double q = 0.7071752369554196;
+  double vh = pow(10, 3.999843853973347 / 20);
+  double vb = pow(vh, 0.4996667741545416);
+  double a0 = 1 + k / q + k * k;
+  r->shelf = (biquad_t){{(vh + vb * k / q + k * k) / a0, 2 * (k * k - vh) / a0,
+                         (vh - vb * k / q + k * k) / a0},
+                        {1, 2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0}};
+  k = tan(M_PI * 38.13547087602444 / rate);
+  q = 0.5003270373238773;
+  a0 = 1 + k / q + k * k;
+  r->hp = (biquad_t){{1, -2, 1},
+                     {1, 2 * (k * k - 1) / a0, (1 - k / q + k * k) / a0}};
+  r->block_frames = rate * BLOCK_MS / 1000;
+}
+
+// What loudness_set_station() does to the meter and the learned level
+static void reference_tune(reference_t *r, bool known, double level) {
+  memset(r->z, 0, sizeof(r->z));
+  r->block_energy = 0;
+  r->block_pos = 0;
+  r->window_len = 0;
+  r->window_next = 0;
+  r->est = known ? level : TARGET_LUFS;
+  r->est_blocks = known ? PRIOR_BLOCKS : 0;
+}
+
+static void reference_end_block(reference_t *r) {
+  r->window[r->window_next] = r->block_energy;
+  r->window_next = (r->window_next + 1) % WINDOW_BLOCKS;
+  if (r->window_len < WINDOW_BLOCKS) {
+    r->window_len++;
+  }
+  r->block_energy = 0;
+  r->block_pos = 0;
+
+  double sum = 0;
+  for (int i = 0; i < r->window_len; i++) {
+    sum += r->window[(r->window_next - 1 - i + WINDOW_BLOCKS) % WINDOW_BLOCKS];
+  }
+  double power = sum / ((double)r->window_len * r->block_frames);
+  double lufs = power > 0 ? -0.691 + 10 * log10(power) : -INFINITY;
+  if (r->window_len >= MIN_WINDOW_BLOCKS && lufs > GATE_ABS &&
+      (r->est_blocks == 0 || lufs > r->est + GATE_REL)) {
+    if (r->est_blocks < TAU_BLOCKS) {
+      r->est_blocks++;
+    }
+    r->est += (lufs - r->est) / r->est_blocks;
+  }
+}
+
+static void reference_run(reference_t *r, const int16_t *pcm, size_t frames) {
+  for (size_t i = 0; i < frames; i++) {
+    for (int c = 0; c < 2; c++) {
+      double x = pcm[2 * i + c] / 32768.0;
+      double y = run_biquad(&r->hp, r->z[c][1],
+                            run_biquad(&r->shelf, r->z[c][0], x));
+      r->block_energy += y * y;
+    }
+    if (++r->block_pos == r->block_frames) {
+      reference_end_block(r);
+    }
+  }
+}
+
+static uint32_t s_rng = 0x12345678;
+
+static double noise(void) {
+  s_rng ^= s_rng << 13;
+  s_rng ^= s_rng >> 17;
+  s_rng ^= s_rng << 5;
+  return s_rng / 2147483648.0 - 1;
+}
+
+// Songs as pink noise and two tones under a 2 Hz beat, with gaps of silence
+static int16_t *synthesise(int rate, size_t *frames) {
+  static const struct {
+    double db; // 0 for a gap
+    int seconds;
+  } songs[] = {{-20, 75}, {0, 3}, {-23, 90}, {0, 2}, {-21.5, 80},
+               {0, 3},    {-19, 60}, {0, 2}, {-22, 45}};
+  size_t n = 0;
+  for (size_t s = 0; s < sizeof(songs) / sizeof(songs[0]); s++) {
+    n += (size_t)songs[s].seconds * rate;
+  }
+  int16_t *pcm = malloc(n * 4);
+  double pink[2][7] = {{0}};
+  size_t t = 0;
+  for (size_t s = 0; s < sizeof(songs) / sizeof(songs[0]); s++) {
+    double amp = songs[s].db ? 3 * pow(10, songs[s].db / 20) : 0;
+    for (size_t i = 0; i < (size_t)songs[s].seconds * rate; i++, t++) {
+      double beat = 0.6 + 0.4 * sin(2 * M_PI * 2 * t / rate);
+      double tone = 0.3 * sin(2 * M_PI * 220.0 * t / rate) +
+                    0.2 * sin(2 * M_PI * 3300.0 * t / rate);
+      for (int c = 0; c < 2; c++) {
+        double *b = pink[c], w = noise();
+        b[0] = 0.99886 * b[0] + w * 0.0555179;
+        b[1] = 0.99332 * b[1] + w * 0.0750759;
+        b[2] = 0.96900 * b[2] + w * 0.1538520;
+        b[3] = 0.86650 * b[3] + w * 0.3104856;
+        b[4] = 0.55000 * b[4] + w * 0.5329522;
+        b[5] = -0.7616 * b[5] - w * 0.0168980;
+        double p = (b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + w * 0.5362);
+        b[6] = w * 0.115926;
+        double v = amp * beat * (0.11 * p + 0.3 * tone) * 32767;
+        pcm[2 * t + c] = (int16_t)fmax(-32768, fmin(32767, lrint(v)));
+      }
+    }
+  }
+  *frames = n;
+  return pcm;
+}
+
+static int16_t *read_pcm(const char *path, size_t *frames) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    perror(path);
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  *frames = (size_t)ftell(f) / 4;
+  fseek(f, 0, SEEK_SET);
+  int16_t *pcm = malloc(*frames * 4 + 4);
+  *frames = fread(pcm, 4, *frames, f);
+  fclose(f);
+  return pcm;
+}
+
+// The element's learned level, read back from the gain it settles on
+static double learned(audio_element_handle_t el) {
+  return TARGET_LUFS - loudness_get_gain_db(el);
+}
+
+// Plays frames of pcm a block at a time, printing the learned level against
+// the reference each minute.
+// @return Largest difference after the first minute, in LU.
+static double play(audio_element_handle_t el, reference_t *r,
+                   const int16_t *pcm, size_t frames, int rate) {
+  size_t block = r->block_frames;
+  size_t minute = (size_t)rate * 60;
+  double worst = 0;
+  for (size_t pos = 0; pos + block <= frames; pos += block) {
+    host_element_run(el, pcm + 2 * pos, block * 4, NULL, 0);
+    reference_run(r, pcm + 2 * pos, block);
+    size_t end = pos + block;
+    if (end >= minute && (end % minute < block || end + block > frames)) {
+      double diff = fabs(learned(el) - r->est);
+      printf("  %5.1f min: learned %7.2f LUFS, reference %7.2f LUFS, "
+             "off by %.2f LU\n",
+             end / (double)minute, learned(el), r->est, diff);
+      worst = diff > worst ? diff : worst;
+    }
+  }
+  return worst;
+}
+
+int main(int argc, char **argv) {
+  int rate = argc > 2 ? atoi(argv[2]) : 44100;
+  size_t frames = 0;
+  int16_t *pcm = argc > 1 ? read_pcm(argv[1], &frames)
+                          : synthesise(rate, &frames);
+  if (pcm == NULL || frames < (size_t)rate * 180) {
+    fprintf(stderr, "need at least three minutes of 16-bit stereo PCM\n");
+    return 2;
+  }
+  printf("%s: %.1f min at %d Hz\n", argc > 1 ? argv[1] : "synthesised",
+         frames / (rate * 60.0), rate);
+
+  loudness_cfg_t cfg = LOUDNESS_CFG_DEFAULT();
+  cfg.rate = rate;
+  cfg.target_lufs = TARGET_LUFS;
+  cfg.max_boost_db = 12; // keep the gain unclamped so it shows the level
+  cfg.max_cut_db = 40;
+  audio_element_handle_t el = loudness_init(&cfg);
+  reference_t ref;
+  reference_init(&ref, rate);
+  int fails = 0;
+
+  printf("new station:\n");
+  loudness_set_station(el, "http://new.example/stream");
+  reference_tune(&ref, false, 0);
+  double worst = play(el, &ref, pcm, frames, rate);
+  if (worst > TOLERANCE_LU) {
+    printf("FAIL: learned level off by %.2f LU\n", worst);
+    fails++;
+  }
+
+  // learn the station 2.5 LU too loud, then hear it at its real level
+  size_t prime = (size_t)rate * 120;
+  int16_t *loud = malloc(prime * 4);
+  double scale = pow(10, STALE_LU / 20);
+  for (size_t i = 0; i < 2 * prime; i++) {
+    loud[i] = (int16_t)fmax(-32768, fmin(32767, lrint(pcm[i] * scale)));
+  }
+  loudness_set_station(el, "http://stale.example/stream");
+  host_element_run(el, loud, prime * 4, NULL, 0);
+  free(loud);
+  int writes = host_nvs_writes();
+  loudness_set_station(el, "http://new.example/stream"); // saves it
+  if (host_nvs_writes() != writes + 1) {
+    printf("FAIL: the stale level was not saved\n");
+    fails++;
+  }
+  host_element_run(el, pcm, (size_t)rate / 10 * 4, NULL, 0);
+
+  printf("station restored %.1f LU too loud:\n", STALE_LU);
+  loudness_set_station(el, "http://stale.example/stream");
+  host_element_run(el, pcm, (size_t)ref.block_frames * 4, NULL, 0);
+  double restored = learned(el);
+  reference_tune(&ref, true, restored);
+  // the first block is already played, so count it for both
+  reference_run(&ref, pcm, ref.block_frames);
+  worst = play(el, &ref, pcm + 2 * ref.block_frames,
+               frames - ref.block_frames, rate);
+  printf("  restored at %.2f LUFS\n", restored);
+  if (worst > TOLERANCE_LU) {
+    printf("FAIL: learned level off by %.2f LU\n", worst);
+    fails++;
+  }
+
+  audio_element_deinit(el);
+  free(pcm);
+  printf("%s\n", fails ? "FAIL" : "all ok");
+  return fails != 0;
+}
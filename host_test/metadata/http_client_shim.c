@@ -0,0 +1,275 @@
+// A blocking HTTP/1.1 client on plain sockets behind the esp_http_client
+// calls main/metadata.c makes. Like the ESP-IDF client it keeps the
+// connection open between requests to the same host, closes it when the URL
+// moves to another host, and reports each response header to the event
+// handler. Only plain http with a Content-Length body is handled, which is
+// all the stand-in server sends.
+
+#include "http_client_shim.h"
+#include "esp_http_client.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define SHIM_MAX_HEADERS 16
+#define SHIM_HEADER_MAX 128
+#define SHIM_LINE_MAX 512
+
+struct esp_http_client {
+  int fd;
+  int timeout_ms;
+  http_event_handle_cb handler;
+  char host[128];
+  int port;
+  char path[256];
+  char headers[SHIM_MAX_HEADERS][2][SHIM_HEADER_MAX];
+  int header_count;
+  int status;
+  int64_t content_length;
+  int64_t received;
+  char buf[4096];
+  int buf_len, buf_pos;
+};
+
+static int s_connects;
+
+int http_client_shim_connects(void) { return s_connects; }
+
+static esp_err_t parse_url(esp_http_client_handle_t c, const char *url) {
+  const char *host = strstr(url, "://");
+  if (host == NULL || strncmp(url, "http://", 7) != 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  host += 3;
+  size_t host_len = strcspn(host, "/");
+  char hostport[128];
+  snprintf(hostport, sizeof(hostport), "%.*s", (int)host_len, host);
+  int port = 80;
+  char *colon = strchr(hostport, ':');
+  if (colon) {
+    *colon = '\0';
+    port = atoi(colon + 1);
+  }
+  if (c->fd >= 0 && (strcmp(hostport, c->host) != 0 || port != c->port)) {
+    esp_http_client_close(c);
+  }
+  snprintf(c->host, sizeof(c->host), "%s", hostport);
+  c->port = port;
+  snprintf(c->path, sizeof(c->path), "%s", host[host_len] ? host + host_len : "/");
+  return ESP_OK;
+}
+
+esp_http_client_handle_t
+esp_http_client_init(const esp_http_client_config_t *config) {
+  esp_http_client_handle_t c = calloc(1, sizeof(*c));
+  if (c == NULL) {
+    return NULL;
+  }
+  c->fd = -1;
+  c->timeout_ms = config->timeout_ms;
+  c->handler = config->event_handler;
+  if (parse_url(c, config->url) != ESP_OK) {
+    free(c);
+    return NULL;
+  }
+  return c;
+}
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t c,
+                                  const char *url) {
+  return parse_url(c, url);
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t c,
+                                     const char *key, const char *value) {
+  int i = 0;
+  while (i < c->header_count && strcasecmp(c->headers[i][0], key) != 0) {
+    i++;
+  }
+  if (i == SHIM_MAX_HEADERS) {
+    return ESP_ERR_NO_MEM;
+  }
+  if (i == c->header_count) {
+    c->header_count++;
+  }
+  snprintf(c->headers[i][0], SHIM_HEADER_MAX, "%s", key);
+  snprintf(c->headers[i][1], SHIM_HEADER_MAX, "%s", value);
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t c,
+                                        const char *key) {
+  for (int i = 0; i < c->header_count; i++) {
+    if (strcasecmp(c->headers[i][0], key) == 0) {
+      memmove(c->headers[i], c->headers[i + 1],
+              (c->header_count - i - 1) * sizeof(c->headers[0]));
+      c->header_count--;
+      break;
+    }
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t c,
+                                     esp_http_client_method_t method) {
+  return method == HTTP_METHOD_GET ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+}
+
+static esp_err_t connect_to_host(esp_http_client_handle_t c) {
+  struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+  struct addrinfo *addr;
+  char port[8];
+  snprintf(port, sizeof(port), "%d", c->port);
+  if (getaddrinfo(c->host, port, &hints, &addr) != 0) {
+    return ESP_FAIL;
+  }
+  c->fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+  struct timeval tv = {c->timeout_ms / 1000, c->timeout_ms % 1000 * 1000};
+  setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  int err = connect(c->fd, addr->ai_addr, addr->ai_addrlen);
+  freeaddrinfo(addr);
+  if (err != 0) {
+    close(c->fd);
+    c->fd = -1;
+    return ESP_FAIL;
+  }
+  s_connects++;
+  c->buf_len = c->buf_pos = 0;
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t c, int write_len) {
+  if (c->fd < 0 && connect_to_host(c) != ESP_OK) {
+    return ESP_FAIL;
+  }
+  char req[2048];
+  int n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s:%d\r\n",
+                   c->path, c->host, c->port);
+  for (int i = 0; i < c->header_count; i++) {
+    n += snprintf(req + n, sizeof(req) - n, "%s: %s\r\n", c->headers[i][0],
+                  c->headers[i][1]);
+  }
+  n += snprintf(req + n, sizeof(req) - n, "\r\n");
+  if (send(c->fd, req, n, MSG_NOSIGNAL) != n) {
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+static int read_some(esp_http_client_handle_t c, char *out, int len) {
+  if (c->buf_pos == c->buf_len) {
+    int r = (int)recv(c->fd, c->buf, sizeof(c->buf), 0);
+    if (r <= 0) {
+      return -1;
+    }
+    c->buf_len = r;
+    c->buf_pos = 0;
+  }
+  int n = c->buf_len - c->buf_pos < len ? c->buf_len - c->buf_pos : len;
+  memcpy(out, c->buf + c->buf_pos, n);
+  c->buf_pos += n;
+  return n;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t c) {
+  char line[SHIM_LINE_MAX];
+  int n = 0;
+  bool status_line = true;
+  c->content_length = 0;
+  c->received = 0;
+  for (;;) {
+    char ch;
+    if (c->fd < 0 || read_some(c, &ch, 1) != 1) {
+      return -1;
+    }
+    if (ch != '\n') {
+      if (n < SHIM_LINE_MAX - 1) {
+        line[n++] = ch;
+      }
+      continue;
+    }
+    line[n > 0 && line[n - 1] == '\r' ? n - 1 : n] = '\0';
+    n = 0;
+    if (line[0] == '\0') {
+      return c->content_length;
+    }
+    if (status_line) {
+      const char *code = strchr(line, ' ');
+      c->status = code ? atoi(code + 1) : 0;
+      status_line = false;
+      continue;
+    }
+    char *colon = strchr(line, ':');
+    if (colon == NULL) {
+      continue;
+    }
+    *colon = '\0';
+    char *value = colon + 1;
+    while (*value == ' ') {
+      value++;
+    }
+    if (strcasecmp(line, "Content-Length") == 0) {
+      c->content_length = atoll(value);
+    }
+    if (c->handler) {
+      esp_http_client_event_t evt = {
+          .event_id = HTTP_EVENT_ON_HEADER,
+          .client = c,
+          .header_key = line,
+          .header_value = value,
+      };
+      c->handler(&evt);
+    }
+  }
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t c) {
+  return c->status;
+}
+
+int esp_http_client_read(esp_http_client_handle_t c, char *buffer, int len) {
+  if (c->received >= c->content_length) {
+    return 0;
+  }
+  if (len > c->content_length - c->received) {
+    len = (int)(c->content_length - c->received);
+  }
+  int r = read_some(c, buffer, len);
+  if (r > 0) {
+    c->received += r;
+  }
+  return r;
+}
+
+esp_err_t esp_http_client_flush_response(esp_http_client_handle_t c,
+                                         int *len) {
+  char buf[512];
+  int total = 0, r;
+  while ((r = esp_http_client_read(c, buf, sizeof(buf))) > 0) {
+    total += r;
+  }
+  if (len) {
+    *len = total;
+  }
+  return r < 0 ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t c) {
+  if (c->fd >= 0) {
+    close(c->fd);
+    c->fd = -1;
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t c) {
+  esp_http_client_close(c);
+  free(c);
+  return ESP_OK;
+}
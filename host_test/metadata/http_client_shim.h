@@ -0,0 +1,7 @@
+#pragma once
+// Test side of http_client_shim.c
+
+/**
+ * @brief Number of TCP connections the shim has opened.
+ */
+int http_client_shim_connects(void);
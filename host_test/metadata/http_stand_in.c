@@ -0,0 +1,256 @@
+#include "http_stand_in.h"
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define STAND_IN_ROUTES 16
+#define STAND_IN_REQUEST_MAX 4096
+
+typedef struct {
+  char path[128];
+  char fixture[128];
+  char content_type[64];
+  char etag[64];
+  char last_modified[64];
+  http_stand_in_stats_t stats;
+} route_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static route_t s_routes[STAND_IN_ROUTES];
+static int s_route_count;
+static char s_fixture_dir[256];
+static int s_listen_fd = -1;
+
+static route_t *find_route(const char *path) {
+  size_t len = strcspn(path, "?");
+  for (int i = 0; i < s_route_count; i++) {
+    if (strlen(s_routes[i].path) == len &&
+        strncmp(s_routes[i].path, path, len) == 0) {
+      return &s_routes[i];
+    }
+  }
+  return NULL;
+}
+
+void http_stand_in_route(const char *path, const char *fixture,
+                         const char *content_type, const char *etag,
+                         const char *last_modified) {
+  pthread_mutex_lock(&s_lock);
+  route_t *r = find_route(path);
+  if (r == NULL && s_route_count < STAND_IN_ROUTES) {
+    r = &s_routes[s_route_count++];
+    memset(r, 0, sizeof(*r));
+    snprintf(r->path, sizeof(r->path), "%s", path);
+  }
+  if (r) {
+    snprintf(r->fixture, sizeof(r->fixture), "%s", fixture);
+    snprintf(r->content_type, sizeof(r->content_type), "%s", content_type);
+    snprintf(r->etag, sizeof(r->etag), "%s", etag ? etag : "");
+    snprintf(r->last_modified, sizeof(r->last_modified), "%s",
+             last_modified ? last_modified : "");
+  }
+  pthread_mutex_unlock(&s_lock);
+}
+
+http_stand_in_stats_t http_stand_in_stats(const char *path) {
+  http_stand_in_stats_t stats = {0};
+  pthread_mutex_lock(&s_lock);
+  route_t *r = find_route(path);
+  if (r) {
+    stats = r->stats;
+  }
+  pthread_mutex_unlock(&s_lock);
+  return stats;
+}
+
+static char *read_fixture(const char *name, long *len) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", s_fixture_dir, name);
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    perror(path);
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  *len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *body = malloc(*len + 1);
+  if (body && fread(body, 1, *len, f) != (size_t)*len) {
+    free(body);
+    body = NULL;
+  }
+  fclose(f);
+  return body;
+}
+
+// value of a request header, or "" if it is missing
+static void header_value(const char *request, const char *key, char *out,
+                         size_t out_len) {
+  out[0] = '\0';
+  size_t key_len = strlen(key);
+  for (const char *line = strstr(request, "\r\n"); line;
+       line = strstr(line + 2, "\r\n")) {
+    const char *name = line + 2;
+    if (strncasecmp(name, key, key_len) == 0 && name[key_len] == ':') {
+      const char *v = name + key_len + 1;
+      v += strspn(v, " ");
+      snprintf(out, out_len, "%.*s", (int)strcspn(v, "\r\n"), v);
+      return;
+    }
+  }
+}
+
+static bool send_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+static bool respond(int fd, const char *request) {
+  char path[256];
+  if (sscanf(request, "GET %255s ", path) != 1) {
+    return false;
+  }
+  char if_none_match[64], if_modified_since[64], range[64];
+  header_value(request, "If-None-Match", if_none_match, sizeof(if_none_match));
+  header_value(request, "If-Modified-Since", if_modified_since,
+               sizeof(if_modified_since));
+  header_value(request, "Range", range, sizeof(range));
+
+  pthread_mutex_lock(&s_lock);
+  route_t *r = find_route(path);
+  route_t route = r ? *r : (route_t){0};
+  bool not_modified =
+      r && ((route.etag[0] && strcmp(if_none_match, route.etag) == 0) ||
+            (route.last_modified[0] &&
+             strcmp(if_modified_since, route.last_modified) == 0));
+  if (r) {
+    r->stats.requests++;
+    r->stats.ranged += range[0] != '\0';
+    r->stats.not_modified += not_modified;
+  }
+  pthread_mutex_unlock(&s_lock);
+
+  long len = 0;
+  char *body = r && !not_modified ? read_fixture(route.fixture, &len) : NULL;
+  int status = r == NULL ? 404 : not_modified ? 304 : body ? 200 : 500;
+  long from = 0, to = len - 1;
+  if (status == 200 && sscanf(range, "bytes=%ld-%ld", &from, &to) == 2 &&
+      from <= to && from < len) {
+    to = to < len ? to : len - 1;
+    status = 206;
+  }
+  const char *text = status == 404 ? "not found" : "";
+
+  char head[1024];
+  int n = snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\n", status,
+                   status == 200   ? "OK"
+                   : status == 206 ? "Partial Content"
+                   : status == 304 ? "Not Modified"
+                   : status == 404 ? "Not Found"
+                                   : "Internal Server Error");
+  if (status == 206) {
+    n += snprintf(head + n, sizeof(head) - n,
+                  "Content-Range: bytes %ld-%ld/%ld\r\n", from, to, len);
+  }
+  if (route.etag[0]) {
+    n += snprintf(head + n, sizeof(head) - n, "ETag: %s\r\n", route.etag);
+  }
+  if (route.last_modified[0]) {
+    n += snprintf(head + n, sizeof(head) - n, "Last-Modified: %s\r\n",
+                  route.last_modified);
+  }
+  long body_len = status == 200 || status == 206 ? to - from + 1 : strlen(text);
+  n += snprintf(head + n, sizeof(head) - n,
+                "Content-Type: %s\r\nContent-Length: %ld\r\n\r\n",
+                r ? route.content_type : "text/plain", body_len);
+  bool ok = send_all(fd, head, n) &&
+            send_all(fd, body ? body + from : text, body_len);
+  free(body);
+  return ok;
+}
+
+// answers requests on one kept-alive connection until the client closes it
+static void *serve_connection(void *arg) {
+  int fd = (int)(intptr_t)arg;
+  char request[STAND_IN_REQUEST_MAX];
+  size_t len = 0;
+  request[0] = '\0';
+  for (;;) {
+    char *end = NULL;
+    while ((end = strstr(request, "\r\n\r\n")) == NULL) {
+      if (len + 1 >= sizeof(request)) {
+        goto done;
+      }
+      ssize_t r = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+      if (r <= 0) {
+        goto done;
+      }
+      len += r;
+      request[len] = '\0';
+    }
+    end += 4;
+    if (!respond(fd, request)) {
+      break;
+    }
+    len -= end - request;
+    memmove(request, end, len + 1);
+  }
+done:
+  close(fd);
+  return NULL;
+}
+
+static void *accept_loop(void *arg) {
+  for (;;) {
+    int fd = accept(s_listen_fd, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    // the head and the body go out in two sends
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, serve_connection, (void *)(intptr_t)fd) !=
+        0) {
+      close(fd);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+  return NULL;
+}
+
+int http_stand_in_start(const char *fixture_dir) {
+  snprintf(s_fixture_dir, sizeof(s_fixture_dir), "%s", fixture_dir);
+  s_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = 0};
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addr_len = sizeof(addr);
+  if (s_listen_fd < 0 ||
+      bind(s_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(s_listen_fd, 8) != 0 ||
+      getsockname(s_listen_fd, (struct sockaddr *)&addr, &addr_len) != 0) {
+    perror("http stand-in");
+    return 0;
+  }
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, accept_loop, NULL) != 0) {
+    return 0;
+  }
+  pthread_detach(thread);
+  return ntohs(addr.sin_port);
+}
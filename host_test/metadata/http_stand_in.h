@@ -0,0 +1,35 @@
+#pragma once
+// A local HTTP/1.1 server that answers with canned responses read from
+// fixture files, standing in for the metadata services. It runs on a thread
+// of its own on a free port of 127.0.0.1, keeps connections alive, and
+// honours If-None-Match, If-Modified-Since and byte Range requests.
+#include <stdbool.h>
+
+typedef struct {
+  int requests;
+  int ranged;       // asked for with a Range header
+  int not_modified; // answered 304
+} http_stand_in_stats_t;
+
+/**
+ * @brief Starts the server on a free port.
+ * @param fixture_dir Directory the fixture names are relative to.
+ * @return The port, or 0 on failure.
+ */
+int http_stand_in_start(const char *fixture_dir);
+
+/**
+ * @brief Serves a fixture at path, replacing what was served there. The
+ * query of a request is ignored when matching. Paths without a route get a
+ * 404.
+ * @param etag ETag to send and match, or NULL.
+ * @param last_modified Last-Modified to send and match, or NULL.
+ */
+void http_stand_in_route(const char *path, const char *fixture,
+                         const char *content_type, const char *etag,
+                         const char *last_modified);
+
+/**
+ * @brief Requests made to path so far.
+ */
+http_stand_in_stats_t http_stand_in_stats(const char *path);
@@ -0,0 +1,234 @@
+// Regression test for main/metadata.c against canned service responses.
+//
+// The fixtures in fixtures/ are responses as KEXP's plays API, an Icecast
+// status-json.xsl and a Spinitron playlist page send them. The parsers are
+// run on them directly, and poll_station() fetches them from http_stand_in.c,
+// a local server, through http_client_shim.c, so the validators, the ranged
+// Spinitron fetch, keep-alive, 404 handling and the back-off are covered too.
+
+#include "metadata.c" // the drivers and the cache are checked directly
+#include "http_client_shim.h"
+#include "http_stand_in.h"
+
+#define KEXP_PATH "/v2/plays/"
+#define ICECAST_PATH "/status-json.xsl"
+#define SPINITRON_PATH "/KXLU/"
+#define LAST_MODIFIED "Sat, 17 Oct 2026 16:41:12 GMT"
+
+static char s_shown[METADATA_TEXT_MAX];
+static int s_shown_count;
+
+void update_now_playing(const char *title) {
+  snprintf(s_shown, sizeof(s_shown), "%s", title);
+  s_shown_count++;
+}
+
+static int check(const char *what, bool ok) {
+  printf("%-50s %s\n", what, ok ? "ok" : "FAIL");
+  return !ok;
+}
+
+static char *read_fixture(const char *name) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", FIXTURE_DIR, name);
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    perror(path);
+    exit(2);
+  }
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *body = malloc(len + 1);
+  if (body == NULL || fread(body, 1, len, f) != (size_t)len) {
+    fprintf(stderr, "%s: read failed\n", path);
+    exit(2);
+  }
+  body[len] = '\0';
+  fclose(f);
+  return body;
+}
+
+// @return true if parse finds expected in the fixture, or nothing if
+// expected is NULL
+static bool parses(metadata_parse_fn parse, const char *body,
+                   const char *stream_uri, const char *expected) {
+  char out[METADATA_TEXT_MAX] = "";
+  bool found = parse(body, stream_uri, out, sizeof(out));
+  if (expected == NULL) {
+    return !found;
+  }
+  if (!found || strcmp(out, expected) != 0) {
+    printf("  got \"%s\", expected \"%s\"\n", out, expected);
+    return false;
+  }
+  return true;
+}
+
+static int check_parsers(void) {
+  char *kexp = read_fixture("kexp_plays.json");
+  char *airbreak = read_fixture("kexp_airbreak.json");
+  char *icecast = read_fixture("icecast_status.json");
+  char *single = read_fixture("icecast_single.json");
+  char *spinitron = read_fixture("spinitron_playlist.html");
+  const char *live = "http://stream.example.org:8000/live";
+  int fails = 0;
+
+  fails += check("kexp trackplay",
+                 parses(parse_kexp, kexp, "", "The Shins & Co - Sea Legs"));
+  fails += check("kexp air break",
+                 parses(parse_kexp, airbreak, "", "Air break"));
+  fails += check("kexp without plays",
+                 parses(parse_kexp, "{\"next\":null,\"results\":[]}", "", NULL));
+  fails += check("kexp truncated json",
+                 parses(parse_kexp, "{\"results\":[{\"song\":\"x\"", "", NULL));
+
+  fails += check("icecast picks the mount of the stream",
+                 parses(parse_icecast, icecast, live,
+                        "Nina Simone - Sinnerman"));
+  fails += check("icecast ignores the query of the stream",
+                 parses(parse_icecast, icecast,
+                        "http://127.0.0.1:8000/live?token=abc",
+                        "Nina Simone - Sinnerman"));
+  fails += check("icecast mount not listed",
+                 parses(parse_icecast, icecast,
+                        "http://stream.example.org:8000/night", NULL));
+  fails += check("icecast single mount sent as an object",
+                 parses(parse_icecast, single, "http://localhost:8000/other",
+                        "Alice Coltrane - Journey in Satchidananda \xe2\x80\x93 "
+                        "Live"));
+  fails += check("icecast not a status document",
+                 parses(parse_icecast, "<html></html>", live, NULL));
+
+  fails += check("spinitron newest spin, entities, white space",
+                 parses(parse_spinitron, spinitron, "",
+                        "Sleater'Kinney - Dig Me Out"));
+  fails += check("spinitron without a current song row",
+                 parses(parse_spinitron,
+                        "<tr class=\"spin-item\"><span class=\"artist\">A &amp; "
+                        "B</span><span class=\"song\">&quot;C&quot;</span>",
+                        "", "A & B - \"C\""));
+  fails += check("spinitron page without spins",
+                 parses(parse_spinitron, "<html><body>Off air</body></html>",
+                        "", NULL));
+
+  free(kexp);
+  free(airbreak);
+  free(icecast);
+  free(single);
+  free(spinitron);
+  return fails;
+}
+
+static int check_polling(int port) {
+  char base[64];
+  snprintf(base, sizeof(base), "http://127.0.0.1:%d", port);
+  int fails = 0;
+
+  http_stand_in_route(KEXP_PATH, "kexp_plays.json", "application/json",
+                      "\"k0\"", NULL);
+  metadata_station_t kexp = {"KEXP", META_DRIVER_KEXP_V2};
+  snprintf(kexp.uri, sizeof(kexp.uri), "%s%s?format=json&limit=1", base,
+           KEXP_PATH);
+  metadata_cache_entry_t *entry = cache_select("KEXP");
+  poll_station(&kexp, entry);
+  fails += check("kexp poll shows the play",
+                 strcmp(entry->text, "The Shins & Co - Sea Legs") == 0 &&
+                     strcmp(entry->etag, "\"k0\"") == 0 &&
+                     s_shown_count == 1 && strcmp(s_shown, entry->text) == 0);
+  poll_station(&kexp, entry);
+  fails += check("kexp unchanged answers 304, ui left alone",
+                 http_stand_in_stats(KEXP_PATH).not_modified == 1 &&
+                     strcmp(entry->text, "The Shins & Co - Sea Legs") == 0 &&
+                     s_shown_count == 1);
+  http_stand_in_route(KEXP_PATH, "kexp_airbreak.json", "application/json",
+                      "\"k1\"", NULL);
+  poll_station(&kexp, entry);
+  fails += check("kexp new etag shows the air break",
+                 strcmp(entry->text, "Air break") == 0 &&
+                     strcmp(entry->etag, "\"k1\"") == 0 && s_shown_count == 2);
+  fails += check("three polls on one connection",
+                 http_client_shim_connects() == 1);
+
+  http_stand_in_route(ICECAST_PATH, "icecast_status.json", "application/json",
+                      NULL, LAST_MODIFIED);
+  metadata_station_t icecast = {"WXYC", META_DRIVER_ICECAST_JSON};
+  snprintf(icecast.stream_uri, sizeof(icecast.stream_uri), "%s/live?sid=1",
+           base);
+  char expected_uri[METADATA_URI_MAX];
+  snprintf(expected_uri, sizeof(expected_uri), "%s%s", base, ICECAST_PATH);
+  fails += check("icecast status uri from the stream uri",
+                 icecast_status_uri(icecast.stream_uri, icecast.uri,
+                                    sizeof(icecast.uri)) &&
+                     strcmp(icecast.uri, expected_uri) == 0);
+  entry = cache_select("WXYC");
+  poll_station(&icecast, entry);
+  fails += check("icecast poll picks the mount",
+                 strcmp(entry->text, "Nina Simone - Sinnerman") == 0 &&
+                     strcmp(entry->last_modified, LAST_MODIFIED) == 0);
+  int shown = s_shown_count;
+  poll_station(&icecast, entry);
+  fails += check("icecast If-Modified-Since answers 304",
+                 http_stand_in_stats(ICECAST_PATH).not_modified == 1 &&
+                     entry->failures == 0 && s_shown_count == shown);
+
+  http_stand_in_route(SPINITRON_PATH, "spinitron_playlist.html",
+                      "text/html; charset=UTF-8", NULL, NULL);
+  metadata_station_t spinitron = {"KXLU", META_DRIVER_SPINITRON};
+  snprintf(spinitron.uri, sizeof(spinitron.uri), "%s%s", base,
+           SPINITRON_PATH);
+  entry = cache_select("KXLU");
+  int connects = http_client_shim_connects();
+  poll_station(&spinitron, entry);
+  fails += check("spinitron ranged fetch of the page head",
+                 http_stand_in_stats(SPINITRON_PATH).ranged == 1 &&
+                     strlen(s_body) == METADATA_BODY_MAX &&
+                     strcmp(entry->text, "Sleater'Kinney - Dig Me Out") == 0);
+  poll_station(&spinitron, entry);
+  fails += check("cut short body drops the connection",
+                 http_client_shim_connects() == connects + 1 &&
+                     strcmp(entry->text, "Sleater'Kinney - Dig Me Out") == 0);
+
+  metadata_station_t missing = {"WNYC", META_DRIVER_ICECAST_JSON};
+  snprintf(missing.uri, sizeof(missing.uri), "%s/stream/status-json.xsl",
+           base);
+  entry = cache_select("WNYC");
+  poll_station(&missing, entry);
+  fails += check("404 marks the endpoint unsupported",
+                 entry->unsupported && entry->text[0] == '\0');
+
+  char text[METADATA_TEXT_MAX];
+  fails += check("cache keeps each station's text",
+                 metadata_get_now_playing("WXYC", text, sizeof(text)) &&
+                     strcmp(text, "Nina Simone - Sinnerman") == 0 &&
+                     metadata_get_now_playing("KEXP", text, sizeof(text)) &&
+                     strcmp(text, "Air break") == 0 &&
+                     !metadata_get_now_playing("WNYC", text, sizeof(text)));
+
+  // port 1 on the loopback refuses the connection
+  metadata_station_t down = {"KDWN", META_DRIVER_KEXP_V2,
+                             "http://127.0.0.1:1/v2/plays/"};
+  entry = cache_select("KDWN");
+  int64_t start = esp_timer_get_time();
+  poll_station(&down, entry);
+  poll_station(&down, entry);
+  int64_t wait_ms = (entry->next_poll_us - start) / 1000;
+  fails += check("refused connection backs off",
+                 entry->failures == 2 && wait_ms >= 4 * 15000 &&
+                     wait_ms < 4 * 15000 + 1000);
+  return fails;
+}
+
+int main(void) {
+  int fails = check_parsers();
+  printf("\n");
+  s_body = malloc(METADATA_BODY_MAX + 1);
+  int port = http_stand_in_start(FIXTURE_DIR);
+  if (s_body == NULL || port == 0) {
+    fprintf(stderr, "could not start the stand-in server\n");
+    return 2;
+  }
+  fails += check_polling(port);
+  printf("\n%s\n", fails ? "FAIL" : "all ok");
+  return fails != 0;
+}
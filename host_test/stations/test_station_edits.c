@@ -0,0 +1,280 @@
+// Checks the single-station edits of main/station_data.c and the journal they
+// are saved in. A temporary directory stands in for SPIFFS, so
+// stations.json and stations.journal are real files, and the station table
+// partition is kept in memory across the simulated reboots.
+//
+// Each edit has to change only what it names, keep a tracked index on its
+// station, and come back the same after a reboot, which replays the journal
+// over the saved list. An edit appends one line and leaves stations.json
+// alone. A line cut short by a reset, or one that cannot be read, has to be
+// dropped with everything after it. The journal has to be folded into
+// stations.json once it passes 16 KB, when an entry would be too long to read
+// back, and when the whole list is saved.
+
+#include "station_data.h"
+#include "esp_log.h"
+#include "host_stubs.h"
+#include "esp_spiffs.h" // after the system headers, to reach the directory
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STATION_FILE "/spiffs/stations.json"
+#define STATION_JOURNAL "/spiffs/stations.journal"
+
+static char s_dir[] = "/tmp/station_edits.XXXXXX";
+static unsigned s_seed = 1;
+
+static int check(const char *what, bool ok) {
+  printf("%-50s %s\n", what, ok ? "ok" : "FAIL");
+  return !ok;
+}
+
+// hands over the JSON in reads of random length, as httpd_req_recv() does
+typedef struct {
+  const char *p;
+  size_t left;
+  unsigned seed;
+} reader_t;
+
+static int read_ragged(char *buf, size_t len, void *ctx) {
+  reader_t *r = ctx;
+  size_t n = 1 + (size_t)rand_r(&r->seed) % len;
+  n = n < r->left ? n : r->left;
+  memcpy(buf, r->p, n);
+  r->p += n;
+  r->left -= n;
+  return (int)n;
+}
+
+static esp_err_t patch(int index, const char *json) {
+  reader_t r = {json, strlen(json), s_seed++};
+  return patch_station_json(index, read_ragged, &r);
+}
+
+static esp_err_t append(const char *json, int *index) {
+  reader_t r = {json, strlen(json), s_seed++};
+  return append_station_json(read_ragged, &r, index);
+}
+
+typedef struct {
+  char *buf;
+  size_t len;
+} text_t;
+
+static esp_err_t collect(const char *buf, size_t len, void *ctx) {
+  text_t *t = ctx;
+  t->buf = realloc(t->buf, t->len + len + 1);
+  memcpy(t->buf + t->len, buf, len);
+  t->len += len;
+  t->buf[t->len] = '\0';
+  return ESP_OK;
+}
+
+// the list as GET /api/stations returns it
+static char *snapshot(void) {
+  text_t t = {calloc(1, 1), 0};
+  write_stations_json(collect, &t);
+  return t.buf;
+}
+
+static long file_size(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+static int journal_lines(void) {
+  FILE *f = fopen(STATION_JOURNAL, "r");
+  int lines = 0, c;
+  while (f && (c = fgetc(f)) != EOF) {
+    lines += c == '\n';
+  }
+  if (f) {
+    fclose(f);
+  }
+  return lines;
+}
+
+static void journal_append(const char *text) {
+  FILE *f = fopen(STATION_JOURNAL, "a");
+  fputs(text, f);
+  fclose(f);
+}
+
+static void reboot(void) {
+  free_station_data();
+  init_station_data();
+}
+
+// the list after a reboot is the one before it
+static bool survives_reboot(void) {
+  char *before = snapshot();
+  reboot();
+  char *after = snapshot();
+  bool same = strcmp(before, after) == 0;
+  free(before);
+  free(after);
+  return same;
+}
+
+static int check_edits(void) {
+  int fails = 0;
+  reboot();
+  int defaults = station_count;
+  fails += check("first boot saves the default list",
+                 defaults > 8 && file_size(STATION_FILE) > 0 &&
+                     file_size(STATION_JOURNAL) == -1);
+  long file = file_size(STATION_FILE);
+
+  station_t before = radio_stations[2];
+  bool ok = patch(2, "{\"uri\":\"http://x/y\",\"meta_uri\":null,\"dsp\":"
+                     "{\"limiter\":false,\"release\":100,\"bands\":"
+                     "[{\"type\":1,\"freq\":100}]}}") == ESP_OK;
+  station_t *st = &radio_stations[2];
+  fails += check("patch changes only the fields it has",
+                 ok && strcmp(st->uri, "http://x/y") == 0 &&
+                     st->meta_uri == NULL && st->has_dsp &&
+                     !st->dsp.limiter && st->dsp.band_count == 1 &&
+                     st->dsp.release_ms == 100.0f &&
+                     strcmp(st->call_sign, before.call_sign) == 0 &&
+                     strcmp(st->origin, before.origin) == 0 &&
+                     st->codec == before.codec &&
+                     st->meta_driver == before.meta_driver);
+  ok = patch(2, "{\"dsp\":null,\"fallback_uri\":\"http://f\"}") == ESP_OK &&
+       !st->has_dsp && strcmp(st->fallback_uri, "http://f") == 0;
+  fails += check("null dsp resets it", ok);
+  fails += check("empty fallback_uri clears it",
+                 patch(2, "{\"fallback_uri\":\"\"}") == ESP_OK &&
+                     st->fallback_uri == NULL);
+
+  char *kept = snapshot();
+  esp_log_level_set("STATION_DATA", ESP_LOG_NONE); // rejections expected
+  ok = patch(2, "{\"uri\":\"http://z\",") == ESP_ERR_INVALID_ARG &&
+       patch(2, "[1]") == ESP_ERR_INVALID_ARG &&
+       patch(station_count, "{}") == ESP_ERR_NOT_FOUND;
+  int index = -1;
+  ok &= append("{\"call_sign\":\"BAD\",\"origin\":\"o\",\"uri\":\"u\"}",
+               &index) == ESP_ERR_INVALID_ARG;
+  esp_log_level_set("STATION_DATA", ESP_LOG_WARN);
+  char *now = snapshot();
+  fails += check("rejected edits change nothing",
+                 ok && strcmp(kept, now) == 0 && journal_lines() == 3);
+  free(kept);
+  free(now);
+
+  ok = append("{\"call_sign\":\"NEW\",\"origin\":\"Olympia\",\"uri\":"
+              "\"http://new/\",\"codec\":2}",
+              &index) == ESP_OK;
+  fails += check("append adds at the end",
+                 ok && index == defaults && station_count == defaults + 1 &&
+                     strcmp(radio_stations[index].call_sign, "NEW") == 0);
+
+  int tracked = 5;
+  ok = delete_station(0, &tracked) == ESP_OK && tracked == 4;
+  tracked = 4;
+  ok &= delete_station(4, &tracked) == ESP_OK && tracked == 4;
+  tracked = station_count - 1;
+  ok &= delete_station(tracked, &tracked) == ESP_OK &&
+        tracked == station_count - 1;
+  fails += check("delete keeps the tracked index on its station", ok);
+  tracked = 2;
+  ok = move_station(2, 7, &tracked) == ESP_OK && tracked == 7;
+  tracked = 5;
+  ok &= move_station(2, 7, &tracked) == ESP_OK && tracked == 4;
+  tracked = 5;
+  ok &= move_station(7, 2, &tracked) == ESP_OK && tracked == 6;
+  ok &= move_station(0, station_count, NULL) == ESP_ERR_NOT_FOUND;
+  fails += check("move keeps the tracked index on its station", ok);
+
+  fails += check("each edit one journal line, the file untouched",
+                 journal_lines() == 10 && file_size(STATION_FILE) == file &&
+                     file_size(STATION_JOURNAL) < 10 * 400);
+  fails += check("edits replayed at boot", survives_reboot() &&
+                                               journal_lines() == 10);
+  fails += check("save_station() journals one more",
+                 save_station(1) == 0 && journal_lines() == 11 &&
+                     save_station(station_count) == -1);
+  return fails;
+}
+
+static int check_journal(void) {
+  int fails = 0;
+  char *good = snapshot();
+  journal_append("put 0 {\"call_sign\":\"TORN");
+  reboot();
+  char *now = snapshot();
+  fails += check("line cut short dropped, journal folded",
+                 strcmp(good, now) == 0 &&
+                     file_size(STATION_JOURNAL) == -1);
+  free(now);
+
+  journal_append("bogus 1\ndelete 0\n");
+  reboot();
+  now = snapshot();
+  fails += check("bad line dropped with the ones after it",
+                 strcmp(good, now) == 0 &&
+                     file_size(STATION_JOURNAL) == -1);
+  free(now);
+  free(good);
+
+  // a uri of control characters, each escaped to six bytes
+  char patch_json[5000] = "{\"uri\":\"";
+  for (int i = 0; i < 360; i++) {
+    strcat(patch_json, "\\u0001");
+  }
+  strcat(patch_json, "\",\"call_sign\":\"");
+  for (int i = 0; i < 360; i++) {
+    strcat(patch_json, "\\u0002");
+  }
+  strcat(patch_json, "\"}");
+  long file = file_size(STATION_FILE);
+  bool ok = patch(1, "{\"origin\":\"Leadville\"}") == ESP_OK &&
+            journal_lines() == 1 && patch(1, patch_json) == ESP_OK;
+  fails += check("entry too long for a line saves the whole list",
+                 ok && file_size(STATION_JOURNAL) == -1 &&
+                     file_size(STATION_FILE) > file &&
+                     strcmp(radio_stations[1].origin, "Leadville") == 0 &&
+                     survives_reboot());
+
+  int edits = 0;
+  char json[96];
+  while (edits < 1000 && (edits == 0 || file_size(STATION_JOURNAL) > 0)) {
+    snprintf(json, sizeof(json), "{\"uri\":\"http://stream.example.org/%d\"}",
+             edits++);
+    ok &= patch(3, json) == ESP_OK;
+  }
+  fails += check("journal folded into the file past 16 KB",
+                 ok && edits > 16 * 1024 / 400 && edits < 1000 &&
+                     survives_reboot());
+
+  ok = patch(0, "{\"origin\":\"Ouray\"}") == ESP_OK && journal_lines() == 1 &&
+       save_station_data() == 0 && file_size(STATION_JOURNAL) == -1;
+  fails += check("saving the list clears the journal",
+                 ok && survives_reboot() &&
+                     strcmp(radio_stations[0].origin, "Ouray") == 0);
+
+  while (station_count > 1 && delete_station(0, NULL) == ESP_OK) {
+  }
+  fails += check("the last station stays",
+                 station_count == 1 &&
+                     delete_station(0, NULL) == ESP_ERR_INVALID_STATE &&
+                     survives_reboot() && station_count == 1);
+  return fails;
+}
+
+int main(void) {
+  if (mkdtemp(s_dir) == NULL) {
+    perror(s_dir);
+    return 2;
+  }
+  host_spiffs_dir(s_dir);
+  esp_log_level_set("*", ESP_LOG_WARN);
+  int fails = check_edits();
+  fails += check_journal();
+  free_station_data();
+  unlink(STATION_FILE);
+  unlink(STATION_JOURNAL);
+  rmdir(s_dir);
+  printf("\n%s\n", fails ? "FAIL" : "all ok");
+  return fails != 0;
+}
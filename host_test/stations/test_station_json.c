@@ -0,0 +1,310 @@
+// Checks and benchmarks write_stations_json() in main/station_data.c, through
+// which GET /api/stations and save_station_data() stream the station list.
+//
+// The JSON written has to parse back with cJSON to the same list, quotes,
+// control characters and UTF-8 in the strings included, and read back through
+// read_stations_json() to the same JSON again. A writer that fails has to
+// stop the output. The benchmark then writes lists of 16, 500 and 5000
+// stations both ways: streamed, and as the cJSON tree printed into one
+// string that the API handler sent before. It reports the time and the peak
+// heap of each, as glibc's malloc counts it; streaming has to take none.
+
+#include "station_data.h"
+#include "cJSON.h"
+#include "esp_timer.h"
+#include "host_stubs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+static const char *s_origins[] = {"Seattle", "Crested Butte", "Durango",
+                                  "Portland", "Salt Lake City", "Missoula"};
+
+static int check(const char *what, bool ok) {
+  printf("%-50s %s\n", what, ok ? "ok" : "FAIL");
+  return !ok;
+}
+
+static size_t heap_in_use(void) {
+#ifdef __GLIBC__
+  return mallinfo2().uordblks;
+#else
+  return 0; // not measured
+#endif
+}
+
+typedef struct {
+  char *buf;
+  size_t len, size;
+  int calls;
+  int fail_at; // the call that fails, or 0
+  size_t heap_base, heap_peak;
+} sink_t;
+
+static esp_err_t sink_write(const char *buf, size_t len, void *ctx) {
+  sink_t *s = ctx;
+  size_t heap = heap_in_use() - s->heap_base;
+  s->heap_peak = heap > s->heap_peak ? heap : s->heap_peak;
+  if (++s->calls == s->fail_at) {
+    return ESP_FAIL;
+  }
+  if (s->buf) {
+    if (s->len + len + 1 > s->size) {
+      s->size = (s->len + len + 1) * 2;
+      s->buf = realloc(s->buf, s->size);
+    }
+    memcpy(s->buf + s->len, buf, len);
+    s->buf[s->len + len] = '\0';
+  }
+  s->len += len;
+  return ESP_OK;
+}
+
+typedef struct {
+  const char *p;
+  size_t left;
+} reader_t;
+
+static int read_mem(char *buf, size_t len, void *ctx) {
+  reader_t *r = ctx;
+  size_t n = len < r->left ? len : r->left;
+  memcpy(buf, r->p, n);
+  r->p += n;
+  r->left -= n;
+  return (int)n;
+}
+
+static esp_err_t load(const char *json) {
+  reader_t r = {json, strlen(json)};
+  return read_stations_json(read_mem, &r);
+}
+
+static char *write_all(void) {
+  sink_t s = {.buf = malloc(1), .size = 1};
+  s.buf[0] = '\0';
+  if (write_stations_json(sink_write, &s) != ESP_OK) {
+    free(s.buf);
+    return NULL;
+  }
+  return s.buf;
+}
+
+// A list of n stations with the optional fields on some. It is set up
+// directly, as 5000 stations are more JSON than the import accepts.
+static void make_list(int n) {
+  static station_t *s_list;
+  static int s_count;
+  for (int i = 0; i < s_count; i++) {
+    free(s_list[i].call_sign);
+    free(s_list[i].uri);
+    free(s_list[i].meta_uri);
+  }
+  free(s_list);
+  free_station_data();
+  s_list = calloc(n, sizeof(station_t));
+  s_count = n;
+  for (int i = 0; i < n; i++) {
+    station_t *st = &s_list[i];
+    char text[96];
+    snprintf(text, sizeof(text), "K%03d", i);
+    st->call_sign = strdup(i == 3 ? "Q\"\\\n\t\x01 Z\xc3\xbcrich" : text);
+    st->origin = (char *)s_origins[i % 6];
+    snprintf(text, sizeof(text), "https://stream%d.example.org/live.mp3", i);
+    st->uri = strdup(text);
+    st->codec = (codec_type_t)(i % 3);
+    st->meta_driver = (metadata_driver_t)(i % 4);
+    if (i % 2) {
+      snprintf(text, sizeof(text), "https://spinitron.com/K%03d/", i);
+      st->meta_uri = strdup(text);
+    }
+    if (i % 7 == 2) {
+      st->fallback_uri = "http://relay.example.org:8000/backup.mp3";
+    }
+    st->dsp = (dsp_settings_t)DSP_SETTINGS_DEFAULT();
+    if (i % 5 == 1) {
+      st->has_dsp = true;
+      st->dsp.band_count = 2;
+      st->dsp.bands[0] = (dsp_band_t){DSP_BAND_LOW_SHELF, 120, 3, 0.7f};
+      st->dsp.bands[1] = (dsp_band_t){DSP_BAND_PEAK, 2500, -1.5f, 1.41f};
+      st->dsp.limiter = false;
+      st->dsp.ceiling_db = -0.5f;
+    }
+  }
+  radio_stations = s_list;
+  station_count = n;
+}
+
+static bool same_string(const cJSON *item, const char *s) {
+  if (s == NULL) {
+    return item == NULL;
+  }
+  return cJSON_IsString(item) && strcmp(item->valuestring, s) == 0;
+}
+
+static bool same_number(const cJSON *item, double d) {
+  return cJSON_IsNumber(item) && item->valuedouble == d;
+}
+
+static bool same_dsp(const cJSON *obj, const dsp_settings_t *dsp) {
+  const cJSON *bands = cJSON_GetObjectItem(obj, "bands");
+  if (cJSON_GetArraySize(bands) != dsp->band_count ||
+      cJSON_IsTrue(cJSON_GetObjectItem(obj, "limiter")) != dsp->limiter ||
+      !same_number(cJSON_GetObjectItem(obj, "ceiling"), dsp->ceiling_db) ||
+      !same_number(cJSON_GetObjectItem(obj, "release"), dsp->release_ms)) {
+    return false;
+  }
+  for (int i = 0; i < dsp->band_count; i++) {
+    const cJSON *band = cJSON_GetArrayItem(bands, i);
+    const dsp_band_t *b = &dsp->bands[i];
+    if (!same_number(cJSON_GetObjectItem(band, "type"), b->type) ||
+        !same_number(cJSON_GetObjectItem(band, "freq"), b->freq) ||
+        !same_number(cJSON_GetObjectItem(band, "gain"), b->gain_db) ||
+        !same_number(cJSON_GetObjectItem(band, "q"), b->q)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// the JSON holds the stations of the list, field for field
+static bool matches_list(const char *json) {
+  cJSON *root = cJSON_Parse(json);
+  bool ok = cJSON_GetArraySize(root) == station_count;
+  for (int i = 0; ok && i < station_count; i++) {
+    const station_t *st = &radio_stations[i];
+    const cJSON *item = cJSON_GetArrayItem(root, i);
+    const cJSON *dsp = cJSON_GetObjectItem(item, "dsp");
+    ok = same_string(cJSON_GetObjectItem(item, "call_sign"), st->call_sign) &&
+         same_string(cJSON_GetObjectItem(item, "origin"), st->origin) &&
+         same_string(cJSON_GetObjectItem(item, "uri"), st->uri) &&
+         same_number(cJSON_GetObjectItem(item, "codec"), st->codec) &&
+         same_number(cJSON_GetObjectItem(item, "meta_driver"),
+                     st->meta_driver) &&
+         same_string(cJSON_GetObjectItem(item, "meta_uri"), st->meta_uri) &&
+         same_string(cJSON_GetObjectItem(item, "fallback_uri"),
+                     st->fallback_uri) &&
+         (st->has_dsp ? same_dsp(dsp, &st->dsp) : dsp == NULL);
+  }
+  cJSON_Delete(root);
+  return ok;
+}
+
+static int check_output(void) {
+  int fails = 0;
+  make_list(40);
+  char *out = write_all();
+  fails += check("written list parses back field for field",
+                 out && matches_list(out));
+  fails += check("escapes and UTF-8 survive",
+                 out && strstr(out,
+                               "\"Q\\\"\\\\\\n\\t\\u0001 Z\xc3\xbcrich\""));
+  bool loaded = out && load(out) == ESP_OK && station_count == 40;
+  fails += check("written list reads back", loaded && matches_list(out));
+  char *again = loaded ? write_all() : NULL;
+  fails += check("and is written again as the same JSON",
+                 again && strcmp(out, again) == 0);
+
+  sink_t s = {.fail_at = 2};
+  esp_err_t err = write_stations_json(sink_write, &s);
+  fails += check("failing writer stops the output",
+                 err == ESP_FAIL && s.calls == 2);
+  free(out);
+  free(again);
+  return fails;
+}
+
+static cJSON *dsp_to_json(const dsp_settings_t *dsp) {
+  cJSON *obj = cJSON_CreateObject();
+  cJSON *bands = cJSON_AddArrayToObject(obj, "bands");
+  for (int i = 0; i < dsp->band_count; i++) {
+    cJSON *band = cJSON_CreateObject();
+    cJSON_AddNumberToObject(band, "type", dsp->bands[i].type);
+    cJSON_AddNumberToObject(band, "freq", dsp->bands[i].freq);
+    cJSON_AddNumberToObject(band, "gain", dsp->bands[i].gain_db);
+    cJSON_AddNumberToObject(band, "q", dsp->bands[i].q);
+    cJSON_AddItemToArray(bands, band);
+  }
+  cJSON_AddBoolToObject(obj, "limiter", dsp->limiter);
+  cJSON_AddNumberToObject(obj, "ceiling", dsp->ceiling_db);
+  cJSON_AddNumberToObject(obj, "release", dsp->release_ms);
+  return obj;
+}
+
+// The list as get_stations_json() returned it before it was streamed: a
+// cJSON tree of every station printed into one string. *heap is what was in
+// use when both were, its peak.
+static size_t tree_print(size_t *heap) {
+  size_t base = heap_in_use();
+  cJSON *root = cJSON_CreateArray();
+  for (int i = 0; i < station_count; i++) {
+    const station_t *st = &radio_stations[i];
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "call_sign", st->call_sign);
+    cJSON_AddStringToObject(item, "origin", st->origin);
+    cJSON_AddStringToObject(item, "uri", st->uri);
+    cJSON_AddNumberToObject(item, "codec", st->codec);
+    cJSON_AddNumberToObject(item, "meta_driver", st->meta_driver);
+    if (st->meta_uri) {
+      cJSON_AddStringToObject(item, "meta_uri", st->meta_uri);
+    }
+    if (st->fallback_uri) {
+      cJSON_AddStringToObject(item, "fallback_uri", st->fallback_uri);
+    }
+    if (st->has_dsp) {
+      cJSON_AddItemToObject(item, "dsp", dsp_to_json(&st->dsp));
+    }
+    cJSON_AddItemToArray(root, item);
+  }
+  char *out = cJSON_Print(root);
+  *heap = heap_in_use() - base;
+  size_t len = strlen(out);
+  cJSON_Delete(root);
+  free(out);
+  return len;
+}
+
+static int benchmark(void) {
+  static const int sizes[] = {16, 500, 5000};
+  bool no_heap = true;
+  printf("\n%-9s %21s  %21s\n", "stations", "cJSON tree + print",
+         "streamed");
+  printf("%-9s %10s %10s  %10s %10s  %s\n", "", "peak heap", "time",
+         "peak heap", "time", "bytes");
+  for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+    int n = sizes[k];
+    make_list(n);
+    int reps = 80000 / n;
+
+    size_t tree_heap = 0, tree_len = 0;
+    int64_t start = esp_timer_get_time();
+    for (int r = 0; r < reps; r++) {
+      tree_len = tree_print(&tree_heap);
+    }
+    double tree_us = (double)(esp_timer_get_time() - start) / reps;
+
+    sink_t s = {0};
+    start = esp_timer_get_time();
+    for (int r = 0; r < reps; r++) {
+      s = (sink_t){.heap_base = heap_in_use()};
+      write_stations_json(sink_write, &s);
+    }
+    double stream_us = (double)(esp_timer_get_time() - start) / reps;
+
+    printf("%-9d %8zu B %7.0f us  %8zu B %7.0f us  %zu streamed, %zu "
+           "printed\n",
+           n, tree_heap, tree_us, s.heap_peak, stream_us, s.len, tree_len);
+    no_heap &= s.heap_peak == 0;
+  }
+  return check("streaming takes no heap", no_heap);
+}
+
+int main(void) {
+  int fails = check_output();
+  fails += benchmark();
+  make_list(0);
+  printf("\n%s\n", fails ? "FAIL" : "all ok");
+  return fails != 0;
+}
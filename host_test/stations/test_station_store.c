@@ -0,0 +1,244 @@
+// Checks the store that holds a station list in main/station_data.c: the
+// arena, the interning index and the station array, looked at directly.
+//
+// Origins and fallback streams have to be shared between the stations that
+// repeat them, and call signs and URIs copied for each. An entry dropped from
+// an import, a rejected patch and a rejected list have to leave the arena
+// where it was and nothing pending for the index. An append that outgrows the
+// array has to leave the old one readable, the index has to double past two
+// strings a bucket, and freeing the list has to give back every byte.
+
+#include "station_data.c" // the store is checked directly
+#include "host_stubs.h"
+
+static char s_dir[] = "/tmp/station_store.XXXXXX";
+
+static int check(const char *what, bool ok) {
+  printf("%-50s %s\n", what, ok ? "ok" : "FAIL");
+  return !ok;
+}
+
+typedef struct {
+  const char *p;
+  size_t left;
+} text_reader_t;
+
+static int read_text(char *buf, size_t len, void *ctx) {
+  text_reader_t *r = ctx;
+  size_t n = len < r->left ? len : r->left;
+  memcpy(buf, r->p, n);
+  r->p += n;
+  r->left -= n;
+  return (int)n;
+}
+
+static esp_err_t load(const char *json) {
+  text_reader_t r = {json, strlen(json)};
+  return read_stations_json(read_text, &r);
+}
+
+static esp_err_t patch(int index, const char *json) {
+  text_reader_t r = {json, strlen(json)};
+  return patch_station_json(index, read_text, &r);
+}
+
+static esp_err_t append(const char *json) {
+  text_reader_t r = {json, strlen(json)};
+  int index;
+  return append_station_json(read_text, &r, &index);
+}
+
+static size_t arena_bytes(const station_store_t *store) {
+  size_t used = 0;
+  for (arena_block_t *b = store->arena; b; b = b->prev) {
+    used += b->used;
+  }
+  return used;
+}
+
+// the arena and index exactly as they were at mark
+static bool unchanged(arena_mark_t mark, uint32_t interned) {
+  return s_store->arena == mark.block && s_store->arena->used == mark.used &&
+         s_store->interned == interned && s_store->pending == NULL;
+}
+
+// every interned string sits in the bucket its hash picks
+static bool index_sound(uint32_t *longest) {
+  uint32_t nodes = 0;
+  *longest = 0;
+  for (uint32_t b = 0; b < s_store->bucket_count; b++) {
+    uint32_t len = 0;
+    for (intern_node_t *n = s_store->buckets[b]; n; n = n->next, len++) {
+      if ((n->hash & (s_store->bucket_count - 1)) != b ||
+          n->hash != intern_hash(n->str, strlen(n->str))) {
+        return false;
+      }
+    }
+    nodes += len;
+    *longest = len > *longest ? len : *longest;
+  }
+  return nodes == s_store->interned && s_store->pending == NULL;
+}
+
+static int check_sharing(void) {
+  int fails = 0;
+  esp_err_t err = load(
+      "[{\"call_sign\":\"KAAA\",\"origin\":\"Portland\",\"uri\":\"http://a/\","
+      "\"codec\":1,\"fallback_uri\":\"http://relay/\"},"
+      "{\"call_sign\":\"KBBB\",\"origin\":\"Portland\",\"uri\":\"http://a/\","
+      "\"codec\":1,\"fallback_uri\":\"http://relay/\"},"
+      "{\"call_sign\":\"Salem\",\"origin\":\"Salem\",\"uri\":\"http://c/\","
+      "\"codec\":2}]");
+  station_t *st = radio_stations;
+  fails += check("origins and fallback streams shared",
+                 err == ESP_OK && station_count == 3 &&
+                     st[0].origin == st[1].origin &&
+                     st[0].fallback_uri == st[1].fallback_uri &&
+                     strcmp(st[2].origin, "Salem") == 0);
+  fails += check("call signs and uris copied for each station",
+                 st[0].uri != st[1].uri && strcmp(st[0].uri, st[1].uri) == 0 &&
+                     st[2].call_sign != st[2].origin);
+  size_t whole = arena_bytes(s_store);
+
+  // the same list with entries that are dropped: no codec, no uri
+  err = load(
+      "[{\"call_sign\":\"KAAA\",\"origin\":\"Portland\",\"uri\":\"http://a/\","
+      "\"codec\":1,\"fallback_uri\":\"http://relay/\"},"
+      "{\"call_sign\":\"KDDD\",\"origin\":\"Eugene\",\"uri\":\"http://d/\","
+      "\"fallback_uri\":\"http://other-relay/\"},"
+      "{\"call_sign\":\"KBBB\",\"origin\":\"Portland\",\"uri\":\"http://a/\","
+      "\"codec\":1,\"fallback_uri\":\"http://relay/\"},"
+      "{\"call_sign\":\"KEEE\",\"origin\":\"Bend\"},"
+      "{\"call_sign\":\"Salem\",\"origin\":\"Salem\",\"uri\":\"http://c/\","
+      "\"codec\":2}]");
+  fails += check("dropped entries leave nothing in the arena",
+                 err == ESP_OK && station_count == 3 &&
+                     arena_bytes(s_store) == whole &&
+                     s_store->interned == 3);
+
+  arena_mark_t mark = arena_mark(s_store->arena);
+  err = patch(0, "{\"origin\":\"Salem\",\"fallback_uri\":\"http://relay/\"}");
+  fails += check("a patch shares the strings already there",
+                 err == ESP_OK && radio_stations[0].origin ==
+                                      radio_stations[2].origin &&
+                     unchanged(mark, 3));
+  return fails;
+}
+
+static int check_rollback(void) {
+  int fails = 0;
+  // strings that spill into a new arena block before the error
+  char big[JSON_SAX_TOKEN_MAX - 8];
+  memset(big, 'x', sizeof(big) - 1);
+  big[sizeof(big) - 1] = '\0';
+  char *json = malloc(4 * sizeof(big) + 200);
+
+  bool ok = true;
+  while (ok && s_store->arena->size - s_store->arena->used > 2 * sizeof(big)) {
+    sprintf(json, "{\"uri\":\"%s\"}", big);
+    ok = patch(1, json) == ESP_OK;
+  }
+  sprintf(json,
+          "{\"uri\":\"%s\",\"fallback_uri\":\"%s1\",\"origin\":\"%s2\","
+          "\"call_sign\":\"%s3\",\"meta_uri\":",
+          big, big, big, big);
+  station_t before = radio_stations[1];
+  arena_mark_t mark = arena_mark(s_store->arena);
+  uint32_t interned = s_store->interned;
+  esp_log_level_set("STATION_DATA", ESP_LOG_NONE); // rejections expected
+  bool rejected = patch(1, json) == ESP_ERR_INVALID_ARG;
+  rejected &= patch(1, "{\"origin\":\"Ashland\",\"codec\":\"x\"") ==
+              ESP_ERR_INVALID_ARG;
+  fails += check("rejected patches roll the arena back",
+                 ok && rejected && unchanged(mark, interned) &&
+                     memcmp(&before, &radio_stations[1], sizeof(before)) == 0);
+
+  station_store_t *live = s_store;
+  size_t used = host_heap_caps_used();
+  rejected = load("[{\"call_sign\":\"Z\",\"origin\":\"Portland\",\"uri\":"
+                  "\"z\",\"codec\":1},") == ESP_ERR_INVALID_ARG &&
+             load("[{\"call_sign\":\"Z\"}]") == ESP_ERR_INVALID_ARG;
+  esp_log_level_set("STATION_DATA", ESP_LOG_WARN);
+  fails += check("rejected lists free their store",
+                 rejected && s_store == live && station_count == 3 &&
+                     host_heap_caps_used() == used);
+
+  // the strings the rejected patch would have added are not in the index
+  sprintf(json, "{\"fallback_uri\":\"%s1\"}", big);
+  fails += check("interning works after a rollback",
+                 patch(1, json) == ESP_OK && patch(2, json) == ESP_OK &&
+                     radio_stations[1].fallback_uri ==
+                         radio_stations[2].fallback_uri &&
+                     s_store->interned == interned + 1);
+  free(json);
+  return fails;
+}
+
+static int check_growth(void) {
+  int fails = 0;
+  station_t *held = radio_stations;
+  int held_count = station_count;
+  char json[160];
+  bool ok = true;
+  for (int i = 0; i < 300; i++) {
+    snprintf(json, sizeof(json),
+             "{\"call_sign\":\"N%d\",\"origin\":\"City %d\",\"uri\":"
+             "\"http://n/%d\",\"codec\":1}",
+             i, i % 120, i);
+    ok &= append(json) == ESP_OK;
+  }
+  int retired = 0;
+  for (retired_array_t *r = s_store->retired; r; r = r->next) {
+    retired++;
+  }
+  ok &= memcmp(held[0].call_sign, "KAAA", 5) == 0 &&
+        held == s_store->retired->next->next->next->next->next->next
+                    ->stations;
+  for (int i = 0; i < held_count; i++) {
+    ok &= held[i].call_sign == radio_stations[i].call_sign;
+  }
+  fails += check("outgrown arrays kept readable",
+                 ok && station_count == 303 && held != radio_stations &&
+                     retired == 7 && s_store->capacity >= station_count &&
+                     s_store->stations == radio_stations);
+
+  uint32_t longest;
+  fails += check("index doubles past two strings a bucket",
+                 index_sound(&longest) && s_store->interned > 120 &&
+                     s_store->bucket_count > STORE_MIN_BUCKETS &&
+                     s_store->interned <= s_store->bucket_count * 2);
+  printf("  %u strings in %u buckets, longest chain %u\n", s_store->interned,
+         s_store->bucket_count, longest);
+  fails += check("appended stations share their origins",
+                 radio_stations[3].origin == radio_stations[123].origin &&
+                     radio_stations[3].call_sign !=
+                         radio_stations[123].call_sign);
+  return fails;
+}
+
+int main(void) {
+  if (mkdtemp(s_dir) == NULL) {
+    perror(s_dir);
+    return 2;
+  }
+  host_spiffs_dir(s_dir); // the edits are journaled
+  esp_log_level_set("*", ESP_LOG_WARN);
+  size_t heap = host_heap_caps_used();
+  int fails = check_sharing();
+  fails += check_rollback();
+  fails += check_growth();
+  free_station_data();
+  fails += check("freeing the list gives back every byte",
+                 s_store == NULL && host_heap_caps_used() == heap);
+
+  fails += check("an append with no list makes a store",
+                 append("{\"call_sign\":\"Q\",\"origin\":\"o\",\"uri\":\"q\","
+                        "\"codec\":1}") == ESP_OK &&
+                     station_count == 1 && s_store->capacity == 8);
+  free_station_data();
+  unlink("/spiffs/stations.json");
+  unlink("/spiffs/stations.journal");
+  rmdir(s_dir);
+  printf("\n%s\n", fails ? "FAIL" : "all ok");
+  return fails != 0;
+}
@@ -0,0 +1,319 @@
+// Checks the binary station table of main/station_table.c through the boot
+// path of main/station_data.c. A temporary directory stands in for SPIFFS and
+// the "stations" partition is kept in memory, so a reboot is
+// free_station_data() and init_station_data() again.
+//
+// Boot has to take the list from the table, its strings read in place in the
+// flash, while the table matches stations.json. A table with a bad CRC, one
+// cut short by a failed write, one of another version, one that does not fit
+// and one stamped with another size or mtime of the file have to be passed
+// over for stations.json, which then writes a good table again. New tables go
+// into the slots in turn. Last it times the boot from the table against the
+// import of the same stations.json at 16, 500 and 1000 stations, and reports
+// the heap each keeps, as glibc's malloc counts it.
+
+#include "station_data.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host_stubs.h"
+#include "esp_spiffs.h" // after the system headers, to reach the directory
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utime.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define STATION_FILE "/spiffs/stations.json"
+#define STATION_JOURNAL "/spiffs/stations.journal"
+#define SLOT_SIZE (0x80000 / 2) // each half of the partition
+
+// the slot header as station_table.c writes it
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  uint32_t sequence;
+  uint32_t count;
+  uint32_t pool_size;
+  uint32_t source_size;
+  uint32_t source_mtime;
+  uint32_t crc;
+} table_header_t;
+
+#define TABLE_MAGIC 0x31425453
+
+static char s_dir[] = "/tmp/station_table.XXXXXX";
+
+static int check(const char *what, bool ok) {
+  printf("%-50s %s\n", what, ok ? "ok" : "FAIL");
+  return !ok;
+}
+
+static size_t heap_in_use(void) {
+#ifdef __GLIBC__
+  return mallinfo2().uordblks;
+#else
+  return 0; // not measured
+#endif
+}
+
+static table_header_t *slot_header(int slot) {
+  size_t size;
+  return (table_header_t *)(host_flash(&size) + slot * SLOT_SIZE);
+}
+
+// the slot a boot would pick, or -1; the CRC is left to the code under test
+static int newest_slot(void) {
+  bool valid[2] = {slot_header(0)->magic == TABLE_MAGIC,
+                   slot_header(1)->magic == TABLE_MAGIC};
+  if (valid[0] && valid[1]) {
+    return slot_header(1)->sequence > slot_header(0)->sequence ? 1 : 0;
+  }
+  return valid[0] ? 0 : (valid[1] ? 1 : -1);
+}
+
+// the list reads its strings from the flash rather than the heap
+static bool from_table(void) {
+  size_t size;
+  const uint8_t *flash = host_flash(&size);
+  for (int i = 0; i < station_count; i++) {
+    const uint8_t *s = (const uint8_t *)radio_stations[i].call_sign;
+    if (s < flash || s >= flash + size) {
+      return false;
+    }
+  }
+  return station_count > 0;
+}
+
+typedef struct {
+  char *buf;
+  size_t len;
+} text_t;
+
+static esp_err_t collect(const char *buf, size_t len, void *ctx) {
+  text_t *t = ctx;
+  t->buf = realloc(t->buf, t->len + len + 1);
+  memcpy(t->buf + t->len, buf, len);
+  t->len += len;
+  t->buf[t->len] = '\0';
+  return ESP_OK;
+}
+
+// the list as GET /api/stations returns it
+static char *snapshot(void) {
+  text_t t = {calloc(1, 1), 0};
+  write_stations_json(collect, &t);
+  return t.buf;
+}
+
+static void reboot(void) {
+  free_station_data();
+  init_station_data();
+}
+
+// reboots, and tells whether the list came from the table and was expected
+static bool boots(bool table, const char *expected) {
+  reboot();
+  char *now = snapshot();
+  bool ok = from_table() == table && strcmp(now, expected) == 0;
+  free(now);
+  return ok;
+}
+
+// a list of count stations, every fourth with DSP settings, in stations.json
+static void write_list(int count, bool short_strings) {
+  FILE *f = fopen(STATION_FILE, "w");
+  fputs("[", f);
+  for (int i = 0; i < count; i++) {
+    if (short_strings) {
+      fprintf(f, "%s{\"call_sign\":\"K%d\",\"origin\":\"o\",\"uri\":\"u\","
+                 "\"codec\":1}\n",
+              i ? "," : "", i);
+      continue;
+    }
+    fprintf(f,
+            "%s{\"call_sign\":\"K%03dX\",\"origin\":\"City %d\",\"uri\":"
+            "\"https://stream%d.example.org:8443/live-128.mp3\",\"codec\":1,"
+            "\"meta_driver\":2,\"meta_uri\":\"https://spinitron.com/K%03dX/\""
+            "%s}\n",
+            i ? "," : "", i % 1000, i % 40, i, i % 1000,
+            i % 4 ? ""
+                  : ",\"dsp\":{\"bands\":[{\"type\":1,\"freq\":100,\"gain\":3,"
+                    "\"q\":0.7}],\"limiter\":true,\"ceiling\":-1,"
+                    "\"release\":150}");
+  }
+  fputs("]\n", f);
+  fclose(f);
+}
+
+static int check_fallbacks(void) {
+  int fails = 0;
+  // before the partition is first mapped
+  host_flash_absent(true);
+  reboot();
+  char *list = snapshot();
+  fails += check("without the partition the file is read",
+                 station_count > 8 && !from_table());
+  host_flash_absent(false);
+
+  fails += check("the table written with the file is booted from",
+                 boots(false, list) && newest_slot() >= 0 &&
+                     boots(true, list));
+
+  int slot = newest_slot();
+  table_header_t *h = slot_header(slot);
+  uint8_t *pool = (uint8_t *)(h + 1) + h->count * h->record_size;
+  pool[h->pool_size / 2] ^= 0x20; // one bit of the strings
+  slot_header(!slot)->magic = 0;
+  fails += check("bad CRC: read from the file, table rewritten",
+                 boots(false, list) &&
+                     slot_header(!slot)->magic == TABLE_MAGIC &&
+                     boots(true, list));
+
+  slot = newest_slot();
+  slot_header(slot)->version++;
+  slot_header(!slot)->magic = 0;
+  fails += check("other version: read from the file",
+                 boots(false, list) && boots(true, list));
+
+  // a reset part way through a write leaves the records without a header
+  host_flash_fail_after(2); // the invalidation and one chunk
+  esp_log_level_set("STATION_TABLE", ESP_LOG_NONE); // failure expected
+  save_station_data();
+  esp_log_level_set("STATION_TABLE", ESP_LOG_ERROR);
+  host_flash_fail_after(-1);
+  fails += check("table cut short: read from the file",
+                 newest_slot() == -1 && boots(false, list) &&
+                     boots(true, list));
+
+  // the file edited or restored behind the radio's back
+  struct stat st;
+  stat(STATION_FILE, &st);
+  char path[sizeof(s_dir) + 32];
+  snprintf(path, sizeof(path), "%s/stations.json", s_dir);
+  struct utimbuf times = {st.st_atime, st.st_mtime - 60};
+  utime(path, &times);
+  fails += check("file of another mtime: read from the file",
+                 boots(false, list) && boots(true, list));
+  FILE *f = fopen(STATION_FILE, "r+");
+  fseek(f, -1, SEEK_END);
+  fputs(" \n", f); // one byte longer, same stations
+  fclose(f);
+  utime(path, &times);
+  fails += check("file of another size: read from the file",
+                 boots(false, list) && boots(true, list));
+  free(list);
+
+  // a list too large for a slot leaves no table at all
+  write_list(2500, true);
+  esp_log_level_set("STATION_TABLE", ESP_LOG_NONE);
+  reboot();
+  list = snapshot();
+  fails += check("list too large for a slot: read from the file",
+                 station_count == 2500 && newest_slot() == -1 &&
+                     boots(false, list));
+  esp_log_level_set("STATION_TABLE", ESP_LOG_ERROR);
+  free(list);
+  return fails;
+}
+
+static int check_slots(void) {
+  int fails = 0;
+  write_list(16, false);
+  reboot(); // from the file, which writes a table
+  reboot();
+  bool turns = from_table();
+  for (int i = 0; i < 4; i++) {
+    // the save invalidates both, then writes the one not booted from
+    int slot = newest_slot();
+    turns &= save_station_data() == 0 && newest_slot() == !slot &&
+             slot_header(slot)->magic != TABLE_MAGIC;
+    reboot();
+    turns &= from_table();
+  }
+  fails += check("new tables go into the slots in turn", turns);
+
+  // the list booted keeps reading the slot the new table does not touch
+  const uint8_t *live = (const uint8_t *)slot_header(newest_slot());
+  const char *call_sign = radio_stations[0].call_sign;
+  char *copy = strdup(call_sign);
+  bool kept = save_station_data() == 0 && radio_stations[0].call_sign ==
+                                              call_sign &&
+              (const uint8_t *)call_sign > live &&
+              (const uint8_t *)call_sign < live + SLOT_SIZE &&
+              strcmp(call_sign, copy) == 0 &&
+              (const uint8_t *)slot_header(newest_slot()) != live;
+  fails += check("a save leaves the strings of the live slot", kept);
+  free(copy);
+  return fails;
+}
+
+static int read_file(char *buf, size_t len, void *ctx) {
+  return (int)fread(buf, 1, len, ctx);
+}
+
+// boots from the table, and imports the same file, reps times each
+static void benchmark(int count, int reps) {
+  write_list(count, false);
+  free_station_data();
+  host_flash_erase();
+  init_station_data(); // imports the file and writes the table
+  struct stat st;
+  stat(STATION_FILE, &st);
+
+  int64_t table_us = 0, json_us = 0;
+  size_t table_heap = 0, json_heap = 0;
+  for (int r = 0; r < reps; r++) {
+    free_station_data();
+    size_t heap = heap_in_use();
+    int64_t start = esp_timer_get_time();
+    init_station_data();
+    table_us += esp_timer_get_time() - start;
+    table_heap = heap_in_use() - heap;
+    if (!from_table()) {
+      printf("  %d stations did not boot from the table\n", count);
+    }
+
+    free_station_data();
+    heap = heap_in_use();
+    start = esp_timer_get_time();
+    FILE *f = fopen(STATION_FILE, "r");
+    if (read_stations_json(read_file, f) != ESP_OK) {
+      printf("  %d stations did not import\n", count);
+    }
+    fclose(f);
+    json_us += esp_timer_get_time() - start;
+    json_heap = heap_in_use() - heap;
+  }
+  printf("%-9d %7.0f KB %7.0f us %7.0f KB %7.0f us %7.0f KB\n", count,
+         st.st_size / 1024.0, (double)json_us / reps, json_heap / 1024.0,
+         (double)table_us / reps, table_heap / 1024.0);
+}
+
+int main(void) {
+  if (mkdtemp(s_dir) == NULL) {
+    perror(s_dir);
+    return 2;
+  }
+  host_spiffs_dir(s_dir);
+  esp_log_level_set("*", ESP_LOG_ERROR);
+  int fails = check_fallbacks();
+  fails += check_slots();
+
+  printf("\n%-9s %10s %21s %21s\n", "stations", "file", "import of the file",
+         "boot from the table");
+  printf("%-9s %10s %10s %10s %10s %10s\n", "", "", "time", "heap kept",
+         "time", "heap kept");
+  benchmark(16, 2000);
+  benchmark(500, 50);
+  benchmark(1000, 25);
+
+  free_station_data();
+  unlink(STATION_FILE);
+  unlink(STATION_JOURNAL);
+  rmdir(s_dir);
+  printf("\n%s\n", fails ? "FAIL" : "all ok");
+  return fails != 0;
+}
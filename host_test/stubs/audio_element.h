@@ -0,0 +1,59 @@
+#pragma once
+// Host stand-in for the ADF element: process() is driven by the test through
+// host_element_run(), which feeds it from and collects it into memory
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef enum {
+  AEL_IO_OK = ESP_OK,
+  AEL_IO_FAIL = ESP_FAIL,
+  AEL_IO_DONE = -2,
+  AEL_IO_ABORT = -3,
+  AEL_IO_TIMEOUT = -4,
+  AEL_PROCESS_FAIL = -5,
+} audio_element_err_t;
+
+typedef struct audio_element *audio_element_handle_t;
+
+typedef int (*stream_func)(audio_element_handle_t self, char *buffer,
+                           int wanted_size, TickType_t ticks_to_wait,
+                           void *context);
+
+typedef esp_err_t (*el_io_func)(audio_element_handle_t self);
+typedef int (*process_func)(audio_element_handle_t self, char *el_buffer,
+                            int el_buf_len);
+
+typedef struct {
+  el_io_func open;
+  process_func process;
+  el_io_func close;
+  el_io_func destroy;
+  int buffer_len;
+  int task_stack;
+  int task_prio;
+  int task_core;
+  int out_rb_size;
+  const char *tag;
+} audio_element_cfg_t;
+
+#define DEFAULT_AUDIO_ELEMENT_CONFIG()                                         \
+  {                                                                            \
+    .buffer_len = 1024, .task_stack = 2 * 1024, .task_prio = 5,                \
+    .out_rb_size = 8 * 1024,                                                   \
+  }
+
+audio_element_handle_t audio_element_init(audio_element_cfg_t *config);
+esp_err_t audio_element_deinit(audio_element_handle_t el);
+esp_err_t audio_element_setdata(audio_element_handle_t el, void *data);
+void *audio_element_getdata(audio_element_handle_t el);
+int audio_element_input(audio_element_handle_t el, char *buffer,
+                        int wanted_size);
+int audio_element_output(audio_element_handle_t el, char *buffer,
+                         int write_size);
+esp_err_t audio_element_set_read_cb(audio_element_handle_t el, stream_func fn,
+                                    void *context);
+stream_func audio_element_get_read_cb(audio_element_handle_t el);
+esp_err_t audio_element_set_tag(audio_element_handle_t el, const char *tag);
+char *audio_element_get_tag(audio_element_handle_t el);
+esp_err_t audio_element_set_uri(audio_element_handle_t el, const char *uri);
+char *audio_element_get_uri(audio_element_handle_t el);
@@ -0,0 +1,3 @@
+#pragma once
+// Host stand-in: the types headers under test mention, nothing behind them
+typedef struct audio_event_iface *audio_event_iface_handle_t;
@@ -0,0 +1,2 @@
+#pragma once
+typedef struct audio_pipeline *audio_pipeline_handle_t;
@@ -0,0 +1,498 @@
+#include "cJSON.h"
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+typedef struct {
+  const char *p;
+  int depth;
+} parser_t;
+
+#define MAX_DEPTH 1000 // as cJSON's CJSON_NESTING_LIMIT
+
+static cJSON *new_item(int type) {
+  cJSON *item = calloc(1, sizeof(cJSON));
+  if (item) {
+    item->type = type;
+  }
+  return item;
+}
+
+static void skip_space(parser_t *ps) {
+  while (*ps->p && isspace((unsigned char)*ps->p)) {
+    ps->p++;
+  }
+}
+
+static int hex4(const char *p) {
+  int v = 0;
+  for (int i = 0; i < 4; i++) {
+    int c = p[i];
+    v <<= 4;
+    if (c >= '0' && c <= '9') {
+      v |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      v |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      v |= c - 'A' + 10;
+    } else {
+      return -1;
+    }
+  }
+  return v;
+}
+
+static size_t put_utf8(char *out, unsigned cp) {
+  if (cp < 0x80) {
+    out[0] = (char)cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    out[0] = (char)(0xC0 | cp >> 6);
+    out[1] = (char)(0x80 | (cp & 0x3F));
+    return 2;
+  }
+  if (cp < 0x10000) {
+    out[0] = (char)(0xE0 | cp >> 12);
+    out[1] = (char)(0x80 | (cp >> 6 & 0x3F));
+    out[2] = (char)(0x80 | (cp & 0x3F));
+    return 3;
+  }
+  out[0] = (char)(0xF0 | cp >> 18);
+  out[1] = (char)(0x80 | (cp >> 12 & 0x3F));
+  out[2] = (char)(0x80 | (cp >> 6 & 0x3F));
+  out[3] = (char)(0x80 | (cp & 0x3F));
+  return 4;
+}
+
+// the decoded string is never longer than the escaped one
+static char *parse_string(parser_t *ps) {
+  const char *start = ++ps->p;
+  const char *end = start;
+  while (*end && *end != '"') {
+    end += *end == '\\' && end[1] ? 2 : 1;
+  }
+  if (*end != '"') {
+    return NULL;
+  }
+  char *out = malloc(end - start + 1);
+  size_t n = 0;
+  const char *p = start;
+  while (out && p < end) {
+    if (*p != '\\') {
+      out[n++] = *p++;
+      continue;
+    }
+    p++;
+    switch (*p++) {
+    case 'b': out[n++] = '\b'; break;
+    case 'f': out[n++] = '\f'; break;
+    case 'n': out[n++] = '\n'; break;
+    case 'r': out[n++] = '\r'; break;
+    case 't': out[n++] = '\t'; break;
+    case '"': case '\\': case '/': out[n++] = p[-1]; break;
+    case 'u': {
+      int cp = end - p >= 4 ? hex4(p) : -1;
+      if (cp < 0) {
+        free(out);
+        return NULL;
+      }
+      p += 4;
+      if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' &&
+          p[1] == 'u') {
+        int low = hex4(p + 2);
+        if (low >= 0xDC00 && low < 0xE000) {
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+          p += 6;
+        }
+      }
+      n += put_utf8(out + n, (unsigned)cp);
+      break;
+    }
+    default:
+      free(out);
+      return NULL;
+    }
+  }
+  if (out) {
+    out[n] = '\0';
+  }
+  ps->p = end + 1;
+  return out;
+}
+
+static cJSON *parse_value(parser_t *ps);
+
+static cJSON *parse_container(parser_t *ps, bool object) {
+  char close = object ? '}' : ']';
+  cJSON *item = new_item(object ? cJSON_Object : cJSON_Array);
+  if (item == NULL || ++ps->depth > MAX_DEPTH) {
+    cJSON_Delete(item);
+    return NULL;
+  }
+  ps->p++;
+  skip_space(ps);
+  if (*ps->p == close) {
+    ps->p++;
+    ps->depth--;
+    return item;
+  }
+  cJSON *last = NULL;
+  for (;;) {
+    char *key = NULL;
+    if (object) {
+      skip_space(ps);
+      if (*ps->p != '"' || (key = parse_string(ps)) == NULL) {
+        break;
+      }
+      skip_space(ps);
+      if (*ps->p != ':') {
+        free(key);
+        break;
+      }
+      ps->p++;
+    }
+    cJSON *child = parse_value(ps);
+    if (child == NULL) {
+      free(key);
+      break;
+    }
+    child->string = key;
+    if (last) {
+      last->next = child;
+      child->prev = last;
+    } else {
+      item->child = child;
+    }
+    last = child;
+    item->child->prev = last; // cJSON keeps the tail in the head's prev
+    skip_space(ps);
+    if (*ps->p == ',') {
+      ps->p++;
+      continue;
+    }
+    if (*ps->p == close) {
+      ps->p++;
+      ps->depth--;
+      return item;
+    }
+    break;
+  }
+  cJSON_Delete(item);
+  return NULL;
+}
+
+static cJSON *parse_value(parser_t *ps) {
+  skip_space(ps);
+  const char *p = ps->p;
+  if (*p == '{' || *p == '[') {
+    return parse_container(ps, *p == '{');
+  }
+  if (*p == '"') {
+    char *s = parse_string(ps);
+    cJSON *item = s ? new_item(cJSON_String) : NULL;
+    if (item) {
+      item->valuestring = s;
+    } else {
+      free(s);
+    }
+    return item;
+  }
+  static const struct {
+    const char *word;
+    int type;
+  } words[] = {{"null", cJSON_NULL}, {"true", cJSON_True}, {"false", cJSON_False}};
+  for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+    size_t len = strlen(words[i].word);
+    if (strncmp(p, words[i].word, len) == 0) {
+      ps->p += len;
+      cJSON *item = new_item(words[i].type);
+      if (item) {
+        item->valueint = words[i].type == cJSON_True;
+      }
+      return item;
+    }
+  }
+  if (*p == '-' || isdigit((unsigned char)*p)) {
+    char *end;
+    double v = strtod(p, &end);
+    cJSON *item = new_item(cJSON_Number);
+    if (item) {
+      item->valuedouble = v;
+      item->valueint = v >= 2147483647.0    ? 2147483647
+                       : v <= -2147483648.0 ? -2147483647 - 1
+                                            : (int)v;
+    }
+    ps->p = end;
+    return item;
+  }
+  return NULL;
+}
+
+cJSON *cJSON_Parse(const char *value) {
+  if (value == NULL) {
+    return NULL;
+  }
+  parser_t ps = {value, 0};
+  cJSON *item = parse_value(&ps);
+  return item;
+}
+
+void cJSON_Delete(cJSON *item) {
+  while (item) {
+    cJSON *next = item->next;
+    cJSON_Delete(item->child);
+    free(item->valuestring);
+    free(item->string);
+    free(item);
+    item = next;
+  }
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string) {
+  if (object == NULL || string == NULL) {
+    return NULL;
+  }
+  for (cJSON *c = object->child; c; c = c->next) {
+    if (c->string && strcasecmp(c->string, string) == 0) {
+      return c;
+    }
+  }
+  return NULL;
+}
+
+cJSON *cJSON_GetArrayItem(const cJSON *array, int index) {
+  if (array == NULL || index < 0) {
+    return NULL;
+  }
+  cJSON *c = array->child;
+  while (c && index-- > 0) {
+    c = c->next;
+  }
+  return c;
+}
+
+int cJSON_GetArraySize(const cJSON *array) {
+  int n = 0;
+  for (cJSON *c = array ? array->child : NULL; c; c = c->next) {
+    n++;
+  }
+  return n;
+}
+
+cJSON_bool cJSON_IsArray(const cJSON *item) {
+  return item && (item->type & 0xFF) == cJSON_Array;
+}
+
+cJSON_bool cJSON_IsObject(const cJSON *item) {
+  return item && (item->type & 0xFF) == cJSON_Object;
+}
+
+cJSON_bool cJSON_IsString(const cJSON *item) {
+  return item && (item->type & 0xFF) == cJSON_String;
+}
+
+cJSON_bool cJSON_IsNumber(const cJSON *item) {
+  return item && (item->type & 0xFF) == cJSON_Number;
+}
+
+cJSON_bool cJSON_IsBool(const cJSON *item) {
+  return item && (item->type & (cJSON_True | cJSON_False)) != 0;
+}
+
+cJSON_bool cJSON_IsTrue(const cJSON *item) {
+  return item && (item->type & 0xFF) == cJSON_True;
+}
+
+cJSON *cJSON_CreateObject(void) { return new_item(cJSON_Object); }
+
+cJSON *cJSON_CreateArray(void) { return new_item(cJSON_Array); }
+
+cJSON_bool cJSON_AddItemToArray(cJSON *array, cJSON *item) {
+  if (array == NULL || item == NULL) {
+    return 0;
+  }
+  if (array->child == NULL) {
+    array->child = item;
+  } else {
+    cJSON *last = array->child->prev;
+    last->next = item;
+    item->prev = last;
+  }
+  array->child->prev = item;
+  return 1;
+}
+
+cJSON_bool cJSON_AddItemToObject(cJSON *object, const char *string,
+                                 cJSON *item) {
+  if (object == NULL || item == NULL || string == NULL) {
+    return 0;
+  }
+  free(item->string);
+  item->string = strdup(string);
+  return item->string && cJSON_AddItemToArray(object, item);
+}
+
+// adds item under name, or deletes it if it cannot be added
+static cJSON *add_new(cJSON *object, const char *name, cJSON *item) {
+  if (!cJSON_AddItemToObject(object, name, item)) {
+    cJSON_Delete(item);
+    return NULL;
+  }
+  return item;
+}
+
+cJSON *cJSON_AddStringToObject(cJSON *object, const char *name,
+                               const char *string) {
+  cJSON *item = new_item(cJSON_String);
+  if (item && (item->valuestring = strdup(string)) == NULL) {
+    cJSON_Delete(item);
+    return NULL;
+  }
+  return add_new(object, name, item);
+}
+
+cJSON *cJSON_AddNumberToObject(cJSON *object, const char *name,
+                               double number) {
+  cJSON *item = new_item(cJSON_Number);
+  if (item) {
+    item->valuedouble = number;
+    item->valueint = number >= INT_MAX   ? INT_MAX
+                     : number <= INT_MIN ? INT_MIN
+                                         : (int)number;
+  }
+  return add_new(object, name, item);
+}
+
+cJSON *cJSON_AddBoolToObject(cJSON *object, const char *name,
+                             cJSON_bool boolean) {
+  return add_new(object, name, new_item(boolean ? cJSON_True : cJSON_False));
+}
+
+cJSON *cJSON_AddArrayToObject(cJSON *object, const char *name) {
+  return add_new(object, name, new_item(cJSON_Array));
+}
+
+typedef struct {
+  char *buf;
+  size_t len, size;
+  bool ok;
+} printer_t;
+
+static void put(printer_t *pr, const char *s, size_t n) {
+  if (pr->ok && pr->len + n + 1 > pr->size) {
+    size_t size = (pr->len + n + 1) * 2;
+    char *buf = realloc(pr->buf, size);
+    pr->ok = buf != NULL;
+    pr->buf = buf ? buf : pr->buf;
+    pr->size = size;
+  }
+  if (pr->ok) {
+    memcpy(pr->buf + pr->len, s, n);
+    pr->len += n;
+    pr->buf[pr->len] = '\0';
+  }
+}
+
+static void put_str(printer_t *pr, const char *s) { put(pr, s, strlen(s)); }
+
+// escaped as cJSON escapes: only quotes, backslashes and control characters
+static void print_string(printer_t *pr, const char *s) {
+  put(pr, "\"", 1);
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    char esc[8];
+    switch (c) {
+    case '"': put_str(pr, "\\\""); break;
+    case '\\': put_str(pr, "\\\\"); break;
+    case '\b': put_str(pr, "\\b"); break;
+    case '\f': put_str(pr, "\\f"); break;
+    case '\n': put_str(pr, "\\n"); break;
+    case '\r': put_str(pr, "\\r"); break;
+    case '\t': put_str(pr, "\\t"); break;
+    default:
+      if (c < 0x20) {
+        snprintf(esc, sizeof(esc), "\\u%04x", c);
+        put_str(pr, esc);
+      } else {
+        put(pr, s, 1);
+      }
+      break;
+    }
+  }
+  put(pr, "\"", 1);
+}
+
+static void print_number(printer_t *pr, double d) {
+  char num[32];
+  if (isnan(d) || isinf(d)) {
+    strcpy(num, "null");
+  } else if (d == (double)(int)d) {
+    snprintf(num, sizeof(num), "%d", (int)d);
+  } else {
+    snprintf(num, sizeof(num), "%1.15g", d);
+    if (strtod(num, NULL) != d) {
+      snprintf(num, sizeof(num), "%1.17g", d);
+    }
+  }
+  put_str(pr, num);
+}
+
+// formatted as cJSON_Print() lays it out: a tab per level
+static void print_value(printer_t *pr, const cJSON *item, int depth,
+                        bool format) {
+  switch (item->type & 0xFF) {
+  case cJSON_NULL: put_str(pr, "null"); return;
+  case cJSON_False: put_str(pr, "false"); return;
+  case cJSON_True: put_str(pr, "true"); return;
+  case cJSON_Number: print_number(pr, item->valuedouble); return;
+  case cJSON_String: print_string(pr, item->valuestring); return;
+  default: break;
+  }
+  bool object = (item->type & 0xFF) == cJSON_Object;
+  put(pr, object ? "{" : "[", 1);
+  for (const cJSON *c = item->child; c; c = c->next) {
+    if (object && format) {
+      put(pr, "\n", 1);
+      for (int i = 0; i <= depth; i++) {
+        put(pr, "\t", 1);
+      }
+    }
+    if (object) {
+      print_string(pr, c->string);
+      put_str(pr, format ? ":\t" : ":");
+    }
+    print_value(pr, c, depth + 1, format);
+    if (c->next) {
+      put_str(pr, format && !object ? ", " : ",");
+    }
+  }
+  if (object && format) {
+    put(pr, "\n", 1);
+    for (int i = 0; i < depth; i++) {
+      put(pr, "\t", 1);
+    }
+  }
+  put(pr, object ? "}" : "]", 1);
+}
+
+static char *print(const cJSON *item, bool format) {
+  printer_t pr = {NULL, 0, 0, true};
+  if (item == NULL) {
+    return NULL;
+  }
+  print_value(&pr, item, 0, format);
+  if (!pr.ok) {
+    free(pr.buf);
+    return NULL;
+  }
+  return pr.buf;
+}
+
+char *cJSON_Print(const cJSON *item) { return print(item, true); }
+
+char *cJSON_PrintUnformatted(const cJSON *item) { return print(item, false); }
@@ -0,0 +1,58 @@
+#pragma once
+// Host stand-in for the cJSON that ships with ESP-IDF, used when that is not
+// found. It parses into the same tree and implements only the calls the
+// sources under test make.
+#include <stdbool.h>
+#include <stddef.h>
+
+#define cJSON_Invalid 0
+#define cJSON_False (1 << 0)
+#define cJSON_True (1 << 1)
+#define cJSON_NULL (1 << 2)
+#define cJSON_Number (1 << 3)
+#define cJSON_String (1 << 4)
+#define cJSON_Array (1 << 5)
+#define cJSON_Object (1 << 6)
+
+typedef struct cJSON {
+  struct cJSON *next;
+  struct cJSON *prev;
+  struct cJSON *child;
+  int type;
+  char *valuestring;
+  int valueint;
+  double valuedouble;
+  char *string;
+} cJSON;
+
+typedef int cJSON_bool;
+
+cJSON *cJSON_Parse(const char *value);
+void cJSON_Delete(cJSON *item);
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string);
+cJSON *cJSON_GetArrayItem(const cJSON *array, int index);
+int cJSON_GetArraySize(const cJSON *array);
+cJSON_bool cJSON_IsArray(const cJSON *item);
+cJSON_bool cJSON_IsObject(const cJSON *item);
+cJSON_bool cJSON_IsString(const cJSON *item);
+cJSON_bool cJSON_IsNumber(const cJSON *item);
+cJSON_bool cJSON_IsBool(const cJSON *item);
+cJSON_bool cJSON_IsTrue(const cJSON *item);
+
+cJSON *cJSON_CreateObject(void);
+cJSON *cJSON_CreateArray(void);
+cJSON_bool cJSON_AddItemToArray(cJSON *array, cJSON *item);
+cJSON_bool cJSON_AddItemToObject(cJSON *object, const char *string,
+                                 cJSON *item);
+cJSON *cJSON_AddStringToObject(cJSON *object, const char *name,
+                               const char *string);
+cJSON *cJSON_AddNumberToObject(cJSON *object, const char *name, double number);
+cJSON *cJSON_AddBoolToObject(cJSON *object, const char *name,
+                             cJSON_bool boolean);
+cJSON *cJSON_AddArrayToObject(cJSON *object, const char *name);
+char *cJSON_Print(const cJSON *item);
+char *cJSON_PrintUnformatted(const cJSON *item);
+
+#define cJSON_ArrayForEach(element, array)                                     \
+  for (element = (array != NULL) ? (array)->child : NULL; element != NULL;     \
+       element = element->next)
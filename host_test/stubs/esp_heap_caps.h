@@ -0,0 +1,14 @@
+#pragma once
+// Host stand-in: every capability is plain malloc. What heap_caps_malloc()
+// has out is counted, and heap_caps_get_free_size() is a nominal 4 MB less
+// that count, so only those allocations show in it.
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void heap_caps_free(void *ptr);
+size_t heap_caps_get_free_size(uint32_t caps);
@@ -0,0 +1,33 @@
+#pragma once
+// Host stand-in: log lines go to stdout, debug and verbose are dropped.
+// esp_log_level_set() quiets a tag, or every tag with "*".
+#include <inttypes.h>
+#include <stdio.h>
+
+typedef enum {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+esp_log_level_t esp_log_level_get(const char *tag);
+
+#define HOST_LOG(level, letter, tag, fmt, ...)                                 \
+  do {                                                                         \
+    if (esp_log_level_get(tag) >= (level)) {                                   \
+      printf(letter " %s: " fmt "\n", tag, ##__VA_ARGS__);                     \
+    }                                                                          \
+  } while (0)
+
+#define ESP_LOGE(tag, fmt, ...)                                                \
+  HOST_LOG(ESP_LOG_ERROR, "E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)                                                \
+  HOST_LOG(ESP_LOG_WARN, "W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)                                                \
+  HOST_LOG(ESP_LOG_INFO, "I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGV(tag, fmt, ...) ((void)(tag))
@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * @brief CRC-32 as the ROM computes it, little-endian, reflected.
+ */
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
@@ -0,0 +1,28 @@
+#pragma once
+// Host stand-in: the SPIFFS partition is a directory on the host, set with
+// host_spiffs_dir(). The calls station_data.c makes on paths under the
+// mounted base path are redirected into it, so the system headers that
+// declare them come first.
+#include "esp_err.h"
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+  const char *base_path;
+  const char *partition_label;
+  size_t max_files;
+  bool format_if_mount_failed;
+} esp_vfs_spiffs_conf_t;
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf);
+esp_err_t esp_spiffs_info(const char *partition_label, size_t *total_bytes,
+                          size_t *used_bytes);
+
+FILE *host_spiffs_fopen(const char *path, const char *mode);
+int host_spiffs_stat(const char *path, struct stat *st);
+int host_spiffs_unlink(const char *path);
+
+#define fopen host_spiffs_fopen
+#define stat(path, st) host_spiffs_stat(path, st)
+#define unlink host_spiffs_unlink
@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * @brief Microseconds of the host's monotonic clock.
+ */
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,10 @@
+#pragma once
+// Host stand-in: there are no tasks on the host, creating one fails
+#include "freertos/FreeRTOS.h"
+
+typedef void *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item);
+void vQueueDelete(QueueHandle_t queue);
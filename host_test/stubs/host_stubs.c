@@ -0,0 +1,440 @@
+#include "host_stubs.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_spiffs.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct audio_element {
+  audio_element_cfg_t cfg;
+  void *data;
+  const char *in;
+  size_t in_len, in_pos;
+  unsigned ragged_seed; // 0 to hand process() all it asks for
+  char *out;
+  size_t out_size, out_len;
+  stream_func read;
+  char tag[16];
+  char *uri;
+};
+
+audio_element_handle_t audio_element_init(audio_element_cfg_t *config) {
+  audio_element_handle_t el = calloc(1, sizeof(*el));
+  if (el) {
+    el->cfg = *config;
+  }
+  return el;
+}
+
+esp_err_t audio_element_deinit(audio_element_handle_t el) {
+  if (el->cfg.destroy) {
+    el->cfg.destroy(el);
+  }
+  free(el->uri);
+  free(el);
+  return ESP_OK;
+}
+
+esp_err_t audio_element_setdata(audio_element_handle_t el, void *data) {
+  el->data = data;
+  return ESP_OK;
+}
+
+void *audio_element_getdata(audio_element_handle_t el) { return el->data; }
+
+esp_err_t audio_element_set_read_cb(audio_element_handle_t el, stream_func fn,
+                                    void *context) {
+  el->read = fn;
+  return ESP_OK;
+}
+
+stream_func audio_element_get_read_cb(audio_element_handle_t el) {
+  return el->read;
+}
+
+esp_err_t audio_element_set_tag(audio_element_handle_t el, const char *tag) {
+  snprintf(el->tag, sizeof(el->tag), "%s", tag);
+  return ESP_OK;
+}
+
+char *audio_element_get_tag(audio_element_handle_t el) {
+  return el->tag[0] || el->cfg.tag == NULL ? el->tag : (char *)el->cfg.tag;
+}
+
+esp_err_t audio_element_set_uri(audio_element_handle_t el, const char *uri) {
+  free(el->uri);
+  el->uri = uri ? strdup(uri) : NULL;
+  return ESP_OK;
+}
+
+char *audio_element_get_uri(audio_element_handle_t el) { return el->uri; }
+
+int audio_element_input(audio_element_handle_t el, char *buffer,
+                        int wanted_size) {
+  size_t n = el->in_len - el->in_pos;
+  if (n == 0) {
+    return AEL_IO_DONE;
+  }
+  if (el->ragged_seed) {
+    // as a ring buffer does when the writer is behind
+    el->ragged_seed = el->ragged_seed * 1103515245u + 12345u;
+    wanted_size = 1 + (int)((el->ragged_seed >> 8) % (unsigned)wanted_size);
+  }
+  if (n > (size_t)wanted_size) {
+    n = wanted_size;
+  }
+  memcpy(buffer, el->in + el->in_pos, n);
+  el->in_pos += n;
+  return (int)n;
+}
+
+int audio_element_output(audio_element_handle_t el, char *buffer,
+                         int write_size) {
+  if (el->out) {
+    if (el->out_len + write_size > el->out_size) {
+      fprintf(stderr, "%s: output overflows the test buffer\n", el->cfg.tag);
+      abort();
+    }
+    memcpy(el->out + el->out_len, buffer, write_size);
+  }
+  el->out_len += write_size;
+  return write_size;
+}
+
+size_t host_element_run(audio_element_handle_t el, const void *in,
+                        size_t in_len, void *out, size_t out_size) {
+  el->in = in;
+  el->in_len = in_len;
+  el->in_pos = 0;
+  el->out = out;
+  el->out_size = out_size;
+  el->out_len = 0;
+  char *buf = malloc(el->cfg.buffer_len);
+  while (el->cfg.process(el, buf, el->cfg.buffer_len) > 0) {
+  }
+  free(buf);
+  return el->out_len;
+}
+
+void host_element_ragged_reads(audio_element_handle_t el, unsigned seed) {
+  el->ragged_seed = seed;
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+  static char name[16];
+  snprintf(name, sizeof(name), "0x%x", code);
+  return name;
+}
+
+#define HOST_LOG_TAGS 16
+
+static struct {
+  const char *tag;
+  esp_log_level_t level;
+} s_log_levels[HOST_LOG_TAGS];
+static int s_log_tags;
+static esp_log_level_t s_log_default = ESP_LOG_INFO;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+  if (strcmp(tag, "*") == 0) {
+    s_log_default = level;
+    s_log_tags = 0;
+    return;
+  }
+  int i = 0;
+  while (i < s_log_tags && strcmp(s_log_levels[i].tag, tag) != 0) {
+    i++;
+  }
+  if (i == HOST_LOG_TAGS) {
+    return;
+  }
+  if (i == s_log_tags) {
+    s_log_levels[s_log_tags++].tag = tag;
+  }
+  s_log_levels[i].level = level;
+}
+
+esp_log_level_t esp_log_level_get(const char *tag) {
+  for (int i = 0; i < s_log_tags; i++) {
+    if (strcmp(s_log_levels[i].tag, tag) == 0) {
+      return s_log_levels[i].level;
+    }
+  }
+  return s_log_default;
+}
+
+#define HOST_NVS_KEYS 32
+
+static struct {
+  char key[16];
+  int16_t value;
+} s_nvs[HOST_NVS_KEYS];
+static int s_nvs_used;
+static int s_nvs_writes;
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out) {
+  *out = 1;
+  return ESP_OK;
+}
+
+esp_err_t nvs_get_i16(nvs_handle_t handle, const char *key, int16_t *out) {
+  for (int i = 0; i < s_nvs_used; i++) {
+    if (strcmp(s_nvs[i].key, key) == 0) {
+      *out = s_nvs[i].value;
+      return ESP_OK;
+    }
+  }
+  return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_i16(nvs_handle_t handle, const char *key, int16_t value) {
+  s_nvs_writes++;
+  int i = 0;
+  while (i < s_nvs_used && strcmp(s_nvs[i].key, key) != 0) {
+    i++;
+  }
+  if (i == HOST_NVS_KEYS) {
+    return ESP_FAIL;
+  }
+  if (i == s_nvs_used) {
+    s_nvs_used++;
+  }
+  snprintf(s_nvs[i].key, sizeof(s_nvs[i].key), "%s", key);
+  s_nvs[i].value = value;
+  return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) { return ESP_OK; }
+
+void nvs_close(nvs_handle_t handle) {}
+
+int host_nvs_writes(void) { return s_nvs_writes; }
+
+#define HOST_HEAP_SIZE (4 * 1024 * 1024)
+
+// each block starts with its size, so the count follows the frees
+typedef union {
+  size_t size;
+  max_align_t align;
+} heap_block_t;
+
+static size_t s_heap_used;
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+  heap_block_t *b = malloc(sizeof(heap_block_t) + size);
+  if (b == NULL) {
+    return NULL;
+  }
+  b->size = size;
+  s_heap_used += size;
+  return b + 1;
+}
+
+void heap_caps_free(void *ptr) {
+  if (ptr) {
+    heap_block_t *b = (heap_block_t *)ptr - 1;
+    s_heap_used -= b->size;
+    free(b);
+  }
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+  return s_heap_used < HOST_HEAP_SIZE ? HOST_HEAP_SIZE - s_heap_used : 0;
+}
+
+size_t host_heap_caps_used(void) { return s_heap_used; }
+
+static const char *s_spiffs_dir;
+static char s_spiffs_base[16];
+
+void host_spiffs_dir(const char *dir) { s_spiffs_dir = dir; }
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf) {
+  if (s_spiffs_dir == NULL) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  snprintf(s_spiffs_base, sizeof(s_spiffs_base), "%s", conf->base_path);
+  return ESP_OK;
+}
+
+esp_err_t esp_spiffs_info(const char *partition_label, size_t *total_bytes,
+                          size_t *used_bytes) {
+  *total_bytes = 0x60000; // the storage partition; use is not tracked
+  *used_bytes = 0;
+  return ESP_OK;
+}
+
+// a path under the mounted base path, moved into the host directory
+static const char *spiffs_path(const char *path, char *buf, size_t size) {
+  size_t base = strlen(s_spiffs_base);
+  if (base == 0 || strncmp(path, s_spiffs_base, base) != 0 ||
+      path[base] != '/') {
+    return path;
+  }
+  snprintf(buf, size, "%s%s", s_spiffs_dir, path + base);
+  return buf;
+}
+
+#undef fopen
+#undef stat
+#undef unlink
+
+FILE *host_spiffs_fopen(const char *path, const char *mode) {
+  char buf[512];
+  return fopen(spiffs_path(path, buf, sizeof(buf)), mode);
+}
+
+int host_spiffs_stat(const char *path, struct stat *st) {
+  char buf[512];
+  return stat(spiffs_path(path, buf, sizeof(buf)), st);
+}
+
+int host_spiffs_unlink(const char *path) {
+  char buf[512];
+  return unlink(spiffs_path(path, buf, sizeof(buf)));
+}
+
+// the "stations" partition of partitions_internet_radio_adf.csv
+#define HOST_FLASH_SIZE 0x80000
+#define HOST_FLASH_SECTOR 4096
+
+static uint8_t s_flash[HOST_FLASH_SIZE];
+static bool s_flash_erased; // it starts out erased, all ones
+static bool s_flash_absent;
+static int s_flash_writes_left = -1;
+static const esp_partition_t s_flash_part = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = (esp_partition_subtype_t)0x40,
+    .size = HOST_FLASH_SIZE,
+    .erase_size = HOST_FLASH_SECTOR,
+    .label = "stations",
+};
+
+void host_flash_erase(void) {
+  memset(s_flash, 0xff, sizeof(s_flash));
+  s_flash_erased = true;
+}
+
+uint8_t *host_flash(size_t *size) {
+  if (!s_flash_erased) {
+    host_flash_erase();
+  }
+  *size = HOST_FLASH_SIZE;
+  return s_flash;
+}
+
+void host_flash_absent(bool absent) { s_flash_absent = absent; }
+
+void host_flash_fail_after(int writes) { s_flash_writes_left = writes; }
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label) {
+  if (s_flash_absent || type != ESP_PARTITION_TYPE_DATA ||
+      strcmp(label, s_flash_part.label) != 0) {
+    return NULL;
+  }
+  if (!s_flash_erased) {
+    host_flash_erase();
+  }
+  return &s_flash_part;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset,
+                             size_t size, esp_partition_mmap_memory_t memory,
+                             const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle) {
+  if (offset + size > HOST_FLASH_SIZE) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *out_ptr = s_flash + offset;
+  *out_handle = 1;
+  return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle) {}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition,
+                                    size_t offset, size_t size) {
+  if (offset % HOST_FLASH_SECTOR || size % HOST_FLASH_SECTOR ||
+      offset + size > HOST_FLASH_SIZE) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  memset(s_flash + offset, 0xff, size);
+  return ESP_OK;
+}
+
+// as on NOR flash a write can only clear bits; setting them takes an erase
+esp_err_t esp_partition_write(const esp_partition_t *partition,
+                              size_t dst_offset, const void *src,
+                              size_t size) {
+  if (dst_offset + size > HOST_FLASH_SIZE) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (s_flash_writes_left == 0) {
+    return ESP_FAIL;
+  }
+  if (s_flash_writes_left > 0) {
+    s_flash_writes_left--;
+  }
+  const uint8_t *p = src;
+  for (size_t i = 0; i < size; i++) {
+    s_flash[dst_offset + i] &= p[i];
+  }
+  return ESP_OK;
+}
+
+// table driven, as the ROM's is, so a table boot is timed fairly
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len) {
+  static uint32_t table[256];
+  if (table[1] == 0) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = c & 1 ? (c >> 1) ^ 0xEDB88320u : c >> 1;
+      }
+      table[i] = c;
+    }
+  }
+  crc = ~crc;
+  while (len--) {
+    crc = table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+int64_t esp_timer_get_time(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  return NULL;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait) {
+  return pdFALSE;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item) {
+  return pdFALSE;
+}
+
+void vQueueDelete(QueueHandle_t queue) {}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name,
+                                   uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *handle,
+                                   BaseType_t core) {
+  return pdFALSE;
+}
@@ -0,0 +1,58 @@
+#pragma once
+// Test side of the host stand-ins
+#include "audio_element.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Runs el's process() until it has taken all in_len bytes of in. What
+ * it writes goes to out, which may be NULL to drop it.
+ * @return Bytes written by the element.
+ */
+size_t host_element_run(audio_element_handle_t el, const void *in,
+                        size_t in_len, void *out, size_t out_size);
+
+/**
+ * @brief With a seed other than 0, each audio_element_input() returns a
+ * pseudo-random number of bytes between 1 and the size asked for.
+ */
+void host_element_ragged_reads(audio_element_handle_t el, unsigned seed);
+
+/**
+ * @brief Number of nvs_set_* calls so far.
+ */
+int host_nvs_writes(void);
+
+/**
+ * @brief Bytes heap_caps_malloc() has out.
+ */
+size_t host_heap_caps_used(void);
+
+/**
+ * @brief Host directory that stands in for the SPIFFS partition; until it is
+ * set esp_vfs_spiffs_register() fails.
+ */
+void host_spiffs_dir(const char *dir);
+
+/**
+ * @brief The "stations" partition, to look at or to damage.
+ * @param size Set to its size.
+ */
+uint8_t *host_flash(size_t *size);
+
+/**
+ * @brief Erases the whole partition, as a fresh flash is.
+ */
+void host_flash_erase(void);
+
+/**
+ * @brief Whether the partition table leaves the partition out.
+ */
+void host_flash_absent(bool absent);
+
+/**
+ * @brief Makes esp_partition_write() fail once it has done this many more
+ * writes, as a reset in the middle of a save would leave it; -1 never.
+ */
+void host_flash_fail_after(int writes);
@@ -0,0 +1,3 @@
+#pragma once
+// Host stand-in: screens.h only names the display type
+typedef struct lv_display_t lv_display_t;
@@ -0,0 +1,15 @@
+#pragma once
+// Host stand-in for the generated sdkconfig.h, the defaults from
+// main/Kconfig.projbuild for the options the sources under test read
+#define CONFIG_RADIO_OUTPUT_SAMPLE_RATE 44100
+#define CONFIG_RADIO_LOUDNESS 1
+#define CONFIG_RADIO_LOUDNESS_TARGET_LUFS -18
+#define CONFIG_RADIO_LOUDNESS_MAX_BOOST_DB 6
+#define CONFIG_RADIO_RESAMPLER 1
+#ifndef CONFIG_RADIO_DRIFT_COMPENSATION // 0 on the command line to turn off
+#define CONFIG_RADIO_DRIFT_COMPENSATION 1
+#endif
+#define CONFIG_RADIO_STATION_LIST_MAX_KB 256
+#ifndef CONFIG_RADIO_STATION_TABLE
+#define CONFIG_RADIO_STATION_TABLE 1
+#endif
@@ -0,0 +1,317 @@
+// Checks the software volume of components/esp_codec_dev, which the radio
+// scales its output with: audio_codec_sw_vol.c built with the host compiler,
+// without the ESP32-S3 vector path.
+//
+// The gain tables have to give within one LSB of the exp() the volume was
+// computed with before, on a 0.01 dB grid, with nothing below -96 dB, and the
+// volume to dB table what walking the curve gave for every volume. Unity
+// gain has to pass samples through untouched and mute has to give silence.
+// Below 0 dB 16-bit output has to match the old per sample multiply bit for
+// bit; above it, 16, 24 and 32-bit samples have to saturate rather than wrap.
+// A fade has to hold one gain per 32-frame block, move the same way every
+// block and end on the gain asked for, however small the change.
+
+#include "audio_codec_sw_vol.c" // the gain tables are checked directly
+#include "esp_codec_dev.c"      // and the volume curve table
+#include <math.h>
+#include <stdio.h>
+
+#define RATE 48000
+#define FADE_MS 50
+#define FRAMES 1152
+
+static int check(const char *what, bool ok) {
+  printf("%-50s %s\n", what, ok ? "ok" : "FAIL");
+  return !ok;
+}
+
+// the gain as _sw_vol_set() computed it before the tables, which wrapped
+// rather than capped past 0xffff
+static int exp_gain(float db) {
+  int gain = db <= -96.0 ? 0 : (int)(exp(db / 20 * log(10)) * (1 << 15));
+  return gain < GAIN_MAX ? gain : GAIN_MAX;
+}
+
+static unsigned next_rand(unsigned *seed) {
+  *seed = *seed * 1103515245u + 12345u;
+  return *seed >> 8;
+}
+
+static void fill_random(void *buf, int size, unsigned seed) {
+  uint8_t *p = buf;
+  for (int i = 0; i < size; i++) {
+    p[i] = (uint8_t)next_rand(&seed);
+  }
+}
+
+static audio_vol_t *open_vol(float db, int bits, int channel) {
+  const audio_codec_vol_if_t *vol = audio_codec_new_sw_vol();
+  vol->set_vol(vol, db); // before open, so it applies without a fade
+  esp_codec_dev_sample_info_t fs = {
+      .bits_per_sample = bits, .channel = channel, .sample_rate = RATE};
+  vol->open(vol, &fs, FADE_MS);
+  return (audio_vol_t *)vol;
+}
+
+static void close_vol(audio_vol_t *vol) {
+  vol->base.close(&vol->base);
+  free(vol);
+}
+
+static int process(audio_vol_t *vol, void *in, int len, void *out) {
+  return vol->base.process(&vol->base, in, len, out, len);
+}
+
+static int check_tables(void) {
+  int fails = 0, worst = 0, exact = 0, total = 0;
+  for (int i = -9600; i <= 700; i++) {
+    float db = i / 100.0f;
+    int diff = abs(db_to_gain(db) - exp_gain(db));
+    worst = diff > worst ? diff : worst;
+    exact += diff == 0;
+    total++;
+  }
+  printf("  %d of %d gains as exp() gave, the rest %d LSB off\n", exact,
+         total, worst);
+  fails += check("gain within one LSB of exp() from -96 to +7 dB",
+                 worst <= 1);
+  fails += check("0 dB is unity, -96 dB and below mute",
+                 db_to_gain(0.0f) == GAIN_0DB && db_to_gain(-96.0f) == 0 &&
+                     db_to_gain(-120.0f) == 0);
+  fails += check("gain capped at 0xffff, just over +6 dB",
+                 db_to_gain(6.0f) < GAIN_MAX && db_to_gain(6.1f) == GAIN_MAX &&
+                     db_to_gain(20.0f) == GAIN_MAX);
+  bool rising = true;
+  for (int i = -9599; i <= 700; i++) {
+    rising &= db_to_gain(i / 100.0f) >= db_to_gain((i - 1) / 100.0f);
+  }
+  fails += check("gain never falls as dB rises", rising);
+  return fails;
+}
+
+// the table a curve is compiled into against walking the curve
+static bool table_matches(codec_dev_t *dev, bool tabled) {
+  bool ok = (dev->vol_db_table != NULL) == tabled;
+  for (int v = -5; v <= 2 * VOL_TABLE_MAX_SIZE; v++) {
+    ok &= _lookup_vol_db(dev, v) == _get_vol_db(&dev->vol_curve, v);
+  }
+  return ok;
+}
+
+static int check_curves(void) {
+  static const audio_codec_data_if_t data_if = {0};
+  esp_codec_dev_cfg_t cfg = {.dev_type = ESP_CODEC_DEV_TYPE_OUT,
+                             .data_if = &data_if};
+  codec_dev_t *dev = (codec_dev_t *)esp_codec_dev_new(&cfg);
+  bool ok = table_matches(dev, true);
+  esp_codec_dev_vol_map_t map[] = {
+      {0, -70.0f}, {1, -60.0f}, {20, -30.5f}, {20, -20.0f}, {64, -3.0f},
+      {255, 2.0f}};
+  esp_codec_dev_vol_curve_t curve = {map, sizeof(map) / sizeof(map[0])};
+  ok &= esp_codec_dev_set_vol_curve(dev, &curve) == ESP_CODEC_DEV_OK &&
+        table_matches(dev, true) && dev->vol_table_size == 256;
+  map[5].vol = VOL_TABLE_MAX_SIZE + 1000; // too long a curve is walked
+  ok &= esp_codec_dev_set_vol_curve(dev, &curve) == ESP_CODEC_DEV_OK &&
+        table_matches(dev, false);
+  esp_codec_dev_delete(dev);
+  return check("volume table as the curve walk, every volume", ok);
+}
+
+static int check_levels(void) {
+  int fails = 0;
+  static int32_t in[FRAMES * 2], out[FRAMES * 2], ref[FRAMES * 2];
+  fill_random(in, sizeof(in), 1);
+  bool unity = true, mute = true;
+  for (int bits = 16; bits <= 32; bits += 8) {
+    int len = FRAMES * 2 * bits / 8;
+    audio_vol_t *vol = open_vol(0.0f, bits, 2);
+    unity &= process(vol, in, len, out) == 0 && memcmp(in, out, len) == 0;
+    close_vol(vol);
+    vol = open_vol(-96.0f, bits, 2);
+    memset(out, 0x55, sizeof(out));
+    memset(ref, 0, sizeof(ref));
+    mute &= process(vol, in, len, out) == 0 && memcmp(out, ref, len) == 0;
+    close_vol(vol);
+  }
+  fails += check("0 dB passes 16, 24 and 32-bit samples untouched", unity);
+  fails += check("-96 dB gives silence", mute);
+
+  // the old per sample multiply, in and out of place, at every alignment
+  const float db_list[] = {-60.0f, -33.5f, -17.0f, -6.0f, -0.5f};
+  bool exact = true;
+  for (size_t d = 0; d < sizeof(db_list) / sizeof(db_list[0]); d++) {
+    int gain = db_to_gain(db_list[d]);
+    for (int channel = 1; channel <= 2; channel++) {
+      for (int offset = 0; offset < 8; offset++) {
+        audio_vol_t *vol = open_vol(db_list[d], 16, channel);
+        int16_t *src = (int16_t *)in + offset;
+        int16_t *dst = (int16_t *)out + (offset * 3) % 8;
+        int frames = FRAMES - offset * 3;
+        for (int i = 0; i < frames * channel; i++) {
+          ((int16_t *)ref)[i] = (src[i] * gain) >> 15;
+        }
+        process(vol, src, frames * channel * 2, dst);
+        exact &= memcmp(dst, ref, frames * channel * 2) == 0;
+        memcpy(dst, src, frames * channel * 2);
+        process(vol, dst, frames * channel * 2, dst);
+        exact &= memcmp(dst, ref, frames * channel * 2) == 0;
+        close_vol(vol);
+      }
+    }
+  }
+  fails += check("16-bit below 0 dB as the old multiply, bit exact",
+                 exact);
+
+  bool scaled = true;
+  int gain = db_to_gain(-6.0f);
+  audio_vol_t *vol = open_vol(-6.0f, 24, 2);
+  process(vol, in, FRAMES * 2 * 3, out);
+  for (int i = 0; i < FRAMES * 2; i++) {
+    const uint8_t *s = (const uint8_t *)in + i * 3;
+    const uint8_t *o = (const uint8_t *)out + i * 3;
+    int32_t v = (int32_t)((uint32_t)s[0] << 8 | (uint32_t)s[1] << 16 |
+                          (uint32_t)s[2] << 24) >> 8;
+    int32_t r = (int32_t)(((int64_t)v * gain) >> 15);
+    int32_t got = (int32_t)((uint32_t)o[0] << 8 | (uint32_t)o[1] << 16 |
+                            (uint32_t)o[2] << 24) >> 8;
+    scaled &= got == r;
+  }
+  close_vol(vol);
+  vol = open_vol(-6.0f, 32, 2);
+  process(vol, in, sizeof(in), out);
+  for (int i = 0; i < FRAMES * 2; i++) {
+    scaled &= out[i] == (int32_t)(((int64_t)in[i] * gain) >> 15);
+  }
+  close_vol(vol);
+  fails += check("24 and 32-bit samples scaled at -6 dB", scaled);
+
+  // full scale at +6 dB clips at each width
+  bool clips = true;
+  int16_t s16[4] = {INT16_MAX, INT16_MIN, 1000, -1000}, o16[4];
+  vol = open_vol(6.0f, 16, 2);
+  process(vol, s16, sizeof(s16), o16);
+  close_vol(vol);
+  clips &= o16[0] == INT16_MAX && o16[1] == INT16_MIN && o16[2] == 1995 &&
+           o16[3] == -1996;
+  uint8_t s24[6] = {0xff, 0xff, 0x7f, 0x00, 0x00, 0x80}, o24[6];
+  vol = open_vol(6.0f, 24, 2);
+  process(vol, s24, sizeof(s24), o24);
+  close_vol(vol);
+  clips &= memcmp(o24, s24, sizeof(s24)) == 0;
+  int32_t s32[2] = {INT32_MAX, INT32_MIN}, o32[2];
+  vol = open_vol(6.0f, 32, 2);
+  process(vol, s32, sizeof(s32), o32);
+  close_vol(vol);
+  clips &= o32[0] == INT32_MAX && o32[1] == INT32_MIN;
+  fails += check("+6 dB saturates 16, 24 and 32-bit samples", clips);
+  return fails;
+}
+
+// Fades from one level to another on a constant input and checks each block
+static bool fade(float from_db, float to_db, int bits, int *blocks_taken) {
+  audio_vol_t *vol = open_vol(from_db, bits, 2);
+  vol->base.set_vol(&vol->base, to_db);
+  int target = db_to_gain(to_db);
+  int sign = target > db_to_gain(from_db) ? 1 : -1;
+  int bytes = bits / 8;
+  int frames = RATE * FADE_MS / 1000 * 2; // twice the fade
+  uint8_t *in = malloc(frames * 2 * bytes), *out = malloc(frames * 2 * bytes);
+  int32_t level = 1 << (bits - 3); // an eighth of full scale
+  for (int i = 0; i < frames * 2; i++) {
+    if (bits == 16) {
+      ((int16_t *)in)[i] = (int16_t)(level);
+    } else if (bits == 24) {
+      in[i * 3] = 0;
+      in[i * 3 + 1] = 0;
+      in[i * 3 + 2] = (uint8_t)(level >> 16);
+    } else {
+      ((int32_t *)in)[i] = level;
+    }
+  }
+  // in uneven reads, as the audio pipeline hands them over
+  unsigned seed = 7;
+  for (int done = 0; done < frames;) {
+    int n = 1 + (int)(next_rand(&seed) % 300);
+    n = n < frames - done ? n : frames - done;
+    process(vol, in + done * 2 * bytes, n * 2 * bytes, out + done * 2 * bytes);
+    done += n;
+  }
+  bool ok = true;
+  int64_t last = sign > 0 ? INT64_MIN : INT64_MAX;
+  int blocks = 0;
+  for (int f = 0; f < frames; f++) {
+    int64_t v;
+    if (bits == 16) {
+      v = ((int16_t *)out)[f * 2];
+    } else if (bits == 24) {
+      v = (int32_t)((uint32_t)out[f * 6] << 8 | (uint32_t)out[f * 6 + 1] << 16 |
+                    (uint32_t)out[f * 6 + 2] << 24) >> 8;
+    } else {
+      v = ((int32_t *)out)[f * 2];
+    }
+    if (f % RAMP_BLOCK_SIZE != 0) {
+      ok &= v == last; // one gain for the whole block
+      continue;
+    }
+    ok &= sign > 0 ? v >= last : v <= last;
+    if (v != last) {
+      blocks++;
+    }
+    last = v;
+  }
+  int64_t end = ((int64_t)level * target) >> 15;
+  ok &= last == end && vol->cur == target && vol->step == 0;
+  *blocks_taken = blocks;
+  close_vol(vol);
+  free(in);
+  free(out);
+  return ok;
+}
+
+static int check_fades(void) {
+  int fails = 0;
+  int full = RATE * FADE_MS / 1000 / RAMP_BLOCK_SIZE;
+  bool ok = true;
+  int blocks;
+  for (int bits = 16; bits <= 32; bits += 8) {
+    ok &= fade(-96.0f, 0.0f, bits, &blocks) && blocks <= full + 2 &&
+          blocks >= full - 2;
+    ok &= fade(0.0f, -96.0f, bits, &blocks) && blocks <= full + 2;
+  }
+  fails += check("fade from mute to 0 dB and back, one gain a block", ok);
+  ok = fade(-20.0f, -20.1f, 16, &blocks) && fade(-20.1f, -20.0f, 32, &blocks);
+  fails += check("a fade of 0.1 dB reaches the level asked for", ok);
+
+  audio_vol_t *vol = open_vol(-10.0f, 16, 2);
+  vol->base.set_vol(&vol->base, -10.0f);
+  fails += check("setting the same level starts no fade",
+                 vol->step == 0 && vol->cur == db_to_gain(-10.0f));
+  close_vol(vol);
+  return fails;
+}
+
+static int check_formats(void) {
+  const audio_codec_vol_if_t *vol = audio_codec_new_sw_vol();
+  esp_codec_dev_sample_info_t fs = {
+      .bits_per_sample = 8, .channel = 2, .sample_rate = RATE};
+  uint8_t buf[8] = {0};
+  bool ok = vol->process(vol, buf, sizeof(buf), buf, sizeof(buf)) ==
+                ESP_CODEC_DEV_WRONG_STATE &&
+            vol->open(vol, &fs, FADE_MS) == ESP_CODEC_DEV_NOT_SUPPORT;
+  fs.bits_per_sample = 24;
+  ok &= vol->open(vol, &fs, FADE_MS) == ESP_CODEC_DEV_OK &&
+        ((audio_vol_t *)vol)->block_size == 6;
+  vol->close(vol);
+  free((void *)vol);
+  return check("8-bit refused, unopened process refused", ok);
+}
+
+int main(void) {
+  int fails = check_tables();
+  fails += check_curves();
+  fails += check_levels();
+  fails += check_fades();
+  fails += check_formats();
+  printf("\n%s\n", fails ? "FAIL" : "all ok");
+  return fails != 0;
+}
@@ -2,17 +2,86 @@
 #include "aac_decoder.h"
 #include "audio_common.h"
 #include "board.h" // For CONFIG_ESP32_C3_LYRA_V2_BOARD and I2S_STREAM_PDM_TX_CFG_DEFAULT
+#include "codec_probe.h"
 #include "esp_log.h"
 #include "flac_decoder.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "http_stream.h"
 #include "i2s_stream.h"
+#include "icy_demux.h"
+#include "jitter_buffer.h"
+#include "lwip/netdb.h"
 #include "mp3_decoder.h"
 #include "ogg_decoder.h"
+#include "profiler.h"
+#include "dsp.h"
+#include "loudness.h"
+#include "resampler.h"
+#include "ringbuf.h"
+#include "stream_stats.h"
+#include "tune_timing.h"
+#include <stdlib.h>
+#include <string.h>
 
 extern audio_pipeline_components_t audio_pipeline_components;
 
 static const char *TAG = "AUDIO_PIPELINE_MGR";
-volatile uint64_t g_bytes_read = 0;
+
+#define CODEC_TYPE_COUNT (CODEC_TYPE_FLAC + 1)
+
+// receives status events from the HTTP source(s) so the app can reconnect
+static audio_event_iface_handle_t s_source_listener = NULL;
+
+// How long a tune waits for the first stream bytes to identify the codec
+// before trusting the station's stored codec
+#define CODEC_PROBE_WAIT_MS 3000
+// probe on the HTTP reader of a created pipeline, only feeds the cache
+static codec_probe_handle_t s_pipeline_probe = NULL;
+
+#if CONFIG_RADIO_STANDBY_PIPELINE
+// Two HTTP sources live outside the pipeline. One feeds the decoder, the other
+// is idle or pre-connected to the station we expect to be tuned next. Each
+// source owns its output ring buffer so a pre-connected source can start
+// buffering before it is swapped in.
+#define STANDBY_SOURCE_COUNT 2
+#define STANDBY_SOURCE_RB_SIZE (64 * 1024)
+
+typedef struct {
+  audio_element_handle_t el;
+  ringbuf_handle_t rb;
+  codec_probe_handle_t probe;
+  char *uri;    // URI the source is connected (or connecting) to
+  bool running; // element task has been resumed for uri
+} standby_source_t;
+
+static standby_source_t s_sources[STANDBY_SOURCE_COUNT];
+static standby_source_t *s_active_source = NULL;
+static audio_element_handle_t s_decoders[CODEC_TYPE_COUNT];
+static bool s_pipeline_linked = false;
+// tune and pre-connect both reassign sources, and run on different tasks
+static SemaphoreHandle_t s_source_lock = NULL;
+
+// Pre-connect requests come from the encoder task, which must not block on a
+// source that is still in the middle of a TLS handshake. A single-slot
+// mailbox hands the latest request to a low priority worker; an empty URI
+// cancels any pending pre-connect.
+#define PRECONNECT_URI_MAX 256
+#define PRECONNECT_TASK_STACK (3 * 1024)
+#define PRECONNECT_TASK_PRIO 3
+typedef struct {
+  char uri[PRECONNECT_URI_MAX];
+  codec_type_t codec;
+} preconnect_request_t;
+static QueueHandle_t s_preconnect_queue = NULL;
+static void preconnect_task(void *pvParameters);
+#endif
+
+void set_audio_source_listener(audio_event_iface_handle_t evt) {
+  s_source_listener = evt;
+}
 
 const char *codec_type_to_string(codec_type_t codec) {
   switch (codec) {
@@ -29,8 +98,44 @@ const char *codec_type_to_string(codec_type_t codec) {
   }
 }
 
+// Resolves the stream host just before esp_http_client does, so DNS time can
+// be told apart from the connect; the client's own lookup then hits the lwIP
+// DNS cache.
+static void resolve_stream_host(audio_element_handle_t el) {
+  const char *uri = audio_element_get_uri(el);
+  if (uri == NULL) {
+    return;
+  }
+  const char *host = strstr(uri, "://");
+  host = host ? host + 3 : uri;
+  size_t len = strcspn(host, ":/?#");
+  char name[128];
+  if (len == 0 || len >= sizeof(name) || host[0] == '[') {
+    return;
+  }
+  memcpy(name, host, len);
+  name[len] = '\0';
+
+  struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+  struct addrinfo *res = NULL;
+  if (getaddrinfo(name, NULL, &hints, &res) == 0) {
+    freeaddrinfo(res);
+    tune_timing_source_mark(el, TUNE_STAGE_DNS);
+  }
+}
+
 static int _http_stream_event_handle(http_stream_event_msg_t *msg) {
   switch (msg->event_id) {
+  case HTTP_STREAM_PRE_REQUEST:
+    icy_demux_request(msg->el, msg->http_client);
+    resolve_stream_host(msg->el);
+    return ESP_OK;
+
+  case HTTP_STREAM_POST_REQUEST:
+    // esp_http_client_open() has connected, done TLS and sent the request
+    tune_timing_source_mark(msg->el, TUNE_STAGE_CONNECTED);
+    return ESP_OK;
+
   case HTTP_STREAM_RESOLVE_ALL_TRACKS:
     return ESP_OK;
 
@@ -41,10 +146,12 @@ static int _http_stream_event_handle(http_stream_event_msg_t *msg) {
     return http_stream_fetch_again(msg->el);
 
   case HTTP_STREAM_ON_RESPONSE:
-    // This is called for each chunk of data received
-    g_bytes_read += msg->buffer_len;
-    // You could log it here, but it will be very verbose.
-    // ESP_LOGI(TAG, "Bytes read: %llu", g_bytes_read);
+    // This is called for each chunk of data received. A pre-connected
+    // standby source fills its buffer too, but only what plays is counted.
+    if (msg->el == audio_pipeline_components.http_stream_reader) {
+      stream_stats_count_bytes(msg->buffer_len);
+    }
+    tune_timing_source_mark(msg->el, TUNE_STAGE_FIRST_BYTE);
     return ESP_OK;
   default:
     return ESP_OK;
@@ -54,6 +161,48 @@ static int _http_stream_event_handle(http_stream_event_msg_t *msg) {
 #include "board.h"                        // remove after debugging
 extern audio_board_handle_t board_handle; // remove after debugging
 
+#if CONFIG_RADIO_RESAMPLER
+// set while a stream the resampler cannot convert has moved the I2S clock
+static bool s_i2s_follows_input = false;
+#endif
+
+// With the resampler the I2S clock stays at the fixed output rate and only
+// the resampler is told about the new stream.
+static void set_output_format(const audio_element_info_t *info) {
+  audio_element_handle_t i2s = audio_pipeline_components.i2s_stream_writer;
+#if CONFIG_RADIO_RESAMPLER
+  audio_element_handle_t resampler = audio_pipeline_components.resampler;
+  if (resampler &&
+      resampler_set_input(resampler, info->sample_rates, info->bits,
+                          info->channels) == ESP_OK) {
+    if (s_i2s_follows_input) {
+      ESP_ERROR_CHECK(i2s_stream_set_clk(
+          i2s, resampler_get_output_rate(resampler), 16, 2));
+      s_i2s_follows_input = false;
+    }
+#if CONFIG_RADIO_LOUDNESS
+    loudness_set_bypass(audio_pipeline_components.loudness, false);
+#endif
+#if CONFIG_RADIO_DSP
+    dsp_set_bypass(audio_pipeline_components.dsp, false);
+#endif
+    return;
+  }
+  ESP_LOGW(TAG, "Resampler cannot convert %d-bit %d channel audio",
+           info->bits, info->channels);
+  s_i2s_follows_input = true;
+#if CONFIG_RADIO_LOUDNESS
+  // the meter only understands the resampler's 16-bit stereo output
+  loudness_set_bypass(audio_pipeline_components.loudness, true);
+#endif
+#if CONFIG_RADIO_DSP
+  dsp_set_bypass(audio_pipeline_components.dsp, true);
+#endif
+#endif
+  ESP_ERROR_CHECK(i2s_stream_set_clk(i2s, info->sample_rates, info->bits,
+                                     info->channels));
+}
+
 static esp_err_t codec_event_cb(audio_element_handle_t el,
                                 audio_event_iface_msg_t *msg, void *ctx) {
   ESP_LOGI(TAG, "Codec event callback triggered for element: %s, command: %d",
@@ -67,13 +216,162 @@ static esp_err_t codec_event_cb(audio_element_handle_t el,
                "[ * ] Callback: Receive music info from codec decoder, "
                "sample_rate=%d, bits=%d, ch=%d",
                music_info.sample_rates, music_info.bits, music_info.channels);
-      ESP_ERROR_CHECK(i2s_stream_set_clk(
-          audio_pipeline_components.i2s_stream_writer, music_info.sample_rates,
-          music_info.bits, music_info.channels));
+      tune_timing_mark(TUNE_STAGE_MUSIC_INFO);
+      set_output_format(&music_info);
+    }
+  }
+  return ESP_OK;
+}
+static audio_element_handle_t create_codec_decoder(codec_type_t codec_type) {
+  audio_element_handle_t decoder = NULL;
+
+  switch (codec_type) {
+  case CODEC_TYPE_AAC:
+    ESP_LOGD(TAG, "Creating AAC decoder");
+    aac_decoder_cfg_t aac_cfg = DEFAULT_AAC_DECODER_CONFIG();
+    aac_cfg.task_core = 1; // unacceptable clicking a popping on KXLU
+    aac_cfg.plus_enable = true;
+    decoder = aac_decoder_init(&aac_cfg);
+    break;
+  case CODEC_TYPE_MP3:
+    ESP_LOGD(TAG, "Creating MP3 decoder");
+    mp3_decoder_cfg_t mp3_cfg = DEFAULT_MP3_DECODER_CONFIG();
+    mp3_cfg.task_core = 1;
+    decoder = mp3_decoder_init(&mp3_cfg);
+    break;
+  case CODEC_TYPE_OGG:
+    ESP_LOGD(TAG, "Creating OGG decoder");
+    ogg_decoder_cfg_t ogg_cfg = DEFAULT_OGG_DECODER_CONFIG();
+    ogg_cfg.task_core = 1;
+    decoder = ogg_decoder_init(&ogg_cfg);
+    break;
+  case CODEC_TYPE_FLAC:
+    ESP_LOGD(TAG, "Creating FLAC decoder");
+    flac_decoder_cfg_t flac_cfg = DEFAULT_FLAC_DECODER_CONFIG();
+    flac_cfg.task_core = 1;
+    decoder = flac_decoder_init(&flac_cfg);
+    break;
+  default:
+    ESP_LOGE(TAG, "Unsupported codec type: %d", codec_type);
+    return NULL;
+  }
+  if (decoder == NULL) {
+    ESP_LOGE(TAG, "Failed to initialize %s decoder",
+             codec_type_to_string(codec_type));
+    return NULL;
+  }
+  // codec callback filters for music info (sample rate, bits, channels) and
+  // sets the resampler input or the i2s stream clock
+  audio_element_set_event_callback(decoder, codec_event_cb, NULL);
+  return decoder;
+}
+
+static audio_element_handle_t create_http_source(void) {
+  http_stream_cfg_t http_cfg = HTTP_STREAM_CFG_DEFAULT();
+  http_cfg.event_handle = _http_stream_event_handle;
+  http_cfg.type = AUDIO_STREAM_READER;
+  http_cfg.enable_playlist_parser = true;
+  audio_element_handle_t http = http_stream_init(&http_cfg);
+#if CONFIG_RADIO_PROFILER
+  // innermost, so only the network read is timed
+  if (http) {
+    profiler_attach_io(http, AUDIO_STREAM_READER);
+  }
+#endif
+  return http;
+}
+
+static audio_element_handle_t create_jitter_buffer(void) {
+  jitter_buffer_cfg_t jb_cfg = JITTER_BUFFER_CFG_DEFAULT();
+  return jitter_buffer_init(&jb_cfg);
+}
+
+static audio_element_handle_t create_i2s_writer(void) {
+#if defined CONFIG_ESP32_C3_LYRA_V2_BOARD
+  i2s_stream_cfg_t i2s_cfg = I2S_STREAM_PDM_TX_CFG_DEFAULT();
+#else
+  i2s_stream_cfg_t i2s_cfg = I2S_STREAM_CFG_DEFAULT();
+#endif
+  i2s_cfg.type = AUDIO_STREAM_WRITER;
+  audio_element_handle_t i2s = i2s_stream_init(&i2s_cfg);
+#if CONFIG_RADIO_RESAMPLER
+  // programmed once; the resampler converts every stream to this rate
+  if (i2s && i2s_stream_set_clk(i2s, CONFIG_RADIO_OUTPUT_SAMPLE_RATE, 16, 2) !=
+                 ESP_OK) {
+    ESP_LOGE(TAG, "Failed to set I2S clock to %d Hz",
+             CONFIG_RADIO_OUTPUT_SAMPLE_RATE);
+  }
+#endif
+#if CONFIG_RADIO_PROFILER
+  if (i2s) {
+    profiler_attach_io(i2s, AUDIO_STREAM_WRITER);
+  }
+#endif
+  return i2s;
+}
+
+// resampler, loudness and dsp
+#define PCM_STAGE_MAX 3
+
+static esp_err_t register_stage(audio_pipeline_handle_t pipeline,
+                                audio_element_handle_t el, const char *tag,
+                                audio_element_handle_t *slot) {
+  if (el == NULL || audio_pipeline_register(pipeline, el, tag) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create %s stage", tag);
+    if (el) {
+      audio_element_deinit(el);
     }
+    return ESP_FAIL;
+  }
+  *slot = el;
+  return ESP_OK;
+}
+
+// Creates the optional stages between the decoder and the i2s writer and
+// registers them with the pipeline. Stages created before a failure are left
+// in components for the caller's cleanup.
+static esp_err_t create_pcm_stages(audio_pipeline_components_t *components) {
+#if CONFIG_RADIO_RESAMPLER
+  resampler_cfg_t rs_cfg = RESAMPLER_CFG_DEFAULT();
+  if (register_stage(components->pipeline, resampler_init(&rs_cfg),
+                     "resample", &components->resampler) != ESP_OK) {
+    return ESP_FAIL;
   }
+#endif
+#if CONFIG_RADIO_LOUDNESS
+  loudness_cfg_t ld_cfg = LOUDNESS_CFG_DEFAULT();
+  if (register_stage(components->pipeline, loudness_init(&ld_cfg),
+                     "loudness", &components->loudness) != ESP_OK) {
+    return ESP_FAIL;
+  }
+#endif
+#if CONFIG_RADIO_DSP
+  dsp_cfg_t dsp_cfg = DSP_CFG_DEFAULT();
+  if (register_stage(components->pipeline, dsp_init(&dsp_cfg), "dsp",
+                     &components->dsp) != ESP_OK) {
+    return ESP_FAIL;
+  }
+#endif
   return ESP_OK;
 }
+
+// Writes the tags of the stages create_pcm_stages made, in pipeline order,
+// and returns their count
+static int pcm_stage_tags(const char **tags) {
+  int n = 0;
+#if CONFIG_RADIO_RESAMPLER
+  tags[n++] = "resample";
+#endif
+#if CONFIG_RADIO_LOUDNESS
+  tags[n++] = "loudness";
+#endif
+#if CONFIG_RADIO_DSP
+  tags[n++] = "dsp";
+#endif
+  (void)tags;
+  return n;
+}
+
 esp_err_t create_audio_pipeline(audio_pipeline_components_t *components,
                                 codec_type_t codec_type, const char *uri) {
 
@@ -88,6 +386,14 @@ esp_err_t create_audio_pipeline(audio_pipeline_components_t *components,
   // board works here
   esp_err_t ret = ESP_OK;
 
+  // Without the standby pipeline the decoder has to be chosen before any
+  // data arrives, so only a codec detected on an earlier tune can override
+  // the stored one. The probe below records what this stream really is.
+  codec_type_t cached_codec;
+  if (codec_probe_cache_lookup(uri, &cached_codec)) {
+    codec_type = cached_codec;
+  }
+
   ESP_LOGI(TAG, "Creating audio pipeline for codec type: %s with URI: %s",
            codec_type_to_string(codec_type), uri);
 
@@ -100,79 +406,67 @@ esp_err_t create_audio_pipeline(audio_pipeline_components_t *components,
     goto cleanup;
   }
 
-  http_stream_cfg_t http_cfg = HTTP_STREAM_CFG_DEFAULT();
-  http_cfg.event_handle = _http_stream_event_handle;
-  http_cfg.type = AUDIO_STREAM_READER;
-  http_cfg.enable_playlist_parser = true;
-  components->http_stream_reader = http_stream_init(&http_cfg);
+  components->http_stream_reader = create_http_source();
   if (components->http_stream_reader == NULL) {
     ESP_LOGE(TAG, "Failed to initialize HTTP stream reader");
     ret = ESP_FAIL;
     goto cleanup;
   }
+  // the demuxer must see the raw stream, so it goes in before the probe
+  if (icy_demux_attach(components->http_stream_reader) != ESP_OK) {
+    ret = ESP_FAIL;
+    goto cleanup;
+  }
+  icy_demux_set_active(components->http_stream_reader);
+  s_pipeline_probe = codec_probe_attach(components->http_stream_reader);
+  if (s_pipeline_probe == NULL) {
+    ret = ESP_FAIL;
+    goto cleanup;
+  }
+  codec_probe_start(s_pipeline_probe, uri, codec_type);
+  tune_timing_source_reset(components->http_stream_reader);
+  tune_timing_set_source(components->http_stream_reader);
+
+  components->jitter_buffer = create_jitter_buffer();
+  if (components->jitter_buffer == NULL) {
+    ret = ESP_FAIL;
+    goto cleanup;
+  }
   // // custom reader to skip junk data before mp3 frames in shoutcast streams
   // // this should be switchable.
   // audio_element_set_read_cb(components->http_stream_reader, custom_read,
   // NULL);
 
-#if defined CONFIG_ESP32_C3_LYRA_V2_BOARD
-  i2s_stream_cfg_t i2s_cfg = I2S_STREAM_PDM_TX_CFG_DEFAULT();
-#else
-  i2s_stream_cfg_t i2s_cfg = I2S_STREAM_CFG_DEFAULT();
-#endif
-  i2s_cfg.type = AUDIO_STREAM_WRITER;
-  components->i2s_stream_writer = i2s_stream_init(&i2s_cfg);
+  components->i2s_stream_writer = create_i2s_writer();
   if (components->i2s_stream_writer == NULL) {
     ESP_LOGE(TAG, "Failed to initialize I2S stream writer");
     ret = ESP_FAIL;
     goto cleanup;
   }
+  tune_timing_attach_i2s(components->i2s_stream_writer);
 
-  switch (codec_type) {
-  case CODEC_TYPE_AAC:
-    ESP_LOGD(TAG, "Creating AAC decoder");
-    aac_decoder_cfg_t aac_cfg = DEFAULT_AAC_DECODER_CONFIG();
-    aac_cfg.task_core = 1; // unacceptable clicking a popping on KXLU
-    aac_cfg.plus_enable = true;
-    components->codec_decoder = aac_decoder_init(&aac_cfg);
-    break;
-  case CODEC_TYPE_MP3:
-    ESP_LOGD(TAG, "Creating MP3 decoder");
-    mp3_decoder_cfg_t mp3_cfg = DEFAULT_MP3_DECODER_CONFIG();
-    mp3_cfg.task_core = 1;
-    components->codec_decoder = mp3_decoder_init(&mp3_cfg);
-    break;
-  case CODEC_TYPE_OGG:
-    ESP_LOGD(TAG, "Creating OGG decoder");
-    ogg_decoder_cfg_t ogg_cfg = DEFAULT_OGG_DECODER_CONFIG();
-    ogg_cfg.task_core = 1;
-    components->codec_decoder = ogg_decoder_init(&ogg_cfg);
-    break;
-  case CODEC_TYPE_FLAC:
-    ESP_LOGD(TAG, "Creating FLAC decoder");
-    flac_decoder_cfg_t flac_cfg = DEFAULT_FLAC_DECODER_CONFIG();
-    flac_cfg.task_core = 1;
-    components->codec_decoder = flac_decoder_init(&flac_cfg);
-    break;
-  default:
+  if (codec_type >= CODEC_TYPE_COUNT) {
     ESP_LOGE(TAG, "Unsupported codec type: %d", codec_type);
     ret = ESP_ERR_INVALID_ARG;
     goto cleanup;
   }
+  components->codec_decoder = create_codec_decoder(codec_type);
   if (components->codec_decoder == NULL) {
-    ESP_LOGE(TAG, "Failed to initialize %s decoder",
-             codec_type_to_string(codec_type));
     ret = ESP_FAIL;
     goto cleanup;
   }
-  // codec callback filters for music info (sample rate, bits, channels) and
-  // sets i2s stream clock
-  audio_element_set_event_callback(components->codec_decoder, codec_event_cb,
-                                   NULL);
-
+  if (create_pcm_stages(components) != ESP_OK) {
+    ret = ESP_FAIL;
+    goto cleanup;
+  }
+#if CONFIG_RADIO_LOUDNESS
+  loudness_set_station(components->loudness, uri);
+#endif
   if (audio_pipeline_register(components->pipeline,
                               components->http_stream_reader,
                               "http") != ESP_OK ||
+      audio_pipeline_register(components->pipeline, components->jitter_buffer,
+                              "jitter") != ESP_OK ||
       audio_pipeline_register(components->pipeline, components->codec_decoder,
                               "codec") != ESP_OK ||
       audio_pipeline_register(components->pipeline,
@@ -182,13 +476,18 @@ esp_err_t create_audio_pipeline(audio_pipeline_components_t *components,
     goto cleanup;
   }
 
-  const char *link_tag[3] = {"http", "codec", "i2s"};
-  if (audio_pipeline_link(components->pipeline, &link_tag[0], 3) != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to link pipeline elements: http->%s->i2s",
+  const char *link_tag[4 + PCM_STAGE_MAX] = {"http", "jitter", "codec"};
+  int link_count = 3;
+  link_count += pcm_stage_tags(&link_tag[link_count]);
+  link_tag[link_count++] = "i2s";
+  if (audio_pipeline_link(components->pipeline, &link_tag[0], link_count) !=
+      ESP_OK) {
+    ESP_LOGE(TAG, "Failed to link pipeline elements: http->jitter->%s->i2s",
              codec_type_to_string(codec_type));
     ret = ESP_FAIL;
     goto cleanup;
   }
+  components->codec_type = codec_type;
 
   if (audio_element_set_uri(components->http_stream_reader, uri) != ESP_OK) {
     ESP_LOGE(TAG, "Failed to set URI for http_stream_reader");
@@ -196,6 +495,14 @@ esp_err_t create_audio_pipeline(audio_pipeline_components_t *components,
     goto cleanup;
   }
 
+  if (s_source_listener) {
+    audio_element_msg_set_listener(components->http_stream_reader,
+                                   s_source_listener);
+  }
+
+#if CONFIG_RADIO_PROFILER
+  profiler_set_pipeline(components);
+#endif
   ESP_LOGI(TAG, "Audio pipeline with %s codec created successfully",
            codec_type_to_string(codec_type));
   return ESP_OK;
@@ -205,13 +512,30 @@ cleanup:
       TAG,
       "Cleaning up audio pipeline components due to error during creation");
   if (components->http_stream_reader) {
+    icy_demux_detach(components->http_stream_reader);
     audio_element_deinit(components->http_stream_reader);
     components->http_stream_reader = NULL;
   }
+  if (components->jitter_buffer) {
+    audio_element_deinit(components->jitter_buffer);
+    components->jitter_buffer = NULL;
+  }
   if (components->codec_decoder) {
     audio_element_deinit(components->codec_decoder);
     components->codec_decoder = NULL;
   }
+  if (components->resampler) {
+    audio_element_deinit(components->resampler);
+    components->resampler = NULL;
+  }
+  if (components->loudness) {
+    audio_element_deinit(components->loudness);
+    components->loudness = NULL;
+  }
+  if (components->dsp) {
+    audio_element_deinit(components->dsp);
+    components->dsp = NULL;
+  }
   if (components->i2s_stream_writer) {
     audio_element_deinit(components->i2s_stream_writer);
     components->i2s_stream_writer = NULL;
@@ -220,6 +544,10 @@ cleanup:
     audio_pipeline_deinit(components->pipeline);
     components->pipeline = NULL;
   }
+  if (s_pipeline_probe) {
+    codec_probe_destroy(s_pipeline_probe);
+    s_pipeline_probe = NULL;
+  }
   return ret;
 }
 
@@ -230,18 +558,482 @@ esp_err_t destroy_audio_pipeline(audio_pipeline_components_t *components) {
   }
 
   ESP_LOGI(TAG, "Destroying audio pipeline");
+#if CONFIG_RADIO_PROFILER
+  profiler_set_pipeline(NULL);
+#endif
 
   if (components->pipeline) {
+    if (s_source_listener && components->http_stream_reader) {
+      audio_element_msg_remove_listener(components->http_stream_reader,
+                                        s_source_listener);
+    }
     audio_pipeline_stop(components->pipeline);
     audio_pipeline_wait_for_stop(components->pipeline);
     audio_pipeline_terminate(components->pipeline);
+    if (components->http_stream_reader) {
+      icy_demux_detach(components->http_stream_reader);
+    }
+#if CONFIG_RADIO_PROFILER
+    profiler_detach_io(components->http_stream_reader);
+    profiler_detach_io(components->i2s_stream_writer);
+#endif
     audio_pipeline_deinit(components->pipeline); // deinits all elements
     components->pipeline = NULL;
   }
+  if (s_pipeline_probe) {
+    codec_probe_destroy(s_pipeline_probe);
+    s_pipeline_probe = NULL;
+  }
   components->http_stream_reader = NULL;
+  components->jitter_buffer = NULL;
   components->codec_decoder = NULL;
+  components->resampler = NULL;
+  components->loudness = NULL;
+  components->dsp = NULL;
   components->i2s_stream_writer = NULL;
 
   ESP_LOGI(TAG, "Audio pipeline destroyed successfully");
   return ESP_OK;
-}
\ No newline at end of file
+}
+
+esp_err_t restart_audio_source(audio_pipeline_components_t *components) {
+  if (components == NULL || components->http_stream_reader == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+#if CONFIG_RADIO_STANDBY_PIPELINE
+  // a tune may be swapping the active source
+  xSemaphoreTake(s_source_lock, portMAX_DELAY);
+#endif
+  audio_element_handle_t source = components->http_stream_reader;
+  ringbuf_handle_t rb = audio_element_get_output_ringbuf(source);
+  ESP_LOGW(TAG, "Restarting %s, keeping buffered audio",
+           audio_element_get_tag(source));
+
+  // Only the source is stopped. The jitter buffer pulls from the source ring
+  // buffer as fast as data arrives, so the audio already downloaded sits in
+  // the jitter buffer and the decoder and I2S ring buffers, all of which keep
+  // draining. Resetting the source ring buffer clears the abort and done
+  // flags that stopping or finishing left on it.
+  audio_element_stop(source);
+  audio_element_wait_for_stop(source);
+  audio_element_reset_state(source);
+  rb_reset(rb);
+  esp_err_t ret = ESP_OK;
+  if (audio_element_run(source) != ESP_OK ||
+      audio_element_resume(source, 0, 0) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to restart %s", audio_element_get_tag(source));
+    ret = ESP_FAIL;
+  }
+#if CONFIG_RADIO_STANDBY_PIPELINE
+  xSemaphoreGive(s_source_lock);
+#endif
+  return ret;
+}
+
+#if CONFIG_RADIO_STANDBY_PIPELINE
+static const char *codec_tag(codec_type_t codec) {
+  switch (codec) {
+  case CODEC_TYPE_MP3:
+    return "mp3";
+  case CODEC_TYPE_AAC:
+    return "aac";
+  case CODEC_TYPE_OGG:
+    return "ogg";
+  case CODEC_TYPE_FLAC:
+    return "flac";
+  default:
+    return "codec";
+  }
+}
+
+static void stop_standby_source(standby_source_t *src) {
+  if (!src->running) {
+    return;
+  }
+  audio_element_stop(src->el);
+  audio_element_wait_for_stop(src->el);
+  audio_element_reset_state(src->el);
+  // stopping aborts the ring buffer, clear that before it is reused
+  rb_reset(src->rb);
+  src->running = false;
+}
+
+static esp_err_t start_standby_source(standby_source_t *src, const char *uri,
+                                      codec_type_t codec_hint) {
+  char *uri_copy = strdup(uri);
+  if (uri_copy == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  free(src->uri);
+  src->uri = uri_copy;
+
+  rb_reset(src->rb);
+  audio_element_reset_state(src->el);
+  codec_probe_start(src->probe, uri, codec_hint);
+  tune_timing_source_reset(src->el);
+  if (audio_element_set_uri(src->el, uri) != ESP_OK ||
+      audio_element_run(src->el) != ESP_OK ||
+      audio_element_resume(src->el, 0, 0) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to start HTTP source %s for %s",
+             audio_element_get_tag(src->el), uri);
+    return ESP_FAIL;
+  }
+  src->running = true;
+  return ESP_OK;
+}
+
+static standby_source_t *find_preconnected_source(const char *uri) {
+  for (int i = 0; i < STANDBY_SOURCE_COUNT; i++) {
+    standby_source_t *src = &s_sources[i];
+    if (src != s_active_source && src->running && src->uri &&
+        strcmp(src->uri, uri) == 0) {
+      // a pre-connect that failed or was closed is started afresh
+      audio_element_state_t state = audio_element_get_state(src->el);
+      return state == AEL_STATE_ERROR || state == AEL_STATE_FINISHED ? NULL
+                                                                     : src;
+    }
+  }
+  return NULL;
+}
+
+static standby_source_t *idle_source(void) {
+  for (int i = 0; i < STANDBY_SOURCE_COUNT; i++) {
+    if (&s_sources[i] != s_active_source) {
+      return &s_sources[i];
+    }
+  }
+  return NULL;
+}
+
+esp_err_t init_standby_audio_pipeline(audio_pipeline_components_t *components) {
+  if (components == NULL) {
+    ESP_LOGE(TAG, "audio_pipeline_components_t pointer is NULL");
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (components->pipeline) {
+    return ESP_OK;
+  }
+
+  ESP_LOGI(TAG, "Creating standby audio pipeline");
+
+  audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+  components->pipeline = audio_pipeline_init(&pipeline_cfg);
+  components->i2s_stream_writer = create_i2s_writer();
+  if (components->pipeline == NULL || components->i2s_stream_writer == NULL ||
+      audio_pipeline_register(components->pipeline,
+                              components->i2s_stream_writer, "i2s") != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create standby pipeline");
+    goto cleanup;
+  }
+  tune_timing_attach_i2s(components->i2s_stream_writer);
+  audio_element_handle_t jitter = create_jitter_buffer();
+  if (jitter == NULL ||
+      audio_pipeline_register(components->pipeline, jitter, "jitter") !=
+          ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create jitter buffer");
+    if (jitter) {
+      audio_element_deinit(jitter);
+    }
+    goto cleanup;
+  }
+  components->jitter_buffer = jitter;
+  if (create_pcm_stages(components) != ESP_OK) {
+    goto cleanup;
+  }
+
+  static const char *source_tags[STANDBY_SOURCE_COUNT] = {"http_a", "http_b"};
+  for (int i = 0; i < STANDBY_SOURCE_COUNT; i++) {
+    s_sources[i].el = create_http_source();
+    s_sources[i].rb = rb_create(STANDBY_SOURCE_RB_SIZE, 1);
+    if (s_sources[i].el == NULL ||
+        icy_demux_attach(s_sources[i].el) != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to create standby HTTP source %d", i);
+      goto cleanup;
+    }
+    s_sources[i].probe = codec_probe_attach(s_sources[i].el);
+    if (s_sources[i].rb == NULL || s_sources[i].probe == NULL) {
+      ESP_LOGE(TAG, "Failed to create standby HTTP source %d", i);
+      goto cleanup;
+    }
+    audio_element_set_tag(s_sources[i].el, source_tags[i]);
+    audio_element_set_output_ringbuf(s_sources[i].el, s_sources[i].rb);
+    if (s_source_listener) {
+      audio_element_msg_set_listener(s_sources[i].el, s_source_listener);
+    }
+  }
+
+  s_source_lock = xSemaphoreCreateMutex();
+  s_preconnect_queue = xQueueCreate(1, sizeof(preconnect_request_t));
+  if (s_source_lock == NULL || s_preconnect_queue == NULL ||
+      xTaskCreatePinnedToCore(preconnect_task, "preconnect_task",
+                              PRECONNECT_TASK_STACK, NULL,
+                              PRECONNECT_TASK_PRIO, NULL, 0) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to start pre-connect worker");
+    goto cleanup;
+  }
+  return ESP_OK;
+
+cleanup:
+  if (s_source_lock) {
+    vSemaphoreDelete(s_source_lock);
+    s_source_lock = NULL;
+  }
+  if (s_preconnect_queue) {
+    vQueueDelete(s_preconnect_queue);
+    s_preconnect_queue = NULL;
+  }
+  for (int i = 0; i < STANDBY_SOURCE_COUNT; i++) {
+    if (s_sources[i].el) {
+      icy_demux_detach(s_sources[i].el);
+      audio_element_deinit(s_sources[i].el);
+    }
+    if (s_sources[i].rb) {
+      rb_destroy(s_sources[i].rb);
+    }
+    if (s_sources[i].probe) {
+      codec_probe_destroy(s_sources[i].probe);
+    }
+    memset(&s_sources[i], 0, sizeof(s_sources[i]));
+  }
+  if (components->pipeline) {
+    // deinits the registered i2s writer, jitter buffer and pcm stages
+    audio_pipeline_deinit(components->pipeline);
+  } else if (components->i2s_stream_writer) {
+    audio_element_deinit(components->i2s_stream_writer);
+  }
+  components->pipeline = NULL;
+  components->i2s_stream_writer = NULL;
+  components->jitter_buffer = NULL;
+  components->resampler = NULL;
+  components->loudness = NULL;
+  components->dsp = NULL;
+  return ESP_FAIL;
+}
+
+static esp_err_t tune_locked(audio_pipeline_components_t *components,
+                             codec_type_t codec_type, const char *uri);
+
+esp_err_t tune_standby_audio_pipeline(audio_pipeline_components_t *components,
+                                      codec_type_t codec_type,
+                                      const char *uri) {
+  if (components == NULL || components->pipeline == NULL || uri == NULL) {
+    ESP_LOGE(TAG, "Standby pipeline not initialized or URI is NULL");
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (codec_type >= CODEC_TYPE_COUNT) {
+    ESP_LOGE(TAG, "Unsupported codec type: %d", codec_type);
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  ESP_LOGI(TAG, "Tuning standby pipeline to %s (%s)", uri,
+           codec_type_to_string(codec_type));
+
+  xSemaphoreTake(s_source_lock, portMAX_DELAY);
+  esp_err_t ret = tune_locked(components, codec_type, uri);
+  xSemaphoreGive(s_source_lock);
+  return ret;
+}
+
+static esp_err_t tune_locked(audio_pipeline_components_t *components,
+                             codec_type_t codec_type, const char *uri) {
+  // the decoder and I2S writer are paused, not torn down
+  if (s_pipeline_linked) {
+    audio_pipeline_stop(components->pipeline);
+    audio_pipeline_wait_for_stop(components->pipeline);
+  }
+
+  standby_source_t *next = find_preconnected_source(uri);
+  if (s_active_source) {
+    stop_standby_source(s_active_source);
+    s_active_source = NULL;
+  }
+  if (next) {
+    ESP_LOGI(TAG, "Using pre-connected source %s",
+             audio_element_get_tag(next->el));
+  } else {
+    next = idle_source();
+    stop_standby_source(next); // drop a pre-connect to some other station
+    if (start_standby_source(next, uri, codec_type) != ESP_OK) {
+      return ESP_FAIL;
+    }
+  }
+  s_active_source = next;
+  // the old station has stopped, from here on pipeline stages are this tune's
+  tune_timing_set_source(next->el);
+  icy_demux_set_active(next->el);
+
+  // A codec detected on an earlier tune wins, then one the source's probe
+  // has finished with. The caller has already waited for the probe with
+  // probe_standby_audio_source(), so nothing blocks here; if the probe is
+  // still running it corrects the cache for the next tune.
+  codec_type_t probed;
+  if (codec_probe_cache_lookup(uri, &probed)) {
+    ESP_LOGI(TAG, "Using cached codec %s", codec_type_to_string(probed));
+    codec_type = probed;
+  } else if (codec_probe_wait(next->probe, 0, &probed)) {
+    codec_type = probed;
+  }
+
+  if (s_decoders[codec_type] == NULL) {
+    audio_element_handle_t decoder = create_codec_decoder(codec_type);
+    if (decoder == NULL) {
+      return ESP_FAIL;
+    }
+    if (audio_pipeline_register(components->pipeline, decoder,
+                                codec_tag(codec_type)) != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to register %s decoder",
+               codec_type_to_string(codec_type));
+      audio_element_deinit(decoder);
+      return ESP_FAIL;
+    }
+    s_decoders[codec_type] = decoder;
+  }
+
+  const char *link_tag[3 + PCM_STAGE_MAX] = {"jitter", codec_tag(codec_type)};
+  int link_count = 2;
+  link_count += pcm_stage_tags(&link_tag[link_count]);
+  link_tag[link_count++] = "i2s";
+  esp_err_t ret;
+  if (s_pipeline_linked) {
+    audio_pipeline_breakup_elements(components->pipeline, NULL);
+    ret = audio_pipeline_relink(components->pipeline, &link_tag[0], link_count);
+  } else {
+    ret = audio_pipeline_link(components->pipeline, &link_tag[0], link_count);
+  }
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to link pipeline elements: jitter->%s->i2s",
+             codec_type_to_string(codec_type));
+    return ESP_FAIL;
+  }
+  s_pipeline_linked = true;
+
+  // Reset the jitter->decoder->i2s buffers so the old station's tail is not
+  // played, then attach the source buffer. The order matters: resetting the
+  // pipeline must not discard audio a pre-connected source has already
+  // buffered. Reopening the jitter buffer starts a new prebuffer.
+  audio_element_set_input_ringbuf(components->jitter_buffer, NULL);
+  audio_pipeline_reset_ringbuffer(components->pipeline);
+  audio_pipeline_reset_items_state(components->pipeline);
+  audio_element_set_input_ringbuf(components->jitter_buffer, next->rb);
+#if CONFIG_RADIO_LOUDNESS
+  // the old station's audio is gone, so its level is final
+  loudness_set_station(components->loudness, uri);
+#endif
+
+  components->http_stream_reader = next->el;
+  components->codec_decoder = s_decoders[codec_type];
+  components->codec_type = codec_type;
+#if CONFIG_RADIO_PROFILER
+  profiler_set_pipeline(components);
+#endif
+
+  if (audio_pipeline_run(components->pipeline) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to run standby pipeline");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+esp_err_t preconnect_standby_audio_source(const char *uri,
+                                          codec_type_t codec_hint) {
+  if (uri == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (s_source_lock == NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  esp_err_t ret = ESP_OK;
+  xSemaphoreTake(s_source_lock, portMAX_DELAY);
+  if (find_preconnected_source(uri) == NULL &&
+      !(s_active_source && s_active_source->uri &&
+        strcmp(s_active_source->uri, uri) == 0)) {
+    standby_source_t *src = idle_source();
+    stop_standby_source(src);
+    ESP_LOGI(TAG, "Pre-connecting %s to %s", audio_element_get_tag(src->el),
+             uri);
+    ret = start_standby_source(src, uri, codec_hint);
+  }
+  xSemaphoreGive(s_source_lock);
+  return ret;
+}
+
+codec_type_t probe_standby_audio_source(const char *uri,
+                                        codec_type_t codec_hint) {
+  codec_type_t codec = codec_hint;
+  if (uri == NULL || s_source_lock == NULL) {
+    return codec;
+  }
+  if (codec_probe_cache_lookup(uri, &codec)) {
+    return codec;
+  }
+  if (preconnect_standby_audio_source(uri, codec_hint) != ESP_OK) {
+    return codec_hint;
+  }
+
+  // the probe outlives its source, so it can be waited on without the lock
+  xSemaphoreTake(s_source_lock, portMAX_DELAY);
+  standby_source_t *src = find_preconnected_source(uri);
+  if (src == NULL && s_active_source && s_active_source->uri &&
+      strcmp(s_active_source->uri, uri) == 0) {
+    src = s_active_source; // a rebuild of the playing station
+  }
+  codec_probe_handle_t probe = src ? src->probe : NULL;
+  xSemaphoreGive(s_source_lock);
+  if (probe == NULL ||
+      !codec_probe_wait(probe, pdMS_TO_TICKS(CODEC_PROBE_WAIT_MS), &codec)) {
+    ESP_LOGW(TAG, "No stream data to probe, using stored codec %s",
+             codec_type_to_string(codec_hint));
+    return codec_hint;
+  }
+
+  // a pre-connect to another station may have taken the source meanwhile
+  xSemaphoreTake(s_source_lock, portMAX_DELAY);
+  bool same = src->uri && strcmp(src->uri, uri) == 0;
+  xSemaphoreGive(s_source_lock);
+  return same ? codec : codec_hint;
+}
+
+static void cancel_preconnect(void) {
+  xSemaphoreTake(s_source_lock, portMAX_DELAY);
+  standby_source_t *src = idle_source();
+  if (src->running) {
+    ESP_LOGI(TAG, "Dropping pre-connect of %s to %s",
+             audio_element_get_tag(src->el), src->uri);
+    stop_standby_source(src);
+  }
+  xSemaphoreGive(s_source_lock);
+}
+
+static void preconnect_task(void *pvParameters) {
+  preconnect_request_t request;
+  while (1) {
+    if (xQueueReceive(s_preconnect_queue, &request, portMAX_DELAY) !=
+        pdTRUE) {
+      continue;
+    }
+    if (request.uri[0] == '\0') {
+      cancel_preconnect();
+    } else {
+      preconnect_standby_audio_source(request.uri, request.codec);
+    }
+  }
+}
+
+void request_standby_preconnect(const char *uri, codec_type_t codec_hint) {
+  if (s_preconnect_queue == NULL) {
+    return;
+  }
+  preconnect_request_t request = {.codec = codec_hint};
+  if (uri) {
+    if (strlen(uri) >= sizeof(request.uri)) {
+      ESP_LOGW(TAG, "URI too long to pre-connect: %s", uri);
+      return;
+    }
+    strcpy(request.uri, uri);
+  }
+  // only the most recent highlight matters
+  xQueueOverwrite(s_preconnect_queue, &request);
+}
+#endif // CONFIG_RADIO_STANDBY_PIPELINE
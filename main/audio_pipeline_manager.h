@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include "audio_pipeline.h"
 #include "audio_element.h"
+#include "audio_event_iface.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,15 +27,15 @@ extern "C" {
     typedef struct {
         audio_pipeline_handle_t pipeline;
         audio_element_handle_t http_stream_reader;
+        audio_element_handle_t jitter_buffer;
         audio_element_handle_t codec_decoder;
+        audio_element_handle_t resampler; // NULL without CONFIG_RADIO_RESAMPLER
+        audio_element_handle_t loudness;  // NULL without CONFIG_RADIO_LOUDNESS
+        audio_element_handle_t dsp;       // NULL without CONFIG_RADIO_DSP
         audio_element_handle_t i2s_stream_writer;
+        codec_type_t codec_type;
     } audio_pipeline_components_t;
 
-    /**
-     * @brief Global counter for bytes read from the HTTP stream.
-     */
-    extern volatile uint64_t g_bytes_read;
-
     /**
      * @brief Converts a codec_type_t enum to its string representation.
      */
@@ -50,6 +51,55 @@ extern "C" {
      */
     esp_err_t destroy_audio_pipeline(audio_pipeline_components_t* components);
 
+    /**
+     * @brief Creates the hot-standby pipeline: the I2S writer, its ring buffers and two
+     * swappable HTTP sources are created once. Decoders are created on first use.
+     */
+    esp_err_t init_standby_audio_pipeline(audio_pipeline_components_t* components);
+
+    /**
+     * @brief Tunes the standby pipeline to a new stream by swapping only the HTTP source
+     * and the decoder. A source pre-connected to the same URI is used when available.
+     * A codec cached or already probed for the URI wins over codec_type; the tune itself
+     * never waits for the probe. Takes the source lock, so call
+     * probe_standby_audio_source() first, before any lock of the caller's.
+     */
+    esp_err_t tune_standby_audio_pipeline(audio_pipeline_components_t* components, codec_type_t codec_type, const char* uri);
+
+    /**
+     * @brief Connects a source to the URI and waits up to 3 s for its codec probe.
+     * Holds no lock while it waits, so it is called before tuning, outside the
+     * caller's locks.
+     * @param codec_hint The station's stored codec.
+     * @return The cached or probed codec, or codec_hint if the probe was inconclusive.
+     */
+    codec_type_t probe_standby_audio_source(const char* uri, codec_type_t codec_hint);
+
+    /**
+     * @brief Connects the idle HTTP source to a URI so a later tune to it starts from
+     * already buffered audio. Blocks while a previous pre-connect is torn down.
+     * @param codec_hint The station's stored codec, used if the stream probe is inconclusive.
+     */
+    esp_err_t preconnect_standby_audio_source(const char* uri, codec_type_t codec_hint);
+
+    /**
+     * @brief Queues a pre-connect for the standby worker task without blocking.
+     * Only the latest request is kept. A NULL URI drops any pre-connected source.
+     */
+    void request_standby_preconnect(const char* uri, codec_type_t codec_hint);
+
+    /**
+     * @brief Sets the event interface that receives status reports from the HTTP
+     * source. Call before the pipeline is created.
+     */
+    void set_audio_source_listener(audio_event_iface_handle_t evt);
+
+    /**
+     * @brief Reconnects the HTTP source without stopping the rest of the pipeline,
+     * so the decoder and I2S writer keep playing the audio already buffered.
+     */
+    esp_err_t restart_audio_source(audio_pipeline_components_t* components);
+
 #ifdef __cplusplus
 }
 #endif
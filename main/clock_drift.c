@@ -0,0 +1,74 @@
+#include "clock_drift.h"
+#include <math.h>
+
+// The stream's sample clock and the I2S clock differ by tens of ppm, so the
+// jitter buffer gains or loses seconds a day. A PI loop on its depth
+// moves the resampling ratio by as much: the proportional term returns the
+// level to where playback settled, the integral learns the offset.
+//
+// The buffer is an integrator, 1 ppm moving it by 1e-3 ms per second. The
+// loop closes at one radian per hour: network bursts move the depth by
+// seconds, and after the 5 minute low-pass even that much noise only dithers
+// the correction by a few ppm. A skew of 100 ppm is learned within hours, the
+// level straying by about 250 ms meanwhile, and is kept across stations. The
+// correction moves by at most 1 ppm per second, far too slowly to hear.
+#define CD_PLANT_MS_PER_PPM_S 1e-3f
+#define CD_CROSSOVER_RAD_S (1.0f / 3600)
+#define CD_KP (CD_CROSSOVER_RAD_S / CD_PLANT_MS_PER_PPM_S) // ppm per ms
+#define CD_KI (CD_KP * CD_CROSSOVER_RAD_S / 2)             // ppm per ms s
+#define CD_LEVEL_TAU_S 300.0f
+#define CD_MAX_PPM 500
+#define CD_SLEW_PPM_PER_S 1.0f
+// the depth right after a (re)buffer includes the fill of the downstream
+// buffers and a byte rate that is still converging
+#define CD_SETTLE_S 10
+#define CD_WARMUP_S 30
+
+void clock_drift_init(clock_drift_t *cd) {
+  cd->skew_ppm = 0;
+  cd->ppm = 0;
+  clock_drift_restart(cd);
+}
+
+void clock_drift_restart(clock_drift_t *cd) {
+  cd->warmup_s = CD_WARMUP_S;
+  cd->has_level = false;
+  cd->level_ms = 0;
+  cd->setpoint_ms = 0;
+}
+
+static float clampf(float v, float limit) {
+  return v > limit ? limit : (v < -limit ? -limit : v);
+}
+
+int clock_drift_update(clock_drift_t *cd, float depth_ms, float dt_s) {
+  float want = cd->skew_ppm;
+  if (cd->warmup_s > 0) {
+    // average the settled part of the warm-up into the setpoint
+    int elapsed = CD_WARMUP_S - cd->warmup_s;
+    if (elapsed >= CD_SETTLE_S) {
+      int n = elapsed - CD_SETTLE_S + 1;
+      cd->level_ms += (depth_ms - cd->level_ms) / n;
+    }
+    cd->warmup_s -= (int)ceilf(dt_s);
+    if (cd->warmup_s <= 0) {
+      cd->setpoint_ms = cd->level_ms;
+      cd->has_level = true;
+    }
+  } else {
+    float a = dt_s < CD_LEVEL_TAU_S ? dt_s / CD_LEVEL_TAU_S : 1.0f;
+    cd->level_ms += (depth_ms - cd->level_ms) * a;
+    float error = cd->level_ms - cd->setpoint_ms; // too full when positive
+    want = CD_KP * error + cd->skew_ppm;
+    // conditional integration: do not wind up against the limit
+    if (fabsf(want) < CD_MAX_PPM || (want > 0) != (error > 0)) {
+      cd->skew_ppm = clampf(cd->skew_ppm + CD_KI * error * dt_s, CD_MAX_PPM);
+    }
+  }
+
+  want = clampf(want, CD_MAX_PPM);
+  float step = CD_SLEW_PPM_PER_S * dt_s;
+  float next = clampf(want - cd->ppm, step) + cd->ppm;
+  cd->ppm = (int)lrintf(next);
+  return cd->ppm;
+}
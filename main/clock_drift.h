@@ -0,0 +1,51 @@
+#ifndef CLOCK_DRIFT_H
+#define CLOCK_DRIFT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief State of the clock drift controller. Plain data with no ESP-IDF
+     * dependency, so the loop can be simulated on a host.
+     */
+    typedef struct {
+        int warmup_s;     // seconds left before the level is trusted
+        bool has_level;
+        float level_ms;   // low-passed jitter buffer depth
+        float setpoint_ms;
+        float skew_ppm;   // integral term, the learned clock offset
+        int ppm;          // last correction handed to the resampler
+    } clock_drift_t;
+
+    /**
+     * @brief Clears the controller at boot.
+     */
+    void clock_drift_init(clock_drift_t* cd);
+
+    /**
+     * @brief Forgets the buffer level after a tune or a rebuffer. The learned
+     * skew is kept since most of it is the local crystal.
+     */
+    void clock_drift_restart(clock_drift_t* cd);
+
+    /**
+     * @brief Runs one step of the controller from the jitter buffer depth.
+     * The depth settled at after a restart becomes the setpoint, and the
+     * returned ratio correction keeps the buffer there.
+     * @param cd Controller state.
+     * @param depth_ms Current jitter buffer depth.
+     * @param dt_s Seconds since the previous step.
+     * @return The correction in ppm for resampler_set_drift_ppm(). Positive
+     * consumes input faster.
+     */
+    int clock_drift_update(clock_drift_t* cd, float depth_ms, float dt_s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CLOCK_DRIFT_H
@@ -0,0 +1,284 @@
+#include "codec_probe.h"
+#include "esp_log.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "CODEC_PROBE";
+
+// Enough for two frames of a 320 kbps MP3 or a typical ID3-free AAC start
+#define CODEC_PROBE_LEN (4 * 1024)
+#define CODEC_CACHE_SIZE 32
+
+struct codec_probe {
+  stream_func read; // the element's own read callback
+  uint8_t buf[CODEC_PROBE_LEN];
+  int filled;
+  uint32_t uri_hash;
+  codec_type_t hint;
+  codec_type_t result;
+  volatile bool probing;
+  SemaphoreHandle_t done; // given when result is valid for the current URI
+};
+
+typedef struct {
+  uint32_t uri_hash; // 0 for an empty slot
+  codec_type_t codec;
+} codec_cache_entry_t;
+
+static codec_cache_entry_t s_cache[CODEC_CACHE_SIZE];
+static int s_cache_next = 0;
+static portMUX_TYPE s_cache_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t uri_hash(const char *uri) {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (const char *p = uri; *p; p++) {
+    h = (h ^ (uint8_t)*p) * 16777619u;
+  }
+  return h ? h : 1;
+}
+
+static void cache_put(uint32_t hash, codec_type_t codec) {
+  taskENTER_CRITICAL(&s_cache_lock);
+  int slot = -1;
+  for (int i = 0; i < CODEC_CACHE_SIZE; i++) {
+    if (s_cache[i].uri_hash == hash) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    slot = s_cache_next;
+    s_cache_next = (s_cache_next + 1) % CODEC_CACHE_SIZE;
+  }
+  s_cache[slot].uri_hash = hash;
+  s_cache[slot].codec = codec;
+  taskEXIT_CRITICAL(&s_cache_lock);
+}
+
+bool codec_probe_cache_lookup(const char *uri, codec_type_t *codec) {
+  if (uri == NULL || codec == NULL) {
+    return false;
+  }
+  uint32_t hash = uri_hash(uri);
+  bool found = false;
+  taskENTER_CRITICAL(&s_cache_lock);
+  for (int i = 0; i < CODEC_CACHE_SIZE; i++) {
+    if (s_cache[i].uri_hash == hash) {
+      *codec = s_cache[i].codec;
+      found = true;
+      break;
+    }
+  }
+  taskEXIT_CRITICAL(&s_cache_lock);
+  return found;
+}
+
+static int id3v2_len(const uint8_t *d, int len) {
+  if (len < 10 || memcmp(d, "ID3", 3) != 0) {
+    return 0;
+  }
+  int size = ((d[6] & 0x7F) << 21) | ((d[7] & 0x7F) << 14) |
+             ((d[8] & 0x7F) << 7) | (d[9] & 0x7F);
+  return 10 + size + ((d[5] & 0x10) ? 10 : 0); // footer present
+}
+
+// ADTS header: 12 bit sync, layer 00. Returns the frame length or 0.
+static int adts_frame_len(const uint8_t *d, int len) {
+  if (len < 7 || d[0] != 0xFF || (d[1] & 0xF6) != 0xF0) {
+    return 0;
+  }
+  if (((d[2] >> 2) & 0x0F) > 12) { // sampling frequency index
+    return 0;
+  }
+  int frame_len = ((d[3] & 0x03) << 11) | (d[4] << 3) | (d[5] >> 5);
+  return frame_len >= 7 ? frame_len : 0;
+}
+
+// MPEG audio header: 11 bit sync. Returns the frame length or 0.
+static int mpeg_frame_len(const uint8_t *d, int len) {
+  static const uint16_t bitrates[2][3][15] = {
+      // MPEG 1: layer I, II, III
+      {{0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+       {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+       {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}},
+      // MPEG 2 and 2.5: layer I, II, III
+      {{0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+       {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+       {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}}};
+  static const uint16_t sample_rates[3] = {44100, 48000, 32000};
+
+  if (len < 4 || d[0] != 0xFF || (d[1] & 0xE0) != 0xE0) {
+    return 0;
+  }
+  int version = (d[1] >> 3) & 0x03; // 0: 2.5, 1: reserved, 2: 2, 3: 1
+  int layer = (d[1] >> 1) & 0x03;   // 1: III, 2: II, 3: I, 0: reserved
+  int bitrate_idx = d[2] >> 4;
+  int rate_idx = (d[2] >> 2) & 0x03;
+  int padding = (d[2] >> 1) & 0x01;
+  if (version == 1 || layer == 0 || bitrate_idx == 0 || bitrate_idx == 15 ||
+      rate_idx == 3) {
+    return 0;
+  }
+
+  int mpeg1 = version == 3;
+  int layer_idx = 3 - layer; // 0: I, 1: II, 2: III
+  int bitrate = bitrates[!mpeg1][layer_idx][bitrate_idx] * 1000;
+  // MPEG 2 halves the MPEG 1 rates, MPEG 2.5 quarters them
+  int rate_shift = mpeg1 ? 0 : version == 2 ? 1 : 2;
+  int sample_rate = sample_rates[rate_idx] >> rate_shift;
+  if (layer_idx == 0) {
+    return (12 * bitrate / sample_rate + padding) * 4;
+  }
+  if (layer_idx == 2 && !mpeg1) {
+    return 72 * bitrate / sample_rate + padding;
+  }
+  return 144 * bitrate / sample_rate + padding;
+}
+
+// A single sync word is easy to hit in random data, so a frame only counts
+// when a second valid header follows it at the computed length.
+static bool detect_sync(const uint8_t *d, int len, codec_type_t *codec) {
+  for (int i = 0; i + 4 <= len; i++) {
+    if (memcmp(d + i, "OggS", 4) == 0) {
+      *codec = CODEC_TYPE_OGG;
+      return true;
+    }
+    if (memcmp(d + i, "fLaC", 4) == 0) {
+      *codec = CODEC_TYPE_FLAC;
+      return true;
+    }
+    if (d[i] != 0xFF) {
+      continue;
+    }
+    int n = adts_frame_len(d + i, len - i);
+    if (n > 0 && adts_frame_len(d + i + n, len - i - n) > 0) {
+      *codec = CODEC_TYPE_AAC;
+      return true;
+    }
+    n = mpeg_frame_len(d + i, len - i);
+    if (n > 0 && mpeg_frame_len(d + i + n, len - i - n) > 0) {
+      *codec = CODEC_TYPE_MP3;
+      return true;
+    }
+  }
+  return false;
+}
+
+codec_type_t codec_probe_detect(const uint8_t *data, int len,
+                                esp_codec_type_t content_type,
+                                codec_type_t hint, bool *confident) {
+  codec_type_t codec;
+  int start = id3v2_len(data, len);
+  bool sync = start < len && detect_sync(data + start, len - start, &codec);
+  if (confident) {
+    *confident = sync;
+  }
+  if (sync) {
+    return codec;
+  }
+
+  switch (content_type) {
+  case ESP_CODEC_TYPE_MP3:
+    return CODEC_TYPE_MP3;
+  case ESP_CODEC_TYPE_AAC:
+    return CODEC_TYPE_AAC;
+  case ESP_CODEC_TYPE_OGG:
+    return CODEC_TYPE_OGG;
+  case ESP_CODEC_TYPE_FLAC:
+    return CODEC_TYPE_FLAC;
+  default:
+    return hint;
+  }
+}
+
+static void probe_finish(codec_probe_handle_t probe, codec_type_t codec,
+                         bool confident) {
+  probe->result = codec;
+  probe->probing = false;
+  if (codec != probe->hint) {
+    ESP_LOGW(TAG, "Station is configured as %s but the stream is %s",
+             codec_type_to_string(probe->hint), codec_type_to_string(codec));
+  }
+  if (confident) {
+    cache_put(probe->uri_hash, codec);
+  }
+  xSemaphoreGive(probe->done);
+}
+
+static int probe_read(audio_element_handle_t self, char *buffer, int len,
+                      TickType_t ticks_to_wait, void *context) {
+  codec_probe_handle_t probe = (codec_probe_handle_t)context;
+  int r = probe->read(self, buffer, len, ticks_to_wait, NULL);
+  if (r <= 0 || !probe->probing) {
+    return r;
+  }
+
+  int n = r < CODEC_PROBE_LEN - probe->filled ? r
+                                               : CODEC_PROBE_LEN - probe->filled;
+  memcpy(probe->buf + probe->filled, buffer, n);
+  probe->filled += n;
+
+  // http_stream has mapped the Content-Type by the time body bytes arrive
+  audio_element_info_t info = {0};
+  audio_element_getinfo(self, &info);
+  bool confident;
+  codec_type_t codec = codec_probe_detect(probe->buf, probe->filled,
+                                          info.codec_fmt, probe->hint,
+                                          &confident);
+  if (confident || probe->filled == CODEC_PROBE_LEN) {
+    probe_finish(probe, codec, confident);
+  }
+  return r;
+}
+
+codec_probe_handle_t codec_probe_attach(audio_element_handle_t http_el) {
+  codec_probe_handle_t probe = calloc(1, sizeof(struct codec_probe));
+  if (probe == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate codec probe");
+    return NULL;
+  }
+  probe->done = xSemaphoreCreateBinary();
+  probe->read = audio_element_get_read_cb(http_el);
+  if (probe->done == NULL || probe->read == NULL) {
+    ESP_LOGE(TAG, "Failed to attach codec probe to %s",
+             audio_element_get_tag(http_el));
+    if (probe->done) {
+      vSemaphoreDelete(probe->done);
+    }
+    free(probe);
+    return NULL;
+  }
+  audio_element_set_read_cb(http_el, probe_read, probe);
+  return probe;
+}
+
+void codec_probe_destroy(codec_probe_handle_t probe) {
+  if (probe == NULL) {
+    return;
+  }
+  vSemaphoreDelete(probe->done);
+  free(probe);
+}
+
+void codec_probe_start(codec_probe_handle_t probe, const char *uri,
+                       codec_type_t hint) {
+  xSemaphoreTake(probe->done, 0);
+  probe->uri_hash = uri_hash(uri);
+  probe->hint = hint;
+  probe->result = hint;
+  probe->filled = 0;
+  probe->probing = true;
+}
+
+bool codec_probe_wait(codec_probe_handle_t probe, TickType_t ticks_to_wait,
+                      codec_type_t *codec) {
+  if (xSemaphoreTake(probe->done, ticks_to_wait) != pdTRUE) {
+    *codec = probe->hint;
+    return false;
+  }
+  xSemaphoreGive(probe->done); // stays done until the next start
+  *codec = probe->result;
+  return true;
+}
@@ -0,0 +1,70 @@
+#ifndef CODEC_PROBE_H
+#define CODEC_PROBE_H
+
+#include "audio_element.h"
+#include "audio_pipeline_manager.h"
+#include "freertos/FreeRTOS.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    typedef struct codec_probe *codec_probe_handle_t;
+
+    /**
+     * @brief Identifies the codec of a stream from its first bytes and Content-Type.
+     * Frame sync patterns win over the Content-Type, which is often wrong for
+     * Shoutcast/Icecast servers; the hint is used only when neither is conclusive.
+     * @param data The first bytes of the stream body.
+     * @param len Number of bytes in data.
+     * @param content_type Codec http_stream derived from the Content-Type header.
+     * @param hint Codec to fall back to, normally the station's stored codec.
+     * @param[out] confident Set when the result came from frame sync, may be NULL.
+     * @return The detected codec.
+     */
+    codec_type_t codec_probe_detect(const uint8_t* data, int len, esp_codec_type_t content_type,
+                                    codec_type_t hint, bool* confident);
+
+    /**
+     * @brief Wraps the read callback of an HTTP stream reader so the first bytes of
+     * every connection are probed as they pass through.
+     * @param http_el The HTTP stream reader element.
+     * @return The probe handle, or NULL on failure.
+     */
+    codec_probe_handle_t codec_probe_attach(audio_element_handle_t http_el);
+
+    /**
+     * @brief Frees a probe. The element it was attached to must be deinitialized first.
+     */
+    void codec_probe_destroy(codec_probe_handle_t probe);
+
+    /**
+     * @brief Arms the probe for a new connection. Call before the source is started.
+     * @param probe The probe handle.
+     * @param uri The URI the source is about to open; used as the cache key.
+     * @param hint Codec reported when the stream data is inconclusive.
+     */
+    void codec_probe_start(codec_probe_handle_t probe, const char* uri, codec_type_t hint);
+
+    /**
+     * @brief Waits for the probe of the current connection to finish.
+     * @param probe The probe handle.
+     * @param ticks_to_wait Maximum time to wait.
+     * @param[out] codec The detected codec.
+     * @return true if the probe finished in time.
+     */
+    bool codec_probe_wait(codec_probe_handle_t probe, TickType_t ticks_to_wait, codec_type_t* codec);
+
+    /**
+     * @brief Looks up the codec detected the last time a URI was played.
+     * @return true if the URI is in the cache.
+     */
+    bool codec_probe_cache_lookup(const char* uri, codec_type_t* codec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CODEC_PROBE_H
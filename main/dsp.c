@@ -0,0 +1,485 @@
+#include "dsp.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h" // needed despite linter suggesting otherwise
+#include "freertos/task.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "DSP";
+
+// EQ biquads: Q28 coefficients, signal with 8 fraction bits. Every band's
+// output is clamped to 30 dB over full scale, so five 64-bit products and the
+// fed back rounding error cannot overflow.
+#define DSP_COEF_BITS 28
+#define DSP_FRAC_BITS 8
+#define DSP_COEF_MAX (8.0 - 1.0 / (1 << DSP_COEF_BITS))
+#define DSP_SIGNAL_MAX ((1 << (15 + DSP_FRAC_BITS + 5)) - 1)
+#define DSP_BUFFER_LEN (2 * 1024)
+#define DSP_MAX_FRAMES (DSP_BUFFER_LEN / 4)
+// new filters are crossfaded in over 2^DSP_XFADE_BITS frames
+#define DSP_XFADE_BITS 9
+#define DSP_XFADE_FRAMES (1 << DSP_XFADE_BITS)
+// the limiter delays the signal by its look-ahead, so it is fixed to keep
+// the latency constant whether the limiter is on or not
+#define DSP_LOOKAHEAD_MS 2
+#define DSP_MIN_RATE 8000
+#define DSP_MAX_RATE 96000
+#define DSP_MAX_LOOKAHEAD (DSP_MAX_RATE * DSP_LOOKAHEAD_MS / 1000)
+// limiter gains: Q15 per frame, Q30 for the release so slow releases do not
+// stall on rounding
+#define DSP_GAIN_BITS 15
+#define DSP_HOLD_BITS 30
+#define DSP_LIMITER_OFF INT32_MAX
+
+typedef struct {
+  int32_t b0, b1, b2, a1, a2;
+} dsp_coef_t;
+
+typedef struct {
+  int32_t x1, x2, y1, y2;
+  int32_t e1, e2; // rounding errors, fed back
+} dsp_biquad_t;
+
+typedef struct {
+  int band_count;
+  dsp_coef_t coef[DSP_MAX_BANDS];
+  dsp_biquad_t state[DSP_MAX_BANDS][2];
+} dsp_bank_t;
+
+// everything dsp_set_settings derives, ready to be taken by the element task
+typedef struct {
+  int band_count;
+  dsp_coef_t coef[DSP_MAX_BANDS];
+  int32_t ceiling; // Q8 sample value, DSP_LIMITER_OFF to only clip
+  int32_t release; // Q30 per frame
+} dsp_params_t;
+
+typedef struct {
+  int rate;
+
+  // written by any task, taken by the element task
+  portMUX_TYPE lock;
+  bool pending;
+  dsp_params_t staged;
+
+  // two cascades; the inactive one receives new coefficients and is faded in
+  dsp_bank_t bank[2];
+  int active;
+  bool fading;
+  int fade_pos;
+
+  int32_t ceiling;
+  int32_t release;
+  int lookahead; // frames
+  int32_t delay[(DSP_MAX_LOOKAHEAD - 1) * 2];
+  int delay_pos;
+  // sliding minimum of the gain each frame needs, over the look-ahead
+  uint32_t frame;
+  uint32_t min_at[DSP_MAX_LOOKAHEAD];
+  int32_t min_gain[DSP_MAX_LOOKAHEAD];
+  int min_head;
+  int min_len;
+  int32_t hold; // Q30, released towards unity
+  // moving average of the held gain over the look-ahead, in Q15
+  int32_t avg[DSP_MAX_LOOKAHEAD];
+  int avg_pos;
+  int32_t avg_sum;
+  uint32_t avg_recip; // 2^32 / lookahead
+
+  volatile bool bypass;
+
+  int32_t work[DSP_MAX_FRAMES * 2];
+  int32_t fade_work[DSP_MAX_FRAMES * 2];
+} dsp_t;
+
+static float clampf(float v, float lo, float hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void dsp_clamp_settings(dsp_settings_t *settings) {
+  if (settings->band_count < 0) {
+    settings->band_count = 0;
+  } else if (settings->band_count > DSP_MAX_BANDS) {
+    settings->band_count = DSP_MAX_BANDS;
+  }
+  for (int i = 0; i < settings->band_count; i++) {
+    dsp_band_t *b = &settings->bands[i];
+    if (b->type < 0 || b->type >= DSP_BAND_TYPE_COUNT) {
+      b->type = DSP_BAND_PEAK;
+    }
+    b->freq = clampf(b->freq, 20.0f, 20000.0f);
+    b->gain_db = clampf(b->gain_db, -12.0f, 12.0f);
+    b->q = clampf(b->q, 0.1f, 10.0f);
+  }
+  settings->ceiling_db = clampf(settings->ceiling_db, -12.0f, 0.0f);
+  settings->release_ms = clampf(settings->release_ms, 10.0f, 2000.0f);
+}
+
+// Coefficients from the Audio EQ Cookbook (R. Bristow-Johnson). Returns false
+// for a band whose coefficients do not fit Q28.
+static bool design_band(const dsp_band_t *band, int rate, dsp_coef_t *c) {
+  double freq = band->freq < 0.45 * rate ? band->freq : 0.45 * rate;
+  double w0 = 2.0 * M_PI * freq / rate;
+  double cw = cos(w0);
+  double alpha = sin(w0) / (2.0 * band->q);
+  double a = pow(10.0, band->gain_db / 40.0);
+  double sa = 2.0 * sqrt(a) * alpha;
+  double b0, b1, b2, a0, a1, a2;
+  switch (band->type) {
+  case DSP_BAND_LOW_SHELF:
+    b0 = a * ((a + 1) - (a - 1) * cw + sa);
+    b1 = 2 * a * ((a - 1) - (a + 1) * cw);
+    b2 = a * ((a + 1) - (a - 1) * cw - sa);
+    a0 = (a + 1) + (a - 1) * cw + sa;
+    a1 = -2 * ((a - 1) + (a + 1) * cw);
+    a2 = (a + 1) + (a - 1) * cw - sa;
+    break;
+  case DSP_BAND_HIGH_SHELF:
+    b0 = a * ((a + 1) + (a - 1) * cw + sa);
+    b1 = -2 * a * ((a - 1) + (a + 1) * cw);
+    b2 = a * ((a + 1) + (a - 1) * cw - sa);
+    a0 = (a + 1) - (a - 1) * cw + sa;
+    a1 = 2 * ((a - 1) - (a + 1) * cw);
+    a2 = (a + 1) - (a - 1) * cw - sa;
+    break;
+  case DSP_BAND_LOW_PASS:
+    b0 = (1 - cw) / 2;
+    b1 = 1 - cw;
+    b2 = (1 - cw) / 2;
+    a0 = 1 + alpha;
+    a1 = -2 * cw;
+    a2 = 1 - alpha;
+    break;
+  case DSP_BAND_HIGH_PASS:
+    b0 = (1 + cw) / 2;
+    b1 = -(1 + cw);
+    b2 = (1 + cw) / 2;
+    a0 = 1 + alpha;
+    a1 = -2 * cw;
+    a2 = 1 - alpha;
+    break;
+  default:
+    b0 = 1 + alpha * a;
+    b1 = -2 * cw;
+    b2 = 1 - alpha * a;
+    a0 = 1 + alpha / a;
+    a1 = -2 * cw;
+    a2 = 1 - alpha / a;
+    break;
+  }
+  double v[5] = {b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0};
+  int32_t q[5];
+  for (int i = 0; i < 5; i++) {
+    if (fabs(v[i]) > DSP_COEF_MAX) {
+      return false;
+    }
+    q[i] = (int32_t)lround(v[i] * (1 << DSP_COEF_BITS));
+  }
+  c->b0 = q[0];
+  c->b1 = q[1];
+  c->b2 = q[2];
+  c->a1 = q[3];
+  c->a2 = q[4];
+  return true;
+}
+
+static void design(const dsp_settings_t *settings, int rate,
+                   dsp_params_t *params) {
+  params->band_count = 0;
+  for (int i = 0; i < settings->band_count; i++) {
+    const dsp_band_t *b = &settings->bands[i];
+    if (fabsf(b->gain_db) < 0.01f && b->type != DSP_BAND_LOW_PASS &&
+        b->type != DSP_BAND_HIGH_PASS) {
+      continue; // flat
+    }
+    if (design_band(b, rate, &params->coef[params->band_count])) {
+      params->band_count++;
+    } else {
+      ESP_LOGW(TAG, "Skipping EQ band %d: %.0f Hz, Q %.2f out of range", i,
+               b->freq, b->q);
+    }
+  }
+  params->ceiling =
+      settings->limiter
+          ? (int32_t)(powf(10.0f, settings->ceiling_db / 20.0f) * INT16_MAX)
+                << DSP_FRAC_BITS
+          : DSP_LIMITER_OFF;
+  params->release =
+      (int32_t)lround((1.0 - exp(-1000.0 / (settings->release_ms * rate))) *
+                      (1 << DSP_HOLD_BITS));
+}
+
+// Filters one channel of interleaved stereo in place
+static void run_biquad(const dsp_coef_t *c, dsp_biquad_t *s, int32_t *buf,
+                       int frames) {
+  const int32_t mask = (1 << DSP_COEF_BITS) - 1;
+  int32_t x1 = s->x1, x2 = s->x2, y1 = s->y1, y2 = s->y2, e1 = s->e1,
+          e2 = s->e2;
+  for (int i = 0; i < frames; i++) {
+    int32_t x = buf[2 * i];
+    // Truncation error fed back through (1 - z^-1)^2 keeps low shelves and
+    // high-passes, whose poles sit next to z = 1, free of limit cycles.
+    int64_t acc = (int64_t)c->b0 * x + (int64_t)c->b1 * x1 +
+                  (int64_t)c->b2 * x2 - (int64_t)c->a1 * y1 -
+                  (int64_t)c->a2 * y2 + 2 * e1 - e2;
+    int32_t y = (int32_t)(acc >> DSP_COEF_BITS);
+    e2 = e1;
+    e1 = (int32_t)(acc & mask);
+    if (y > DSP_SIGNAL_MAX) {
+      y = DSP_SIGNAL_MAX;
+    } else if (y < -DSP_SIGNAL_MAX) {
+      y = -DSP_SIGNAL_MAX;
+    }
+    x2 = x1;
+    x1 = x;
+    y2 = y1;
+    y1 = y;
+    buf[2 * i] = y;
+  }
+  s->x1 = x1;
+  s->x2 = x2;
+  s->y1 = y1;
+  s->y2 = y2;
+  s->e1 = e1;
+  s->e2 = e2;
+}
+
+static void run_bank(dsp_bank_t *bank, int32_t *buf, int frames) {
+  for (int b = 0; b < bank->band_count; b++) {
+    run_biquad(&bank->coef[b], &bank->state[b][0], buf, frames);
+    run_biquad(&bank->coef[b], &bank->state[b][1], buf + 1, frames);
+  }
+}
+
+static void apply_pending(dsp_t *d) {
+  if (!d->pending || d->fading) {
+    return; // a change during a crossfade waits for it to finish
+  }
+  const dsp_bank_t *cur = &d->bank[d->active];
+  dsp_bank_t *next = &d->bank[!d->active];
+  taskENTER_CRITICAL(&d->lock);
+  next->band_count = d->staged.band_count;
+  memcpy(next->coef, d->staged.coef, sizeof(next->coef));
+  d->ceiling = d->staged.ceiling;
+  d->release = d->staged.release;
+  d->pending = false;
+  taskEXIT_CRITICAL(&d->lock);
+
+  if (next->band_count == cur->band_count &&
+      memcmp(next->coef, cur->coef,
+             next->band_count * sizeof(dsp_coef_t)) == 0) {
+    return; // limiter only
+  }
+  // The new cascade starts from the state of the current one, so bands
+  // kept across the change carry on where they were.
+  memcpy(next->state, cur->state, sizeof(next->state));
+  for (int b = cur->band_count; b < DSP_MAX_BANDS; b++) {
+    memset(next->state[b], 0, sizeof(next->state[b]));
+  }
+  d->fading = true;
+  d->fade_pos = 0;
+}
+
+// Mixes the new cascade's output in from the old one's along a smoothstep,
+// which starts and ends without a kink
+static void crossfade(dsp_t *d, int32_t *buf, const int32_t *next,
+                      int frames) {
+  int pos = d->fade_pos;
+  for (int i = 0; i < frames * 2; i += 2) {
+    int t = pos < DSP_XFADE_FRAMES ? pos : DSP_XFADE_FRAMES;
+    int w = (t * t * (3 * DSP_XFADE_FRAMES - 2 * t)) >> (2 * DSP_XFADE_BITS);
+    buf[i] += (int32_t)(((int64_t)(next[i] - buf[i]) * w) >> DSP_XFADE_BITS);
+    buf[i + 1] +=
+        (int32_t)(((int64_t)(next[i + 1] - buf[i + 1]) * w) >> DSP_XFADE_BITS);
+    pos++;
+  }
+  d->fade_pos = pos;
+  if (pos >= DSP_XFADE_FRAMES) {
+    d->active = !d->active;
+    d->fading = false;
+  }
+}
+
+static inline int16_t clamp16(int32_t v) {
+  return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v);
+}
+
+// Look-ahead peak limiter. Each frame's output is the input of lookahead - 1
+// frames earlier times the average of the held gain over the last lookahead
+// frames. Every gain in that average is at most the minimum needed within
+// the look-ahead window, which contains the delayed frame, so the output
+// stays under the ceiling while the gain still moves smoothly.
+static void limit(dsp_t *d, const int32_t *buf, int16_t *pcm, int frames) {
+  const int len = d->lookahead;
+  const int32_t unity = 1 << DSP_GAIN_BITS;
+  const int32_t round = 1 << (DSP_FRAC_BITS - 1);
+  for (int i = 0; i < frames; i++) {
+    int32_t l = buf[2 * i];
+    int32_t r = buf[2 * i + 1];
+    int32_t peak = abs(l) > abs(r) ? abs(l) : abs(r);
+    int32_t need = unity;
+    if (peak > d->ceiling) {
+      need = ((d->ceiling >> DSP_FRAC_BITS) << DSP_GAIN_BITS) /
+             (peak >> DSP_FRAC_BITS);
+    }
+
+    uint32_t now = d->frame++;
+    if (d->min_len > 0 && now - d->min_at[d->min_head] >= (uint32_t)len) {
+      d->min_head = d->min_head + 1 < len ? d->min_head + 1 : 0;
+      d->min_len--;
+    }
+    while (d->min_len > 0) {
+      int back = d->min_head + d->min_len - 1;
+      back = back < len ? back : back - len;
+      if (d->min_gain[back] < need) {
+        break;
+      }
+      d->min_len--;
+    }
+    int tail = d->min_head + d->min_len;
+    tail = tail < len ? tail : tail - len;
+    d->min_at[tail] = now;
+    d->min_gain[tail] = need;
+    d->min_len++;
+    int32_t cap = d->min_gain[d->min_head] << (DSP_HOLD_BITS - DSP_GAIN_BITS);
+
+    int32_t hold = d->hold;
+    hold += (int32_t)(((int64_t)((1 << DSP_HOLD_BITS) - hold) * d->release) >>
+                      DSP_HOLD_BITS);
+    hold = hold < cap ? hold : cap;
+    d->hold = hold;
+    int32_t h = hold >> (DSP_HOLD_BITS - DSP_GAIN_BITS);
+    d->avg_sum += h - d->avg[d->avg_pos];
+    d->avg[d->avg_pos] = h;
+    d->avg_pos = d->avg_pos + 1 < len ? d->avg_pos + 1 : 0;
+    int32_t gain = d->avg_sum == len << DSP_GAIN_BITS
+                       ? unity
+                       : (int32_t)(((uint64_t)d->avg_sum * d->avg_recip) >> 32);
+
+    int32_t *slot = &d->delay[d->delay_pos * 2];
+    int32_t dl = slot[0];
+    int32_t dr = slot[1];
+    slot[0] = l;
+    slot[1] = r;
+    d->delay_pos = d->delay_pos + 2 < len ? d->delay_pos + 1 : 0;
+    if (gain < unity) {
+      dl = (int32_t)(((int64_t)dl * gain) >> DSP_GAIN_BITS);
+      dr = (int32_t)(((int64_t)dr * gain) >> DSP_GAIN_BITS);
+    }
+    pcm[2 * i] = clamp16((dl + round) >> DSP_FRAC_BITS);
+    pcm[2 * i + 1] = clamp16((dr + round) >> DSP_FRAC_BITS);
+  }
+}
+
+static esp_err_t _dsp_destroy(audio_element_handle_t self) {
+  dsp_t *d = (dsp_t *)audio_element_getdata(self);
+  free(d);
+  return ESP_OK;
+}
+
+static int _dsp_process(audio_element_handle_t self, char *in_buffer,
+                        int in_len) {
+  dsp_t *d = (dsp_t *)audio_element_getdata(self);
+  apply_pending(d);
+
+  int r = audio_element_input(self, in_buffer, in_len);
+  if (r <= 0) {
+    return r;
+  }
+  if (!d->bypass) {
+    // the resampler only writes whole stereo frames
+    int16_t *pcm = (int16_t *)in_buffer;
+    int frames = r / 4;
+    for (int i = 0; i < frames * 2; i++) {
+      d->work[i] = (int32_t)pcm[i] << DSP_FRAC_BITS;
+    }
+    if (d->fading) {
+      memcpy(d->fade_work, d->work, frames * 2 * sizeof(int32_t));
+      run_bank(&d->bank[d->active], d->work, frames);
+      run_bank(&d->bank[!d->active], d->fade_work, frames);
+      crossfade(d, d->work, d->fade_work, frames);
+    } else {
+      run_bank(&d->bank[d->active], d->work, frames);
+    }
+    limit(d, d->work, pcm, frames);
+  }
+  return audio_element_output(self, in_buffer, r);
+}
+
+audio_element_handle_t dsp_init(dsp_cfg_t *cfg) {
+  if (cfg == NULL || cfg->rate < DSP_MIN_RATE || cfg->rate > DSP_MAX_RATE) {
+    ESP_LOGE(TAG, "Invalid DSP configuration");
+    return NULL;
+  }
+  dsp_t *d = calloc(1, sizeof(dsp_t));
+  if (d == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate DSP state");
+    return NULL;
+  }
+  d->rate = cfg->rate;
+  d->lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+  d->lookahead = cfg->rate * DSP_LOOKAHEAD_MS / 1000;
+  d->avg_recip = (uint32_t)((1ULL << 32) / d->lookahead);
+  d->hold = 1 << DSP_HOLD_BITS;
+  for (int i = 0; i < d->lookahead; i++) {
+    d->avg[i] = 1 << DSP_GAIN_BITS;
+  }
+  d->avg_sum = d->lookahead << DSP_GAIN_BITS;
+
+  dsp_settings_t defaults = DSP_SETTINGS_DEFAULT();
+  design(&defaults, d->rate, &d->staged);
+  d->pending = true;
+
+  audio_element_cfg_t el_cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+  el_cfg.process = _dsp_process;
+  el_cfg.destroy = _dsp_destroy;
+  el_cfg.buffer_len = DSP_BUFFER_LEN;
+  el_cfg.out_rb_size = cfg->out_rb_size;
+  el_cfg.task_stack = cfg->task_stack;
+  el_cfg.task_prio = cfg->task_prio;
+  el_cfg.task_core = cfg->task_core;
+  el_cfg.tag = "dsp";
+
+  audio_element_handle_t el = audio_element_init(&el_cfg);
+  if (el == NULL) {
+    ESP_LOGE(TAG, "Failed to initialize DSP element");
+    free(d);
+    return NULL;
+  }
+  audio_element_setdata(el, d);
+  ESP_LOGI(TAG, "DSP: %d Hz, limiter look-ahead %d frames", d->rate,
+           d->lookahead);
+  return el;
+}
+
+esp_err_t dsp_set_settings(audio_element_handle_t el,
+                           const dsp_settings_t *settings) {
+  if (el == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  dsp_t *d = (dsp_t *)audio_element_getdata(el);
+  dsp_settings_t s = DSP_SETTINGS_DEFAULT();
+  if (settings) {
+    s = *settings;
+  }
+  dsp_clamp_settings(&s);
+  dsp_params_t params;
+  design(&s, d->rate, &params);
+
+  taskENTER_CRITICAL(&d->lock);
+  d->staged = params;
+  d->pending = true;
+  taskEXIT_CRITICAL(&d->lock);
+  ESP_LOGI(TAG, "EQ %d bands, limiter %s", params.band_count,
+           s.limiter ? "on" : "off");
+  return ESP_OK;
+}
+
+void dsp_set_bypass(audio_element_handle_t el, bool bypass) {
+  if (el) {
+    dsp_t *d = (dsp_t *)audio_element_getdata(el);
+    d->bypass = bypass;
+  }
+}
@@ -0,0 +1,105 @@
+#ifndef DSP_H
+#define DSP_H
+
+#include "audio_element.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DSP_MAX_BANDS 5
+
+    /**
+     * @brief Filter shape of an EQ band. Values are stored in stations.json.
+     */
+    typedef enum {
+        DSP_BAND_PEAK,
+        DSP_BAND_LOW_SHELF,
+        DSP_BAND_HIGH_SHELF,
+        DSP_BAND_LOW_PASS,
+        DSP_BAND_HIGH_PASS,
+        DSP_BAND_TYPE_COUNT
+    } dsp_band_type_t;
+
+    /**
+     * @brief One parametric EQ band.
+     */
+    typedef struct {
+        dsp_band_type_t type;
+        float freq;    // Hz
+        float gain_db; // peak and shelves only, -12 to +12
+        float q;
+    } dsp_band_t;
+
+    /**
+     * @brief EQ and limiter settings of a station.
+     */
+    typedef struct {
+        int band_count;
+        dsp_band_t bands[DSP_MAX_BANDS];
+        bool limiter;
+        float ceiling_db; // limiter output ceiling, -12 to 0 dBFS
+        float release_ms;
+    } dsp_settings_t;
+
+#define DSP_SETTINGS_DEFAULT() {                                   \
+        .band_count = 0,                                           \
+        .limiter = true,                                           \
+        .ceiling_db = -1.0f,                                       \
+        .release_ms = 150.0f,                                      \
+    }
+
+    /**
+     * @brief Configuration for the DSP element.
+     */
+    typedef struct {
+        int rate; // input is 16-bit stereo at this rate
+        int out_rb_size;
+        int task_stack;
+        int task_prio;
+        int task_core;
+    } dsp_cfg_t;
+
+#define DSP_CFG_DEFAULT() {                                        \
+        .rate = CONFIG_RADIO_OUTPUT_SAMPLE_RATE,                   \
+        .out_rb_size = 8 * 1024,                                   \
+        .task_stack = 3 * 1024,                                    \
+        .task_prio = 5,                                            \
+        .task_core = 1,                                            \
+    }
+
+    /**
+     * @brief Creates the DSP element: a cascade of up to DSP_MAX_BANDS fixed-point
+     * biquads followed by a look-ahead peak limiter. It starts with the default
+     * settings.
+     * @return The element handle, or NULL on failure.
+     */
+    audio_element_handle_t dsp_init(dsp_cfg_t* cfg);
+
+    /**
+     * @brief Clamps every field of the settings to its supported range.
+     */
+    void dsp_clamp_settings(dsp_settings_t* settings);
+
+    /**
+     * @brief Sets new EQ and limiter settings. Coefficients are computed in the
+     * caller's task; the element crossfades to the new filters at the start of
+     * its next buffer, without allocating.
+     * @return ESP_OK, or ESP_ERR_INVALID_ARG.
+     */
+    esp_err_t dsp_set_settings(audio_element_handle_t el, const dsp_settings_t* settings);
+
+    /**
+     * @brief Passes audio through unprocessed while the input is not 16-bit
+     * stereo at the configured rate.
+     */
+    void dsp_set_bypass(audio_element_handle_t el, bool bypass);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DSP_H
@@ -188,6 +188,7 @@ void update_volume_pulse_counter(void *pvParameters) {
         counter->adjust = new_volume - (count / 4 * counter->speed);
 
         is_muted = false;
+        update_mute_state(false);
         ESP_LOGI(TAG, "Unmuted by volume change to %d (restored from %d)",
                  new_volume, volume_before_mute);
         save_mute_state_to_nvs(false);
@@ -245,6 +246,7 @@ static void volume_press_task(void *pvParameters) {
       } else {
         // Timeout reached, no second click -> Single Click Action (Mute Toggle)
         is_muted = !is_muted; // Toggle mute state
+        update_mute_state(is_muted);
 
         if (is_muted) {
           ESP_LOGI(TAG, "Muting volume");
@@ -355,6 +357,9 @@ void update_station_select_pulse_counter(void *pvParameters) {
         DELAY_BEFORE_STATION_CHANGE_MS; // 2 seconds before action
     static int current_poll_ms = slow_poll_ms;
     static TickType_t last_change_time = 0;
+#if CONFIG_RADIO_STANDBY_PIPELINE
+    static bool prefetched = false;
+#endif
 
     int raw_count;
     ESP_ERROR_CHECK(pcnt_unit_get_count(counter->pcnt_unit, &raw_count));
@@ -384,6 +389,9 @@ void update_station_select_pulse_counter(void *pvParameters) {
       // A change occurred, switch to fast polling and record the time
       current_poll_ms = fast_poll_ms;
       last_change_time = xTaskGetTickCount();
+#if CONFIG_RADIO_STANDBY_PIPELINE
+      prefetched = false;
+#endif
     } else if (current_poll_ms == fast_poll_ms &&
                (xTaskGetTickCount() - last_change_time) >
                    pdMS_TO_TICKS(inactivity_timeout_ms)) {
@@ -399,6 +407,15 @@ void update_station_select_pulse_counter(void *pvParameters) {
       current_poll_ms = slow_poll_ms;
       on_station_screen = false;
     }
+#if CONFIG_RADIO_STANDBY_PIPELINE
+    else if (current_poll_ms == fast_poll_ms && !prefetched &&
+             (xTaskGetTickCount() - last_change_time) >
+                 pdMS_TO_TICKS(CONFIG_RADIO_PREFETCH_SETTLE_MS)) {
+      // The roller has settled, start connecting while the commit delay runs
+      prefetch_station(counter->current_index);
+      prefetched = true;
+    }
+#endif
     vTaskDelay(pdMS_TO_TICKS(current_poll_ms));
   }
 }
@@ -436,6 +453,7 @@ bool is_volume_switch_pressed(void) {
 void init_encoders(audio_board_handle_t board_handle, int initial_volume,
                    bool initial_mute, int unmuted_volume) {
   is_muted = initial_mute;
+  update_mute_state(is_muted);
   volume_before_mute = unmuted_volume;
 
   // ESP_LOGI(TAG, "set glitch filter");
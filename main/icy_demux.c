@@ -0,0 +1,533 @@
+#include "icy_demux.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "screens.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "ICY_DEMUX";
+
+// standby sources plus the reader of a created pipeline
+#define ICY_DEMUX_MAX 4
+// A metadata block is a length byte N followed by N * 16 bytes of text
+#define ICY_META_MAX (255 * 16)
+#define ICY_TITLE_MAX 128
+// intervals tried for one title block: it may follow up to 3 empty blocks
+#define ICY_GUESS_MAX 4
+// http_stream hides the response headers, so icy-metaint is found in-band:
+// the first block with a StreamTitle gives the interval, or a multiple of it
+// when empty blocks came before. Give up if none shows up in this many bytes.
+#define ICY_SEARCH_LIMIT (ICY_GUESS_MAX * 32 * 1024 + ICY_META_MAX)
+#define ICY_KEY "StreamTitle='"
+#define ICY_KEY_LEN (sizeof(ICY_KEY) - 1)
+#define ICY_METAINT_MIN 256
+#define ICY_METAINT_MAX (64 * 1024)
+// block boundaries an interval must hit before reads are split on it
+#define ICY_CONFIRM 3
+// title blocks whose guesses may all fail before the search gives up
+#define ICY_MISS_MAX 4
+
+typedef enum {
+  ICY_SEARCHING, // metaint not known yet, data is scanned as it passes
+  ICY_VERIFYING, // a title block was found, its interval is being checked
+  ICY_LOCKED,    // reads are split at block boundaries
+  ICY_OFF,       // no metadata on this connection
+} icy_state_t;
+
+// One candidate interval, followed through the data that passes by
+typedef struct {
+  int metaint;
+  int block;     // body offset of the last length byte it hit
+  int block_len; // metadata bytes after that length byte
+  int next;      // body offset of the next length byte
+  int title_at;  // body offset that must hold 'S', or -1
+  int confirmed;
+  bool rejected;
+} icy_guess_t;
+
+typedef struct {
+  audio_element_handle_t el;
+  stream_func read; // the element's own read callback
+  icy_state_t state;
+  uint32_t generation; // bumped for every new connection
+  int offset;          // body bytes seen before locking
+  int since;           // body offset after the last title block found
+  bool seen_key;       // a title block was found on this connection
+  int misses;          // title blocks no interval fitted
+  uint32_t plain_uri;  // hash of a URI to request without metadata, or 0
+  char tail[ICY_KEY_LEN];
+  int tail_len;
+  icy_guess_t guess[ICY_GUESS_MAX];
+  int guess_count;
+  int metaint;
+  int audio_left; // audio bytes before the next length byte
+  int meta_left;  // metadata bytes still to be read
+  int meta_len;
+  char meta[ICY_META_MAX + 1];
+  char title[ICY_TITLE_MAX];
+} icy_demux_t;
+
+static icy_demux_t *s_demuxers[ICY_DEMUX_MAX];
+static audio_element_handle_t s_active = NULL;
+// guards titles and s_active, which the tune and reader tasks share
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static icy_demux_t *find_demux(audio_element_handle_t el) {
+  for (int i = 0; i < ICY_DEMUX_MAX; i++) {
+    if (s_demuxers[i] && s_demuxers[i]->el == el) {
+      return s_demuxers[i];
+    }
+  }
+  return NULL;
+}
+
+static void finish_meta(icy_demux_t *d) {
+  d->meta[d->meta_len] = '\0';
+  const char *start = strstr(d->meta, ICY_KEY);
+  if (start == NULL) {
+    return;
+  }
+  start += ICY_KEY_LEN;
+  // titles may contain quotes, the field ends at the quote before ';'
+  const char *end = strstr(start, "';");
+  if (end == NULL) {
+    end = strrchr(start, '\'');
+  }
+  size_t len = end ? (size_t)(end - start) : strlen(start);
+  if (len >= ICY_TITLE_MAX) {
+    len = ICY_TITLE_MAX - 1;
+  }
+
+  char title[ICY_TITLE_MAX];
+  memcpy(title, start, len);
+  title[len] = '\0';
+
+  bool publish = false;
+  taskENTER_CRITICAL(&s_lock);
+  if (strcmp(title, d->title) != 0) {
+    strcpy(d->title, title);
+    publish = d->el == s_active && title[0] != '\0';
+  }
+  taskEXIT_CRITICAL(&s_lock);
+
+  if (publish) {
+    ESP_LOGI(TAG, "Now playing: %s", title);
+    update_now_playing(title);
+  }
+}
+
+// byte at body offset pos, which is in buffer or in the tail kept before it
+static char byte_at(const icy_demux_t *d, const char *buffer, int base,
+                    int pos) {
+  return pos >= base ? buffer[pos - base] : d->tail[d->tail_len - (base - pos)];
+}
+
+// Returns the body offset of ICY_KEY in the tail and buffer, or -1. The byte
+// before the key, the length byte, must be available too.
+static int find_key(const icy_demux_t *d, const char *buffer, int base,
+                    int len) {
+  // a key that starts in the tail and ends in the buffer
+  char window[2 * ICY_KEY_LEN];
+  int head = len < (int)ICY_KEY_LEN - 1 ? len : (int)ICY_KEY_LEN - 1;
+  memcpy(window, d->tail, d->tail_len);
+  memcpy(window + d->tail_len, buffer, head);
+  for (int w = 1; w < d->tail_len && w + (int)ICY_KEY_LEN <= d->tail_len + head;
+       w++) {
+    if (memcmp(window + w, ICY_KEY, ICY_KEY_LEN) == 0) {
+      return base - d->tail_len + w;
+    }
+  }
+
+  int i = 0;
+  while (i + (int)ICY_KEY_LEN <= len) {
+    const char *p = memchr(buffer + i, 'S', len - ICY_KEY_LEN - i + 1);
+    if (p == NULL) {
+      break;
+    }
+    i = p - buffer;
+    if (memcmp(p, ICY_KEY, ICY_KEY_LEN) == 0 && (i > 0 || d->tail_len > 0)) {
+      return base + i;
+    }
+    i++;
+  }
+  return -1;
+}
+
+static uint32_t uri_hash(const char *uri) {
+  uint32_t h = 2166136261u;
+  for (; uri && *uri; uri++) {
+    h = (h ^ (uint8_t)*uri) * 16777619u;
+  }
+  return h ? h : 1;
+}
+
+// Ends the search. Metadata that was found but never lined up is mixed into
+// the audio, so the connection is failed and the reconnect, which the event
+// loop makes for a failed source, asks for the stream without it.
+static int give_up(icy_demux_t *d, int len) {
+  d->state = ICY_OFF;
+  if (!d->seen_key) {
+    ESP_LOGD(TAG, "No ICY metadata in %s", audio_element_get_tag(d->el));
+    return len;
+  }
+  ESP_LOGW(TAG, "No ICY interval fits %s, reconnecting without metadata",
+           audio_element_get_tag(d->el));
+  d->plain_uri = uri_hash(audio_element_get_uri(d->el));
+  return AEL_IO_FAIL;
+}
+
+// Guesses the interval from the bytes between the last title block, or the
+// start of the body, and the one found at body offset block: that gap holds
+// k intervals of audio and k - 1 empty blocks of one length byte each.
+static void guess_intervals(icy_demux_t *d, int block, int block_end) {
+  int gap = block - d->since;
+  d->guess_count = 0;
+  for (int k = 1; k <= ICY_GUESS_MAX; k++) {
+    int metaint = (gap - (k - 1)) / k;
+    if ((gap - (k - 1)) % k != 0 || metaint < ICY_METAINT_MIN ||
+        metaint > ICY_METAINT_MAX) {
+      continue;
+    }
+    icy_guess_t *g = &d->guess[d->guess_count++];
+    *g = (icy_guess_t){.metaint = metaint,
+                       .block = block,
+                       .block_len = block_end - block - 1,
+                       .next = block_end + metaint,
+                       .title_at = -1};
+  }
+}
+
+// Whether a guess with a longer interval than g also has a boundary at pos.
+// Only the boundaries a guess does not share with its multiples tell it apart
+// from them, so only those confirm it.
+static bool shared_boundary(const icy_demux_t *d, const icy_guess_t *g,
+                            int pos) {
+  for (int i = 0; i < d->guess_count; i++) {
+    const icy_guess_t *h = &d->guess[i];
+    if (!h->rejected && h->metaint > g->metaint &&
+        (h->block == pos || h->next == pos)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Follows the guesses through body bytes [base, base + len) of data. Each
+// boundary a guess predicts must hold a length byte whose block, if any,
+// starts like a StreamTitle.
+static void follow_guesses(icy_demux_t *d, const char *data, int base,
+                           int len) {
+  int end = base + len;
+  for (int i = 0; i < d->guess_count; i++) {
+    icy_guess_t *g = &d->guess[i];
+    while (!g->rejected) {
+      if (g->title_at >= 0) {
+        if (g->title_at >= end) {
+          break;
+        }
+        if (data[g->title_at - base] != 'S') {
+          g->rejected = true;
+          break;
+        }
+        g->title_at = -1;
+      }
+      if (g->next >= end) {
+        break;
+      }
+      int n = (uint8_t)data[g->next - base] * 16;
+      if (!shared_boundary(d, g, g->next)) {
+        g->confirmed++;
+      }
+      g->block = g->next;
+      g->block_len = n;
+      g->title_at = n > 0 ? g->next + 1 : -1;
+      g->next += 1 + n + g->metaint;
+    }
+  }
+}
+
+// Keeps the guesses that predicted the title block found at body offset
+// block, returns how many did
+static int keep_guesses_at(icy_demux_t *d, int block) {
+  int kept = 0;
+  for (int i = 0; i < d->guess_count; i++) {
+    icy_guess_t *g = &d->guess[i];
+    if (g->rejected || g->block != block) {
+      g->rejected = true;
+    } else {
+      g->title_at = -1; // the search has seen the key
+      kept++;
+    }
+  }
+  return kept;
+}
+
+// Picks the smallest interval left, as larger multiples of it fit empty blocks
+// too, and locks once it is confirmed. end is the body offset the reads have
+// reached. Returns to searching when every guess failed.
+static void decide(icy_demux_t *d, int end) {
+  icy_guess_t *best = NULL;
+  for (int i = 0; i < d->guess_count; i++) {
+    icy_guess_t *g = &d->guess[i];
+    if (!g->rejected && (best == NULL || g->metaint < best->metaint)) {
+      best = g;
+    }
+  }
+  if (best == NULL) {
+    d->misses++;
+    d->state = ICY_SEARCHING;
+    return;
+  }
+  if (best->confirmed < ICY_CONFIRM || best->title_at >= 0) {
+    return;
+  }
+  // The last block it hit passed on as audio; skip what is left of it
+  d->metaint = best->metaint;
+  d->meta_len = 0;
+  d->meta_left = best->block + 1 + best->block_len - end;
+  if (d->meta_left > 0) {
+    d->audio_left = 0;
+  } else {
+    d->meta_left = 0;
+    d->audio_left = best->next - end;
+  }
+  ESP_LOGI(TAG, "%s has ICY metadata every %d bytes",
+           audio_element_get_tag(d->el), d->metaint);
+  d->state = ICY_LOCKED;
+}
+
+static void keep_tail(icy_demux_t *d, const char *buffer, int len) {
+  if (len >= (int)ICY_KEY_LEN) {
+    memcpy(d->tail, buffer + len - ICY_KEY_LEN, ICY_KEY_LEN);
+    d->tail_len = ICY_KEY_LEN;
+  } else {
+    int keep =
+        ICY_KEY_LEN - len < d->tail_len ? ICY_KEY_LEN - len : d->tail_len;
+    memmove(d->tail, d->tail + d->tail_len - keep, keep);
+    memcpy(d->tail + keep, buffer, len);
+    d->tail_len = keep + len;
+  }
+}
+
+// Scans data of a connection whose interval is not known yet. Removes a title
+// block from the buffer when it is found and returns the audio bytes left in
+// it. A block that starts in the previous read has its first few bytes
+// already passed on; the decoder skips them while resyncing. The interval
+// must be longer than a read, which every server's is.
+static int search(icy_demux_t *d, char *buffer, int len) {
+  int base = d->offset;
+  d->offset += len;
+
+  int key = find_key(d, buffer, base, len);
+  int meta_size =
+      key < 0 ? 0 : (uint8_t)byte_at(d, buffer, base, key - 1) * 16;
+  if (key < 0 || meta_size < (int)ICY_KEY_LEN) {
+    keep_tail(d, buffer, len);
+    if (d->state == ICY_VERIFYING) {
+      follow_guesses(d, buffer, base, len);
+      decide(d, base + len);
+    } else if (d->offset - d->since > ICY_SEARCH_LIMIT ||
+               d->misses >= ICY_MISS_MAX) {
+      return give_up(d, len);
+    }
+    return len;
+  }
+
+  d->seen_key = true;
+  int block = key - 1;
+  int block_end = key + meta_size;
+  // while verifying, a title block the guesses did not predict rules them out
+  if (d->state == ICY_VERIFYING) {
+    if (block >= base) {
+      follow_guesses(d, buffer, base, block + 1 - base);
+    }
+    if (keep_guesses_at(d, block) == 0) {
+      d->misses++;
+      d->state = ICY_SEARCHING;
+    }
+  }
+  if (d->state == ICY_SEARCHING) {
+    guess_intervals(d, block, block_end);
+    if (d->guess_count == 0) {
+      d->misses++;
+      d->since = block_end;
+      keep_tail(d, buffer, len);
+      return len; // search on from this block
+    }
+  }
+  d->since = block_end;
+  int avail_end = block_end < base + len ? block_end : base + len;
+  d->meta_len = 0;
+  for (int pos = key; pos < avail_end; pos++) {
+    d->meta[d->meta_len++] = byte_at(d, buffer, base, pos);
+  }
+  d->meta_left = meta_size - d->meta_len;
+
+  // The only copy of audio the demuxer makes: the tail of this one buffer.
+  int cut = (block > base ? block : base) - base;
+  int cut_end = avail_end - base;
+  memmove(buffer + cut, buffer + cut_end, len - cut_end);
+  len -= cut_end - cut;
+  d->tail_len = 0;
+
+  d->audio_left = 0;
+  d->state = ICY_VERIFYING;
+  if (d->meta_left == 0) {
+    finish_meta(d);
+    follow_guesses(d, buffer + cut, block_end, len - cut);
+    decide(d, block_end + len - cut);
+  }
+  return len;
+}
+
+// Adds r bytes of the current block, returns true once it is complete
+static bool add_meta(icy_demux_t *d, const char *buffer, int r) {
+  memcpy(d->meta + d->meta_len, buffer, r);
+  d->meta_len += r;
+  d->meta_left -= r;
+  if (d->meta_left > 0) {
+    return false;
+  }
+  finish_meta(d);
+  return true;
+}
+
+static int icy_read(audio_element_handle_t self, char *buffer, int len,
+                    TickType_t ticks_to_wait, void *context) {
+  icy_demux_t *d = find_demux(self);
+  // a read can never return 0 for "no audio", that marks the stream done
+  while (1) {
+    if (d->state == ICY_OFF) {
+      return d->read(self, buffer, len, ticks_to_wait, NULL);
+    }
+    uint32_t generation = d->generation;
+    int want = len;
+    if (d->state == ICY_LOCKED) {
+      if (d->audio_left > 0) {
+        want = len < d->audio_left ? len : d->audio_left;
+      } else if (d->meta_left > 0) {
+        want = len < d->meta_left ? len : d->meta_left;
+      } else {
+        want = 1; // the length byte
+      }
+    } else if (d->meta_left > 0) {
+      want = len < d->meta_left ? len : d->meta_left; // the title block
+    }
+    int r = d->read(self, buffer, want, ticks_to_wait, NULL);
+    if (r <= 0) {
+      return r;
+    }
+
+    // http_stream reconnects inside the read to follow a playlist
+    if (d->state == ICY_VERIFYING && d->meta_left > 0 &&
+        d->generation == generation) {
+      d->offset += r; // the rest of the title block that was found
+      add_meta(d, buffer, r);
+    } else if (d->state != ICY_LOCKED || d->generation != generation) {
+      r = search(d, buffer, r);
+      if (r != 0) {
+        return r;
+      }
+    } else if (d->audio_left > 0) {
+      d->audio_left -= r;
+      return r;
+    } else if (d->meta_left > 0) {
+      if (add_meta(d, buffer, r)) {
+        d->audio_left = d->metaint;
+      }
+    } else {
+      d->meta_len = 0;
+      d->meta_left = (uint8_t)buffer[0] * 16;
+      if (d->meta_left == 0) {
+        d->audio_left = d->metaint;
+      }
+    }
+  }
+}
+
+esp_err_t icy_demux_attach(audio_element_handle_t http_el) {
+  int slot = -1;
+  for (int i = 0; i < ICY_DEMUX_MAX; i++) {
+    if (s_demuxers[i] == NULL) {
+      slot = i;
+      break;
+    }
+  }
+  icy_demux_t *d = slot >= 0 ? calloc(1, sizeof(icy_demux_t)) : NULL;
+  if (d == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate ICY demuxer");
+    return ESP_ERR_NO_MEM;
+  }
+  d->el = http_el;
+  d->read = audio_element_get_read_cb(http_el);
+  if (d->read == NULL) {
+    ESP_LOGE(TAG, "Failed to attach ICY demuxer to %s",
+             audio_element_get_tag(http_el));
+    free(d);
+    return ESP_FAIL;
+  }
+  d->state = ICY_OFF;
+  s_demuxers[slot] = d;
+  return audio_element_set_read_cb(http_el, icy_read, NULL);
+}
+
+void icy_demux_detach(audio_element_handle_t http_el) {
+  for (int i = 0; i < ICY_DEMUX_MAX; i++) {
+    if (s_demuxers[i] && s_demuxers[i]->el == http_el) {
+      taskENTER_CRITICAL(&s_lock);
+      if (s_active == http_el) {
+        s_active = NULL;
+      }
+      taskEXIT_CRITICAL(&s_lock);
+      free(s_demuxers[i]);
+      s_demuxers[i] = NULL;
+      return;
+    }
+  }
+}
+
+void icy_demux_request(audio_element_handle_t http_el, void *http_client) {
+  icy_demux_t *d = find_demux(http_el);
+  if (d == NULL) {
+    return;
+  }
+  d->generation++;
+  d->state = ICY_OFF;
+  if (d->plain_uri != uri_hash(audio_element_get_uri(http_el))) {
+    d->plain_uri = 0;
+    esp_http_client_set_header((esp_http_client_handle_t)http_client,
+                               "Icy-MetaData", "1");
+    d->state = ICY_SEARCHING;
+  }
+  d->offset = 0;
+  d->since = 0;
+  d->seen_key = false;
+  d->misses = 0;
+  d->guess_count = 0;
+  d->tail_len = 0;
+  d->metaint = 0;
+  d->audio_left = 0;
+  d->meta_left = 0;
+  taskENTER_CRITICAL(&s_lock);
+  d->title[0] = '\0';
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+void icy_demux_set_active(audio_element_handle_t http_el) {
+  char title[ICY_TITLE_MAX] = {0};
+  taskENTER_CRITICAL(&s_lock);
+  s_active = http_el;
+  icy_demux_t *d = find_demux(http_el);
+  if (d) {
+    strcpy(title, d->title);
+  }
+  taskEXIT_CRITICAL(&s_lock);
+
+  // a pre-connected source may already know what is playing
+  if (title[0] != '\0') {
+    update_now_playing(title);
+  }
+}
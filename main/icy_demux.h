@@ -0,0 +1,46 @@
+#ifndef ICY_DEMUX_H
+#define ICY_DEMUX_H
+
+#include "audio_element.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Wraps the read callback of an HTTP stream reader so ICY metadata blocks
+     * are removed before the data reaches the next element. Must be attached before
+     * any other read wrapper, such as the codec probe.
+     * @param http_el The HTTP stream reader element.
+     * @return ESP_OK on success.
+     */
+    esp_err_t icy_demux_attach(audio_element_handle_t http_el);
+
+    /**
+     * @brief Frees the demuxer of an HTTP stream reader. Call before the element is
+     * deinitialized.
+     */
+    void icy_demux_detach(audio_element_handle_t http_el);
+
+    /**
+     * @brief Asks the server for ICY metadata and restarts the demuxer for the new
+     * connection. Call from the HTTP_STREAM_PRE_REQUEST hook. When the last
+     * connection to the same URI failed because its metadata could not be lined
+     * up, the stream is requested without metadata instead.
+     * @param http_el The HTTP stream reader element.
+     * @param http_client The esp_http_client handle of the request.
+     */
+    void icy_demux_request(audio_element_handle_t http_el, void* http_client);
+
+    /**
+     * @brief Selects the reader whose titles are shown. The last title the reader
+     * has seen, if any, is shown straight away.
+     */
+    void icy_demux_set_active(audio_element_handle_t http_el);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ICY_DEMUX_H
@@ -13,6 +13,7 @@
 #include "audio_event_iface.h"
 #include "audio_pipeline_manager.h"
 #include "board.h"
+#include "clock_drift.h"
 // #include "driver/gpio.h"
 #include "encoders.h"
 #include "esp_event.h"
@@ -23,16 +24,26 @@
 #include "esp_wifi.h"
 // #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "ir_rmt.h"
+#include "jitter_buffer.h"
 #include "lvgl_ssd1306_setup.h"
+#include "metadata.h"
+#include "metrics.h"
 #include "nvs_flash.h"
+#include "profiler.h"
+#include "recovery.h"
+#include "resampler.h"
 #include "screens.h"
 // #include "sdkconfig.h"
 #include "station_data.h"
+#include "stream_stats.h"
+#include "tune_timing.h"
 #include "web_server.h"
 #include "wifi_provisioning/manager.h"
 #include "wifi_provisioning/scheme_ble.h"
+#include <inttypes.h>
 #include <string.h>
 
 static const char *TAG = "INTERNET_RADIO";
@@ -45,6 +56,11 @@ static const char *TAG = "INTERNET_RADIO";
 #define BUTTON_POLLING_PERIOD_MS 100
 
 #define BITRATE_UPDATE_INTERVAL_MS 1000
+// source reconnect back-off, restarting from the base delay once a reconnect
+// has held for RECONNECT_RESET_US
+#define RECONNECT_BASE_DELAY_MS 500
+#define RECONNECT_MAX_DELAY_MS 8000
+#define RECONNECT_RESET_US (30 * 1000 * 1000)
 
 // oled screen with lvgl
 extern int station_count; // from station_data.c
@@ -60,12 +76,20 @@ static audio_event_iface_handle_t evt = NULL;
 static esp_periph_set_handle_t periph_set = NULL;
 rmt_channel_handle_t g_ir_tx_channel = NULL;
 
-volatile int g_bitrate_kbps = 0;
 // system monitor logging enable
 static bool g_enable_sys_monitor = true;
 // Button Handles
 static EventGroupHandle_t wifi_event_group;
 const int WIFI_CONNECTED_BIT = BIT0;
+// serializes tunes, source restarts and recovery on the pipeline
+static SemaphoreHandle_t s_stream_lock = NULL;
+// bumped under s_stream_lock whenever a tune or recovery replaces the source
+static uint32_t s_source_generation = 0;
+// access point of the last association, for a quick re-association
+static uint8_t s_ap_bssid[6];
+static uint8_t s_ap_channel = 0;
+static bool s_ap_cached = false;
+static bool s_ap_pinned = false;
 
 static void save_current_station_to_nvs(int station_index) {
   nvs_handle_t nvs_handle;
@@ -93,9 +117,61 @@ static void save_current_station_to_nvs(int station_index) {
   nvs_close(nvs_handle);
 }
 
-void change_station(int new_station_index) {
+void apply_station_dsp(int station_index) {
+#if CONFIG_RADIO_DSP
+  if (station_index == current_station && audio_pipeline_components.dsp) {
+    dsp_set_settings(audio_pipeline_components.dsp,
+                     &radio_stations[station_index].dsp);
+  }
+#endif
+}
+
+/**
+ * @brief (Re)starts the current station from uri, which is its own or its
+ * fallback. Without the standby pipeline the old pipeline is destroyed first.
+ */
+static esp_err_t play_current_station(const char *uri) {
   esp_err_t ret;
+#if CONFIG_RADIO_STANDBY_PIPELINE
+  // the probe can take seconds, so the decoder is picked before locking
+  codec_type_t codec =
+      probe_standby_audio_source(uri, radio_stations[current_station].codec);
+#endif
+  xSemaphoreTake(s_stream_lock, portMAX_DELAY);
+  s_source_generation++;
+#if CONFIG_RADIO_STANDBY_PIPELINE
+  ret = tune_standby_audio_pipeline(&audio_pipeline_components, codec, uri);
+  if (ret != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to tune standby pipeline to station %s, %s. Error: %d",
+             radio_stations[current_station].call_sign,
+             radio_stations[current_station].origin, ret);
+  }
+#else
+  ESP_LOGI(TAG, "Destroying current pipeline...");
+  destroy_audio_pipeline(&audio_pipeline_components);
+  ret = create_audio_pipeline(&audio_pipeline_components,
+                              radio_stations[current_station].codec, uri);
+  if (ret != ESP_OK) {
+    ESP_LOGE(
+        TAG,
+        "Failed to create new audio pipeline for station %s, %s. Error: %d",
+        radio_stations[current_station].call_sign,
+        radio_stations[current_station].origin, ret);
+  } else {
+    ESP_LOGI(TAG, "Starting new audio pipeline");
+    ret = audio_pipeline_run(audio_pipeline_components.pipeline);
+    if (ret != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to run new audio pipeline. Error: %d", ret);
+      destroy_audio_pipeline(&audio_pipeline_components);
+    }
+  }
+#endif
+  xSemaphoreGive(s_stream_lock);
+  apply_station_dsp(current_station);
+  return ret;
+}
 
+void change_station(int new_station_index) {
   if (new_station_index < 0 || new_station_index >= station_count) {
     ESP_LOGE(TAG, "Invalid station index: %d", new_station_index);
     return;
@@ -108,10 +184,12 @@ void change_station(int new_station_index) {
     return;
   }
 
-  ESP_LOGI(TAG, "Destroying current pipeline...");
-  destroy_audio_pipeline(&audio_pipeline_components);
+  tune_timing_begin(radio_stations[new_station_index].call_sign);
+  stream_stats_reset();
 
   current_station = new_station_index;
+  metrics_set_station(current_station,
+                      radio_stations[current_station].call_sign);
   ESP_LOGI(TAG, "Switching to station %d: %s, %s", current_station,
            radio_stations[current_station].call_sign,
            radio_stations[current_station].origin);
@@ -119,24 +197,67 @@ void change_station(int new_station_index) {
   save_current_station_to_nvs(current_station);
   update_station_name(radio_stations[current_station].call_sign);
   update_station_origin(radio_stations[current_station].origin);
+  metadata_set_station(&radio_stations[current_station]);
 
-  ret = create_audio_pipeline(&audio_pipeline_components,
-                              radio_stations[current_station].codec,
-                              radio_stations[current_station].uri);
-  if (ret != ESP_OK) {
-    ESP_LOGE(
-        TAG,
-        "Failed to create new audio pipeline for station %s, %s. Error: %d",
-        radio_stations[current_station].call_sign,
-        radio_stations[current_station].origin, ret);
+  play_current_station(radio_stations[current_station].uri);
+}
+
+void current_station_moved(int new_index) {
+  if (new_index == current_station) {
     return;
   }
+  current_station = new_index;
+  metrics_set_station(current_station,
+                      radio_stations[current_station].call_sign);
+  ESP_LOGI(TAG, "Playing station is now at index %d", current_station);
+  sync_station_encoder_index();
+  save_current_station_to_nvs(current_station);
+}
 
-  ESP_LOGI(TAG, "Starting new audio pipeline");
-  ret = audio_pipeline_run(audio_pipeline_components.pipeline);
-  if (ret != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to run new audio pipeline. Error: %d", ret);
-    destroy_audio_pipeline(&audio_pipeline_components);
+void prefetch_station(int station_index) {
+#if CONFIG_RADIO_STANDBY_PIPELINE
+  if (station_index < 0 || station_index >= station_count) {
+    return;
+  }
+  if (station_index == current_station) {
+    // scrolled back to the playing station, a warm connection is wasted
+    request_standby_preconnect(NULL, CODEC_TYPE_MP3);
+    return;
+  }
+  ESP_LOGI(TAG, "Prefetching highlighted station %s",
+           radio_stations[station_index].call_sign);
+  request_standby_preconnect(radio_stations[station_index].uri,
+                             radio_stations[station_index].codec);
+#endif
+}
+
+static void cache_ap_info(void) {
+  wifi_ap_record_t ap;
+  if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+    memcpy(s_ap_bssid, ap.bssid, sizeof(s_ap_bssid));
+    s_ap_channel = ap.primary;
+    s_ap_cached = true;
+  }
+}
+
+/**
+ * @brief Locks the station config to the cached BSSID and channel so a
+ * reconnect skips the scan, or releases it again. The config is saved to
+ * flash, so it must not stay pinned to an access point that may go away.
+ */
+static void pin_wifi_ap(bool pin) {
+  wifi_config_t cfg;
+  if (pin == s_ap_pinned || (pin && !s_ap_cached) ||
+      esp_wifi_get_config(WIFI_IF_STA, &cfg) != ESP_OK) {
+    return;
+  }
+  cfg.sta.bssid_set = pin;
+  cfg.sta.channel = pin ? s_ap_channel : 0;
+  if (pin) {
+    memcpy(cfg.sta.bssid, s_ap_bssid, sizeof(s_ap_bssid));
+  }
+  if (esp_wifi_set_config(WIFI_IF_STA, &cfg) == ESP_OK) {
+    s_ap_pinned = pin;
   }
 }
 
@@ -185,6 +306,8 @@ static void event_handler(void *arg, esp_event_base_t event_base,
   } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
     ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
     ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
+    cache_ap_info();
+    pin_wifi_ap(false); // a recovery re-association has done its job
     xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
   } else if (event_base == WIFI_EVENT &&
              event_id == WIFI_EVENT_STA_DISCONNECTED) {
@@ -210,18 +333,87 @@ static void get_device_service_name(char *service_name, size_t max) {
 #include "esp_timer.h" // Added for watchdog timer
 
 /**
- * @brief Task to measure and log the data throughput in kbps.
+ * @brief Runs one tier of the stall recovery ladder.
  */
-static void data_throughput_task(void *pvParameters) {
-#define BITRATE_HISTORY_SIZE 10
-  static int bitrate_history[BITRATE_HISTORY_SIZE] = {0};
-  static int history_index = 0;
-  static int consecutive_zero_count = 0;
+static void run_recovery_tier(recovery_tier_t tier) {
+  const char *fallback = radio_stations[current_station].fallback_uri;
+  if (tier != RECOVERY_TIER_WIFI) {
+    pin_wifi_ap(false); // the re-association did not get an address
+  }
+  switch (tier) {
+  case RECOVERY_TIER_RECONNECT:
+    xSemaphoreTake(s_stream_lock, portMAX_DELAY);
+    s_source_generation++;
+    restart_audio_source(&audio_pipeline_components);
+    xSemaphoreGive(s_stream_lock);
+    break;
+  case RECOVERY_TIER_REBUILD:
+    play_current_station(radio_stations[current_station].uri);
+    break;
+  case RECOVERY_TIER_WIFI:
+    pin_wifi_ap(true);
+    esp_wifi_disconnect(); // the disconnect handler connects again
+    break;
+  case RECOVERY_TIER_FALLBACK:
+    ESP_LOGW(TAG, "Switching %s to its fallback %s",
+             radio_stations[current_station].call_sign, fallback);
+    play_current_station(fallback);
+    break;
+  case RECOVERY_TIER_REBOOT:
+    ESP_LOGE(TAG, "Stream did not recover. Restarting...");
+    esp_restart();
+    break;
+  default:
+    break;
+  }
+}
+
+#if CONFIG_RADIO_DRIFT_COMPENSATION
+/**
+ * @brief Steers the resampling ratio so the jitter buffer holds the depth it
+ * settled at, whatever the offset between the stream and I2S clocks.
+ */
+static void track_clock_drift(void) {
+  static clock_drift_t drift;
+  static bool initialized = false;
+  static uint32_t last_underruns = 0;
+  static int last_station = -1;
+
+  if (!initialized) {
+    clock_drift_init(&drift);
+    initialized = true;
+  }
+
+  jitter_buffer_stats_t jb;
+  if (audio_pipeline_components.resampler == NULL ||
+      jitter_buffer_get_stats(audio_pipeline_components.jitter_buffer,
+                              &jb) != ESP_OK) {
+    return;
+  }
+  // the level after a tune or an underrun says nothing about the clocks
+  if (jb.buffering || jb.underruns != last_underruns ||
+      current_station != last_station) {
+    last_underruns = jb.underruns;
+    last_station = current_station;
+    clock_drift_restart(&drift);
+    return;
+  }
 
-  uint64_t last_bytes_read = 0;
-  uint64_t current_bytes_read;
-  uint64_t bytes_read_in_interval;
+  int prev_ppm = drift.ppm;
+  int ppm = clock_drift_update(&drift, jb.depth_ms,
+                               BITRATE_UPDATE_INTERVAL_MS / 1000.0f);
+  resampler_set_drift_ppm(audio_pipeline_components.resampler, ppm);
+  if (ppm != prev_ppm && ppm % 10 == 0) {
+    ESP_LOGI(TAG, "Clock drift: %d ppm, buffer %" PRIu32 " ms (setpoint %d)",
+             ppm, jb.depth_ms, (int)drift.setpoint_ms);
+  }
+}
+#endif
 
+/**
+ * @brief Task to measure and log the data throughput in kbps.
+ */
+static void data_throughput_task(void *pvParameters) {
   static uint64_t prev_idle_0 = 0;
   static uint64_t prev_idle_1 = 0;
   static uint64_t prev_total = 0;
@@ -229,28 +421,66 @@ static void data_throughput_task(void *pvParameters) {
   while (1) {
     vTaskDelay(pdMS_TO_TICKS(BITRATE_UPDATE_INTERVAL_MS));
 
-    current_bytes_read = g_bytes_read;
-    bytes_read_in_interval = current_bytes_read - last_bytes_read;
-    last_bytes_read = current_bytes_read;
-
-    // Calculate current bitrate and add to history
-    int current_bitrate =
-        (bytes_read_in_interval * 8) / BITRATE_UPDATE_INTERVAL_MS;
-    bitrate_history[history_index] = current_bitrate;
-    history_index = (history_index + 1) % BITRATE_HISTORY_SIZE;
-
-    // Calculate weighted moving average
-    long weighted_sum = 0;
-    int total_weight = 0;
-    for (int i = 0; i < BITRATE_HISTORY_SIZE; i++) {
-      int weight = i + 1; // Simple linear weight (1 for oldest, 10 for newest)
-      int data_index = (history_index + i) % BITRATE_HISTORY_SIZE;
-      weighted_sum += bitrate_history[data_index] * weight;
-      total_weight += weight;
+    uint32_t current_bitrate = stream_stats_tick(BITRATE_UPDATE_INTERVAL_MS);
+    update_bitrate_label((int)stream_stats_kbps());
+
+#if CONFIG_RADIO_DRIFT_COMPENSATION
+    track_clock_drift();
+#endif
+
+    metrics_sample_t sample = {0};
+    jitter_buffer_stats_t jb;
+    bool have_jb = jitter_buffer_get_stats(
+                       audio_pipeline_components.jitter_buffer, &jb) == ESP_OK;
+    if (have_jb) {
+      sample.jitter_depth_ms = jb.depth_ms;
+      sample.jitter_underruns = jb.underruns;
+      web_events_buffer(jb.depth_ms, jb.target_ms, jb.buffering);
     }
 
-    g_bitrate_kbps = weighted_sum / total_weight;
-    update_bitrate_label(g_bitrate_kbps);
+    // Core load, from the run time of the idle tasks
+    TaskStatus_t status;
+    vTaskGetInfo(xTaskGetIdleTaskHandleForCPU(0), &status, pdFALSE, eInvalid);
+    uint64_t idle_0 = status.ulRunTimeCounter;
+
+    vTaskGetInfo(xTaskGetIdleTaskHandleForCPU(1), &status, pdFALSE, eInvalid);
+    uint64_t idle_1 = status.ulRunTimeCounter;
+
+    uint64_t current_total_time = esp_timer_get_time();
+    float load_0 = 0;
+    float load_1 = 0;
+    bool have_load = false;
+
+    if (prev_total > 0) {
+      uint64_t total_diff = current_total_time - prev_total;
+      uint64_t idle_0_diff = idle_0 - prev_idle_0;
+      uint64_t idle_1_diff = idle_1 - prev_idle_1;
+
+      // Ensure we don't divide by zero or get negative load due to
+      // overflow/timing glitches
+      if (total_diff > 0) {
+        load_0 = 100.0f * (1.0f - ((float)idle_0_diff / total_diff));
+        load_1 = 100.0f * (1.0f - ((float)idle_1_diff / total_diff));
+
+        // Clamp to 0-100 range
+        if (load_0 < 0)
+          load_0 = 0;
+        else if (load_0 > 100)
+          load_0 = 100;
+        if (load_1 < 0)
+          load_1 = 0;
+        else if (load_1 > 100)
+          load_1 = 100;
+        have_load = true;
+      }
+    }
+
+    prev_idle_0 = idle_0;
+    prev_idle_1 = idle_1;
+    prev_total = current_total_time;
+    sample.core_load[0] = load_0 / 100;
+    sample.core_load[1] = load_1 / 100;
+    metrics_publish(&sample);
 
     if (g_enable_sys_monitor) {
       // monitoring ram usage.  remove this for production
@@ -261,61 +491,67 @@ static void data_throughput_task(void *pvParameters) {
       // Log RAM usage
       ESP_LOGI(TAG, "RAM: Used: %zu, Free: %zu, Total: %zu", used_ram, free_ram,
                total_ram);
-    }
 
-    if (g_enable_sys_monitor) {
-      // Core Load Monitoring
-      TaskStatus_t status;
-      vTaskGetInfo(xTaskGetIdleTaskHandleForCPU(0), &status, pdFALSE, eInvalid);
-      uint64_t idle_0 = status.ulRunTimeCounter;
-
-      vTaskGetInfo(xTaskGetIdleTaskHandleForCPU(1), &status, pdFALSE, eInvalid);
-      uint64_t idle_1 = status.ulRunTimeCounter;
-
-      uint64_t current_total_time = esp_timer_get_time();
-
-      if (prev_total > 0) {
-        uint64_t total_diff = current_total_time - prev_total;
-        uint64_t idle_0_diff = idle_0 - prev_idle_0;
-        uint64_t idle_1_diff = idle_1 - prev_idle_1;
-
-        // Ensure we don't divide by zero or get negative load due to
-        // overflow/timing glitches
-        if (total_diff > 0) {
-          float load_0 = 100.0f * (1.0f - ((float)idle_0_diff / total_diff));
-          float load_1 = 100.0f * (1.0f - ((float)idle_1_diff / total_diff));
-
-          // Clamp to 0-100 range
-          if (load_0 < 0)
-            load_0 = 0;
-          else if (load_0 > 100)
-            load_0 = 100;
-          if (load_1 < 0)
-            load_1 = 0;
-          else if (load_1 > 100)
-            load_1 = 100;
-
-          ESP_LOGI(TAG, "Core Load: Core 0: %.2f%%, Core 1: %.2f%%", load_0,
-                   load_1);
-        }
+      if (have_jb) {
+        ESP_LOGI(TAG,
+                 "Jitter buffer: %" PRIu32 " bytes (%" PRIu32
+                 " ms), target %" PRIu32 " ms, jitter %" PRIu32
+                 " ms, underruns %" PRIu32 "%s",
+                 jb.depth_bytes, jb.depth_ms, jb.target_ms, jb.jitter_ms,
+                 jb.underruns, jb.buffering ? ", buffering" : "");
       }
 
-      prev_idle_0 = idle_0;
-      prev_idle_1 = idle_1;
-      prev_total = current_total_time;
+      stream_stats_t st;
+      stream_stats_get(&st);
+      ESP_LOGI(TAG,
+               "Throughput: %" PRIu32 " kbps (avg %" PRIu32 ", p50 %" PRIu32
+               ", p95 %" PRIu32 ", min %" PRIu32 " over %" PRIu32 " s)",
+               st.last_kbps, st.ewma_kbps, st.p50_kbps, st.p95_kbps,
+               st.min_kbps, st.samples);
+
+      if (have_load) {
+        ESP_LOGI(TAG, "Core Load: Core 0: %.2f%%, Core 1: %.2f%%", load_0,
+                 load_1);
+      }
     }
 
-    // Watchdog check
-    if (current_bitrate == 0) {
-      consecutive_zero_count++;
-    } else {
-      consecutive_zero_count = 0;
+    // Watchdog check, escalating from a reconnect to a reboot
+    recovery_tier_t tier =
+        recovery_update(radio_stations[current_station].call_sign,
+                        current_bitrate == 0,
+                        radio_stations[current_station].fallback_uri != NULL);
+    if (tier != RECOVERY_TIER_NONE) {
+      metrics_count_recovery(tier);
+      run_recovery_tier(tier);
     }
+  }
+}
 
-    if (consecutive_zero_count >= 30) {
-      ESP_LOGE(TAG, "Watchdog triggered: 0 kbps for 30 consecutive seconds. "
-                    "Restarting...");
-      esp_restart();
+/**
+ * @brief Drops el's status reports from the event queue before a source
+ * restart. Those still queued describe the connection being replaced, so each
+ * would otherwise cost another restart. Events from other sources are posted
+ * back, in order, to the interface's internal queue, which only this loop
+ * reads. At most its capacity is taken out, so posting back never blocks; a
+ * longer backlog is left in place.
+ */
+static void drop_source_events(audio_event_iface_handle_t evt,
+                               audio_element_handle_t el) {
+  audio_event_iface_msg_t keep[DEFAULT_AUDIO_EVENT_IFACE_SIZE];
+  int kept = 0;
+  audio_event_iface_msg_t msg;
+  while (kept < DEFAULT_AUDIO_EVENT_IFACE_SIZE &&
+         audio_event_iface_listen(evt, &msg, 0) == ESP_OK) {
+    if (msg.source == (void *)el && msg.cmd == AEL_MSG_CMD_REPORT_STATUS) {
+      ESP_LOGD(TAG, "Dropping queued source status %d", (int)msg.data);
+      continue;
+    }
+    keep[kept++] = msg;
+  }
+  for (int i = 0; i < kept; i++) {
+    if (audio_event_iface_cmd(evt, &keep[i]) != ESP_OK) {
+      ESP_LOGW(TAG, "Lost queued event %d from %X", keep[i].cmd,
+               (int)keep[i].source);
     }
   }
 }
@@ -336,6 +572,14 @@ void app_main(void) {
   ESP_ERROR_CHECK(err);
 
   init_station_data();
+  recovery_init();
+  s_stream_lock = xSemaphoreCreateMutex();
+#if CONFIG_RADIO_PROFILER
+  if (profiler_init(CONFIG_RADIO_PROFILER_INTERVAL_MS,
+                    CONFIG_RADIO_PROFILER_SAMPLES) != ESP_OK) {
+    ESP_LOGW(TAG, "Pipeline profiler disabled");
+  }
+#endif
 
   nvs_handle_t nvs_handle;
   err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
@@ -417,6 +661,8 @@ void app_main(void) {
   screens_init(display);
   update_station_name(radio_stations[current_station].call_sign);
   update_station_origin(radio_stations[current_station].origin);
+  metrics_set_station(current_station,
+                      radio_stations[current_station].call_sign);
 
   // start oled display test task,  remove after debugging
   // xTaskCreate(task_test_ssd1306, "u8g2_task", 4096, NULL, 5, NULL);
@@ -479,6 +725,9 @@ void app_main(void) {
                       portMAX_DELAY);
   ESP_LOGI(TAG, "Wi-Fi Connected.");
   start_web_server();
+  if (metadata_init() != ESP_OK) {
+    ESP_LOGW(TAG, "Now playing polling disabled");
+  }
 
   // wifi_event_group = xEventGroupCreate();
 
@@ -571,6 +820,8 @@ void app_main(void) {
   ESP_LOGI(TAG, "Listening event from peripherals");
   audio_event_iface_set_listener(esp_periph_set_get_event_iface(periph_set),
                                  evt);
+  // and from the HTTP source, for reconnects
+  set_audio_source_listener(evt);
 
   ESP_LOGI(TAG, "Initializing IR RMT");
   g_ir_tx_channel = init_ir_rmt(IR_TX_GPIO_NUM);
@@ -580,9 +831,22 @@ void app_main(void) {
   ESP_LOGI(TAG, "Starting initial stream: %s, %s",
            radio_stations[current_station].call_sign,
            radio_stations[current_station].origin);
+  tune_timing_begin(radio_stations[current_station].call_sign);
+  metadata_set_station(&radio_stations[current_station]);
+#if CONFIG_RADIO_STANDBY_PIPELINE
+  err = init_standby_audio_pipeline(&audio_pipeline_components);
+  if (err == ESP_OK) {
+    codec_type_t codec =
+        probe_standby_audio_source(radio_stations[current_station].uri,
+                                   radio_stations[current_station].codec);
+    err = tune_standby_audio_pipeline(&audio_pipeline_components, codec,
+                                      radio_stations[current_station].uri);
+  }
+#else
   err = create_audio_pipeline(&audio_pipeline_components,
                               radio_stations[current_station].codec,
                               radio_stations[current_station].uri);
+#endif
   if (err != ESP_OK) {
     ESP_LOGE(TAG, "Failed to create initial audio pipeline, error: %d", err);
     // Cleanup before returning
@@ -593,9 +857,12 @@ void app_main(void) {
     // audio_board_deinit(board_handle); // If applicable
     return;
   }
+  apply_station_dsp(current_station);
 
+#if !CONFIG_RADIO_STANDBY_PIPELINE
   ESP_LOGI(TAG, "Start audio_pipeline");
   audio_pipeline_run(audio_pipeline_components.pipeline);
+#endif
 
   xTaskCreate(data_throughput_task, "data_throughput_task", 3 * 1024, NULL, 5,
               NULL);
@@ -604,6 +871,8 @@ void app_main(void) {
 
   init_encoders(board_handle, initial_volume, initial_mute, unmuted_volume);
 
+  int reconnect_attempts = 0;
+  int64_t last_reconnect_us = 0;
   while (1) {
     audio_event_iface_msg_t msg;
     esp_err_t ret = audio_event_iface_listen(evt, &msg, portMAX_DELAY);
@@ -614,21 +883,52 @@ void app_main(void) {
     ESP_LOGI(TAG, "Received event from element: %X, command: %d",
              (int)msg.source, msg.cmd);
 
-    /* restart stream when the first pipeline element (http_stream_reader in
-     * this case) receives stop event (caused by reading errors) */
+    /* reconnect the stream when the HTTP source fails or the server closes
+     * the connection. Only the source restarts; the decoder and I2S keep
+     * playing what is already buffered. */
     if (audio_pipeline_components.http_stream_reader &&
         msg.source_type == AUDIO_ELEMENT_TYPE_ELEMENT &&
         msg.source == (void *)audio_pipeline_components.http_stream_reader &&
         msg.cmd == AEL_MSG_CMD_REPORT_STATUS &&
-        (int)msg.data == AEL_STATUS_ERROR_OPEN) {
-      ESP_LOGW(TAG, "[ * ] Restart stream");
-      audio_pipeline_stop(audio_pipeline_components.pipeline);
-      audio_pipeline_wait_for_stop(audio_pipeline_components.pipeline);
-      audio_element_reset_state(audio_pipeline_components.codec_decoder);
-      audio_element_reset_state(audio_pipeline_components.i2s_stream_writer);
-      audio_pipeline_reset_ringbuffer(audio_pipeline_components.pipeline);
-      audio_pipeline_reset_items_state(audio_pipeline_components.pipeline);
-      audio_pipeline_run(audio_pipeline_components.pipeline);
+        ((int)msg.data == AEL_STATUS_ERROR_OPEN ||
+         (int)msg.data == AEL_STATUS_ERROR_INPUT ||
+         (int)msg.data == AEL_STATUS_ERROR_PROCESS ||
+         (int)msg.data == AEL_STATUS_ERROR_TIMEOUT ||
+         (int)msg.data == AEL_STATUS_STATE_FINISHED)) {
+      audio_element_handle_t failed = (audio_element_handle_t)msg.source;
+      uint32_t generation = s_source_generation;
+      int64_t now = esp_timer_get_time();
+      if (now - last_reconnect_us > RECONNECT_RESET_US) {
+        reconnect_attempts = 0;
+      }
+      if (reconnect_attempts > 0) {
+        // back off while the server stays unreachable
+        int delay_ms = RECONNECT_BASE_DELAY_MS << (reconnect_attempts - 1);
+        if (delay_ms > RECONNECT_MAX_DELAY_MS) {
+          delay_ms = RECONNECT_MAX_DELAY_MS;
+        }
+        vTaskDelay(pdMS_TO_TICKS(delay_ms));
+      }
+      xSemaphoreTake(s_stream_lock, portMAX_DELAY);
+      if (generation != s_source_generation ||
+          audio_pipeline_components.http_stream_reader != failed) {
+        // a tune or recovery replaced the source while we waited
+        xSemaphoreGive(s_stream_lock);
+        ESP_LOGI(TAG, "[ * ] Source replaced, dropping status %d",
+                 (int)msg.data);
+        continue;
+      }
+      // further reports queued so far belong to the connection that failed
+      drop_source_events(evt, failed);
+      if (reconnect_attempts < 16) {
+        reconnect_attempts++;
+      }
+      ESP_LOGW(TAG, "[ * ] Source status %d, reconnecting (attempt %d)",
+               (int)msg.data, reconnect_attempts);
+      metrics_count_reconnect();
+      restart_audio_source(&audio_pipeline_components);
+      xSemaphoreGive(s_stream_lock);
+      last_reconnect_us = esp_timer_get_time();
       continue;
     }
   }
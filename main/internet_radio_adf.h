@@ -11,4 +11,26 @@ extern "C" {
      */
     void change_station(int new_station_index);
 
+    /**
+     * @brief Follows the playing station to a new index after the list was
+     * edited, so recovery, the station encoder and the index saved in NVS
+     * stay on it. The stream is not touched.
+     * @param new_index The index the playing station has now.
+     */
+    void current_station_moved(int new_index);
+
+    /**
+     * @brief Starts connecting to a station highlighted in the roller so a
+     * following change_station() to it does not wait on DNS, TLS and buffering.
+     * @param station_index The index of the highlighted station.
+     */
+    void prefetch_station(int station_index);
+
+    /**
+     * @brief Applies a station's EQ and limiter settings to the output if the
+     * station is the one playing.
+     * @param station_index The index of the station whose settings changed.
+     */
+    void apply_station_dsp(int station_index);
+
 #endif // INTERNET_RADIO_ADF_H
\ No newline at end of file
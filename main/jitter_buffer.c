@@ -0,0 +1,289 @@
+#include "jitter_buffer.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h" // needed despite linter suggesting otherwise
+#include "freertos/task.h"
+#include "ringbuf.h"
+#include "tune_timing.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "JITTER_BUFFER";
+
+#define JB_BUFFER_LEN (4 * 1024)
+#define JB_POLL_MS 20
+// Byte rate assumed until the decoder has pulled data for a while (128 kbps)
+#define JB_DEFAULT_BYTE_RATE (128000 / 8)
+#define JB_RATE_WINDOW_US (1000 * 1000)
+// The arrival jitter estimate loses 1/16 of its value per rate window, so a
+// single stall keeps the target raised for roughly a minute.
+#define JB_JITTER_DECAY_SHIFT 4
+// Head room above prebuffer_ms, in multiples of the jitter estimate
+#define JB_JITTER_MULTIPLIER 2
+
+#define JB_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+typedef struct {
+  char *fifo; // PSRAM
+  int size;
+  int head; // next byte to read
+  int fill;
+  int prebuffer_ms;
+  int max_target_ms;
+
+  bool playing;
+  bool input_ended; // source finished or is being restarted
+  int64_t open_us;
+  int64_t last_arrival_us; // 0 until the first byte after open
+  uint32_t jitter_ms;
+
+  uint32_t byte_rate;
+  int64_t window_start_us;
+  uint32_t window_bytes;
+  // playing for the whole window without running dry; the window in which
+  // playback starts is never clean because it includes the output fill
+  bool window_clean;
+
+  uint32_t underruns;
+} jitter_buffer_t;
+
+static void fifo_push(jitter_buffer_t *jb, const char *data, int len) {
+  int tail = (jb->head + jb->fill) % jb->size;
+  int first = JB_MIN(len, jb->size - tail);
+  memcpy(jb->fifo + tail, data, first);
+  memcpy(jb->fifo, data + first, len - first);
+  jb->fill += len;
+}
+
+static void fifo_pop(jitter_buffer_t *jb, char *data, int len) {
+  int first = JB_MIN(len, jb->size - jb->head);
+  memcpy(data, jb->fifo + jb->head, first);
+  memcpy(data + first, jb->fifo, len - first);
+  jb->head = (jb->head + len) % jb->size;
+  jb->fill -= len;
+}
+
+static uint32_t target_ms(const jitter_buffer_t *jb) {
+  uint32_t target = jb->prebuffer_ms + JB_JITTER_MULTIPLIER * jb->jitter_ms;
+  return JB_MIN(target, (uint32_t)jb->max_target_ms);
+}
+
+static int target_bytes(const jitter_buffer_t *jb) {
+  int64_t bytes = (int64_t)target_ms(jb) * jb->byte_rate / 1000;
+  // never ask for more than fits alongside one input chunk
+  return (int)JB_MIN(bytes, (int64_t)(jb->size - JB_BUFFER_LEN));
+}
+
+static void note_arrival(jitter_buffer_t *jb, int64_t now) {
+  if (jb->last_arrival_us == 0) {
+    // the wait for the first byte is connection setup, not jitter
+    jb->last_arrival_us = now;
+    return;
+  }
+  uint32_t gap_ms = (now - jb->last_arrival_us) / 1000;
+  if (gap_ms > jb->jitter_ms) {
+    jb->jitter_ms = gap_ms;
+  }
+  jb->last_arrival_us = now;
+}
+
+static void update_rate(jitter_buffer_t *jb, int64_t now) {
+  if (now - jb->window_start_us < JB_RATE_WINDOW_US) {
+    return;
+  }
+  if (jb->window_clean) {
+    // while the decoder is never starved it pulls at the stream bitrate
+    uint32_t rate = (uint64_t)jb->window_bytes * 1000000 /
+                    (now - jb->window_start_us);
+    jb->byte_rate += ((int32_t)rate - (int32_t)jb->byte_rate) / 4;
+  }
+  jb->jitter_ms -= jb->jitter_ms >> JB_JITTER_DECAY_SHIFT;
+  jb->window_clean = jb->playing;
+  jb->window_bytes = 0;
+  jb->window_start_us = now;
+}
+
+static esp_err_t _jitter_open(audio_element_handle_t self) {
+  jitter_buffer_t *jb = (jitter_buffer_t *)audio_element_getdata(self);
+  int64_t now = esp_timer_get_time();
+  jb->head = 0;
+  jb->fill = 0;
+  jb->playing = false;
+  jb->input_ended = false;
+  jb->open_us = now;
+  jb->last_arrival_us = 0;
+  jb->jitter_ms = 0;
+  jb->byte_rate = JB_DEFAULT_BYTE_RATE;
+  jb->window_start_us = now;
+  jb->window_bytes = 0;
+  jb->window_clean = false;
+  return ESP_OK;
+}
+
+static esp_err_t _jitter_close(audio_element_handle_t self) {
+  jitter_buffer_t *jb = (jitter_buffer_t *)audio_element_getdata(self);
+  jb->fill = 0;
+  jb->playing = false;
+  return ESP_OK;
+}
+
+static esp_err_t _jitter_destroy(audio_element_handle_t self) {
+  jitter_buffer_t *jb = (jitter_buffer_t *)audio_element_getdata(self);
+  heap_caps_free(jb->fifo);
+  free(jb);
+  return ESP_OK;
+}
+
+static int _jitter_process(audio_element_handle_t self, char *in_buffer,
+                           int in_len) {
+  jitter_buffer_t *jb = (jitter_buffer_t *)audio_element_getdata(self);
+  int64_t now = esp_timer_get_time();
+  int moved = 0;
+  bool waited = false; // the input read already blocked for JB_POLL_MS
+
+  ringbuf_handle_t in_rb = audio_element_get_input_ringbuf(self);
+  int queued = in_rb ? rb_bytes_filled(in_rb) : 0;
+  int space = jb->size - jb->fill;
+  if (jb->input_ended && queued == 0) {
+    // reading would only report done or abort again until the source is
+    // restarted and its ring buffer reset
+  } else if (space == 0) {
+    // back-pressure on the source is not network jitter
+    if (jb->last_arrival_us) {
+      jb->last_arrival_us = now;
+    }
+  } else {
+    // With nothing queued, block on a single byte: a read that times out
+    // part way through would discard what it had already consumed.
+    int wanted = queued > 0 ? JB_MIN(queued, JB_MIN(in_len, space)) : 1;
+    int r = audio_element_input(self, in_buffer, wanted);
+    if (r > 0) {
+      fifo_push(jb, in_buffer, r);
+      note_arrival(jb, now);
+      jb->input_ended = false;
+      moved += r;
+    } else if (r == AEL_IO_TIMEOUT) {
+      waited = true;
+    } else {
+      // Done or aborted: the source finished, failed or is being
+      // restarted. Live streams do not end, so keep playing what is
+      // buffered until the source is back. Stopping this element arrives
+      // as a command to its task, not through the input.
+      jb->input_ended = true;
+    }
+  }
+
+  if (!jb->playing && jb->fill > 0 &&
+      (jb->fill >= target_bytes(jb) || jb->input_ended)) {
+    jb->playing = true;
+    ESP_LOGI(TAG, "Prebuffered %d bytes (target %" PRIu32 " ms) in %d ms",
+             jb->fill, target_ms(jb), (int)((now - jb->open_us) / 1000));
+    tune_timing_mark(TUNE_STAGE_PREBUFFERED);
+  }
+
+  if (jb->playing) {
+    ringbuf_handle_t out_rb = audio_element_get_output_ringbuf(self);
+    int n = JB_MIN(rb_bytes_available(out_rb), JB_MIN(jb->fill, in_len));
+    if (n > 0) {
+      // sized to the free space, so the write cannot block
+      fifo_pop(jb, in_buffer, n);
+      int w = audio_element_output(self, in_buffer, n);
+      if (w < 0) {
+        return w;
+      }
+      jb->window_bytes += n;
+      moved += n;
+    } else if (jb->fill == 0) {
+      if (rb_bytes_filled(out_rb) == 0) {
+        jb->underruns++;
+        jb->playing = false;
+        jb->window_clean = false;
+        jb->open_us = now;
+        ESP_LOGW(TAG, "Underrun %" PRIu32 ", rebuffering to %" PRIu32 " ms",
+                 jb->underruns, target_ms(jb));
+      }
+    }
+  }
+
+  update_rate(jb, now);
+
+  if (moved == 0) {
+    if (!waited) {
+      // FIFO and output both full, or no source, do not spin
+      vTaskDelay(pdMS_TO_TICKS(JB_POLL_MS));
+    }
+    return AEL_IO_TIMEOUT;
+  }
+  return moved;
+}
+
+audio_element_handle_t jitter_buffer_init(jitter_buffer_cfg_t *cfg) {
+  if (cfg == NULL || cfg->fifo_size <= JB_BUFFER_LEN) {
+    ESP_LOGE(TAG, "Invalid jitter buffer configuration");
+    return NULL;
+  }
+
+  jitter_buffer_t *jb = calloc(1, sizeof(jitter_buffer_t));
+  if (jb == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate jitter buffer state");
+    return NULL;
+  }
+  jb->fifo =
+      heap_caps_malloc(cfg->fifo_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (jb->fifo == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate %d byte jitter buffer in PSRAM",
+             cfg->fifo_size);
+    free(jb);
+    return NULL;
+  }
+  jb->size = cfg->fifo_size;
+  jb->prebuffer_ms = cfg->prebuffer_ms;
+  jb->max_target_ms = cfg->max_target_ms;
+  jb->byte_rate = JB_DEFAULT_BYTE_RATE;
+
+  audio_element_cfg_t el_cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+  el_cfg.open = _jitter_open;
+  el_cfg.close = _jitter_close;
+  el_cfg.process = _jitter_process;
+  el_cfg.destroy = _jitter_destroy;
+  el_cfg.buffer_len = JB_BUFFER_LEN;
+  el_cfg.out_rb_size = cfg->out_rb_size;
+  el_cfg.task_stack = cfg->task_stack;
+  el_cfg.task_prio = cfg->task_prio;
+  el_cfg.task_core = cfg->task_core;
+  el_cfg.tag = "jitter";
+
+  audio_element_handle_t el = audio_element_init(&el_cfg);
+  if (el == NULL) {
+    ESP_LOGE(TAG, "Failed to initialize jitter buffer element");
+    heap_caps_free(jb->fifo);
+    free(jb);
+    return NULL;
+  }
+  audio_element_setdata(el, jb);
+  audio_element_set_input_timeout(el, pdMS_TO_TICKS(JB_POLL_MS));
+  ESP_LOGI(TAG, "Jitter buffer: %d KB in PSRAM, prebuffer %d ms, max %d ms",
+           cfg->fifo_size / 1024, cfg->prebuffer_ms, cfg->max_target_ms);
+  return el;
+}
+
+esp_err_t jitter_buffer_get_stats(audio_element_handle_t el,
+                                  jitter_buffer_stats_t *stats) {
+  if (el == NULL || stats == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  // fields are written by the element task only; a torn snapshot across
+  // fields is acceptable for logging
+  jitter_buffer_t *jb = (jitter_buffer_t *)audio_element_getdata(el);
+  stats->depth_bytes = jb->fill;
+  stats->byte_rate = jb->byte_rate;
+  stats->depth_ms =
+      jb->byte_rate ? (uint64_t)jb->fill * 1000 / jb->byte_rate : 0;
+  stats->target_ms = target_ms(jb);
+  stats->jitter_ms = jb->jitter_ms;
+  stats->underruns = jb->underruns;
+  stats->buffering = !jb->playing;
+  return ESP_OK;
+}
@@ -0,0 +1,69 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include "audio_element.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Configuration for the jitter buffer element.
+     */
+    typedef struct {
+        int fifo_size;      // bytes of compressed audio held in PSRAM
+        int prebuffer_ms;   // minimum depth before playback starts or resumes
+        int max_target_ms;  // cap on the adaptive target depth
+        int out_rb_size;
+        int task_stack;
+        int task_prio;
+        int task_core;
+    } jitter_buffer_cfg_t;
+
+#define JITTER_BUFFER_CFG_DEFAULT() {                              \
+        .fifo_size = CONFIG_RADIO_JITTER_BUFFER_SIZE_KB * 1024,    \
+        .prebuffer_ms = CONFIG_RADIO_JITTER_PREBUFFER_MS,          \
+        .max_target_ms = CONFIG_RADIO_JITTER_MAX_TARGET_MS,        \
+        .out_rb_size = 8 * 1024,                                   \
+        .task_stack = 3 * 1024,                                    \
+        .task_prio = 5,                                            \
+        .task_core = 0,                                            \
+    }
+
+    /**
+     * @brief Snapshot of the jitter buffer state.
+     */
+    typedef struct {
+        uint32_t depth_bytes;  // bytes currently buffered
+        uint32_t depth_ms;     // depth at the measured byte rate
+        uint32_t target_ms;    // depth required before playback (re)starts
+        uint32_t jitter_ms;    // decaying peak of the arrival gaps
+        uint32_t byte_rate;    // compressed bytes per second consumed downstream
+        uint32_t underruns;    // times the decoder ran dry since boot
+        bool buffering;        // waiting for target_ms before releasing data
+    } jitter_buffer_stats_t;
+
+    /**
+     * @brief Creates a jitter buffer element to sit between the HTTP source and the
+     * decoder. The FIFO is allocated in PSRAM.
+     * @return The element handle, or NULL on failure.
+     */
+    audio_element_handle_t jitter_buffer_init(jitter_buffer_cfg_t* cfg);
+
+    /**
+     * @brief Copies the current depth, target and underrun counters.
+     * @param el The jitter buffer element.
+     * @param stats Receives the snapshot.
+     * @return ESP_OK on success, ESP_ERR_INVALID_ARG if either argument is NULL.
+     */
+    esp_err_t jitter_buffer_get_stats(audio_element_handle_t el, jitter_buffer_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JITTER_BUFFER_H
@@ -0,0 +1,378 @@
+#include "json_sax.h"
+#include <stdlib.h>
+#include <string.h>
+
+// A byte at a time state machine, so a document can arrive in pieces of any
+// size and nothing but the json_sax_t is ever held. Strings and numbers are
+// collected in tok and handed to the callback whole.
+
+typedef enum {
+  ST_VALUE,   // a value, or ']' right after '['
+  ST_KEY,     // a member name, or '}' right after '{'
+  ST_COLON,
+  ST_AFTER,   // ',' or the end of the open container
+  ST_STRING,
+  ST_ESCAPE,
+  ST_UNICODE, // the hex digits of \uXXXX
+  ST_NUMBER,
+  ST_LITERAL,
+  ST_DONE,    // the top-level value is complete
+} sax_state_t;
+
+// long enough for any double, JSON does not limit the digits but nothing
+// this firmware reads needs more
+#define NUMBER_MAX 40
+
+void json_sax_init(json_sax_t *p, json_sax_cb_t cb, void *ctx) {
+  memset(p, 0, sizeof(*p));
+  p->cb = cb;
+  p->ctx = ctx;
+  p->err = ESP_OK;
+  p->state = ST_VALUE;
+}
+
+static bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static esp_err_t emit(json_sax_t *p, json_sax_event_t event,
+                      const json_sax_value_t *value) {
+  static const json_sax_value_t none = {0};
+  return p->cb(event, value ? value : &none, p->ctx);
+}
+
+static esp_err_t append(json_sax_t *p, const char *s, size_t n) {
+  if (p->tok_len + n > JSON_SAX_TOKEN_MAX) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(p->tok + p->tok_len, s, n);
+  p->tok_len += n;
+  return ESP_OK;
+}
+
+static esp_err_t append_utf8(json_sax_t *p, uint32_t cp) {
+  char u[4];
+  size_t n;
+  if (cp < 0x80) {
+    u[0] = (char)cp;
+    n = 1;
+  } else if (cp < 0x800) {
+    u[0] = (char)(0xC0 | cp >> 6);
+    u[1] = (char)(0x80 | (cp & 0x3F));
+    n = 2;
+  } else if (cp < 0x10000) {
+    u[0] = (char)(0xE0 | cp >> 12);
+    u[1] = (char)(0x80 | (cp >> 6 & 0x3F));
+    u[2] = (char)(0x80 | (cp & 0x3F));
+    n = 3;
+  } else {
+    u[0] = (char)(0xF0 | cp >> 18);
+    u[1] = (char)(0x80 | (cp >> 12 & 0x3F));
+    u[2] = (char)(0x80 | (cp >> 6 & 0x3F));
+    u[3] = (char)(0x80 | (cp & 0x3F));
+    n = 4;
+  }
+  return append(p, u, n);
+}
+
+static void value_done(json_sax_t *p) {
+  p->state = p->depth == 0 ? ST_DONE : ST_AFTER;
+  p->first = false;
+}
+
+static bool top_is_object(const json_sax_t *p) {
+  return p->depth > 0 && (p->in_object >> (p->depth - 1) & 1);
+}
+
+static esp_err_t open_container(json_sax_t *p, bool object) {
+  if (p->depth == JSON_SAX_DEPTH_MAX) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (object) {
+    p->in_object |= 1u << p->depth;
+  } else {
+    p->in_object &= ~(1u << p->depth);
+  }
+  p->depth++;
+  p->first = true;
+  p->state = object ? ST_KEY : ST_VALUE;
+  return emit(p, object ? JSON_SAX_OBJECT_START : JSON_SAX_ARRAY_START, NULL);
+}
+
+static esp_err_t close_container(json_sax_t *p, bool object) {
+  p->depth--;
+  value_done(p);
+  return emit(p, object ? JSON_SAX_OBJECT_END : JSON_SAX_ARRAY_END, NULL);
+}
+
+// -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool valid_number(const char *s) {
+  if (*s == '-') {
+    s++;
+  }
+  if (*s == '0') {
+    s++;
+  } else if (*s >= '1' && *s <= '9') {
+    while (*s >= '0' && *s <= '9') {
+      s++;
+    }
+  } else {
+    return false;
+  }
+  if (*s == '.') {
+    s++;
+    if (!(*s >= '0' && *s <= '9')) {
+      return false;
+    }
+    while (*s >= '0' && *s <= '9') {
+      s++;
+    }
+  }
+  if (*s == 'e' || *s == 'E') {
+    s++;
+    if (*s == '+' || *s == '-') {
+      s++;
+    }
+    if (!(*s >= '0' && *s <= '9')) {
+      return false;
+    }
+    while (*s >= '0' && *s <= '9') {
+      s++;
+    }
+  }
+  return *s == '\0';
+}
+
+static esp_err_t end_number(json_sax_t *p) {
+  p->tok[p->tok_len] = '\0';
+  if (!valid_number(p->tok)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  json_sax_value_t v = {.str = p->tok, .len = p->tok_len,
+                        .number = strtod(p->tok, NULL)};
+  value_done(p);
+  return emit(p, JSON_SAX_NUMBER, &v);
+}
+
+static esp_err_t end_string(json_sax_t *p) {
+  if (p->hi_surrogate) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  p->tok[p->tok_len] = '\0';
+  json_sax_value_t v = {.str = p->tok, .len = p->tok_len};
+  if (p->key) {
+    p->state = ST_COLON;
+    return emit(p, JSON_SAX_KEY, &v);
+  }
+  value_done(p);
+  return emit(p, JSON_SAX_STRING, &v);
+}
+
+static esp_err_t end_unicode(json_sax_t *p) {
+  uint32_t code = p->code;
+  p->state = ST_STRING;
+  if (p->hi_surrogate) {
+    if (code < 0xDC00 || code > 0xDFFF) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    code = 0x10000 + ((uint32_t)(p->hi_surrogate - 0xD800) << 10) +
+           (code - 0xDC00);
+    p->hi_surrogate = 0;
+    return append_utf8(p, code);
+  }
+  if (code >= 0xD800 && code <= 0xDBFF) {
+    p->hi_surrogate = (uint16_t)code; // the low half must follow
+    return ESP_OK;
+  }
+  if ((code >= 0xDC00 && code <= 0xDFFF) || code == 0) {
+    return ESP_ERR_INVALID_ARG; // a lone low half, or a NUL in a C string
+  }
+  return append_utf8(p, code);
+}
+
+static esp_err_t start_value(json_sax_t *p, char c) {
+  switch (c) {
+  case '{':
+    return open_container(p, true);
+  case '[':
+    return open_container(p, false);
+  case ']':
+    if (p->first && !top_is_object(p)) {
+      return close_container(p, false);
+    }
+    return ESP_ERR_INVALID_ARG;
+  case '"':
+    p->key = false;
+    p->tok_len = 0;
+    p->state = ST_STRING;
+    return ESP_OK;
+  case 't':
+    p->lit = "rue";
+    p->lit_event = JSON_SAX_BOOL;
+    p->lit_value = true;
+    p->state = ST_LITERAL;
+    return ESP_OK;
+  case 'f':
+    p->lit = "alse";
+    p->lit_event = JSON_SAX_BOOL;
+    p->lit_value = false;
+    p->state = ST_LITERAL;
+    return ESP_OK;
+  case 'n':
+    p->lit = "ull";
+    p->lit_event = JSON_SAX_NULL;
+    p->state = ST_LITERAL;
+    return ESP_OK;
+  default:
+    if (c == '-' || (c >= '0' && c <= '9')) {
+      p->tok[0] = c;
+      p->tok_len = 1;
+      p->state = ST_NUMBER;
+      return ESP_OK;
+    }
+    return ESP_ERR_INVALID_ARG;
+  }
+}
+
+// *consumed is cleared when c ends a number and has to be looked at again
+static esp_err_t step(json_sax_t *p, char c, bool *consumed) {
+  *consumed = true;
+  switch ((sax_state_t)p->state) {
+  case ST_VALUE:
+    return is_space(c) ? ESP_OK : start_value(p, c);
+
+  case ST_KEY:
+    if (is_space(c)) {
+      return ESP_OK;
+    }
+    if (c == '"') {
+      p->key = true;
+      p->tok_len = 0;
+      p->state = ST_STRING;
+      return ESP_OK;
+    }
+    if (c == '}' && p->first) {
+      return close_container(p, true);
+    }
+    return ESP_ERR_INVALID_ARG;
+
+  case ST_COLON:
+    if (is_space(c)) {
+      return ESP_OK;
+    }
+    if (c != ':') {
+      return ESP_ERR_INVALID_ARG;
+    }
+    p->state = ST_VALUE;
+    p->first = false;
+    return ESP_OK;
+
+  case ST_AFTER:
+    if (is_space(c)) {
+      return ESP_OK;
+    }
+    if (c == ',') {
+      p->state = top_is_object(p) ? ST_KEY : ST_VALUE;
+      p->first = false;
+      return ESP_OK;
+    }
+    if (c == (top_is_object(p) ? '}' : ']')) {
+      return close_container(p, c == '}');
+    }
+    return ESP_ERR_INVALID_ARG;
+
+  case ST_STRING:
+    if (c == '"') {
+      return end_string(p);
+    }
+    if (c == '\\') {
+      p->state = ST_ESCAPE;
+      return ESP_OK;
+    }
+    if ((unsigned char)c < 0x20 || p->hi_surrogate) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    return append(p, &c, 1);
+
+  case ST_ESCAPE: {
+    static const char from[] = "\"\\/bfnrt";
+    static const char to[] = "\"\\/\b\f\n\r\t";
+    if (c == 'u') {
+      p->code = 0;
+      p->hex_left = 4;
+      p->state = ST_UNICODE;
+      return ESP_OK;
+    }
+    const char *e = c ? strchr(from, c) : NULL;
+    if (e == NULL || p->hi_surrogate) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    p->state = ST_STRING;
+    return append(p, &to[e - from], 1);
+  }
+
+  case ST_UNICODE: {
+    int digit;
+    if (c >= '0' && c <= '9') {
+      digit = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      return ESP_ERR_INVALID_ARG;
+    }
+    p->code = p->code << 4 | digit;
+    return --p->hex_left ? ESP_OK : end_unicode(p);
+  }
+
+  case ST_NUMBER:
+    if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' ||
+        c == 'e' || c == 'E') {
+      if (p->tok_len == NUMBER_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+      }
+      p->tok[p->tok_len++] = c;
+      return ESP_OK;
+    }
+    *consumed = false;
+    return end_number(p);
+
+  case ST_LITERAL:
+    if (c != *p->lit) {
+      return ESP_ERR_INVALID_ARG;
+    }
+    if (*++p->lit == '\0') {
+      json_sax_value_t v = {.boolean = p->lit_value};
+      value_done(p);
+      return emit(p, p->lit_event, &v);
+    }
+    return ESP_OK;
+
+  case ST_DONE:
+    return is_space(c) ? ESP_OK : ESP_ERR_INVALID_ARG;
+  }
+  return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t json_sax_feed(json_sax_t *p, const char *buf, size_t len) {
+  size_t i = 0;
+  while (i < len && p->err == ESP_OK) {
+    bool consumed;
+    p->err = step(p, buf[i], &consumed);
+    if (consumed) {
+      i++;
+    }
+  }
+  return p->err;
+}
+
+esp_err_t json_sax_finish(json_sax_t *p) {
+  if (p->err == ESP_OK && p->state == ST_NUMBER && p->depth == 0) {
+    p->err = end_number(p);
+  }
+  if (p->err == ESP_OK && p->state != ST_DONE) {
+    p->err = ESP_ERR_INVALID_ARG;
+  }
+  return p->err;
+}
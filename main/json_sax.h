@@ -0,0 +1,99 @@
+#ifndef JSON_SAX_H
+#define JSON_SAX_H
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Longest string, after unescaping, and deepest nesting the parser accepts
+#define JSON_SAX_TOKEN_MAX 512
+#define JSON_SAX_DEPTH_MAX 16
+
+    /**
+     * @brief What the parser found.
+     */
+    typedef enum {
+        JSON_SAX_OBJECT_START,
+        JSON_SAX_OBJECT_END,
+        JSON_SAX_ARRAY_START,
+        JSON_SAX_ARRAY_END,
+        JSON_SAX_KEY,    // object member name, in str
+        JSON_SAX_STRING, // in str
+        JSON_SAX_NUMBER, // in number
+        JSON_SAX_BOOL,   // in boolean
+        JSON_SAX_NULL,
+    } json_sax_event_t;
+
+    /**
+     * @brief A parsed token. str is NUL terminated UTF-8 and only valid during
+     * the callback.
+     */
+    typedef struct {
+        const char* str;
+        size_t len;
+        double number;
+        bool boolean;
+    } json_sax_value_t;
+
+    /**
+     * @brief Receives each token as soon as it is complete.
+     * @return ESP_OK to continue; anything else stops the parse and is
+     * returned by json_sax_feed().
+     */
+    typedef esp_err_t (*json_sax_cb_t)(json_sax_event_t event,
+                                       const json_sax_value_t* value, void* ctx);
+
+    /**
+     * @brief Parser state. Its size is fixed, however long the document is;
+     * treat the members as private.
+     */
+    typedef struct {
+        json_sax_cb_t cb;
+        void* ctx;
+        esp_err_t err;      // sticky
+        uint8_t state;
+        uint8_t depth;
+        uint8_t hex_left;
+        bool key;           // the string being read is a member name
+        bool first;         // no member or element yet in the open container
+        uint16_t hi_surrogate;
+        uint32_t code;
+        const char* lit;    // the rest of "true", "false" or "null"
+        json_sax_event_t lit_event;
+        bool lit_value;
+        uint32_t in_object; // bit per level, 1 for an object
+        size_t tok_len;
+        char tok[JSON_SAX_TOKEN_MAX + 1];
+    } json_sax_t;
+
+    /**
+     * @brief Starts a new document.
+     */
+    void json_sax_init(json_sax_t* p, json_sax_cb_t cb, void* ctx);
+
+    /**
+     * @brief Parses the next piece of the document. Tokens may be split
+     * anywhere between pieces.
+     * @return ESP_OK, ESP_ERR_INVALID_ARG on a syntax error,
+     * ESP_ERR_INVALID_SIZE on a string or nesting over the limits, or the
+     * error the callback returned. Feeding after an error returns it again.
+     */
+    esp_err_t json_sax_feed(json_sax_t* p, const char* buf, size_t len);
+
+    /**
+     * @brief Ends the document.
+     * @return ESP_OK if one complete value was read, ESP_ERR_INVALID_ARG if
+     * it was cut short.
+     */
+    esp_err_t json_sax_finish(json_sax_t* p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_SAX_H
@@ -0,0 +1,466 @@
+#include "loudness.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h" // needed despite linter suggesting otherwise
+#include "freertos/task.h"
+#include "nvs_flash.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "LOUDNESS";
+
+// Short-term loudness is the mean K-weighted power of the last 3 s, updated
+// every 100 ms block. Levels and gains are kept in hundredths of a dB (cLU,
+// cdB) so the control loop needs no floating point per sample.
+#define LD_BLOCK_MS 100
+#define LD_WINDOW_BLOCKS 30
+#define LD_MIN_WINDOW_BLOCKS 10 // meter settles for 1 s after a tune
+#define LD_BUFFER_LEN (2 * 1024)
+// K-weighting biquads: Q28 coefficients, signal with 8 fraction bits
+#define LD_COEF_BITS 28
+#define LD_FRAC_BITS 8
+#define LD_ENERGY_SHIFT 4 // squares of the signal shifted down to Q4
+// programme below the absolute gate or 10 LU under the learned level (fades,
+// talk between songs) does not move the learned level
+#define LD_GATE_ABS_CLU (-7000)
+#define LD_GATE_REL_CLU (-1000)
+// the learned level is a running mean over the last minute of programme; one
+// loaded from NVS counts as 30 s of it
+#define LD_TAU_BLOCKS 600
+#define LD_PRIOR_BLOCKS 300
+// it is kept with 8 fraction bits: in whole cLU a block 3 LU off would move a
+// mean over 600 blocks by less than 1 and the estimate would never reach it
+#define LD_EST_BITS 8
+#define LD_SAVE_MIN_BLOCKS 200
+#define LD_SAVE_DELTA_CLU 50
+#define LD_SLEW_CDB 50 // gain change per block while converging
+// applied gain: Q14 with 8 extra bits for the per frame ramp, +12 dB at most
+// so a sample times the gain fits 32 bits
+#define LD_GAIN_BITS 14
+#define LD_RAMP_BITS 8
+#define LD_MAX_BOOST_CDB 1200
+#define LD_NVS_NAMESPACE "loudness"
+
+typedef struct {
+  int32_t x1, x2; // shelf input
+  int32_t y1, y2; // shelf output, also the high-pass input
+  int32_t z1, z2; // high-pass output
+  int32_t e1, e2; // high-pass rounding errors, fed back
+} ld_channel_t;
+
+typedef struct {
+  int block_frames;
+  int target_clu;
+  int max_boost_cdb;
+  int max_cut_cdb;
+
+  // K-weighting: high shelf, then a high-pass whose zeros are b = 1, -2, 1
+  int32_t shelf_b0, shelf_b1, shelf_b2, shelf_a1, shelf_a2;
+  int32_t hp_a1, hp_a2;
+  ld_channel_t ch[2];
+
+  int block_pos;
+  int64_t block_energy;
+  int64_t window[LD_WINDOW_BLOCKS];
+  int64_t window_sum;
+  int window_len;
+  int window_next;
+
+  // station whose level is being learned, 0 for none
+  uint32_t station;
+  int32_t est_q; // learned level, cLU in Q(LD_EST_BITS)
+  int est_blocks;
+  int saved_clu;
+  bool has_saved;
+
+  int gain_cdb;
+  int32_t gain_q; // Q(LD_GAIN_BITS + LD_RAMP_BITS)
+  int32_t gain_step;
+
+  // written at tune time, taken by the element task
+  portMUX_TYPE lock;
+  bool pending;
+  uint32_t pending_station;
+  bool pending_found;
+  int pending_clu;
+
+  volatile bool bypass;
+  volatile float short_term;
+} loudness_t;
+
+static uint32_t uri_hash(const char *uri) {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (const char *p = uri; *p; p++) {
+    h = (h ^ (uint8_t)*p) * 16777619u;
+  }
+  return h ? h : 1;
+}
+
+static void nvs_key(uint32_t station, char *key, size_t len) {
+  snprintf(key, len, "ld%08" PRIx32, station);
+}
+
+static bool load_station_level(uint32_t station, int *clu) {
+  nvs_handle_t nvs_handle;
+  if (nvs_open(LD_NVS_NAMESPACE, NVS_READONLY, &nvs_handle) != ESP_OK) {
+    return false; // nothing saved yet
+  }
+  char key[16];
+  nvs_key(station, key, sizeof(key));
+  int16_t value;
+  esp_err_t err = nvs_get_i16(nvs_handle, key, &value);
+  nvs_close(nvs_handle);
+  if (err != ESP_OK) {
+    return false;
+  }
+  *clu = value;
+  return true;
+}
+
+static void save_station_level(uint32_t station, int clu) {
+  nvs_handle_t nvs_handle;
+  esp_err_t err = nvs_open(LD_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) opening NVS handle for loudness!",
+             esp_err_to_name(err));
+    return;
+  }
+  char key[16];
+  nvs_key(station, key, sizeof(key));
+  err = nvs_set_i16(nvs_handle, key, (int16_t)clu);
+  if (err == ESP_OK) {
+    err = nvs_commit(nvs_handle);
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Error (%s) saving loudness to NVS!", esp_err_to_name(err));
+  } else {
+    ESP_LOGI(TAG, "Saved station loudness %.1f LUFS", clu / 100.0);
+  }
+  nvs_close(nvs_handle);
+}
+
+// The learned level rounded to whole cLU
+static int est_clu(const loudness_t *ld) {
+  return (ld->est_q + (1 << (LD_EST_BITS - 1))) >> LD_EST_BITS;
+}
+
+// Saves the learned level when it is established and has moved since the
+// last save. Runs at tune time, so this never adds a flash write per volume
+// or per block.
+static void save_learned(loudness_t *ld) {
+  if (ld->station == 0 || ld->est_blocks < LD_SAVE_MIN_BLOCKS) {
+    return;
+  }
+  int clu = est_clu(ld);
+  if (ld->has_saved && abs(clu - ld->saved_clu) < LD_SAVE_DELTA_CLU) {
+    return;
+  }
+  save_station_level(ld->station, clu);
+  ld->saved_clu = clu;
+  ld->has_saved = true;
+}
+
+static int32_t q28(double v) { return (int32_t)lround(v * (1 << LD_COEF_BITS)); }
+
+// ITU-R BS.1770 K-weighting for any rate, from the analogue prototypes of
+// the 48 kHz coefficients in the standard
+static void build_k_filter(loudness_t *ld, int rate) {
+  double k = tan(M_PI * 1681.974450955533 / rate);
+  double q = 0.7071752369554196;
+  double vh = pow(10.0, 3.999843853973347 / 20.0);
+  double vb = pow(vh, 0.4996667741545416);
+  double a0 = 1.0 + k / q + k * k;
+  ld->shelf_b0 = q28((vh + vb * k / q + k * k) / a0);
+  ld->shelf_b1 = q28(2.0 * (k * k - vh) / a0);
+  ld->shelf_b2 = q28((vh - vb * k / q + k * k) / a0);
+  ld->shelf_a1 = q28(2.0 * (k * k - 1.0) / a0);
+  ld->shelf_a2 = q28((1.0 - k / q + k * k) / a0);
+
+  k = tan(M_PI * 38.13547087602444 / rate);
+  q = 0.5003270373238773;
+  a0 = 1.0 + k / q + k * k;
+  ld->hp_a1 = q28(2.0 * (k * k - 1.0) / a0);
+  ld->hp_a2 = q28((1.0 - k / q + k * k) / a0);
+}
+
+// Filters one channel of interleaved stereo and returns the sum of squares
+static int64_t meter_channel(const loudness_t *ld, ld_channel_t *c,
+                             const int16_t *pcm, int frames) {
+  const int64_t round = 1 << (LD_COEF_BITS - 1);
+  const int32_t mask = (1 << LD_COEF_BITS) - 1;
+  int32_t x1 = c->x1, x2 = c->x2, y1 = c->y1, y2 = c->y2, z1 = c->z1,
+          z2 = c->z2, e1 = c->e1, e2 = c->e2;
+  int64_t energy = 0;
+  for (int i = 0; i < frames; i++) {
+    int32_t x = (int32_t)pcm[2 * i] << LD_FRAC_BITS;
+    int64_t acc = (int64_t)ld->shelf_b0 * x + (int64_t)ld->shelf_b1 * x1 +
+                  (int64_t)ld->shelf_b2 * x2 - (int64_t)ld->shelf_a1 * y1 -
+                  (int64_t)ld->shelf_a2 * y2;
+    int32_t y = (int32_t)((acc + round) >> LD_COEF_BITS);
+    // The high-pass poles sit next to z = 1, where plain rounding leaves a
+    // DC limit cycle far above the gate. Feeding the truncation error back
+    // through (1 - z^-1)^2 cancels it.
+    acc = ((int64_t)(y - 2 * y1 + y2) << LD_COEF_BITS) -
+          (int64_t)ld->hp_a1 * z1 - (int64_t)ld->hp_a2 * z2 + 2 * e1 - e2;
+    int32_t z = (int32_t)(acc >> LD_COEF_BITS);
+    e2 = e1;
+    e1 = (int32_t)(acc & mask);
+    x2 = x1;
+    x1 = x;
+    y2 = y1;
+    y1 = y;
+    z2 = z1;
+    z1 = z;
+    int32_t s = z >> LD_ENERGY_SHIFT;
+    energy += (int64_t)s * s;
+  }
+  c->x1 = x1;
+  c->x2 = x2;
+  c->y1 = y1;
+  c->y2 = y2;
+  c->z1 = z1;
+  c->z2 = z2;
+  c->e1 = e1;
+  c->e2 = e2;
+  return energy;
+}
+
+static inline int16_t clamp16(int32_t v) {
+  return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v);
+}
+
+static void apply_gain(loudness_t *ld, int16_t *pcm, int frames) {
+  if (ld->gain_step == 0 &&
+      ld->gain_q == 1 << (LD_GAIN_BITS + LD_RAMP_BITS)) {
+    return; // unity
+  }
+  int32_t g = ld->gain_q;
+  for (int i = 0; i < frames; i++) {
+    int32_t gi = g >> LD_RAMP_BITS;
+    pcm[2 * i] = clamp16((pcm[2 * i] * gi) >> LD_GAIN_BITS);
+    pcm[2 * i + 1] = clamp16((pcm[2 * i + 1] * gi) >> LD_GAIN_BITS);
+    g += ld->gain_step;
+  }
+  ld->gain_q = g;
+}
+
+static int32_t gain_to_q(int cdb) {
+  return (int32_t)lrintf(powf(10.0f, cdb / 2000.0f) *
+                         (1 << (LD_GAIN_BITS + LD_RAMP_BITS)));
+}
+
+static int target_gain(const loudness_t *ld) {
+  int gain = ld->target_clu - est_clu(ld);
+  if (gain > ld->max_boost_cdb) {
+    gain = ld->max_boost_cdb;
+  } else if (gain < -ld->max_cut_cdb) {
+    gain = -ld->max_cut_cdb;
+  }
+  return gain;
+}
+
+static void reset_meter(loudness_t *ld) {
+  memset(ld->ch, 0, sizeof(ld->ch));
+  memset(ld->window, 0, sizeof(ld->window));
+  ld->window_sum = 0;
+  ld->window_len = 0;
+  ld->window_next = 0;
+  ld->block_pos = 0;
+  ld->block_energy = 0;
+  ld->short_term = -INFINITY;
+}
+
+static void apply_pending(loudness_t *ld) {
+  if (!ld->pending) {
+    return;
+  }
+  taskENTER_CRITICAL(&ld->lock);
+  uint32_t station = ld->pending_station;
+  bool found = ld->pending_found;
+  int clu = ld->pending_clu;
+  ld->pending = false;
+  taskEXIT_CRITICAL(&ld->lock);
+
+  reset_meter(ld);
+  ld->station = station;
+  ld->has_saved = found;
+  ld->saved_clu = clu;
+  if (found) {
+    // start at the station's level instead of converging audibly
+    ld->est_q = clu * (1 << LD_EST_BITS);
+    ld->est_blocks = LD_PRIOR_BLOCKS;
+    ld->gain_cdb = target_gain(ld);
+  } else {
+    ld->est_q = ld->target_clu * (1 << LD_EST_BITS);
+    ld->est_blocks = 0;
+    ld->gain_cdb = 0;
+  }
+  ld->gain_q = gain_to_q(ld->gain_cdb);
+  ld->gain_step = 0;
+  ESP_LOGI(TAG, "Station level %s, gain %.1f dB",
+           found ? "restored" : "unknown", ld->gain_cdb / 100.0);
+}
+
+// Updates the short-term loudness, the learned level and the gain ramp for
+// the next block
+static void end_block(loudness_t *ld) {
+  ld->window_sum += ld->block_energy - ld->window[ld->window_next];
+  ld->window[ld->window_next] = ld->block_energy;
+  ld->window_next = (ld->window_next + 1) % LD_WINDOW_BLOCKS;
+  if (ld->window_len < LD_WINDOW_BLOCKS) {
+    ld->window_len++;
+  }
+  ld->block_energy = 0;
+  ld->block_pos = 0;
+
+  // mean square relative to full scale, summed over both channels
+  double power = (double)ld->window_sum /
+                 ((double)ld->window_len * ld->block_frames) /
+                 (double)(1ULL << (2 * (15 + LD_FRAC_BITS - LD_ENERGY_SHIFT)));
+  float lufs = power > 0 ? -0.691f + 10.0f * log10f((float)power) : -INFINITY;
+  ld->short_term = lufs;
+
+  if (ld->window_len >= LD_MIN_WINDOW_BLOCKS && lufs * 100 > LD_GATE_ABS_CLU &&
+      (ld->est_blocks == 0 ||
+       lufs * 100 > est_clu(ld) + LD_GATE_REL_CLU)) {
+    int clu = (int)lrintf(lufs * 100);
+    if (ld->est_blocks < LD_TAU_BLOCKS) {
+      ld->est_blocks++;
+    }
+    ld->est_q += (clu * (1 << LD_EST_BITS) - ld->est_q) / ld->est_blocks;
+  }
+
+  int gain = ld->est_blocks > 0 ? target_gain(ld) : 0;
+  if (gain > ld->gain_cdb + LD_SLEW_CDB) {
+    gain = ld->gain_cdb + LD_SLEW_CDB;
+  } else if (gain < ld->gain_cdb - LD_SLEW_CDB) {
+    gain = ld->gain_cdb - LD_SLEW_CDB;
+  }
+  if (gain != ld->gain_cdb) {
+    int32_t next = gain_to_q(gain);
+    ld->gain_step = (next - ld->gain_q) / ld->block_frames;
+    ld->gain_cdb = gain;
+  } else {
+    // land exactly on the target after a ramp
+    ld->gain_q = gain_to_q(gain);
+    ld->gain_step = 0;
+  }
+}
+
+static esp_err_t _loudness_destroy(audio_element_handle_t self) {
+  loudness_t *ld = (loudness_t *)audio_element_getdata(self);
+  save_learned(ld);
+  free(ld);
+  return ESP_OK;
+}
+
+static int _loudness_process(audio_element_handle_t self, char *in_buffer,
+                             int in_len) {
+  loudness_t *ld = (loudness_t *)audio_element_getdata(self);
+  apply_pending(ld);
+
+  int r = audio_element_input(self, in_buffer, in_len);
+  if (r <= 0) {
+    return r;
+  }
+  if (!ld->bypass) {
+    // the resampler only writes whole stereo frames
+    int16_t *pcm = (int16_t *)in_buffer;
+    int frames = r / 4;
+    while (frames > 0) {
+      int n = ld->block_frames - ld->block_pos;
+      n = n < frames ? n : frames;
+      ld->block_energy += meter_channel(ld, &ld->ch[0], pcm, n) +
+                          meter_channel(ld, &ld->ch[1], pcm + 1, n);
+      apply_gain(ld, pcm, n);
+      ld->block_pos += n;
+      if (ld->block_pos == ld->block_frames) {
+        end_block(ld);
+      }
+      pcm += n * 2;
+      frames -= n;
+    }
+  }
+  return audio_element_output(self, in_buffer, r);
+}
+
+audio_element_handle_t loudness_init(loudness_cfg_t *cfg) {
+  if (cfg == NULL || cfg->rate <= 0 || cfg->max_boost_db < 0 ||
+      cfg->max_boost_db * 100 > LD_MAX_BOOST_CDB || cfg->max_cut_db < 0) {
+    ESP_LOGE(TAG, "Invalid loudness configuration");
+    return NULL;
+  }
+  loudness_t *ld = calloc(1, sizeof(loudness_t));
+  if (ld == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate loudness state");
+    return NULL;
+  }
+  ld->block_frames = cfg->rate * LD_BLOCK_MS / 1000;
+  ld->target_clu = cfg->target_lufs * 100;
+  ld->max_boost_cdb = cfg->max_boost_db * 100;
+  ld->max_cut_cdb = cfg->max_cut_db * 100;
+  ld->lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+  ld->est_q = ld->target_clu * (1 << LD_EST_BITS);
+  ld->gain_q = gain_to_q(0);
+  build_k_filter(ld, cfg->rate);
+  reset_meter(ld);
+
+  audio_element_cfg_t el_cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+  el_cfg.process = _loudness_process;
+  el_cfg.destroy = _loudness_destroy;
+  el_cfg.buffer_len = LD_BUFFER_LEN;
+  el_cfg.out_rb_size = cfg->out_rb_size;
+  el_cfg.task_stack = cfg->task_stack;
+  el_cfg.task_prio = cfg->task_prio;
+  el_cfg.task_core = cfg->task_core;
+  el_cfg.tag = "loudness";
+
+  audio_element_handle_t el = audio_element_init(&el_cfg);
+  if (el == NULL) {
+    ESP_LOGE(TAG, "Failed to initialize loudness element");
+    free(ld);
+    return NULL;
+  }
+  audio_element_setdata(el, ld);
+  ESP_LOGI(TAG, "Loudness: target %d LUFS, boost up to %d dB", cfg->target_lufs,
+           cfg->max_boost_db);
+  return el;
+}
+
+void loudness_set_station(audio_element_handle_t el, const char *uri) {
+  if (el == NULL || uri == NULL) {
+    return;
+  }
+  loudness_t *ld = (loudness_t *)audio_element_getdata(el);
+  save_learned(ld);
+
+  uint32_t station = uri_hash(uri);
+  int clu = 0;
+  bool found = load_station_level(station, &clu);
+  taskENTER_CRITICAL(&ld->lock);
+  ld->pending_station = station;
+  ld->pending_found = found;
+  ld->pending_clu = clu;
+  ld->pending = true;
+  taskEXIT_CRITICAL(&ld->lock);
+}
+
+void loudness_set_bypass(audio_element_handle_t el, bool bypass) {
+  if (el) {
+    loudness_t *ld = (loudness_t *)audio_element_getdata(el);
+    ld->bypass = bypass;
+  }
+}
+
+float loudness_get_short_term(audio_element_handle_t el) {
+  loudness_t *ld = (loudness_t *)audio_element_getdata(el);
+  return ld->short_term;
+}
+
+float loudness_get_gain_db(audio_element_handle_t el) {
+  loudness_t *ld = (loudness_t *)audio_element_getdata(el);
+  return ld->gain_cdb / 100.0f;
+}
@@ -0,0 +1,75 @@
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+
+#include "audio_element.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Configuration for the loudness element.
+     */
+    typedef struct {
+        int rate;           // input is 16-bit stereo at this rate
+        int target_lufs;    // short-term loudness every station is brought to
+        int max_boost_db;   // 0 to 12
+        int max_cut_db;
+        int out_rb_size;
+        int task_stack;
+        int task_prio;
+        int task_core;
+    } loudness_cfg_t;
+
+#define LOUDNESS_CFG_DEFAULT() {                                   \
+        .rate = CONFIG_RADIO_OUTPUT_SAMPLE_RATE,                   \
+        .target_lufs = CONFIG_RADIO_LOUDNESS_TARGET_LUFS,          \
+        .max_boost_db = CONFIG_RADIO_LOUDNESS_MAX_BOOST_DB,        \
+        .max_cut_db = 20,                                          \
+        .out_rb_size = 8 * 1024,                                   \
+        .task_stack = 3 * 1024,                                    \
+        .task_prio = 5,                                            \
+        .task_core = 1,                                            \
+    }
+
+    /**
+     * @brief Creates the loudness element. It meters the K-weighted short-term
+     * loudness (EBU R128, 3 s window) of 16-bit stereo PCM in fixed point and
+     * applies a slowly adapting gain that brings it to cfg->target_lufs.
+     * @return The element handle, or NULL on failure.
+     */
+    audio_element_handle_t loudness_init(loudness_cfg_t* cfg);
+
+    /**
+     * @brief Switches the element to a new station. The loudness learned for the
+     * previous station is saved to NVS when it has moved, and the one stored
+     * for uri is applied from the next block on, so known stations start at
+     * their level. Call at tune time, once the old station's audio is flushed.
+     */
+    void loudness_set_station(audio_element_handle_t el, const char* uri);
+
+    /**
+     * @brief Passes audio through unmetered while the input is not 16-bit
+     * stereo at the configured rate.
+     */
+    void loudness_set_bypass(audio_element_handle_t el, bool bypass);
+
+    /**
+     * @brief Returns the last short-term loudness in LUFS, or -INFINITY
+     * before the first block.
+     */
+    float loudness_get_short_term(audio_element_handle_t el);
+
+    /**
+     * @brief Returns the gain currently applied in dB.
+     */
+    float loudness_get_gain_db(audio_element_handle_t el);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOUDNESS_H
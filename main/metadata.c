@@ -0,0 +1,514 @@
+#include "metadata.h"
+#include "cJSON.h"
+#include "esp_heap_caps.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "screens.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *TAG = "METADATA";
+
+// The decoders run on core 1 at priority 5 and up; metadata is never urgent
+#define METADATA_TASK_STACK (6 * 1024)
+#define METADATA_TASK_PRIO 2
+#define METADATA_TASK_CORE 0
+
+#define METADATA_HTTP_TIMEOUT_MS 5000
+// a Spinitron page is ~100 KB, the current song is near the top
+#define METADATA_BODY_MAX (16 * 1024)
+#define METADATA_RANGE "bytes=0-16383" // METADATA_BODY_MAX - 1
+#define METADATA_CACHE_SIZE 8
+#define METADATA_TEXT_MAX 128
+#define METADATA_URI_MAX 256
+#define METADATA_VALIDATOR_MAX 64
+#define METADATA_RETRY_MAX_MS (5 * 60 * 1000)
+
+typedef bool (*metadata_parse_fn)(const char *body, const char *stream_uri,
+                                  char *out, size_t out_len);
+
+typedef struct {
+  const char *name;
+  int poll_ms;
+  bool ranged; // only the start of the document is needed
+  metadata_parse_fn parse;
+} metadata_driver_ops_t;
+
+typedef struct {
+  char call_sign[16];
+  metadata_driver_t driver;
+  char uri[METADATA_URI_MAX];        // metadata endpoint
+  char stream_uri[METADATA_URI_MAX]; // picks the mount on an Icecast server
+} metadata_station_t;
+
+typedef struct {
+  char call_sign[16]; // "" for a free slot
+  char text[METADATA_TEXT_MAX];
+  // validators from the last 200 response, sent back to get a 304
+  char etag[METADATA_VALIDATOR_MAX];
+  char last_modified[METADATA_VALIDATOR_MAX];
+  int64_t next_poll_us;
+  int64_t used_us; // least recently selected slot is reused
+  int failures;
+  bool unsupported; // the endpoint does not exist, stop asking
+} metadata_cache_entry_t;
+
+static bool parse_icecast(const char *body, const char *stream_uri, char *out,
+                          size_t out_len);
+static bool parse_kexp(const char *body, const char *stream_uri, char *out,
+                       size_t out_len);
+static bool parse_spinitron(const char *body, const char *stream_uri,
+                            char *out, size_t out_len);
+
+static const metadata_driver_ops_t s_drivers[META_DRIVER_NONE] = {
+    [META_DRIVER_ICECAST_JSON] = {"icecast", 15000, false, parse_icecast},
+    [META_DRIVER_KEXP_V2] = {"kexp", 15000, false, parse_kexp},
+    [META_DRIVER_SPINITRON] = {"spinitron", 30000, true, parse_spinitron},
+};
+
+static metadata_cache_entry_t s_cache[METADATA_CACHE_SIZE];
+// guards the cached text, which other tasks read
+static portMUX_TYPE s_cache_lock = portMUX_INITIALIZER_UNLOCKED;
+// single-slot mailbox, only the station tuned last matters
+static QueueHandle_t s_station_queue = NULL;
+
+// owned by the metadata task
+static esp_http_client_handle_t s_client = NULL;
+static char *s_body = NULL;
+static char s_resp_etag[METADATA_VALIDATOR_MAX];
+static char s_resp_last_modified[METADATA_VALIDATOR_MAX];
+
+static void copy_text(char *dst, size_t len, const char *src, size_t n) {
+  if (n >= len) {
+    n = len - 1;
+  }
+  memcpy(dst, src, n);
+  dst[n] = '\0';
+}
+
+static void join_artist_title(const char *artist, const char *title,
+                              char *out, size_t out_len) {
+  if (artist && artist[0] && title && title[0]) {
+    snprintf(out, out_len, "%s - %s", artist, title);
+  } else {
+    snprintf(out, out_len, "%s", title && title[0] ? title : artist);
+  }
+}
+
+static const char *json_string(const cJSON *obj, const char *key) {
+  const cJSON *item = cJSON_GetObjectItem(obj, key);
+  return cJSON_IsString(item) ? item->valuestring : NULL;
+}
+
+// path of a URI without the query, "/" if it has none
+static const char *uri_path(const char *uri) {
+  const char *p = strstr(uri, "://");
+  p = p ? p + 3 : uri;
+  p = strchr(p, '/');
+  return p ? p : "/";
+}
+
+static bool parse_icecast(const char *body, const char *stream_uri, char *out,
+                          size_t out_len) {
+  cJSON *root = cJSON_Parse(body);
+  cJSON *sources = cJSON_GetObjectItem(cJSON_GetObjectItem(root, "icestats"),
+                                       "source");
+  // a server with one mount sends an object instead of an array
+  const cJSON *match = cJSON_IsObject(sources) ? sources : NULL;
+  if (cJSON_IsArray(sources)) {
+    const char *mount = uri_path(stream_uri);
+    size_t mount_len = strcspn(mount, "?");
+    const cJSON *src;
+    cJSON_ArrayForEach(src, sources) {
+      const char *listen = json_string(src, "listenurl");
+      if (listen && strlen(uri_path(listen)) == mount_len &&
+          strncmp(uri_path(listen), mount, mount_len) == 0) {
+        match = src;
+        break;
+      }
+    }
+    if (match == NULL && cJSON_GetArraySize(sources) == 1) {
+      match = cJSON_GetArrayItem(sources, 0);
+    }
+  }
+
+  bool found = false;
+  const char *title = match ? json_string(match, "title") : NULL;
+  if (title && title[0]) {
+    join_artist_title(json_string(match, "artist"), title, out, out_len);
+    found = true;
+  }
+  cJSON_Delete(root);
+  return found;
+}
+
+static bool parse_kexp(const char *body, const char *stream_uri, char *out,
+                       size_t out_len) {
+  cJSON *root = cJSON_Parse(body);
+  const cJSON *play =
+      cJSON_GetArrayItem(cJSON_GetObjectItem(root, "results"), 0);
+  bool found = false;
+  if (play) {
+    const char *type = json_string(play, "play_type");
+    if (type && strcmp(type, "airbreak") == 0) {
+      snprintf(out, out_len, "Air break");
+      found = true;
+    } else if (json_string(play, "song")) {
+      join_artist_title(json_string(play, "artist"), json_string(play, "song"),
+                        out, out_len);
+      found = true;
+    }
+  }
+  cJSON_Delete(root);
+  return found;
+}
+
+// Copies the text of an HTML element up to the next tag, decoding the
+// entities playlist pages use and collapsing white space.
+static void html_text(const char *p, char *out, size_t out_len) {
+  static const struct {
+    const char *entity;
+    char c;
+  } entities[] = {{"&amp;", '&'},  {"&lt;", '<'},   {"&gt;", '>'},
+                  {"&quot;", '"'}, {"&#39;", '\''}, {"&#039;", '\''},
+                  {"&apos;", '\''}};
+  size_t n = 0;
+  bool space = false;
+  while (*p && *p != '<' && n + 1 < out_len) {
+    char c = *p++;
+    for (size_t i = 0; c == '&' && i < sizeof(entities) / sizeof(entities[0]);
+         i++) {
+      size_t len = strlen(entities[i].entity);
+      if (strncmp(p - 1, entities[i].entity, len) == 0) {
+        c = entities[i].c;
+        p += len - 1;
+      }
+    }
+    if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+      space = n > 0;
+      continue;
+    }
+    if (space && n + 2 < out_len) {
+      out[n++] = ' ';
+    }
+    space = false;
+    out[n++] = c;
+  }
+  out[n] = '\0';
+}
+
+// text of the first element with the given class at or after p
+static bool html_class_text(const char *p, const char *end, const char *cls,
+                            char *out, size_t out_len) {
+  char attr[48];
+  snprintf(attr, sizeof(attr), "class=\"%s\"", cls);
+  const char *at = strstr(p, attr);
+  if (at == NULL || at > end) {
+    return false;
+  }
+  const char *text = strchr(at, '>');
+  if (text == NULL) {
+    return false;
+  }
+  html_text(text + 1, out, out_len);
+  return out[0] != '\0';
+}
+
+static bool parse_spinitron(const char *body, const char *stream_uri,
+                            char *out, size_t out_len) {
+  // the newest spin is the first row of the playlist
+  const char *row = strstr(body, "current-song");
+  if (row == NULL) {
+    row = strstr(body, "spin-item");
+  }
+  if (row == NULL) {
+    return false;
+  }
+  size_t rest = strlen(row);
+  const char *end = row + (rest < 4096 ? rest : 4096);
+  char artist[METADATA_TEXT_MAX];
+  char song[METADATA_TEXT_MAX];
+  if (!html_class_text(row, end, "song", song, sizeof(song))) {
+    return false;
+  }
+  if (!html_class_text(row, end, "artist", artist, sizeof(artist))) {
+    artist[0] = '\0';
+  }
+  join_artist_title(artist, song, out, out_len);
+  return true;
+}
+
+// "scheme://host[:port]/status-json.xsl" for a stream URI
+static bool icecast_status_uri(const char *stream_uri, char *out,
+                               size_t out_len) {
+  const char *host = strstr(stream_uri, "://");
+  if (host == NULL) {
+    return false;
+  }
+  size_t prefix = (host + 3 - stream_uri) + strcspn(host + 3, "/?#");
+  return snprintf(out, out_len, "%.*s/status-json.xsl", (int)prefix,
+                  stream_uri) < (int)out_len;
+}
+
+static metadata_cache_entry_t *cache_find(const char *call_sign) {
+  for (int i = 0; i < METADATA_CACHE_SIZE; i++) {
+    if (strcmp(s_cache[i].call_sign, call_sign) == 0) {
+      return &s_cache[i];
+    }
+  }
+  return NULL;
+}
+
+static metadata_cache_entry_t *cache_select(const char *call_sign) {
+  metadata_cache_entry_t *entry = cache_find(call_sign);
+  if (entry == NULL) {
+    entry = &s_cache[0];
+    for (int i = 1; i < METADATA_CACHE_SIZE; i++) {
+      if (s_cache[i].used_us < entry->used_us) {
+        entry = &s_cache[i];
+      }
+    }
+    taskENTER_CRITICAL(&s_cache_lock);
+    memset(entry, 0, sizeof(*entry));
+    copy_text(entry->call_sign, sizeof(entry->call_sign), call_sign,
+              strlen(call_sign));
+    taskEXIT_CRITICAL(&s_cache_lock);
+  }
+  entry->used_us = esp_timer_get_time();
+  return entry;
+}
+
+static esp_err_t http_event_handler(esp_http_client_event_t *evt) {
+  if (evt->event_id != HTTP_EVENT_ON_HEADER) {
+    return ESP_OK;
+  }
+  if (strcasecmp(evt->header_key, "ETag") == 0) {
+    copy_text(s_resp_etag, sizeof(s_resp_etag), evt->header_value,
+              strlen(evt->header_value));
+  } else if (strcasecmp(evt->header_key, "Last-Modified") == 0) {
+    copy_text(s_resp_last_modified, sizeof(s_resp_last_modified),
+              evt->header_value, strlen(evt->header_value));
+  }
+  return ESP_OK;
+}
+
+static void set_optional_header(const char *key, const char *value) {
+  if (value && value[0]) {
+    esp_http_client_set_header(s_client, key, value);
+  } else {
+    esp_http_client_delete_header(s_client, key);
+  }
+}
+
+// Fetches the endpoint into s_body. Returns the HTTP status, or -1 when the
+// request failed. The connection is kept open for the next poll unless the
+// body was cut short.
+static int fetch(const metadata_station_t *station,
+                 const metadata_cache_entry_t *entry, bool ranged) {
+  if (s_client == NULL) {
+    esp_http_client_config_t cfg = {
+        .url = station->uri,
+        .timeout_ms = METADATA_HTTP_TIMEOUT_MS,
+        .event_handler = http_event_handler,
+        .keep_alive_enable = true,
+        .buffer_size = 2048,
+    };
+    s_client = esp_http_client_init(&cfg);
+    if (s_client == NULL) {
+      ESP_LOGE(TAG, "Failed to create HTTP client");
+      return -1;
+    }
+  } else if (esp_http_client_set_url(s_client, station->uri) != ESP_OK) {
+    // changing host drops the kept-alive connection
+    return -1;
+  }
+  esp_http_client_set_method(s_client, HTTP_METHOD_GET);
+  set_optional_header("If-None-Match", entry->etag);
+  set_optional_header("If-Modified-Since", entry->last_modified);
+  set_optional_header("Range",
+                      ranged ? METADATA_RANGE : NULL);
+  s_resp_etag[0] = '\0';
+  s_resp_last_modified[0] = '\0';
+
+  // the server may have dropped the kept-alive connection, reconnect once
+  bool opened = false;
+  for (int attempt = 0; attempt < 2 && !opened; attempt++) {
+    opened = esp_http_client_open(s_client, 0) == ESP_OK &&
+             esp_http_client_fetch_headers(s_client) >= 0;
+    if (!opened) {
+      esp_http_client_close(s_client);
+    }
+  }
+  if (!opened) {
+    return -1;
+  }
+  int status = esp_http_client_get_status_code(s_client);
+  int len = 0;
+  if (status == 200 || status == 206) {
+    int r;
+    while (len < METADATA_BODY_MAX &&
+           (r = esp_http_client_read(s_client, s_body + len,
+                                     METADATA_BODY_MAX - len)) > 0) {
+      len += r;
+    }
+  }
+  s_body[len] = '\0';
+  if (len >= METADATA_BODY_MAX) {
+    // the rest of the page is not needed, drop it with the connection
+    esp_http_client_close(s_client);
+  } else {
+    // drain what is left so the connection can be reused
+    esp_http_client_flush_response(s_client, NULL);
+  }
+  return status;
+}
+
+static void publish(const metadata_cache_entry_t *entry) {
+  char text[METADATA_TEXT_MAX];
+  taskENTER_CRITICAL(&s_cache_lock);
+  strcpy(text, entry->text);
+  taskEXIT_CRITICAL(&s_cache_lock);
+  if (text[0]) {
+    update_now_playing(text);
+  }
+}
+
+static void poll_station(const metadata_station_t *station,
+                         metadata_cache_entry_t *entry) {
+  const metadata_driver_ops_t *ops = &s_drivers[station->driver];
+  int64_t start = esp_timer_get_time();
+  int status = fetch(station, entry, ops->ranged);
+  int64_t now = esp_timer_get_time();
+  int next_ms = ops->poll_ms;
+
+  if (status == 304) {
+    ESP_LOGD(TAG, "%s unchanged", station->call_sign);
+    entry->failures = 0;
+  } else if (status == 200 || status == 206) {
+    char text[METADATA_TEXT_MAX];
+    if (ops->parse(s_body, station->stream_uri, text, sizeof(text))) {
+      bool changed;
+      taskENTER_CRITICAL(&s_cache_lock);
+      changed = strcmp(text, entry->text) != 0;
+      strcpy(entry->text, text);
+      taskEXIT_CRITICAL(&s_cache_lock);
+      strcpy(entry->etag, s_resp_etag);
+      strcpy(entry->last_modified, s_resp_last_modified);
+      entry->failures = 0;
+      ESP_LOGI(TAG, "%s (%s, %d ms): %s", station->call_sign, ops->name,
+               (int)((now - start) / 1000), text);
+      if (changed) {
+        publish(entry);
+      }
+    } else {
+      ESP_LOGW(TAG, "%s: no track in %s response", station->call_sign,
+               ops->name);
+      entry->failures++;
+    }
+  } else if (status == 404 || status == 410) {
+    ESP_LOGW(TAG, "%s: %s has no metadata endpoint", station->call_sign,
+             station->uri);
+    entry->unsupported = true;
+  } else {
+    ESP_LOGW(TAG, "%s: %s poll failed, status %d", station->call_sign,
+             ops->name, status);
+    entry->failures++;
+  }
+
+  // back off while a service is down
+  for (int i = 0; i < entry->failures && next_ms < METADATA_RETRY_MAX_MS;
+       i++) {
+    next_ms *= 2;
+  }
+  if (next_ms > METADATA_RETRY_MAX_MS) {
+    next_ms = METADATA_RETRY_MAX_MS;
+  }
+  entry->next_poll_us = now + (int64_t)next_ms * 1000;
+}
+
+static void metadata_task(void *pvParameters) {
+  metadata_station_t station = {0};
+  metadata_cache_entry_t *entry = NULL;
+  while (1) {
+    TickType_t wait = portMAX_DELAY;
+    if (entry && !entry->unsupported) {
+      int64_t due_us = entry->next_poll_us - esp_timer_get_time();
+      wait = due_us > 0 ? pdMS_TO_TICKS(due_us / 1000) + 1 : 0;
+    }
+    if (xQueueReceive(s_station_queue, &station, wait) == pdTRUE) {
+      entry = NULL;
+      if (station.driver < META_DRIVER_NONE && station.uri[0]) {
+        entry = cache_select(station.call_sign);
+        publish(entry); // may be a few seconds stale, better than nothing
+      }
+      continue;
+    }
+    if (entry && !entry->unsupported &&
+        esp_timer_get_time() >= entry->next_poll_us) {
+      poll_station(&station, entry);
+    }
+  }
+}
+
+esp_err_t metadata_init(void) {
+  if (s_station_queue) {
+    return ESP_OK;
+  }
+  s_body = heap_caps_malloc(METADATA_BODY_MAX + 1,
+                            MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  s_station_queue = xQueueCreate(1, sizeof(metadata_station_t));
+  if (s_body == NULL || s_station_queue == NULL ||
+      xTaskCreatePinnedToCore(metadata_task, "metadata_task",
+                              METADATA_TASK_STACK, NULL, METADATA_TASK_PRIO,
+                              NULL, METADATA_TASK_CORE) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to start metadata task");
+    if (s_station_queue) {
+      vQueueDelete(s_station_queue);
+      s_station_queue = NULL;
+    }
+    heap_caps_free(s_body);
+    s_body = NULL;
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+void metadata_set_station(const station_t *station) {
+  if (s_station_queue == NULL || station == NULL) {
+    return;
+  }
+  metadata_station_t request = {.driver = station->meta_driver};
+  copy_text(request.call_sign, sizeof(request.call_sign), station->call_sign,
+            strlen(station->call_sign));
+  copy_text(request.stream_uri, sizeof(request.stream_uri), station->uri,
+            strlen(station->uri));
+  if (request.driver >= META_DRIVER_NONE) {
+    // ICY titles only; still sent so polling of the old station stops
+  } else if (station->meta_uri) {
+    copy_text(request.uri, sizeof(request.uri), station->meta_uri,
+              strlen(station->meta_uri));
+  } else if (request.driver != META_DRIVER_ICECAST_JSON ||
+             !icecast_status_uri(station->uri, request.uri,
+                                 sizeof(request.uri))) {
+    request.driver = META_DRIVER_NONE;
+  }
+  xQueueOverwrite(s_station_queue, &request);
+}
+
+bool metadata_get_now_playing(const char *call_sign, char *buf, size_t len) {
+  bool found = false;
+  taskENTER_CRITICAL(&s_cache_lock);
+  metadata_cache_entry_t *entry = cache_find(call_sign);
+  if (entry && entry->text[0]) {
+    copy_text(buf, len, entry->text, strlen(entry->text));
+    found = true;
+  }
+  taskEXIT_CRITICAL(&s_cache_lock);
+  return found;
+}
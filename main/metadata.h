@@ -0,0 +1,39 @@
+#ifndef METADATA_H
+#define METADATA_H
+
+#include "esp_err.h"
+#include "station_data.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Starts the metadata task. It polls the "now playing" service of the
+     * current station and sends new text to the UI.
+     * @return ESP_OK on success.
+     */
+    esp_err_t metadata_init(void);
+
+    /**
+     * @brief Switches polling to a station. A cached result for the station is shown
+     * at once. The station is copied, so the caller may free it afterwards.
+     */
+    void metadata_set_station(const station_t* station);
+
+    /**
+     * @brief Copies the last "now playing" text polled for a station.
+     * @param call_sign Station call sign.
+     * @param[out] buf Destination buffer.
+     * @param len Size of buf.
+     * @return true if the station has a result in the cache.
+     */
+    bool metadata_get_now_playing(const char* call_sign, char* buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METADATA_H
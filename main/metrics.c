@@ -0,0 +1,195 @@
+#include "metrics.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h" // needed despite linter suggesting otherwise
+#include "freertos/task.h"
+#include "stream_stats.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// about 2.5 KB of text today
+#define METRICS_PAGE_SIZE 4096
+// a 15 character call sign with every character escaped
+#define METRICS_LABEL_MAX 32
+
+typedef struct {
+  char *buf;
+  size_t len;
+  bool overflow;
+} page_t;
+
+static char s_page[METRICS_PAGE_SIZE];
+
+static metrics_sample_t s_sample;
+static int s_station_index = -1;
+static char s_station_label[METRICS_LABEL_MAX] = "";
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static atomic_uint s_reconnects = 0;
+static atomic_uint s_recoveries[RECOVERY_TIER_COUNT];
+
+void metrics_publish(const metrics_sample_t *sample) {
+  taskENTER_CRITICAL(&s_lock);
+  s_sample = *sample;
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+void metrics_count_reconnect(void) {
+  atomic_fetch_add_explicit(&s_reconnects, 1, memory_order_relaxed);
+}
+
+void metrics_count_recovery(recovery_tier_t tier) {
+  if (tier < RECOVERY_TIER_COUNT) {
+    atomic_fetch_add_explicit(&s_recoveries[tier], 1, memory_order_relaxed);
+  }
+}
+
+void metrics_set_station(int index, const char *call_sign) {
+  // label values escape backslash, double quote and newline
+  char label[METRICS_LABEL_MAX];
+  size_t n = 0;
+  for (const char *c = call_sign ? call_sign : "";
+       *c && n + 2 < sizeof(label); c++) {
+    if (*c == '\\' || *c == '"' || *c == '\n') {
+      label[n++] = '\\';
+      label[n++] = *c == '\n' ? 'n' : *c;
+    } else {
+      label[n++] = *c;
+    }
+  }
+  label[n] = '\0';
+
+  taskENTER_CRITICAL(&s_lock);
+  s_station_index = index;
+  memcpy(s_station_label, label, sizeof(label));
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+static void append(page_t *p, const char *fmt, ...) {
+  if (p->overflow) {
+    return;
+  }
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(p->buf + p->len, METRICS_PAGE_SIZE - p->len, fmt, args);
+  va_end(args);
+  if (n < 0 || (size_t)n >= METRICS_PAGE_SIZE - p->len) {
+    p->overflow = true;
+    return;
+  }
+  p->len += n;
+}
+
+static void append_header(page_t *p, const char *name, const char *type,
+                          const char *help) {
+  append(p, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+typedef struct {
+  const char *region;
+  size_t total;
+  size_t free;
+  size_t min_free;
+} heap_region_t;
+
+// the lines of a metric family must be contiguous, so each family loops over
+// the regions
+static void append_heap(page_t *p, const heap_region_t *regions, int count,
+                        const char *name, const char *help, int field) {
+  append_header(p, name, "gauge", help);
+  for (int i = 0; i < count; i++) {
+    const heap_region_t *r = &regions[i];
+    size_t values[] = {r->total, r->free, r->total - r->free, r->min_free};
+    append(p, "%s{region=\"%s\"} %zu\n", name, r->region, values[field]);
+  }
+}
+
+const char *metrics_render(size_t *len) {
+  metrics_sample_t sample;
+  int station_index;
+  char station_label[METRICS_LABEL_MAX];
+  taskENTER_CRITICAL(&s_lock);
+  sample = s_sample;
+  station_index = s_station_index;
+  memcpy(station_label, s_station_label, sizeof(station_label));
+  taskEXIT_CRITICAL(&s_lock);
+  stream_stats_t st;
+  stream_stats_get(&st);
+
+  page_t p = {.buf = s_page, .len = 0, .overflow = false};
+
+  append_header(&p, "radio_uptime_seconds", "gauge", "Time since boot.");
+  append(&p, "radio_uptime_seconds %" PRId64 "\n",
+         esp_timer_get_time() / 1000000);
+
+  heap_region_t heap[] = {{.region = "internal"}, {.region = "psram"}};
+  const uint32_t heap_caps[] = {MALLOC_CAP_INTERNAL, MALLOC_CAP_SPIRAM};
+  for (int i = 0; i < 2; i++) {
+    heap[i].total = heap_caps_get_total_size(heap_caps[i]);
+    heap[i].free = heap_caps_get_free_size(heap_caps[i]);
+    heap[i].min_free = heap_caps_get_minimum_free_size(heap_caps[i]);
+  }
+  append_heap(&p, heap, 2, "radio_heap_size_bytes", "Heap size.", 0);
+  append_heap(&p, heap, 2, "radio_heap_free_bytes", "Free heap.", 1);
+  append_heap(&p, heap, 2, "radio_heap_used_bytes", "Allocated heap.", 2);
+  append_heap(&p, heap, 2, "radio_heap_min_free_bytes",
+              "Lowest free heap since boot.", 3);
+
+  append_header(&p, "radio_cpu_load_ratio", "gauge",
+                "Share of the last second a core was not idle.");
+  append(&p,
+         "radio_cpu_load_ratio{core=\"0\"} %.3f\n"
+         "radio_cpu_load_ratio{core=\"1\"} %.3f\n",
+         sample.core_load[0], sample.core_load[1]);
+
+  append_header(&p, "radio_stream_bitrate_kbps", "gauge",
+                "Stream rate over the last second.");
+  append(&p, "radio_stream_bitrate_kbps %" PRIu32 "\n", st.last_kbps);
+  append_header(&p, "radio_stream_bitrate_avg_kbps", "gauge",
+                "Stream rate averaged over about 10 s.");
+  append(&p, "radio_stream_bitrate_avg_kbps %" PRIu32 "\n", st.ewma_kbps);
+  append_header(&p, "radio_stream_received_bytes_total", "counter",
+                "Stream bytes received since boot.");
+  append(&p, "radio_stream_received_bytes_total %" PRIu64 "\n",
+         st.total_bytes);
+  append_header(&p, "radio_stream_stall_seconds", "gauge",
+                "Length of the stall in progress, 0 while data flows.");
+  append(&p, "radio_stream_stall_seconds %" PRIu32 "\n", st.stall_s);
+
+  append_header(&p, "radio_jitter_buffer_depth_ms", "gauge",
+                "Audio held in the jitter buffer.");
+  append(&p, "radio_jitter_buffer_depth_ms %" PRIu32 "\n",
+         sample.jitter_depth_ms);
+  append_header(&p, "radio_jitter_buffer_underruns_total", "counter",
+                "Times the decoder ran dry.");
+  append(&p, "radio_jitter_buffer_underruns_total %" PRIu32 "\n",
+         sample.jitter_underruns);
+
+  append_header(&p, "radio_reconnects_total", "counter",
+                "HTTP source restarts after a source error.");
+  append(&p, "radio_reconnects_total %u\n",
+         atomic_load_explicit(&s_reconnects, memory_order_relaxed));
+  append_header(&p, "radio_recovery_escalations_total", "counter",
+                "Stall recovery steps taken, by tier.");
+  for (int i = RECOVERY_TIER_RECONNECT; i < RECOVERY_TIER_COUNT; i++) {
+    append(&p, "radio_recovery_escalations_total{tier=\"%s\"} %u\n",
+           recovery_tier_name(i),
+           atomic_load_explicit(&s_recoveries[i], memory_order_relaxed));
+  }
+
+  append_header(&p, "radio_station_info", "gauge", "The tuned station.");
+  if (station_index >= 0) {
+    append(&p, "radio_station_info{index=\"%d\",call_sign=\"%s\"} 1\n",
+           station_index, station_label);
+  }
+
+  if (p.overflow) {
+    return NULL;
+  }
+  *len = p.len;
+  return s_page;
+}
@@ -0,0 +1,53 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "recovery.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Values sampled once a second by the throughput task.
+     */
+    typedef struct {
+        float core_load[2];       // 0 to 1, from the idle task run time
+        uint32_t jitter_depth_ms;
+        uint32_t jitter_underruns;
+    } metrics_sample_t;
+
+    /**
+     * @brief Publishes the latest periodic sample.
+     */
+    void metrics_publish(const metrics_sample_t* sample);
+
+    /**
+     * @brief Counts a restart of the HTTP source after it reported an error.
+     */
+    void metrics_count_reconnect(void);
+
+    /**
+     * @brief Counts a step of the stall recovery ladder.
+     */
+    void metrics_count_recovery(recovery_tier_t tier);
+
+    /**
+     * @brief Sets the station reported by radio_station_info.
+     */
+    void metrics_set_station(int index, const char* call_sign);
+
+    /**
+     * @brief Formats every metric in the Prometheus text format into a static
+     * buffer. Nothing is allocated. Call from the web server task only.
+     * @param len Receives the length of the text.
+     * @return The text, or NULL if it did not fit the buffer.
+     */
+    const char* metrics_render(size_t* len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_H
@@ -0,0 +1,556 @@
+#include "profiler.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h" // needed despite linter suggesting otherwise
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "ringbuf.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "PROFILER";
+
+#define PROFILER_TASK_STACK (3 * 1024)
+// above the pipeline tasks, so samples stay evenly spaced under load
+#define PROFILER_TASK_PRIO 10
+// standby sources, the reader of a created pipeline and the I2S writer, with
+// room for the elements of the previous pipeline
+#define PROFILER_IO_SLOTS 6
+// a blocked task counts as waiting on a ring buffer this close to empty/full
+#define PROFILER_RB_EMPTY_PCT 5
+#define PROFILER_RB_FULL_PCT 95
+#define PROFILER_TRACE_CHUNK 1024
+
+typedef enum { PE_HTTP, PE_CODEC, PE_I2S, PE_COUNT } profiled_element_t;
+
+static const char *const element_names[PE_COUNT] = {"http", "codec", "i2s"};
+
+typedef enum {
+  PS_NONE, // no element, or its task is not running
+  PS_BUSY, // running or ready to run
+  PS_WAIT_READ,
+  PS_WAIT_WRITE,
+  PS_WAIT, // blocked on anything else, e.g. paused
+  PS_COUNT
+} element_state_t;
+
+static const char *const state_names[PS_COUNT] = {
+    "none", "busy", "wait read", "wait write", "wait"};
+
+typedef struct {
+  uint16_t cpu_permille; // of one core
+  uint16_t io_permille;  // of the interval spent in the I/O callback
+  int8_t in_fill_pct;    // -1 without an input ring buffer
+  int8_t out_fill_pct;   // -1 without an output ring buffer
+  uint8_t state;
+} element_sample_t;
+
+typedef struct {
+  int64_t t_us;
+  element_sample_t el[PE_COUNT];
+  uint16_t decode_us; // CPU time per frame, 0 until known
+} sample_t;
+
+typedef struct {
+  audio_element_handle_t el;
+  stream_func io; // the element's own read or write callback
+  bool reader;
+  int64_t total_us; // time spent in finished calls
+  int64_t call_us;  // start of the call in progress, 0 between calls
+  uint32_t bytes;
+} io_slot_t;
+
+// sampler's view of one profiled element between samples
+typedef struct {
+  audio_element_handle_t el;
+  TaskHandle_t task;
+  uint32_t runtime; // run time counter, wraps
+  int64_t io_us;
+  uint32_t bytes;
+} tracker_t;
+
+static io_slot_t s_io[PROFILER_IO_SLOTS];
+static int s_next_io = 0;
+static portMUX_TYPE s_io_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// elements are only deinitialized after profiler_set_pipeline(NULL), which
+// waits for the sample in progress
+static SemaphoreHandle_t s_pipeline_lock = NULL;
+static audio_element_handle_t s_elements[PE_COUNT];
+static codec_type_t s_codec = CODEC_TYPE_MP3;
+
+static SemaphoreHandle_t s_ring_lock = NULL;
+static sample_t *s_ring = NULL;
+static int s_ring_size = 0;
+static int s_ring_count = 0;
+static int s_ring_next = 0;
+static int s_interval_ms = 0;
+
+// owned by the sampling task
+static tracker_t s_trackers[PE_COUNT];
+static uint32_t s_decode_cpu_us = 0;
+static uint32_t s_decode_bytes = 0;
+static uint16_t s_decode_us = 0;
+
+static io_slot_t *find_io(audio_element_handle_t el) {
+  for (int i = 0; i < PROFILER_IO_SLOTS; i++) {
+    if (s_io[i].el == el) {
+      return &s_io[i];
+    }
+  }
+  return NULL;
+}
+
+static int timed_io(audio_element_handle_t self, char *buffer, int len,
+                    TickType_t ticks_to_wait) {
+  io_slot_t *slot = find_io(self);
+  if (slot == NULL) {
+    return AEL_IO_FAIL;
+  }
+  int64_t start = esp_timer_get_time();
+  taskENTER_CRITICAL(&s_io_lock);
+  slot->call_us = start;
+  taskEXIT_CRITICAL(&s_io_lock);
+
+  int r = slot->io(self, buffer, len, ticks_to_wait, NULL);
+
+  int64_t end = esp_timer_get_time();
+  taskENTER_CRITICAL(&s_io_lock);
+  slot->total_us += end - start;
+  slot->call_us = 0;
+  if (r > 0) {
+    slot->bytes += r;
+  }
+  taskEXIT_CRITICAL(&s_io_lock);
+  return r;
+}
+
+static int timed_read(audio_element_handle_t self, char *buffer, int len,
+                      TickType_t ticks_to_wait, void *context) {
+  return timed_io(self, buffer, len, ticks_to_wait);
+}
+
+static int timed_write(audio_element_handle_t self, char *buffer, int len,
+                       TickType_t ticks_to_wait, void *context) {
+  return timed_io(self, buffer, len, ticks_to_wait);
+}
+
+esp_err_t profiler_attach_io(audio_element_handle_t el,
+                             audio_stream_type_t type) {
+  bool reader = type == AUDIO_STREAM_READER;
+  stream_func io = reader ? audio_element_get_read_cb(el)
+                          : audio_element_get_write_cb(el);
+  if (io == NULL) {
+    ESP_LOGE(TAG, "%s has no %s callback to time", audio_element_get_tag(el),
+             reader ? "read" : "write");
+    return ESP_FAIL;
+  }
+  taskENTER_CRITICAL(&s_io_lock);
+  // An element created where a freed one was would match the old slot, so
+  // that slot is taken over; otherwise a free one, or the oldest.
+  io_slot_t *slot = find_io(el);
+  if (slot == NULL) {
+    slot = find_io(NULL);
+  }
+  if (slot == NULL) {
+    slot = &s_io[s_next_io];
+    s_next_io = (s_next_io + 1) % PROFILER_IO_SLOTS;
+  }
+  memset(slot, 0, sizeof(*slot));
+  slot->el = el;
+  slot->io = io;
+  slot->reader = reader;
+  taskEXIT_CRITICAL(&s_io_lock);
+  return reader ? audio_element_set_read_cb(el, timed_read, NULL)
+                : audio_element_set_write_cb(el, timed_write, NULL);
+}
+
+void profiler_detach_io(audio_element_handle_t el) {
+  taskENTER_CRITICAL(&s_io_lock);
+  io_slot_t *slot = find_io(el);
+  if (slot) {
+    memset(slot, 0, sizeof(*slot));
+  }
+  taskEXIT_CRITICAL(&s_io_lock);
+}
+
+void profiler_set_pipeline(const audio_pipeline_components_t *components) {
+  if (s_pipeline_lock == NULL) {
+    return;
+  }
+  xSemaphoreTake(s_pipeline_lock, portMAX_DELAY);
+  if (components) {
+    s_elements[PE_HTTP] = components->http_stream_reader;
+    s_elements[PE_CODEC] = components->codec_decoder;
+    s_elements[PE_I2S] = components->i2s_stream_writer;
+    s_codec = components->codec_type;
+  } else {
+    memset(s_elements, 0, sizeof(s_elements));
+  }
+  xSemaphoreGive(s_pipeline_lock);
+}
+
+static int fill_pct(ringbuf_handle_t rb) {
+  int size = rb ? rb_get_size(rb) : 0;
+  if (size <= 0) {
+    return -1;
+  }
+  return (int)((int64_t)rb_bytes_filled(rb) * 100 / size);
+}
+
+static uint16_t permille(int64_t part_us, int64_t whole_us) {
+  if (whole_us <= 0 || part_us <= 0) {
+    return 0;
+  }
+  return part_us >= whole_us ? 1000 : (uint16_t)(part_us * 1000 / whole_us);
+}
+
+// Samples one element. Run time and I/O time are deltas since the previous
+// sample of the same element; *cpu_us and *bytes return them for the decode
+// time estimate.
+static void sample_element(int i, int64_t now, int64_t dt_us,
+                           element_sample_t *out, uint32_t *cpu_us,
+                           uint32_t *bytes) {
+  tracker_t *tr = &s_trackers[i];
+  audio_element_handle_t el = s_elements[i];
+  memset(out, 0, sizeof(*out));
+  out->in_fill_pct = -1;
+  out->out_fill_pct = -1;
+  *cpu_us = 0;
+  *bytes = 0;
+  if (el == NULL) {
+    tr->el = NULL;
+    return;
+  }
+
+  // element tasks are named after the element's tag
+  TaskHandle_t task = xTaskGetHandle(audio_element_get_tag(el));
+  out->in_fill_pct = fill_pct(audio_element_get_input_ringbuf(el));
+  out->out_fill_pct = fill_pct(audio_element_get_output_ringbuf(el));
+
+  int64_t io_us = 0;
+  uint32_t io_bytes = 0;
+  bool in_call = false;
+  bool reader = false;
+  taskENTER_CRITICAL(&s_io_lock);
+  io_slot_t *slot = find_io(el);
+  if (slot) {
+    in_call = slot->call_us != 0;
+    io_us = slot->total_us;
+    if (in_call && now > slot->call_us) {
+      io_us += now - slot->call_us;
+    }
+    io_bytes = slot->bytes;
+    reader = slot->reader;
+  }
+  taskEXIT_CRITICAL(&s_io_lock);
+
+  bool fresh = el != tr->el;
+  if (!fresh) {
+    out->io_permille = permille(io_us - tr->io_us, dt_us);
+    *bytes = io_bytes - tr->bytes;
+  }
+  tr->el = el;
+  tr->io_us = io_us;
+  tr->bytes = io_bytes;
+
+  if (task == NULL) {
+    tr->task = NULL;
+    return;
+  }
+  TaskStatus_t status;
+  vTaskGetInfo(task, &status, pdFALSE, eInvalid);
+  if (!fresh && task == tr->task) {
+    *cpu_us = status.ulRunTimeCounter - tr->runtime;
+    out->cpu_permille = permille(*cpu_us, dt_us);
+  }
+  tr->task = task;
+  tr->runtime = status.ulRunTimeCounter;
+
+  if (status.eCurrentState == eRunning || status.eCurrentState == eReady) {
+    out->state = PS_BUSY;
+  } else if (in_call) {
+    out->state = reader ? PS_WAIT_READ : PS_WAIT_WRITE;
+  } else if (out->in_fill_pct >= 0 &&
+             out->in_fill_pct <= PROFILER_RB_EMPTY_PCT) {
+    out->state = PS_WAIT_READ;
+  } else if (out->out_fill_pct >= PROFILER_RB_FULL_PCT) {
+    out->state = PS_WAIT_WRITE;
+  } else {
+    out->state = PS_WAIT;
+  }
+}
+
+static int frame_samples(codec_type_t codec) {
+  switch (codec) {
+  case CODEC_TYPE_MP3:
+    return 1152;
+  case CODEC_TYPE_FLAC:
+    return 4096; // the usual block size, streams may differ
+  default:
+    return 1024; // AAC; Vorbis blocks vary around this
+  }
+}
+
+// Decoder run time per frame, from its CPU time over the audio the I2S writer
+// played meanwhile. The decoder works in bursts as its output buffer drains,
+// so both are summed over at least a second of audio.
+static void update_decode_time(uint32_t codec_cpu_us, uint32_t i2s_bytes,
+                               bool changed) {
+  if (changed) {
+    s_decode_cpu_us = 0;
+    s_decode_bytes = 0;
+    s_decode_us = 0;
+  }
+  s_decode_cpu_us += codec_cpu_us;
+  s_decode_bytes += i2s_bytes;
+
+  audio_element_info_t out = {0};
+  audio_element_info_t in = {0};
+  audio_element_getinfo(s_elements[PE_I2S], &out);
+  audio_element_getinfo(s_elements[PE_CODEC], &in);
+  int64_t out_bytes_per_s =
+      (int64_t)out.sample_rates * out.channels * out.bits / 8;
+  if (out_bytes_per_s <= 0 || in.sample_rates <= 0 ||
+      s_decode_bytes < out_bytes_per_s) {
+    return;
+  }
+  int64_t us = (int64_t)s_decode_cpu_us * frame_samples(s_codec) *
+               out_bytes_per_s / ((int64_t)in.sample_rates * s_decode_bytes);
+  s_decode_us = us > UINT16_MAX ? UINT16_MAX : (uint16_t)us;
+  s_decode_cpu_us = 0;
+  s_decode_bytes = 0;
+}
+
+static void profiler_task(void *pvParameters) {
+  TickType_t wake = xTaskGetTickCount();
+  int64_t last_us = esp_timer_get_time();
+  audio_element_handle_t last_codec = NULL;
+  while (1) {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(s_interval_ms));
+
+    sample_t sample;
+    uint32_t cpu_us[PE_COUNT];
+    uint32_t bytes[PE_COUNT];
+    xSemaphoreTake(s_pipeline_lock, portMAX_DELAY);
+    int64_t now = esp_timer_get_time();
+    sample.t_us = now;
+    for (int i = 0; i < PE_COUNT; i++) {
+      sample_element(i, now, now - last_us, &sample.el[i], &cpu_us[i],
+                     &bytes[i]);
+    }
+    if (s_elements[PE_CODEC] && s_elements[PE_I2S]) {
+      update_decode_time(cpu_us[PE_CODEC], bytes[PE_I2S],
+                         s_elements[PE_CODEC] != last_codec);
+    }
+    last_codec = s_elements[PE_CODEC];
+    xSemaphoreGive(s_pipeline_lock);
+    sample.decode_us = last_codec ? s_decode_us : 0;
+    last_us = now;
+
+    xSemaphoreTake(s_ring_lock, portMAX_DELAY);
+    s_ring[s_ring_next] = sample;
+    s_ring_next = (s_ring_next + 1) % s_ring_size;
+    if (s_ring_count < s_ring_size) {
+      s_ring_count++;
+    }
+    xSemaphoreGive(s_ring_lock);
+  }
+}
+
+esp_err_t profiler_init(int interval_ms, int samples) {
+  if (s_ring) {
+    return ESP_OK;
+  }
+  if (interval_ms <= 0 || samples <= 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  s_ring = heap_caps_malloc(samples * sizeof(sample_t), MALLOC_CAP_SPIRAM);
+  s_pipeline_lock = xSemaphoreCreateMutex();
+  s_ring_lock = xSemaphoreCreateMutex();
+  if (s_ring == NULL || s_pipeline_lock == NULL || s_ring_lock == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate %d profiler samples", samples);
+    goto cleanup;
+  }
+  s_ring_size = samples;
+  s_interval_ms = interval_ms;
+  if (xTaskCreate(profiler_task, "profiler_task", PROFILER_TASK_STACK, NULL,
+                  PROFILER_TASK_PRIO, NULL) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to start profiler task");
+    goto cleanup;
+  }
+  ESP_LOGI(TAG, "Profiling every %d ms, keeping %d s", interval_ms,
+           interval_ms * samples / 1000);
+  return ESP_OK;
+
+cleanup:
+  if (s_pipeline_lock) {
+    vSemaphoreDelete(s_pipeline_lock);
+    s_pipeline_lock = NULL;
+  }
+  if (s_ring_lock) {
+    vSemaphoreDelete(s_ring_lock);
+    s_ring_lock = NULL;
+  }
+  heap_caps_free(s_ring);
+  s_ring = NULL;
+  s_ring_size = 0;
+  return ESP_FAIL;
+}
+
+typedef struct {
+  profiler_write_fn write;
+  void *ctx;
+  esp_err_t err;
+  bool first; // no event written yet, so no comma before the next
+  int len;
+  char buf[PROFILER_TRACE_CHUNK];
+} trace_writer_t;
+
+static void flush(trace_writer_t *w) {
+  if (w->err == ESP_OK && w->len > 0) {
+    w->err = w->write(w->buf, w->len, w->ctx);
+  }
+  w->len = 0;
+}
+
+// appends one event, or any other text when event is false
+static void emit(trace_writer_t *w, bool event, const char *fmt, ...) {
+  if (event) {
+    if (!w->first) {
+      emit(w, false, ",");
+    }
+    w->first = false;
+  }
+  for (int attempt = 0; attempt < 2; attempt++) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(w->buf + w->len, sizeof(w->buf) - w->len, fmt, args);
+    va_end(args);
+    if (n < (int)sizeof(w->buf) - w->len) {
+      w->len += n;
+      return;
+    }
+    flush(w); // did not fit, retry in an empty buffer
+  }
+}
+
+static void emit_counter(trace_writer_t *w, const char *name, int64_t t_us,
+                         const element_sample_t *s) {
+  char args[96];
+  int pos = snprintf(args, sizeof(args), "\"cpu %%\":%u.%u,\"io %%\":%u.%u",
+                     s->cpu_permille / 10, s->cpu_permille % 10,
+                     s->io_permille / 10, s->io_permille % 10);
+  if (s->in_fill_pct >= 0) {
+    pos += snprintf(args + pos, sizeof(args) - pos, ",\"in fill %%\":%d",
+                    s->in_fill_pct);
+  }
+  if (s->out_fill_pct >= 0) {
+    snprintf(args + pos, sizeof(args) - pos, ",\"out fill %%\":%d",
+             s->out_fill_pct);
+  }
+  emit(w, true,
+       "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%" PRId64
+       ",\"pid\":1,\"args\":{%s}}",
+       name, t_us, args);
+}
+
+static void emit_slice(trace_writer_t *w, int tid, uint8_t state,
+                       int64_t start_us, int64_t end_us) {
+  if (state == PS_NONE || end_us <= start_us) {
+    return;
+  }
+  emit(w, true,
+       "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%" PRId64 ",\"dur\":%" PRId64
+       ",\"pid\":1,\"tid\":%d}",
+       state_names[state], start_us, end_us - start_us, tid);
+}
+
+esp_err_t profiler_write_trace(profiler_write_fn write, void *ctx) {
+  if (s_ring == NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  // copy the ring so the sampler is not held up while the trace is sent
+  xSemaphoreTake(s_ring_lock, portMAX_DELAY);
+  int count = s_ring_count;
+  int first = (s_ring_next - count + s_ring_size) % s_ring_size;
+  sample_t *samples =
+      heap_caps_malloc((count ? count : 1) * sizeof(sample_t),
+                       MALLOC_CAP_SPIRAM);
+  if (samples) {
+    for (int n = 0; n < count; n++) {
+      samples[n] = s_ring[(first + n) % s_ring_size];
+    }
+  }
+  xSemaphoreGive(s_ring_lock);
+  if (samples == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  trace_writer_t *w = malloc(sizeof(trace_writer_t));
+  if (w == NULL) {
+    heap_caps_free(samples);
+    return ESP_ERR_NO_MEM;
+  }
+  w->write = write;
+  w->ctx = ctx;
+  w->err = ESP_OK;
+  w->first = true;
+  w->len = 0;
+
+  emit(w, false, "{\"displayTimeUnit\":\"ms\",\"otherData\":{"
+                 "\"interval_ms\":%d},\"traceEvents\":[",
+       s_interval_ms);
+  emit(w, true,
+       "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+       "\"args\":{\"name\":\"audio pipeline\"}}");
+  for (int i = 0; i < PE_COUNT; i++) {
+    emit(w, true,
+         "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+         "\"args\":{\"name\":\"%s\"}}",
+         i + 1, element_names[i]);
+  }
+
+  // counters, one event per element and sample
+  for (int n = 0; n < count && w->err == ESP_OK; n++) {
+    const sample_t *s = &samples[n];
+    for (int i = 0; i < PE_COUNT; i++) {
+      if (s->el[i].state != PS_NONE) {
+        emit_counter(w, element_names[i], s->t_us, &s->el[i]);
+      }
+    }
+    if (s->decode_us && (n == 0 || s->decode_us != samples[n - 1].decode_us)) {
+      emit(w, true,
+           "{\"name\":\"decode\",\"ph\":\"C\",\"ts\":%" PRId64
+           ",\"pid\":1,\"args\":{\"us per frame\":%u}}",
+           s->t_us, s->decode_us);
+    }
+  }
+
+  // each sample's state lasts until the next sample; equal states merge
+  for (int i = 0; i < PE_COUNT && w->err == ESP_OK; i++) {
+    int start = 0;
+    for (int n = 1; n < count; n++) {
+      if (samples[n].el[i].state != samples[start].el[i].state) {
+        emit_slice(w, i + 1, samples[start].el[i].state, samples[start].t_us,
+                   samples[n].t_us);
+        start = n;
+      }
+    }
+    if (count > 1) {
+      emit_slice(w, i + 1, samples[start].el[i].state, samples[start].t_us,
+                 samples[count - 1].t_us);
+    }
+  }
+
+  emit(w, false, "]}");
+  flush(w);
+  esp_err_t err = w->err;
+  free(w);
+  heap_caps_free(samples);
+  return err;
+}
@@ -0,0 +1,59 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "audio_common.h"
+#include "audio_element.h"
+#include "audio_pipeline_manager.h"
+#include "esp_err.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Receives the trace text in pieces.
+     * @return ESP_OK to continue, anything else aborts the export.
+     */
+    typedef esp_err_t (*profiler_write_fn)(const char* buf, size_t len, void* ctx);
+
+    /**
+     * @brief Allocates the sample ring in PSRAM and starts the sampling task.
+     * @param interval_ms Time between samples.
+     * @param samples Ring length; the trace covers interval_ms * samples.
+     */
+    esp_err_t profiler_init(int interval_ms, int samples);
+
+    /**
+     * @brief Times the element's callback I/O: the network read of an HTTP
+     * reader or the DMA write of an I2S writer. Call right after the element
+     * is created, before anything else wraps the callback.
+     * @param type AUDIO_STREAM_READER wraps the read callback, AUDIO_STREAM_WRITER
+     * the write callback.
+     */
+    esp_err_t profiler_attach_io(audio_element_handle_t el, audio_stream_type_t type);
+
+    /**
+     * @brief Frees the timing slot of an element. Call once the element has
+     * stopped and before it is deinitialized.
+     */
+    void profiler_detach_io(audio_element_handle_t el);
+
+    /**
+     * @brief Points the sampler at the HTTP source, decoder and I2S writer of
+     * the pipeline. Pass NULL before the elements are deinitialized; returns
+     * once no sample is using them.
+     */
+    void profiler_set_pipeline(const audio_pipeline_components_t* components);
+
+    /**
+     * @brief Writes the sample ring as Chrome trace event JSON, which Perfetto
+     * and chrome://tracing open directly.
+     */
+    esp_err_t profiler_write_trace(profiler_write_fn write, void* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,227 @@
+#include "recovery.h"
+#include "cJSON.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h" // needed despite linter suggesting otherwise
+#include "freertos/task.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "RECOVERY";
+
+#define RECOVERY_HISTORY_SIZE 16
+// seconds of data needed before a stall counts as fixed
+#define RECOVERY_HOLD_S 10
+// seconds a stall carried over a reboot may go on before the ladder restarts
+#define RECOVERY_GIVE_UP_S 60
+#define RECOVERY_REBOOT_MAGIC 0x52435652
+
+static const char *const tier_names[RECOVERY_TIER_COUNT] = {
+    "none", "reconnect", "rebuild", "wifi", "fallback", "reboot"};
+
+// seconds of stall before each tier runs; every tier gets time to show
+// results, the rebuild and fallback a prebuffer on top of the connection
+static const int tier_after_s[RECOVERY_TIER_COUNT] = {0, 10, 20, 35, 50, 80};
+
+static recovery_record_t s_history[RECOVERY_HISTORY_SIZE];
+static int s_count = 0;   // records in s_history
+static int s_current = 0; // index of the newest record
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// ladder state, only touched by recovery_update()
+static bool s_in_stall = false;
+static bool s_recorded = false; // the stall reached a tier and is in s_history
+static recovery_tier_t s_tier = RECOVERY_TIER_NONE;
+static char s_station[16];
+static int64_t s_stall_us = 0;
+static int s_stalled_s = 0;
+static int s_flowing_s = 0;
+static int64_t s_flow_us = 0;
+
+// survive esp_restart() so the reboot tier gets its outcome recorded
+static RTC_NOINIT_ATTR uint32_t s_reboot_magic;
+static RTC_NOINIT_ATTR recovery_record_t s_reboot_record;
+
+static void log_record(const recovery_record_t *rec) {
+  char line[128];
+  int pos = 0;
+  for (int i = RECOVERY_TIER_RECONNECT; i < RECOVERY_TIER_COUNT &&
+                                        pos < sizeof(line);
+       i++) {
+    if (rec->tier_ms[i] >= 0) {
+      pos += snprintf(line + pos, sizeof(line) - pos, " %s %" PRId32,
+                      tier_names[i], rec->tier_ms[i]);
+    }
+  }
+  if (rec->recovered_ms >= 0) {
+    ESP_LOGI(TAG, "Stall on %s fixed by %s after %" PRId32 " ms (ms:%s)",
+             rec->station, tier_names[rec->fixed_by], rec->recovered_ms, line);
+  } else {
+    ESP_LOGW(TAG, "Stall on %s abandoned (ms:%s)", rec->station, line);
+  }
+}
+
+static void push_record(void) {
+  taskENTER_CRITICAL(&s_lock);
+  s_current = (s_current + 1) % RECOVERY_HISTORY_SIZE;
+  if (s_count < RECOVERY_HISTORY_SIZE) {
+    s_count++;
+  }
+  recovery_record_t *rec = &s_history[s_current];
+  memset(rec, 0, sizeof(*rec));
+  memcpy(rec->station, s_station, sizeof(rec->station));
+  rec->stall_us = s_stall_us;
+  for (int i = 0; i < RECOVERY_TIER_COUNT; i++) {
+    rec->tier_ms[i] = -1;
+  }
+  rec->recovered_ms = -1;
+  taskEXIT_CRITICAL(&s_lock);
+  s_recorded = true;
+}
+
+static void end_stall(bool recovered) {
+  if (s_recorded) {
+    recovery_record_t done;
+    taskENTER_CRITICAL(&s_lock);
+    recovery_record_t *rec = &s_history[s_current];
+    if (recovered) {
+      rec->recovered_ms = (int32_t)((s_flow_us - s_stall_us) / 1000);
+      rec->fixed_by = s_tier;
+    }
+    done = *rec;
+    taskEXIT_CRITICAL(&s_lock);
+    log_record(&done);
+  }
+  s_in_stall = false;
+  s_recorded = false;
+  s_tier = RECOVERY_TIER_NONE;
+}
+
+void recovery_init(void) {
+  if (s_reboot_magic == RECOVERY_REBOOT_MAGIC &&
+      esp_reset_reason() == ESP_RST_SW) {
+    // continue the stall on this boot's clock, which started at the reboot
+    memcpy(s_station, s_reboot_record.station, sizeof(s_station));
+    s_station[sizeof(s_station) - 1] = '\0';
+    s_stall_us =
+        -(int64_t)s_reboot_record.tier_ms[RECOVERY_TIER_REBOOT] * 1000;
+    push_record();
+    taskENTER_CRITICAL(&s_lock);
+    memcpy(s_history[s_current].tier_ms, s_reboot_record.tier_ms,
+           sizeof(s_reboot_record.tier_ms));
+    taskEXIT_CRITICAL(&s_lock);
+    s_in_stall = true;
+    s_tier = RECOVERY_TIER_REBOOT;
+    s_stalled_s = 0;
+    s_flowing_s = 0;
+    ESP_LOGW(TAG, "Rebooted to recover a stall on %s", s_station);
+  }
+  s_reboot_magic = 0;
+}
+
+recovery_tier_t recovery_update(const char *station, bool stalled,
+                                bool has_fallback) {
+  int64_t now = esp_timer_get_time();
+  if (s_in_stall && strncmp(s_station, station, sizeof(s_station) - 1) != 0) {
+    end_stall(false); // tuned away, the stall is no longer ours to fix
+  }
+
+  if (!stalled) {
+    if (s_in_stall) {
+      if (s_flowing_s++ == 0) {
+        s_flow_us = now;
+      }
+      if (s_flowing_s >= RECOVERY_HOLD_S) {
+        end_stall(true);
+      }
+    }
+    return RECOVERY_TIER_NONE;
+  }
+
+  s_flowing_s = 0;
+  if (!s_in_stall) {
+    s_in_stall = true;
+    s_tier = RECOVERY_TIER_NONE;
+    s_stall_us = now;
+    s_stalled_s = 0;
+    strncpy(s_station, station, sizeof(s_station) - 1);
+    s_station[sizeof(s_station) - 1] = '\0';
+  }
+  s_stalled_s++;
+
+  recovery_tier_t next = s_tier + 1;
+  if (next == RECOVERY_TIER_FALLBACK && !has_fallback) {
+    next = RECOVERY_TIER_REBOOT;
+  }
+  if (next >= RECOVERY_TIER_COUNT) {
+    // still stalled after a recovery reboot: start the ladder over
+    if (s_stalled_s >= RECOVERY_GIVE_UP_S) {
+      end_stall(false);
+    }
+    return RECOVERY_TIER_NONE;
+  }
+  if (s_stalled_s < tier_after_s[next]) {
+    return RECOVERY_TIER_NONE;
+  }
+
+  if (!s_recorded) {
+    push_record();
+  }
+  s_tier = next;
+  int32_t at_ms = (int32_t)((now - s_stall_us) / 1000);
+  taskENTER_CRITICAL(&s_lock);
+  s_history[s_current].tier_ms[next] = at_ms;
+  if (next == RECOVERY_TIER_REBOOT) {
+    s_reboot_record = s_history[s_current];
+    s_reboot_magic = RECOVERY_REBOOT_MAGIC;
+  }
+  taskEXIT_CRITICAL(&s_lock);
+  ESP_LOGW(TAG, "No data from %s for %d s, trying %s", s_station, s_stalled_s,
+           tier_names[next]);
+  return next;
+}
+
+const char *recovery_tier_name(recovery_tier_t tier) {
+  return tier < RECOVERY_TIER_COUNT ? tier_names[tier] : "unknown";
+}
+
+char *recovery_get_history_json(void) {
+  recovery_record_t history[RECOVERY_HISTORY_SIZE];
+  int count;
+  int current;
+  taskENTER_CRITICAL(&s_lock);
+  memcpy(history, s_history, sizeof(history));
+  count = s_count;
+  current = s_current;
+  taskEXIT_CRITICAL(&s_lock);
+
+  cJSON *root = cJSON_CreateArray();
+  for (int n = 0; n < count; n++) {
+    const recovery_record_t *rec =
+        &history[(current - n + RECOVERY_HISTORY_SIZE) % RECOVERY_HISTORY_SIZE];
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "station", rec->station);
+    cJSON_AddNumberToObject(item, "stall_ms", rec->stall_us / 1000);
+    for (int i = RECOVERY_TIER_RECONNECT; i < RECOVERY_TIER_COUNT; i++) {
+      if (rec->tier_ms[i] >= 0) {
+        cJSON_AddNumberToObject(item, tier_names[i], rec->tier_ms[i]);
+      } else {
+        cJSON_AddNullToObject(item, tier_names[i]);
+      }
+    }
+    if (rec->recovered_ms >= 0) {
+      cJSON_AddNumberToObject(item, "recovered", rec->recovered_ms);
+      cJSON_AddStringToObject(item, "fixed_by", tier_names[rec->fixed_by]);
+    } else {
+      cJSON_AddNullToObject(item, "recovered");
+      cJSON_AddNullToObject(item, "fixed_by");
+    }
+    cJSON_AddItemToArray(root, item);
+  }
+  char *out = cJSON_Print(root);
+  cJSON_Delete(root);
+  return out;
+}
@@ -0,0 +1,69 @@
+#ifndef RECOVERY_H
+#define RECOVERY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Steps of the stall recovery ladder, cheapest first.
+     */
+    typedef enum {
+        RECOVERY_TIER_NONE,
+        RECOVERY_TIER_RECONNECT, // restart the HTTP source only
+        RECOVERY_TIER_REBUILD,   // tear down and rebuild the pipeline
+        RECOVERY_TIER_WIFI,      // re-associate with the cached BSSID and channel
+        RECOVERY_TIER_FALLBACK,  // play the station's fallback URI
+        RECOVERY_TIER_REBOOT,
+        RECOVERY_TIER_COUNT
+    } recovery_tier_t;
+
+    /**
+     * @brief One stall and the tiers that were tried on it. Offsets are ms from
+     * the start of the stall; a tier that did not run is -1.
+     */
+    typedef struct {
+        char station[16];
+        int64_t stall_us;                     // esp_timer_get_time() of the stall, this boot
+        int32_t tier_ms[RECOVERY_TIER_COUNT]; // RECOVERY_TIER_NONE is unused
+        int32_t recovered_ms;                 // data flowing again, -1 if it never did
+        recovery_tier_t fixed_by;             // last tier before the recovery
+    } recovery_record_t;
+
+    /**
+     * @brief Picks up the record of a stall that ended in a recovery reboot, so
+     * the tier that finally fixed it is still recorded. Call once at boot.
+     */
+    void recovery_init(void);
+
+    /**
+     * @brief Advances the ladder by one second of stream throughput. Data must
+     * flow for a while before a stall counts as fixed, so a connection that
+     * trickles and dies again keeps escalating.
+     * @param station Call sign of the playing station; a tune ends the stall.
+     * @param stalled No stream data arrived in the last second.
+     * @param has_fallback The station has a fallback URI, else that tier is skipped.
+     * @return The tier to run now, usually RECOVERY_TIER_NONE. For
+     * RECOVERY_TIER_REBOOT the record is already saved for the next boot.
+     */
+    recovery_tier_t recovery_update(const char* station, bool stalled, bool has_fallback);
+
+    /**
+     * @brief Returns the name of a tier for logs.
+     */
+    const char* recovery_tier_name(recovery_tier_t tier);
+
+    /**
+     * @brief Returns the stall history, newest first, as a JSON string. The
+     * caller must free the string.
+     */
+    char* recovery_get_history_json(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RECOVERY_H
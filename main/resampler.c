@@ -0,0 +1,353 @@
+#include "resampler.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h" // needed despite linter suggesting otherwise
+#include "freertos/task.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "RESAMPLER";
+
+// Polyphase windowed-sinc filter. Each output sample is a 32 tap dot product
+// with two neighbouring phases of the table, blended by the fractional phase.
+#define RS_TAPS 32
+#define RS_PHASE_BITS 6
+#define RS_PHASES (1 << RS_PHASE_BITS)
+#define RS_KAISER_BETA 8.0
+// cutoff as a fraction of the lower of the two Nyquist frequencies
+#define RS_CUTOFF 0.87
+#define RS_BUFFER_LEN (2 * 1024)
+#define RS_BLOCK_FRAMES 256
+// worst case input per read is mono, one frame per 2 bytes
+#define RS_MAX_FRAMES (RS_TAPS + RS_BUFFER_LEN / 2 + 1)
+#define RS_MIN_RATE 8000
+#define RS_MAX_RATE 192000
+
+typedef enum {
+  RS_COPY,    // 16-bit stereo at the output rate, or a format we cannot handle
+  RS_UPMIX,   // mono at the output rate
+  RS_CONVERT, // any other rate
+} resampler_mode_t;
+
+typedef struct {
+  int out_rate;
+
+  // written by the decoder's task, taken by the element task
+  portMUX_TYPE lock;
+  bool pending;
+  int pending_rate;
+  int pending_channels;
+  bool pending_supported;
+
+  resampler_mode_t mode;
+  int in_rate;
+  int in_channels;
+  // input position of the next output frame, Q32.32 in frames[]
+  uint64_t pos;
+  uint64_t step;
+  uint64_t nominal_step; // step without the clock drift correction
+  volatile int drift_ppm; // written by the drift controller
+  int applied_ppm;
+  uint8_t carry[4]; // a frame split across two reads
+  int carry_len;
+
+  int nframes;
+  int16_t frames[RS_MAX_FRAMES * 2]; // input history, stereo interleaved
+  int16_t out[RS_BLOCK_FRAMES * 2];
+  // phase RS_PHASES is the last phase advanced by one input frame, so the
+  // blend never wraps
+  int16_t coef[(RS_PHASES + 1) * RS_TAPS] __attribute__((aligned(16)));
+} resampler_t;
+
+static double bessel_i0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12) {
+      break;
+    }
+  }
+  return sum;
+}
+
+// Builds the Q15 table for the current rates. Runs once per format change.
+static void build_filter(resampler_t *rs) {
+  double fc = RS_CUTOFF;
+  if (rs->out_rate < rs->in_rate) {
+    fc *= (double)rs->out_rate / rs->in_rate;
+  }
+  double half = RS_TAPS / 2;
+  double i0_beta = bessel_i0(RS_KAISER_BETA);
+  for (int p = 0; p <= RS_PHASES; p++) {
+    double frac = (double)p / RS_PHASES;
+    double h[RS_TAPS];
+    double sum = 0;
+    for (int k = 0; k < RS_TAPS; k++) {
+      // distance of tap k from the output instant, in input frames
+      double d = k - (half - 1) - frac;
+      double x = fc * d;
+      double sinc = x == 0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+      double w = 1.0 - (d / half) * (d / half);
+      double win = w > 0 ? bessel_i0(RS_KAISER_BETA * sqrt(w)) / i0_beta : 0;
+      h[k] = sinc * win;
+      sum += h[k];
+    }
+    // unity gain at DC for every phase
+    for (int k = 0; k < RS_TAPS; k++) {
+      long q = lround(h[k] / sum * 32768.0);
+      rs->coef[p * RS_TAPS + k] =
+          q > INT16_MAX ? INT16_MAX : (q < INT16_MIN ? INT16_MIN : q);
+    }
+  }
+}
+
+static void reset_history(resampler_t *rs) {
+  // the first input frame lines up with the first output frame
+  rs->nframes = rs->mode == RS_CONVERT ? RS_TAPS / 2 - 1 : 0;
+  memset(rs->frames, 0, rs->nframes * 2 * sizeof(int16_t));
+  rs->pos = 0;
+  rs->carry_len = 0;
+}
+
+static void apply_drift(resampler_t *rs) {
+  rs->applied_ppm = rs->drift_ppm;
+  rs->step = rs->nominal_step +
+             (int64_t)rs->nominal_step * rs->applied_ppm / 1000000;
+}
+
+static void apply_pending(resampler_t *rs) {
+  if (!rs->pending) {
+    return;
+  }
+  taskENTER_CRITICAL(&rs->lock);
+  int rate = rs->pending_rate;
+  int channels = rs->pending_channels;
+  bool supported = rs->pending_supported;
+  rs->pending = false;
+  taskEXIT_CRITICAL(&rs->lock);
+
+  rs->in_rate = rate;
+  rs->in_channels = channels;
+  if (!supported) {
+    rs->mode = RS_COPY;
+#if !CONFIG_RADIO_DRIFT_COMPENSATION
+    // drift correction needs the interpolating path even at the output rate
+  } else if (rate == rs->out_rate && channels == 2) {
+    rs->mode = RS_COPY;
+  } else if (rate == rs->out_rate) {
+    rs->mode = RS_UPMIX;
+#endif
+  } else {
+    rs->mode = RS_CONVERT;
+    rs->nominal_step = ((uint64_t)rate << 32) / rs->out_rate;
+    apply_drift(rs);
+    build_filter(rs);
+  }
+  reset_history(rs);
+  ESP_LOGI(TAG, "%d Hz %s -> %d Hz stereo (%s)", rate,
+           channels == 1 ? "mono" : "stereo", rs->out_rate,
+           rs->mode == RS_CONVERT ? "resampling"
+           : rs->mode == RS_UPMIX ? "upmix"
+                                  : "passthrough");
+}
+
+static void push_frames(resampler_t *rs, const uint8_t *data, int count) {
+  int16_t *dst = rs->frames + rs->nframes * 2;
+  if (rs->in_channels == 2) {
+    memcpy(dst, data, count * 4);
+  } else {
+    for (int i = 0; i < count; i++) {
+      int16_t s;
+      memcpy(&s, data + i * 2, sizeof(s));
+      dst[2 * i] = s;
+      dst[2 * i + 1] = s;
+    }
+  }
+  rs->nframes += count;
+}
+
+static inline int16_t clamp16(int32_t v) {
+  return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v);
+}
+
+// One stereo output frame from frames x[0..RS_TAPS-1]. The taps of both
+// phases are contiguous Q15, and the sum of their magnitudes stays below 2,
+// so 32-bit accumulators cannot overflow.
+static inline void convolve(const int16_t *x, const int16_t *h0, uint32_t blend,
+                            int16_t *out) {
+  const int16_t *h1 = h0 + RS_TAPS;
+  int32_t l0 = 0, r0 = 0, l1 = 0, r1 = 0;
+  for (int k = 0; k < RS_TAPS; k++) {
+    l0 += x[2 * k] * h0[k];
+    r0 += x[2 * k + 1] * h0[k];
+    l1 += x[2 * k] * h1[k];
+    r1 += x[2 * k + 1] * h1[k];
+  }
+  int32_t l = l0 + (int32_t)(((int64_t)(l1 - l0) * blend) >> 16);
+  int32_t r = r0 + (int32_t)(((int64_t)(r1 - r0) * blend) >> 16);
+  out[0] = clamp16((l + (1 << 14)) >> 15);
+  out[1] = clamp16((r + (1 << 14)) >> 15);
+}
+
+// Produces every output frame the buffered input allows and writes it on in
+// blocks. Returns a negative element error if the output failed.
+static int render(audio_element_handle_t self, resampler_t *rs) {
+  int n = 0;
+  while ((int)(rs->pos >> 32) + RS_TAPS <= rs->nframes) {
+    uint32_t frac = (uint32_t)rs->pos;
+    const int16_t *x = rs->frames + (rs->pos >> 32) * 2;
+    const int16_t *h = rs->coef + (frac >> (32 - RS_PHASE_BITS)) * RS_TAPS;
+    uint32_t blend = (frac >> (16 - RS_PHASE_BITS)) & 0xffff;
+    convolve(x, h, blend, rs->out + n * 2);
+    rs->pos += rs->step;
+    if (++n == RS_BLOCK_FRAMES) {
+      int w = audio_element_output(self, (char *)rs->out, n * 4);
+      if (w < 0) {
+        return w;
+      }
+      n = 0;
+    }
+  }
+  if (n > 0) {
+    int w = audio_element_output(self, (char *)rs->out, n * 4);
+    if (w < 0) {
+      return w;
+    }
+  }
+
+  // keep the frames the next output still needs
+  int used = rs->pos >> 32;
+  memmove(rs->frames, rs->frames + used * 2,
+          (rs->nframes - used) * 2 * sizeof(int16_t));
+  rs->nframes -= used;
+  rs->pos -= (uint64_t)used << 32;
+  return 0;
+}
+
+static int upmix(audio_element_handle_t self, resampler_t *rs) {
+  int w = audio_element_output(self, (char *)rs->frames, rs->nframes * 4);
+  rs->nframes = 0;
+  return w < 0 ? w : 0;
+}
+
+static esp_err_t _resampler_open(audio_element_handle_t self) {
+  resampler_t *rs = (resampler_t *)audio_element_getdata(self);
+  reset_history(rs);
+  return ESP_OK;
+}
+
+static esp_err_t _resampler_destroy(audio_element_handle_t self) {
+  resampler_t *rs = (resampler_t *)audio_element_getdata(self);
+  free(rs);
+  return ESP_OK;
+}
+
+static int _resampler_process(audio_element_handle_t self, char *in_buffer,
+                              int in_len) {
+  resampler_t *rs = (resampler_t *)audio_element_getdata(self);
+  apply_pending(rs);
+  if (rs->drift_ppm != rs->applied_ppm && rs->mode == RS_CONVERT) {
+    apply_drift(rs);
+  }
+
+  int r = audio_element_input(self, in_buffer, in_len);
+  if (r <= 0 || rs->mode == RS_COPY) {
+    return r <= 0 ? r : audio_element_output(self, in_buffer, r);
+  }
+
+  const uint8_t *p = (const uint8_t *)in_buffer;
+  int left = r;
+  int frame_bytes = rs->in_channels * 2;
+  if (rs->carry_len > 0) {
+    int n = frame_bytes - rs->carry_len < left ? frame_bytes - rs->carry_len
+                                               : left;
+    memcpy(rs->carry + rs->carry_len, p, n);
+    rs->carry_len += n;
+    p += n;
+    left -= n;
+    if (rs->carry_len < frame_bytes) {
+      return r;
+    }
+    push_frames(rs, rs->carry, 1);
+    rs->carry_len = 0;
+  }
+  int count = left / frame_bytes;
+  push_frames(rs, p, count);
+  rs->carry_len = left - count * frame_bytes;
+  memcpy(rs->carry, p + count * frame_bytes, rs->carry_len);
+
+  int ret = rs->mode == RS_UPMIX ? upmix(self, rs) : render(self, rs);
+  return ret < 0 ? ret : r;
+}
+
+audio_element_handle_t resampler_init(resampler_cfg_t *cfg) {
+  if (cfg == NULL || cfg->out_rate < RS_MIN_RATE ||
+      cfg->out_rate > RS_MAX_RATE) {
+    ESP_LOGE(TAG, "Invalid resampler configuration");
+    return NULL;
+  }
+  resampler_t *rs = calloc(1, sizeof(resampler_t));
+  if (rs == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate resampler state");
+    return NULL;
+  }
+  rs->out_rate = cfg->out_rate;
+  rs->lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+  rs->mode = RS_COPY;
+  rs->in_rate = cfg->out_rate;
+  rs->in_channels = 2;
+
+  audio_element_cfg_t el_cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+  el_cfg.open = _resampler_open;
+  el_cfg.process = _resampler_process;
+  el_cfg.destroy = _resampler_destroy;
+  el_cfg.buffer_len = RS_BUFFER_LEN;
+  el_cfg.out_rb_size = cfg->out_rb_size;
+  el_cfg.task_stack = cfg->task_stack;
+  el_cfg.task_prio = cfg->task_prio;
+  el_cfg.task_core = cfg->task_core;
+  el_cfg.tag = "resample";
+
+  audio_element_handle_t el = audio_element_init(&el_cfg);
+  if (el == NULL) {
+    ESP_LOGE(TAG, "Failed to initialize resampler element");
+    free(rs);
+    return NULL;
+  }
+  audio_element_setdata(el, rs);
+  ESP_LOGI(TAG, "Resampler: fixed output %d Hz", cfg->out_rate);
+  return el;
+}
+
+esp_err_t resampler_set_input(audio_element_handle_t el, int rate, int bits,
+                              int channels) {
+  if (el == NULL) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  resampler_t *rs = (resampler_t *)audio_element_getdata(el);
+  bool supported = bits == 16 && (channels == 1 || channels == 2) &&
+                   rate >= RS_MIN_RATE && rate <= RS_MAX_RATE;
+  taskENTER_CRITICAL(&rs->lock);
+  rs->pending_rate = rate;
+  rs->pending_channels = channels;
+  rs->pending_supported = supported;
+  rs->pending = true;
+  taskEXIT_CRITICAL(&rs->lock);
+  return supported ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+}
+
+int resampler_get_output_rate(audio_element_handle_t el) {
+  resampler_t *rs = (resampler_t *)audio_element_getdata(el);
+  return rs->out_rate;
+}
+
+void resampler_set_drift_ppm(audio_element_handle_t el, int ppm) {
+  if (el) {
+    resampler_t *rs = (resampler_t *)audio_element_getdata(el);
+    rs->drift_ppm = ppm;
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include "audio_element.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Configuration for the resampler element.
+     */
+    typedef struct {
+        int out_rate;       // fixed I2S sample rate, output is always 16-bit stereo
+        int out_rb_size;
+        int task_stack;
+        int task_prio;
+        int task_core;
+    } resampler_cfg_t;
+
+#define RESAMPLER_CFG_DEFAULT() {                                  \
+        .out_rate = CONFIG_RADIO_OUTPUT_SAMPLE_RATE,               \
+        .out_rb_size = 8 * 1024,                                   \
+        .task_stack = 3 * 1024,                                    \
+        .task_prio = 5,                                            \
+        .task_core = 1,                                            \
+    }
+
+    /**
+     * @brief Creates a resampler element to sit between the decoder and the I2S
+     * writer. It converts 16-bit mono or stereo PCM at any rate to 16-bit stereo at
+     * cfg->out_rate with a fixed-point polyphase filter. Until resampler_set_input()
+     * is called the input is assumed to be 16-bit stereo at the output rate.
+     * @return The element handle, or NULL on failure.
+     */
+    audio_element_handle_t resampler_init(resampler_cfg_t* cfg);
+
+    /**
+     * @brief Sets the format of the decoded PCM. Safe to call from the decoder's
+     * music info callback; the filter is rebuilt by the element task before it
+     * reads the next block.
+     * @param el The resampler element.
+     * @param rate Input sample rate in Hz.
+     * @param bits Input bits per sample.
+     * @param channels Input channel count.
+     * @return ESP_OK on success. ESP_ERR_NOT_SUPPORTED if the format cannot be
+     * converted; the element then copies data unchanged and the caller must set
+     * the I2S clock to the input format itself.
+     */
+    esp_err_t resampler_set_input(audio_element_handle_t el, int rate, int bits, int channels);
+
+    /**
+     * @brief Returns the fixed output sample rate of the element.
+     */
+    int resampler_get_output_rate(audio_element_handle_t el);
+
+    /**
+     * @brief Corrects the conversion ratio for the difference between the
+     * stream's clock and the I2S clock. Takes effect at the next block without
+     * resetting the filter, and only while the element is converting.
+     * @param el The resampler element.
+     * @param ppm Correction in parts per million; positive consumes input faster.
+     */
+    void resampler_set_drift_ppm(audio_element_handle_t el, int ppm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RESAMPLER_H
@@ -7,11 +7,14 @@
 #include "screens.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "lvgl.h"
 #include "station_data.h"
+#include "stream_stats.h"
+#include "web_server.h"
+#include <stdio.h>
 #include <string.h>
 
-extern int g_bitrate_kbps;
 extern int current_station;
 
 QueueHandle_t g_ui_queue;
@@ -29,15 +32,25 @@ static lv_obj_t *station_selection_screen_obj = NULL;
 static lv_obj_t *message_screen_obj = NULL;
 static lv_obj_t *message_label = NULL;
 
+// str_value only carries a pointer, so the title is kept here until the UI
+// task picks it up
+#define NOW_PLAYING_MAX 128
+static char s_now_playing[NOW_PLAYING_MAX];
+static portMUX_TYPE s_now_playing_lock = portMUX_INITIALIZER_UNLOCKED;
+
 void update_bitrate_label(int bitrate) {
   ui_update_message_t msg = {.type = UPDATE_BITRATE, .data.value = bitrate};
   xQueueSend(g_ui_queue, &msg, 0);
+  web_events_bitrate(bitrate);
 }
 
 void update_station_name(const char *name) {
   ui_update_message_t msg = {.type = UPDATE_STATION_NAME,
                              .data.str_value = name};
   xQueueSend(g_ui_queue, &msg, 0);
+  web_events_station(current_station, name,
+                     radio_stations[current_station].origin);
+  web_events_now_playing(""); // the origin line is back until a new title
 }
 
 void update_station_origin(const char *origin) {
@@ -49,6 +62,12 @@ void update_station_origin(const char *origin) {
 void update_volume_slider(int volume) {
   ui_update_message_t msg = {.type = UPDATE_VOLUME, .data.value = volume};
   xQueueSend(g_ui_queue, &msg, 0);
+  web_events_volume(volume);
+}
+
+void update_mute_state(bool muted) {
+  // the screen shows mute as a zero volume, only the web UI needs this
+  web_events_mute(muted);
 }
 
 void update_station_roller(int new_station_index) {
@@ -57,6 +76,15 @@ void update_station_roller(int new_station_index) {
   xQueueSend(g_ui_queue, &msg, 0);
 }
 
+void update_now_playing(const char *title) {
+  taskENTER_CRITICAL(&s_now_playing_lock);
+  snprintf(s_now_playing, sizeof(s_now_playing), "%s", title);
+  taskEXIT_CRITICAL(&s_now_playing_lock);
+  ui_update_message_t msg = {.type = UPDATE_NOW_PLAYING};
+  xQueueSend(g_ui_queue, &msg, 0);
+  web_events_now_playing(title);
+}
+
 void switch_to_provisioning_screen(void) {
   ui_update_message_t msg = {.type = SWITCH_TO_PROVISIONING};
   xQueueSend(g_ui_queue, &msg, 0);
@@ -98,6 +126,15 @@ void process_ui_updates(void) {
       if (origin_label)
         lv_label_set_text(origin_label, msg.data.str_value);
       break;
+    case UPDATE_NOW_PLAYING:
+      if (origin_label) {
+        char title[NOW_PLAYING_MAX];
+        taskENTER_CRITICAL(&s_now_playing_lock);
+        strcpy(title, s_now_playing);
+        taskEXIT_CRITICAL(&s_now_playing_lock);
+        lv_label_set_text(origin_label, title);
+      }
+      break;
     case UPDATE_VOLUME:
       if (volume_slider)
         lv_slider_set_value(volume_slider, msg.data.value, LV_ANIM_ON);
@@ -220,9 +257,13 @@ static void create_home_screen_widgets(lv_obj_t *parent) {
   lv_obj_set_style_text_font(origin_label, &lv_font_montserrat_12,
                              0); // Use default font for smaller text
   lv_obj_set_style_text_letter_space(origin_label, 1, 0);
+  // track titles are longer than the screen is wide
+  lv_obj_set_width(origin_label, lv_pct(100));
+  lv_obj_set_style_text_align(origin_label, LV_TEXT_ALIGN_CENTER, 0);
+  lv_label_set_long_mode(origin_label, LV_LABEL_LONG_SCROLL_CIRCULAR);
   // bitrate label
   bitrate_label = lv_label_create(text_container);
-  lv_label_set_text_fmt(bitrate_label, "%d KBPS", g_bitrate_kbps);
+  lv_label_set_text_fmt(bitrate_label, "%d KBPS", (int)stream_stats_kbps());
   lv_obj_set_style_text_font(bitrate_label, &lv_font_montserrat_14,
                              0); // Use default font for smaller text
   lv_obj_set_style_text_letter_space(bitrate_label, 1, 0);
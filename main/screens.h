@@ -20,7 +20,8 @@ typedef enum {
   SWITCH_TO_PROVISIONING,
   SWITCH_TO_IP_SCREEN,
   SWITCH_TO_REBOOT_SCREEN,
-  UPDATE_IP_LABEL
+  UPDATE_IP_LABEL,
+  UPDATE_NOW_PLAYING
 } ui_update_type_t;
 
 typedef struct {
@@ -92,12 +93,26 @@ void update_bitrate_label(int bitrate);
  */
 void update_volume_slider(int volume);
 
+/**
+ * @brief Reports the mute state. The slider already shows 0 while muted,
+ * so this only reaches the web UI.
+ * @param muted True while muted.
+ */
+void update_mute_state(bool muted);
+
 /**
  * @brief Updates the station roller to a new station index.
  * @param new_station_index The index of the new station to select.
  */
 void update_station_roller(int new_station_index);
 
+/**
+ * @brief Shows the current track in place of the station origin until the
+ * next station change. The title is copied, so it may live on the stack.
+ * @param title The track title, typically "Artist - Title".
+ */
+void update_now_playing(const char *title);
+
 /**
  * @brief Updates the IP address label on the screen.
  * @param ip The IP address string.
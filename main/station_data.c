@@ -1,15 +1,29 @@
 #include "station_data.h"
 #include "cJSON.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "esp_spiffs.h"
+#include "esp_timer.h"
+#include "json_sax.h"
+#include "station_table.h"
+#include <limits.h>
+#include <math.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 static const char *TAG = "STATION_DATA";
 #define STORAGE_BASE_PATH "/spiffs"
 #define STATION_FILE "/spiffs/stations.json"
+// Edits through the per-station API are appended here, one line each, and
+// replayed over STATION_FILE at boot. save_station_data() folds them in.
+#define STATION_JOURNAL "/spiffs/stations.journal"
+#define JOURNAL_MAX_SIZE (16 * 1024)
+#define JOURNAL_LINE_MAX 4096
 
 station_t *radio_stations = NULL;
 int station_count = 0;
@@ -20,42 +34,50 @@ typedef struct {
   const char *origin;
   const char *uri;
   codec_type_t codec;
+  metadata_driver_t meta_driver;
+  const char *meta_uri;
 } default_station_t;
 
 static const default_station_t default_stations[] = {
     {"KEXP", "Seattle", "https://kexp.streamguys1.com/kexp160.aac",
-     CODEC_TYPE_AAC},
+     CODEC_TYPE_AAC, META_DRIVER_KEXP_V2,
+     "https://api.kexp.org/v2/plays/?format=json&limit=1"},
     {"KBUT", "Crested Butte",
      "http://playerservices.streamtheworld.com/api/livestream-redirect/"
      "KBUTFM.mp3",
-     CODEC_TYPE_MP3},
-    {"KSUT", "4 Corners", "https://ksut.streamguys1.com/kute", CODEC_TYPE_AAC},
+     CODEC_TYPE_MP3, META_DRIVER_SPINITRON, "https://spinitron.com/KBUT/"},
+    {"KSUT", "4 Corners", "https://ksut.streamguys1.com/kute", CODEC_TYPE_AAC,
+     META_DRIVER_SPINITRON, "https://spinitron.com/ksutfourcorners/"},
     {"KDUR", "Durango", "https://kdurradio.fortlewis.edu/stream",
-     CODEC_TYPE_MP3},
+     CODEC_TYPE_MP3, META_DRIVER_SPINITRON, "https://spinitron.com/KDUR/"},
     {"KOTO", "Telluride", "http://26193.live.streamtheworld.com/KOTOFM.mp3",
-     CODEC_TYPE_MP3},
+     CODEC_TYPE_MP3, META_DRIVER_SPINITRON, "https://spinitron.com/KOTO/"},
     {"KHEN", "Salida", "https://stream.pacificaservice.org:9000/khen_128",
      CODEC_TYPE_MP3},
     {"KWSB", "Gunnison", "https://kwsb.streamguys1.com/live", CODEC_TYPE_MP3},
     {"KFFP", "Portland", "http://listen.freeformportland.org:8000/stream",
-     CODEC_TYPE_MP3}, // this is a 256K stream  it works sporadically
+     CODEC_TYPE_MP3, META_DRIVER_SPINITRON,
+     "https://spinitron.com/KFFP/"}, // this is a 256K stream  it works sporadically
      // new kffp steam: https://stream.freeformportland.org/listen/freeformportland/relay.mp3
      // this new stream is still 256kbps but AzuraCast api reports that it is 128kbps.
-    {"KBOO", "Portland", "https://live.kboo.fm:8443/high", CODEC_TYPE_MP3},
+    {"KBOO", "Portland", "https://live.kboo.fm:8443/high", CODEC_TYPE_MP3,
+     META_DRIVER_SPINITRON, "https://spinitron.com/KBOO/"},
     {"KXLU", "Loyola Marymnt", "http://kxlu.streamguys1.com:80/kxlu-lo",
-     CODEC_TYPE_AAC},
+     CODEC_TYPE_AAC, META_DRIVER_SPINITRON, "https://spinitron.com/KXLU/"},
     {"WPRB", "Princeton", "https://wprb.streamguys1.com/listen.mp3",
-     CODEC_TYPE_AAC},
-    {"WMBR", "MIT", "https://wmbr.org:8002/hi", CODEC_TYPE_MP3},
+     CODEC_TYPE_AAC, META_DRIVER_SPINITRON, "https://spinitron.com/WPRB/"},
+    {"WMBR", "MIT", "https://wmbr.org:8002/hi", CODEC_TYPE_MP3,
+     META_DRIVER_SPINITRON, "https://spinitron.com/WMBR/"},
     {"KALX", "Berkeley", "https://stream.kalx.berkeley.edu:8443/kalx-128.mp3",
-     CODEC_TYPE_MP3},
+     CODEC_TYPE_MP3, META_DRIVER_SPINITRON, "https://spinitron.com/KALX/"},
     {"WFUV", "Fordham", "https://onair.wfuv.org/onair-hi", CODEC_TYPE_MP3},
     {"KUFM", "Missoula",
      "https://playerservices.streamtheworld.com/api/livestream-redirect/"
      "KUFMFM.mp3",
-     CODEC_TYPE_MP3},
+     CODEC_TYPE_MP3, META_DRIVER_NONE}, // StreamTheWorld has no status page
     {"KRCL", "Salt Lake City", "http://stream.xmission.com:8000/krcl-low",
-     CODEC_TYPE_AAC},
+     CODEC_TYPE_AAC,
+     META_DRIVER_SPINITRON, "https://spinitron.com/KRCL/"},
     // {"KRRC", "Reed College", "https://stream.radiojar.com/3wg5hpdkfkeuv",
     // CODEC_TYPE_MP3}
 
@@ -65,6 +87,284 @@ static const int default_station_count =
 
 static void load_stations_from_file(void);
 static void create_default_station_file(void);
+static void replay_journal(void);
+#if CONFIG_RADIO_STATION_TABLE
+static bool load_stations_from_table(const struct stat *st);
+static void save_station_table(void);
+#endif
+
+// Station strings are bump allocated from PSRAM blocks and freed together.
+#define ARENA_BLOCK_SIZE 4096
+
+typedef struct arena_block {
+  struct arena_block *prev;
+  size_t used;
+  size_t size;
+  char data[];
+} arena_block_t;
+
+static void *arena_take(arena_block_t **arena, size_t size, size_t align) {
+  arena_block_t *b = *arena;
+  size_t start = b ? (b->used + align - 1) & ~(align - 1) : 0;
+  if (b == NULL || start > b->size || b->size - start < size) {
+    size_t data = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    b = heap_caps_malloc(sizeof(arena_block_t) + data,
+                         MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (b == NULL) {
+      return NULL;
+    }
+    b->prev = *arena;
+    b->size = data;
+    *arena = b;
+    start = 0;
+  }
+  b->used = start + size;
+  return b->data + start;
+}
+
+static void *arena_alloc(arena_block_t **arena, size_t size) {
+  return arena_take(arena, size, 8);
+}
+
+// strings need no alignment, so they are packed end to end
+static char *arena_alloc_chars(arena_block_t **arena, size_t size) {
+  return arena_take(arena, size, 1);
+}
+
+static void arena_free(arena_block_t **arena) {
+  while (*arena) {
+    arena_block_t *prev = (*arena)->prev;
+    heap_caps_free(*arena);
+    *arena = prev;
+  }
+}
+
+typedef struct {
+  arena_block_t *block;
+  size_t used;
+} arena_mark_t;
+
+static arena_mark_t arena_mark(arena_block_t *arena) {
+  return (arena_mark_t){arena, arena ? arena->used : 0};
+}
+
+static void arena_rollback(arena_block_t **arena, arena_mark_t mark) {
+  while (*arena != mark.block) {
+    arena_block_t *prev = (*arena)->prev;
+    heap_caps_free(*arena);
+    *arena = prev;
+  }
+  if (*arena) {
+    (*arena)->used = mark.used;
+  }
+}
+
+// Everything of one station list hangs off one store: the station array and
+// an arena with the store itself, the strings and the hash index they are
+// interned through. Origins and fallback streams repeat across stations and
+// are stored once; call signs and URIs are unique to a station and are packed
+// into the arena without an index entry. Replacing the list builds a new
+// store and swaps s_store; the old one goes with store_free(). An array the
+// list outgrows stays in the store too, as other tasks may still index it.
+#define STORE_MIN_BUCKETS 16
+
+typedef struct intern_node {
+  struct intern_node *next;
+  uint32_t hash;
+  char str[];
+} intern_node_t;
+
+typedef struct retired_array {
+  struct retired_array *next;
+  station_t *stations;
+} retired_array_t;
+
+typedef struct {
+  arena_block_t *arena;    // newest block first
+  station_t *stations;     // the array radio_stations points at
+  int capacity;            // entries allocated in stations
+  retired_array_t *retired; // arrays stations has outgrown
+  intern_node_t **buckets; // a power of two of them, or NULL
+  uint32_t bucket_count;
+  uint32_t interned;
+  intern_node_t *pending; // interned since the last store_keep()
+} station_store_t;
+
+static station_store_t *s_store = NULL;
+
+static station_store_t *store_create(void) {
+  arena_block_t *arena = NULL;
+  station_store_t *store = arena_alloc(&arena, sizeof(*store));
+  if (store == NULL) {
+    return NULL;
+  }
+  memset(store, 0, sizeof(*store));
+  store->arena = arena;
+  return store;
+}
+
+static void store_free(station_store_t **store) {
+  if (*store) {
+    heap_caps_free((*store)->stations);
+    for (retired_array_t *r = (*store)->retired; r; r = r->next) {
+      heap_caps_free(r->stations);
+    }
+    arena_block_t *arena = (*store)->arena;
+    arena_free(&arena);
+    *store = NULL;
+  }
+}
+
+// Makes room for count stations in PSRAM, keeping those already there. A
+// larger array is a new one with the old entries copied over; the old array
+// is retired rather than freed, so a reader holding it never sees it go.
+static station_t *store_stations(station_store_t *store, int count) {
+  if (count <= store->capacity && store->stations) {
+    return store->stations;
+  }
+  int capacity = count > 0 ? count : 1;
+  retired_array_t *retired = NULL;
+  if (store->stations) {
+    retired = arena_alloc(&store->arena, sizeof(*retired));
+    if (retired == NULL) {
+      return NULL;
+    }
+  }
+  station_t *stations =
+      heap_caps_malloc(sizeof(station_t) * capacity,
+                       MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (stations == NULL) {
+    return NULL; // the retired entry stays unused in the arena
+  }
+  if (retired) {
+    memcpy(stations, store->stations, sizeof(station_t) * store->capacity);
+    retired->stations = store->stations;
+    retired->next = store->retired;
+    store->retired = retired;
+  }
+  store->stations = stations;
+  store->capacity = capacity;
+  return stations;
+}
+
+// FNV-1a
+static uint32_t intern_hash(const char *s, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ (uint8_t)s[i]) * 16777619u;
+  }
+  return h;
+}
+
+static char *intern_find(intern_node_t *n, uint32_t hash, const char *s,
+                         size_t len) {
+  for (; n; n = n->next) {
+    if (n->hash == hash && memcmp(n->str, s, len + 1) == 0) {
+      return n->str;
+    }
+  }
+  return NULL;
+}
+
+// A copy of s in the store, shared with any equal string already there. New
+// strings stay pending, out of the index, until store_keep(), so rolling the
+// arena back over them never leaves the index pointing into freed space.
+static char *store_intern(station_store_t *store, const char *s, size_t len) {
+  uint32_t hash = intern_hash(s, len);
+  char *found = NULL;
+  if (store->buckets) {
+    found = intern_find(store->buckets[hash & (store->bucket_count - 1)],
+                        hash, s, len);
+  }
+  if (found == NULL) {
+    found = intern_find(store->pending, hash, s, len);
+  }
+  if (found) {
+    return found;
+  }
+  intern_node_t *n = arena_alloc(&store->arena, sizeof(*n) + len + 1);
+  if (n == NULL) {
+    return NULL;
+  }
+  n->hash = hash;
+  memcpy(n->str, s, len);
+  n->str[len] = '\0';
+  n->next = store->pending;
+  store->pending = n;
+  return n->str;
+}
+
+// the index doubles past two strings a bucket; a failed grow only makes the
+// chains longer
+static void store_grow_index(station_store_t *store) {
+  uint32_t count = store->bucket_count ? store->bucket_count * 2
+                                       : STORE_MIN_BUCKETS;
+  intern_node_t **buckets =
+      arena_alloc(&store->arena, sizeof(*buckets) * count);
+  if (buckets == NULL) {
+    return;
+  }
+  memset(buckets, 0, sizeof(*buckets) * count);
+  for (uint32_t i = 0; i < store->bucket_count; i++) {
+    for (intern_node_t *n = store->buckets[i], *next; n; n = next) {
+      next = n->next;
+      n->next = buckets[n->hash & (count - 1)];
+      buckets[n->hash & (count - 1)] = n;
+    }
+  }
+  store->buckets = buckets;
+  store->bucket_count = count;
+}
+
+// adds the pending strings to the index
+static void store_keep(station_store_t *store) {
+  for (intern_node_t *n = store->pending, *next; n; n = next) {
+    next = n->next;
+    if (store->interned >= store->bucket_count * 2) {
+      store_grow_index(store);
+    }
+    if (store->buckets == NULL) {
+      n->next = NULL; // no index: still a valid string, just not shared
+      continue;
+    }
+    n->next = store->buckets[n->hash & (store->bucket_count - 1)];
+    store->buckets[n->hash & (store->bucket_count - 1)] = n;
+    store->interned++;
+  }
+  store->pending = NULL;
+}
+
+// drops everything allocated since mark, which was taken with nothing pending
+static void store_rollback(station_store_t *store, arena_mark_t mark) {
+  arena_rollback(&store->arena, mark);
+  store->pending = NULL;
+}
+
+static char *store_copy(station_store_t *store, const char *s, size_t len) {
+  char *copy = arena_alloc_chars(&store->arena, len + 1);
+  if (copy) {
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+  }
+  return copy;
+}
+
+static cJSON *dsp_to_json(const dsp_settings_t *dsp) {
+  cJSON *obj = cJSON_CreateObject();
+  cJSON *bands = cJSON_AddArrayToObject(obj, "bands");
+  for (int i = 0; i < dsp->band_count; i++) {
+    cJSON *band = cJSON_CreateObject();
+    cJSON_AddNumberToObject(band, "type", dsp->bands[i].type);
+    cJSON_AddNumberToObject(band, "freq", dsp->bands[i].freq);
+    cJSON_AddNumberToObject(band, "gain", dsp->bands[i].gain_db);
+    cJSON_AddNumberToObject(band, "q", dsp->bands[i].q);
+    cJSON_AddItemToArray(bands, band);
+  }
+  cJSON_AddBoolToObject(obj, "limiter", dsp->limiter);
+  cJSON_AddNumberToObject(obj, "ceiling", dsp->ceiling_db);
+  cJSON_AddNumberToObject(obj, "release", dsp->release_ms);
+  return obj;
+}
 
 void init_station_data(void) {
   ESP_LOGI(TAG, "Initializing SPIFFS");
@@ -96,29 +396,41 @@ void init_station_data(void) {
     ESP_LOGI(TAG, "Partition size: total: %d, used: %d", total, used);
   }
 
+  int64_t start = esp_timer_get_time();
+  size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
   // Check if file exists
   struct stat st;
   if (stat(STATION_FILE, &st) == 0) {
     ESP_LOGI(TAG, "Station file found, loading...");
+#if CONFIG_RADIO_STATION_TABLE
+    if (!load_stations_from_table(&st)) {
+      load_stations_from_file();
+      save_station_table(); // boot from it next time
+    }
+#else
     load_stations_from_file();
+#endif
+    replay_journal();
   } else {
     ESP_LOGI(TAG, "Station file not found, creating defaults...");
+    unlink(STATION_JOURNAL); // edits to a list that is gone
     create_default_station_file();
     load_stations_from_file(); // Load back what we just wrote
+#if CONFIG_RADIO_STATION_TABLE
+    save_station_table();
+#endif
   }
+
+  ESP_LOGI(TAG, "%d stations ready in %lld us, %d bytes of heap",
+           station_count, (long long)(esp_timer_get_time() - start),
+           (int)(heap_before - heap_caps_get_free_size(MALLOC_CAP_8BIT)));
 }
 
 void free_station_data(void) {
-  if (radio_stations != NULL) {
-    for (int i = 0; i < station_count; i++) {
-      free(radio_stations[i].call_sign);
-      free(radio_stations[i].origin);
-      free(radio_stations[i].uri);
-    }
-    free(radio_stations);
-    radio_stations = NULL;
-  }
+  radio_stations = NULL;
   station_count = 0;
+  store_free(&s_store);
 }
 
 static void create_default_station_file(void) {
@@ -133,6 +445,11 @@ static void create_default_station_file(void) {
     cJSON_AddStringToObject(item, "origin", default_stations[i].origin);
     cJSON_AddStringToObject(item, "uri", default_stations[i].uri);
     cJSON_AddNumberToObject(item, "codec", default_stations[i].codec);
+    cJSON_AddNumberToObject(item, "meta_driver",
+                            default_stations[i].meta_driver);
+    if (default_stations[i].meta_uri) {
+      cJSON_AddStringToObject(item, "meta_uri", default_stations[i].meta_uri);
+    }
     cJSON_AddItemToArray(root, item);
   }
 
@@ -153,39 +470,205 @@ static void create_default_station_file(void) {
   cJSON_Delete(root);
 }
 
-int save_station_data(void) {
-  char *json_str = get_stations_json();
-  if (json_str == NULL) {
-    return -1;
+// The station list is serialized straight into this much buffer, which goes
+// to the writer whenever it fills; with hundreds of stations a cJSON tree and
+// its printout would need about three times the text in heap.
+#define JSON_OUT_SIZE 512
+
+typedef struct {
+  station_write_fn write;
+  void *ctx;
+  esp_err_t err;
+  size_t len;
+  char buf[JSON_OUT_SIZE];
+} json_out_t;
+
+static void out_flush(json_out_t *out) {
+  if (out->len > 0 && out->err == ESP_OK) {
+    out->err = out->write(out->buf, out->len, out->ctx);
   }
+  out->len = 0;
+}
 
+static void out_raw(json_out_t *out, const char *s, size_t n) {
+  while (n > 0 && out->err == ESP_OK) {
+    size_t room = JSON_OUT_SIZE - out->len;
+    size_t take = n < room ? n : room;
+    memcpy(out->buf + out->len, s, take);
+    out->len += take;
+    s += take;
+    n -= take;
+    if (out->len == JSON_OUT_SIZE) {
+      out_flush(out);
+    }
+  }
+}
+
+static void out_lit(json_out_t *out, const char *s) {
+  out_raw(out, s, strlen(s));
+}
+
+// escaped as cJSON does: UTF-8 passes through, control characters do not
+static void out_string(json_out_t *out, const char *s) {
+  out_raw(out, "\"", 1);
+  const char *run = s;
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    out_raw(out, run, s - run);
+    run = s + 1;
+    char esc[8];
+    switch (c) {
+    case '"':
+    case '\\':
+      esc[0] = '\\';
+      esc[1] = c;
+      esc[2] = '\0';
+      break;
+    case '\b':
+      strcpy(esc, "\\b");
+      break;
+    case '\f':
+      strcpy(esc, "\\f");
+      break;
+    case '\n':
+      strcpy(esc, "\\n");
+      break;
+    case '\r':
+      strcpy(esc, "\\r");
+      break;
+    case '\t':
+      strcpy(esc, "\\t");
+      break;
+    default:
+      snprintf(esc, sizeof(esc), "\\u%04x", c);
+      break;
+    }
+    out_lit(out, esc);
+  }
+  out_raw(out, run, s - run);
+  out_raw(out, "\"", 1);
+}
+
+// the number format of cJSON, so files written before read back the same
+static void out_number(json_out_t *out, double d) {
+  char num[32];
+  if (isnan(d) || isinf(d)) {
+    strcpy(num, "null");
+  } else if (d >= INT_MIN && d <= INT_MAX && d == (int)d) {
+    snprintf(num, sizeof(num), "%d", (int)d);
+  } else {
+    snprintf(num, sizeof(num), "%1.15g", d);
+    if (strtod(num, NULL) != d) {
+      snprintf(num, sizeof(num), "%1.17g", d);
+    }
+  }
+  out_lit(out, num);
+}
+
+static void out_key(json_out_t *out, const char *key) {
+  out_raw(out, ",", 1);
+  out_string(out, key);
+  out_raw(out, ":", 1);
+}
+
+static void out_dsp(json_out_t *out, const dsp_settings_t *dsp) {
+  out_lit(out, "{\"bands\":[");
+  for (int i = 0; i < dsp->band_count; i++) {
+    out_lit(out, i ? ",{\"type\":" : "{\"type\":");
+    out_number(out, dsp->bands[i].type);
+    out_key(out, "freq");
+    out_number(out, dsp->bands[i].freq);
+    out_key(out, "gain");
+    out_number(out, dsp->bands[i].gain_db);
+    out_key(out, "q");
+    out_number(out, dsp->bands[i].q);
+    out_raw(out, "}", 1);
+  }
+  out_lit(out, "],\"limiter\":");
+  out_lit(out, dsp->limiter ? "true" : "false");
+  out_key(out, "ceiling");
+  out_number(out, dsp->ceiling_db);
+  out_key(out, "release");
+  out_number(out, dsp->release_ms);
+  out_raw(out, "}", 1);
+}
+
+static void out_station(json_out_t *out, const station_t *st) {
+  out_lit(out, "{\"call_sign\":");
+  out_string(out, st->call_sign);
+  out_key(out, "origin");
+  out_string(out, st->origin);
+  out_key(out, "uri");
+  out_string(out, st->uri);
+  out_key(out, "codec");
+  out_number(out, st->codec);
+  out_key(out, "meta_driver");
+  out_number(out, st->meta_driver);
+  if (st->meta_uri) {
+    out_key(out, "meta_uri");
+    out_string(out, st->meta_uri);
+  }
+  if (st->fallback_uri) {
+    out_key(out, "fallback_uri");
+    out_string(out, st->fallback_uri);
+  }
+  if (st->has_dsp) {
+    out_key(out, "dsp");
+    out_dsp(out, &st->dsp);
+  }
+  out_raw(out, "}", 1);
+}
+
+esp_err_t write_stations_json(station_write_fn write, void *ctx) {
+  json_out_t out = {.write = write, .ctx = ctx, .err = ESP_OK, .len = 0};
+  out_raw(&out, "[", 1);
+  for (int i = 0; i < station_count && out.err == ESP_OK; i++) {
+    out_lit(&out, i ? ",\n" : "\n");
+    out_station(&out, &radio_stations[i]);
+  }
+  out_lit(&out, "\n]\n");
+  out_flush(&out);
+  return out.err;
+}
+
+static esp_err_t write_to_file(const char *buf, size_t len, void *ctx) {
+  return fwrite(buf, 1, len, (FILE *)ctx) == len ? ESP_OK : ESP_FAIL;
+}
+
+int save_station_data(void) {
+  // The journal goes first: if the write below is cut short the edits in it
+  // are lost, but they are never replayed over a list they do not belong to.
+  unlink(STATION_JOURNAL);
+#if CONFIG_RADIO_STATION_TABLE
+  station_table_invalidate(); // it no longer matches the file
+#endif
   FILE *f = fopen(STATION_FILE, "w");
   if (f == NULL) {
     ESP_LOGE(TAG, "Failed to open file for writing");
-    free(json_str);
     return -1;
   }
-  fprintf(f, "%s", json_str);
-  fclose(f);
+  esp_err_t err = write_stations_json(write_to_file, f);
+  if (fclose(f) != 0 && err == ESP_OK) {
+    err = ESP_FAIL;
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to write stations file");
+    return -1;
+  }
 
   ESP_LOGI(TAG, "Saved stations to file");
-  free(json_str);
+#if CONFIG_RADIO_STATION_TABLE
+  save_station_table();
+#endif
   return 0;
 }
 
-char *get_stations_json(void) {
-  cJSON *root = cJSON_CreateArray();
-  for (int i = 0; i < station_count; i++) {
-    cJSON *item = cJSON_CreateObject();
-    cJSON_AddStringToObject(item, "call_sign", radio_stations[i].call_sign);
-    cJSON_AddStringToObject(item, "origin", radio_stations[i].origin);
-    cJSON_AddStringToObject(item, "uri", radio_stations[i].uri);
-    cJSON_AddNumberToObject(item, "codec", radio_stations[i].codec);
-    cJSON_AddItemToArray(root, item);
-  }
-  char *out = cJSON_Print(root);
-  cJSON_Delete(root);
-  return out;
+static int read_from_file(char *buf, size_t len, void *ctx) {
+  size_t n = fread(buf, 1, len, (FILE *)ctx);
+  return n == 0 && ferror((FILE *)ctx) ? -1 : (int)n;
 }
 
 static void load_stations_from_file(void) {
@@ -194,79 +677,838 @@ static void load_stations_from_file(void) {
     ESP_LOGE(TAG, "Failed to open station data file");
     return;
   }
+  esp_err_t err = read_stations_json(read_from_file, f);
+  fclose(f);
+
+  if (err == ESP_OK) {
+    ESP_LOGI(TAG, "Loaded %d stations from file", station_count);
+  }
+}
 
-  fseek(f, 0, SEEK_END);
-  long length = ftell(f);
-  fseek(f, 0, SEEK_SET);
+#if CONFIG_RADIO_STATION_TABLE
+// stations.json is also kept as a binary table in its own flash partition,
+// stamped with the file's size and mtime. Booting from it skips the parse and
+// every string copy: the list points into the mapped flash, and only the
+// array and strings edited since live in the store. The table is rewritten
+// after each full save of the file, never by the journal, which replays over
+// it as over the file.
 
-  char *data = (char *)malloc(length + 1);
-  if (!data) {
-    ESP_LOGE(TAG, "Failed to allocate memory for reading file");
-    fclose(f);
+static station_t *alloc_from_store(int count, void *ctx) {
+  return store_stations(ctx, count);
+}
+
+static bool load_stations_from_table(const struct stat *st) {
+  station_store_t *store = store_create();
+  if (store == NULL) {
+    return false;
+  }
+  station_t *stations;
+  int count;
+  if (station_table_load((uint32_t)st->st_size, (uint32_t)st->st_mtime,
+                         alloc_from_store, store, &stations,
+                         &count) != ESP_OK) {
+    store_free(&store);
+    return false;
+  }
+  free_station_data();
+  s_store = store;
+  radio_stations = stations;
+  station_count = count;
+  ESP_LOGI(TAG, "Loaded %d stations from table", station_count);
+  return true;
+}
+
+static void save_station_table(void) {
+  struct stat st;
+  // an empty list means the file did not load; leave the table to it
+  if (station_count == 0 || stat(STATION_FILE, &st) != 0) {
     return;
   }
+  station_table_save(radio_stations, station_count, (uint32_t)st.st_size,
+                     (uint32_t)st.st_mtime);
+}
+#endif
 
-  fread(data, 1, length, f);
-  data[length] = '\0';
-  fclose(f);
+// Stations are imported as the JSON arrives: json_sax hands over one token at
+// a time and each station is assembled from them. Its strings are interned
+// into a new store, which is rolled back if the entry turns out to be
+// incomplete, and the finished station_t goes into a staging list. Only when
+// the whole document has parsed does the array go into the store and the
+// store become the live one, so a bad upload leaves the stations as they
+// were. Parse memory is the fixed import_t whatever the length.
+//
+// A single station (the per-station API and the journal) is parsed the same
+// way from a top-level object. Its strings go straight into the live store,
+// and a base station, when given, supplies every field the object leaves out.
 
-  int ret = update_stations_from_json(data);
-  free(data);
+typedef enum {
+  FIELD_NONE,
+  FIELD_CALL_SIGN,
+  FIELD_ORIGIN,
+  FIELD_URI,
+  FIELD_CODEC,
+  FIELD_META_DRIVER,
+  FIELD_META_URI,
+  FIELD_FALLBACK_URI,
+  FIELD_DSP,
+  FIELD_BANDS,
+  FIELD_LIMITER,
+  FIELD_CEILING,
+  FIELD_RELEASE,
+  FIELD_TYPE,
+  FIELD_FREQ,
+  FIELD_GAIN,
+  FIELD_Q,
+} import_field_t;
 
-  if (ret == 0) {
-    ESP_LOGI(TAG, "Loaded %d stations from file", station_count);
+// nesting of the values being read
+typedef enum {
+  LEVEL_TOP,
+  LEVEL_LIST,
+  LEVEL_STATION,
+  LEVEL_DSP,
+  LEVEL_BANDS,
+  LEVEL_BAND,
+} import_level_t;
+
+static const struct {
+  import_level_t level;
+  const char *name;
+  import_field_t field;
+} import_keys[] = {
+    {LEVEL_STATION, "call_sign", FIELD_CALL_SIGN},
+    {LEVEL_STATION, "origin", FIELD_ORIGIN},
+    {LEVEL_STATION, "uri", FIELD_URI},
+    {LEVEL_STATION, "codec", FIELD_CODEC},
+    {LEVEL_STATION, "meta_driver", FIELD_META_DRIVER},
+    {LEVEL_STATION, "meta_uri", FIELD_META_URI},
+    {LEVEL_STATION, "fallback_uri", FIELD_FALLBACK_URI},
+    {LEVEL_STATION, "dsp", FIELD_DSP},
+    {LEVEL_DSP, "bands", FIELD_BANDS},
+    {LEVEL_DSP, "limiter", FIELD_LIMITER},
+    {LEVEL_DSP, "ceiling", FIELD_CEILING},
+    {LEVEL_DSP, "release", FIELD_RELEASE},
+    {LEVEL_BAND, "type", FIELD_TYPE},
+    {LEVEL_BAND, "freq", FIELD_FREQ},
+    {LEVEL_BAND, "gain", FIELD_GAIN},
+    {LEVEL_BAND, "q", FIELD_Q},
+};
+
+typedef struct staged_station {
+  station_t station;
+  struct staged_station *next;
+} staged_station_t;
+
+typedef struct {
+  json_sax_t sax;
+  char chunk[256];
+  bool single;            // one station object rather than a list
+  const station_t *base;  // single only: the station being patched, or NULL
+  bool dsp_only;          // single only: the object is base's "dsp" settings
+  import_level_t level;
+  int skip; // nesting of an unused object or array being passed over
+  import_field_t field;
+
+  station_t cur;
+  bool has_call_sign, has_origin, has_uri, has_codec;
+  arena_mark_t station_start;
+  dsp_band_t band;
+  bool has_type, has_freq;
+
+  station_store_t *store; // the strings go here
+  arena_block_t *staging;
+  staged_station_t *first;
+  staged_station_t *last;
+  int count;
+} import_t;
+
+// the saturating conversion of cJSON's valueint
+static int json_int(double d) {
+  if (d >= INT_MAX) {
+    return INT_MAX;
+  }
+  if (d <= INT_MIN) {
+    return INT_MIN;
   }
+  return (int)d;
 }
 
-int update_stations_from_json(const char *json_str) {
-  cJSON *json = cJSON_Parse(json_str);
-  if (json == NULL) {
-    ESP_LOGE(TAG, "Failed to parse JSON");
-    return -1;
+// shared for the fields whose values tend to repeat across stations
+static esp_err_t import_string(import_t *imp, const json_sax_value_t *v,
+                               bool shared, char **out) {
+  char *s = shared ? store_intern(imp->store, v->str, v->len)
+                   : store_copy(imp->store, v->str, v->len);
+  if (s == NULL) {
+    return ESP_ERR_NO_MEM;
   }
+  *out = s;
+  return ESP_OK;
+}
 
-  if (!cJSON_IsArray(json)) {
-    ESP_LOGE(TAG, "JSON is not an array");
-    cJSON_Delete(json);
-    return -1;
+static void begin_station(import_t *imp) {
+  bool base = imp->base != NULL;
+  if (base) {
+    imp->cur = *imp->base;
+  } else {
+    memset(&imp->cur, 0, sizeof(imp->cur));
+    imp->cur.meta_driver = META_DRIVER_ICECAST_JSON;
+    imp->cur.dsp = (dsp_settings_t)DSP_SETTINGS_DEFAULT();
   }
+  imp->has_call_sign = imp->has_origin = imp->has_uri = imp->has_codec = base;
+  imp->station_start = arena_mark(imp->store->arena);
+}
 
-  int new_count = cJSON_GetArraySize(json);
+// entries without the required fields are dropped, as they always were
+static esp_err_t end_station(import_t *imp) {
+  if (!imp->has_call_sign || !imp->has_origin || !imp->has_uri ||
+      !imp->has_codec) {
+    store_rollback(imp->store, imp->station_start);
+    return ESP_OK;
+  }
+  if (!imp->single) {
+    store_keep(imp->store); // a single station is kept once it has parsed
+  }
+  staged_station_t *st = arena_alloc(&imp->staging, sizeof(*st));
+  if (st == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  st->station = imp->cur;
+  st->next = NULL;
+  if (imp->last) {
+    imp->last->next = st;
+  } else {
+    imp->first = st;
+  }
+  imp->last = st;
+  imp->count++;
+  return ESP_OK;
+}
 
-  // Allocate new array first
-  station_t *new_stations = (station_t *)malloc(sizeof(station_t) * new_count);
-  if (!new_stations) {
-    ESP_LOGE(TAG, "Failed to allocate memory for new stations");
-    cJSON_Delete(json);
-    return -1;
+static void end_band(import_t *imp) {
+  dsp_settings_t *dsp = &imp->cur.dsp;
+  if (imp->has_type && imp->has_freq && dsp->band_count < DSP_MAX_BANDS) {
+    dsp->bands[dsp->band_count++] = imp->band;
   }
+}
+
+// a value for the member named by the last key; mismatched types are ignored
+static esp_err_t import_value(import_t *imp, json_sax_event_t event,
+                              const json_sax_value_t *v) {
+  station_t *st = &imp->cur;
+  bool number = event == JSON_SAX_NUMBER;
+  bool string = event == JSON_SAX_STRING;
+  esp_err_t err = ESP_OK;
+
+  switch (imp->field) {
+  case FIELD_CALL_SIGN:
+    if (string &&
+        (err = import_string(imp, v, false, &st->call_sign)) == ESP_OK) {
+      imp->has_call_sign = true;
+    }
+    break;
+  case FIELD_ORIGIN:
+    if (string &&
+        (err = import_string(imp, v, true, &st->origin)) == ESP_OK) {
+      imp->has_origin = true;
+    }
+    break;
+  case FIELD_URI:
+    if (string &&
+        (err = import_string(imp, v, false, &st->uri)) == ESP_OK) {
+      imp->has_uri = true;
+    }
+    break;
+  case FIELD_CODEC:
+    if (number) {
+      st->codec = (codec_type_t)json_int(v->number);
+      imp->has_codec = true;
+    }
+    break;
+  case FIELD_META_DRIVER:
+    if (number && json_int(v->number) >= 0 &&
+        json_int(v->number) <= META_DRIVER_NONE) {
+      st->meta_driver = (metadata_driver_t)json_int(v->number);
+    }
+    break;
+  // "" or null clears the optional ones, which only matters for a patch
+  case FIELD_META_URI:
+    if (string || event == JSON_SAX_NULL) {
+      st->meta_uri = NULL;
+    }
+    if (string && v->len > 0) {
+      err = import_string(imp, v, false, &st->meta_uri);
+    }
+    break;
+  case FIELD_FALLBACK_URI:
+    if (string || event == JSON_SAX_NULL) {
+      st->fallback_uri = NULL;
+    }
+    if (string && v->len > 0) {
+      err = import_string(imp, v, true, &st->fallback_uri);
+    }
+    break;
+  case FIELD_DSP:
+    if (event == JSON_SAX_NULL) {
+      st->has_dsp = false;
+      st->dsp = (dsp_settings_t)DSP_SETTINGS_DEFAULT();
+    }
+    break;
+  case FIELD_LIMITER:
+    if (event == JSON_SAX_BOOL) {
+      st->dsp.limiter = v->boolean;
+    }
+    break;
+  case FIELD_CEILING:
+    if (number) {
+      st->dsp.ceiling_db = (float)v->number;
+    }
+    break;
+  case FIELD_RELEASE:
+    if (number) {
+      st->dsp.release_ms = (float)v->number;
+    }
+    break;
+  case FIELD_TYPE:
+    if (number) {
+      imp->band.type = (dsp_band_type_t)json_int(v->number);
+      imp->has_type = true;
+    }
+    break;
+  case FIELD_FREQ:
+    if (number) {
+      imp->band.freq = (float)v->number;
+      imp->has_freq = true;
+    }
+    break;
+  case FIELD_GAIN:
+    if (number) {
+      imp->band.gain_db = (float)v->number;
+    }
+    break;
+  case FIELD_Q:
+    if (number) {
+      imp->band.q = (float)v->number;
+    }
+    break;
+  default:
+    break;
+  }
+  imp->field = FIELD_NONE;
+  return err;
+}
+
+static esp_err_t import_event(json_sax_event_t event,
+                              const json_sax_value_t *v, void *ctx) {
+  import_t *imp = ctx;
+  bool start = event == JSON_SAX_OBJECT_START || event == JSON_SAX_ARRAY_START;
+  bool end = event == JSON_SAX_OBJECT_END || event == JSON_SAX_ARRAY_END;
+
+  if (imp->skip > 0) {
+    imp->skip += start ? 1 : (end ? -1 : 0);
+    return ESP_OK;
+  }
+
+  if (event == JSON_SAX_KEY) {
+    imp->field = FIELD_NONE;
+    for (size_t i = 0; i < sizeof(import_keys) / sizeof(import_keys[0]); i++) {
+      // case-insensitive, as cJSON_GetObjectItem() matched them
+      if (import_keys[i].level == imp->level &&
+          strcasecmp(import_keys[i].name, v->str) == 0) {
+        imp->field = import_keys[i].field;
+        break;
+      }
+    }
+    return ESP_OK;
+  }
+
+  switch (imp->level) {
+  case LEVEL_TOP:
+    if (imp->single) {
+      if (event != JSON_SAX_OBJECT_START) {
+        ESP_LOGE(TAG, "JSON is not an object");
+        return ESP_ERR_INVALID_ARG;
+      }
+      begin_station(imp);
+      imp->level = LEVEL_STATION;
+      if (imp->dsp_only) {
+        imp->cur.dsp = (dsp_settings_t)DSP_SETTINGS_DEFAULT();
+        imp->cur.has_dsp = true;
+        imp->level = LEVEL_DSP;
+      }
+      return ESP_OK;
+    }
+    if (event != JSON_SAX_ARRAY_START) {
+      ESP_LOGE(TAG, "JSON is not an array");
+      return ESP_ERR_INVALID_ARG;
+    }
+    imp->level = LEVEL_LIST;
+    return ESP_OK;
 
-  memset(new_stations, 0, sizeof(station_t) * new_count);
+  case LEVEL_LIST:
+    if (event == JSON_SAX_OBJECT_START) {
+      begin_station(imp);
+      imp->level = LEVEL_STATION;
+    } else if (event == JSON_SAX_ARRAY_END) {
+      imp->level = LEVEL_TOP;
+    } else if (start) {
+      imp->skip = 1;
+    }
+    return ESP_OK;
 
-  int idx = 0;
-  cJSON *item = NULL;
-  cJSON_ArrayForEach(item, json) {
-    cJSON *call_sign = cJSON_GetObjectItem(item, "call_sign");
-    cJSON *origin = cJSON_GetObjectItem(item, "origin");
-    cJSON *uri = cJSON_GetObjectItem(item, "uri");
-    cJSON *codec = cJSON_GetObjectItem(item, "codec");
+  case LEVEL_STATION:
+    if (event == JSON_SAX_OBJECT_END) {
+      imp->level = imp->single ? LEVEL_TOP : LEVEL_LIST;
+      return end_station(imp);
+    }
+    if (event == JSON_SAX_OBJECT_START && imp->field == FIELD_DSP) {
+      // missing settings take their defaults, not the base station's
+      imp->cur.dsp = (dsp_settings_t)DSP_SETTINGS_DEFAULT();
+      imp->cur.has_dsp = true;
+      imp->level = LEVEL_DSP;
+    } else if (start) {
+      imp->skip = 1;
+    } else {
+      return import_value(imp, event, v);
+    }
+    imp->field = FIELD_NONE;
+    return ESP_OK;
 
-    if (cJSON_IsString(call_sign) && cJSON_IsString(origin) &&
-        cJSON_IsString(uri) && cJSON_IsNumber(codec)) {
+  case LEVEL_DSP:
+    if (event == JSON_SAX_OBJECT_END) {
+      dsp_clamp_settings(&imp->cur.dsp);
+      if (imp->dsp_only) {
+        imp->level = LEVEL_TOP;
+        return end_station(imp);
+      }
+      imp->level = LEVEL_STATION;
+    } else if (event == JSON_SAX_ARRAY_START && imp->field == FIELD_BANDS) {
+      imp->level = LEVEL_BANDS;
+    } else if (start) {
+      imp->skip = 1;
+    } else {
+      return import_value(imp, event, v);
+    }
+    imp->field = FIELD_NONE;
+    return ESP_OK;
 
-      new_stations[idx].call_sign = strdup(call_sign->valuestring);
-      new_stations[idx].origin = strdup(origin->valuestring);
-      new_stations[idx].uri = strdup(uri->valuestring);
-      new_stations[idx].codec = (codec_type_t)codec->valueint;
-      idx++;
+  case LEVEL_BANDS:
+    if (event == JSON_SAX_OBJECT_START) {
+      imp->band = (dsp_band_t){.gain_db = 0.0f, .q = 0.707f};
+      imp->has_type = imp->has_freq = false;
+      imp->level = LEVEL_BAND;
+    } else if (event == JSON_SAX_ARRAY_END) {
+      imp->level = LEVEL_DSP;
+    } else if (start) {
+      imp->skip = 1;
     }
+    return ESP_OK;
+
+  case LEVEL_BAND:
+    if (event == JSON_SAX_OBJECT_END) {
+      end_band(imp);
+      imp->level = LEVEL_BANDS;
+    } else if (start) {
+      imp->skip = 1;
+    } else {
+      return import_value(imp, event, v);
+    }
+    imp->field = FIELD_NONE;
+    return ESP_OK;
+  }
+  return ESP_OK;
+}
+
+// the staged stations go into their strings' store, which becomes the live one
+static esp_err_t import_commit(import_t *imp) {
+  if (imp->count == 0) {
+    // an empty list would leave nothing to play, now and after a reboot
+    ESP_LOGE(TAG, "Station list has no complete station");
+    return ESP_ERR_INVALID_ARG;
+  }
+  station_t *stations = store_stations(imp->store, imp->count);
+  if (stations == NULL) {
+    ESP_LOGE(TAG, "Failed to allocate memory for new stations");
+    return ESP_ERR_NO_MEM;
+  }
+  int i = 0;
+  for (const staged_station_t *st = imp->first; st; st = st->next) {
+    stations[i++] = st->station;
   }
 
-  // Now replace the global data
   free_station_data();
-  radio_stations = new_stations;
-  station_count = idx; // Use actual read count, in case of partial failures
+  s_store = imp->store;
+  imp->store = NULL;
+  radio_stations = stations;
+  station_count = imp->count;
+  return ESP_OK;
+}
 
-  cJSON_Delete(json);
-  return 0;
-}
\ No newline at end of file
+// feeds everything read to the parser, *total counts it
+static esp_err_t import_run(import_t *imp, station_read_fn read, void *ctx,
+                            size_t *total) {
+  json_sax_init(&imp->sax, import_event, imp);
+  *total = 0;
+  for (;;) {
+    int n = read(imp->chunk, sizeof(imp->chunk), ctx);
+    if (n < 0) {
+      return ESP_FAIL;
+    }
+    if (n == 0) {
+      return json_sax_finish(&imp->sax);
+    }
+    *total += n;
+    if (*total > STATION_LIST_MAX_SIZE) {
+      return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t err = json_sax_feed(&imp->sax, imp->chunk, n);
+    if (err != ESP_OK) {
+      return err;
+    }
+  }
+}
+
+esp_err_t read_stations_json(station_read_fn read, void *ctx) {
+  import_t *imp = calloc(1, sizeof(import_t));
+  if (imp == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  imp->store = store_create();
+  if (imp->store == NULL) {
+    free(imp);
+    return ESP_ERR_NO_MEM;
+  }
+
+  size_t total;
+  esp_err_t err = import_run(imp, read, ctx, &total);
+  if (err == ESP_OK) {
+    err = import_commit(imp);
+  } else {
+    ESP_LOGE(TAG, "Station list rejected after %u bytes: %s",
+             (unsigned)total, esp_err_to_name(err));
+  }
+  arena_free(&imp->staging);
+  store_free(&imp->store);
+  free(imp);
+  return err;
+}
+
+// Reads one station object into *out, over base if it is given, or with
+// dsp_only just base's DSP settings. The strings are interned into the live
+// store, and taken back out again on error.
+static esp_err_t parse_station(station_read_fn read, void *ctx,
+                               const station_t *base, bool dsp_only,
+                               station_t *out) {
+  if (s_store == NULL && (s_store = store_create()) == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  import_t *imp = calloc(1, sizeof(import_t));
+  if (imp == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  imp->single = true;
+  imp->base = base;
+  imp->dsp_only = dsp_only;
+  imp->store = s_store;
+  arena_mark_t start = arena_mark(s_store->arena);
+
+  size_t total;
+  esp_err_t err = import_run(imp, read, ctx, &total);
+  if (err == ESP_OK && imp->count == 0) {
+    ESP_LOGE(TAG, "Station needs call_sign, origin, uri and codec");
+    err = ESP_ERR_INVALID_ARG;
+  }
+  if (err == ESP_OK) {
+    *out = imp->first->station;
+    store_keep(s_store);
+  } else {
+    ESP_LOGE(TAG, "Station rejected after %u bytes: %s", (unsigned)total,
+             esp_err_to_name(err));
+    store_rollback(s_store, start);
+  }
+  arena_free(&imp->staging);
+  free(imp);
+  return err;
+}
+
+// The edits below change the list in memory only. The strings a station no
+// longer uses, and the array an append outgrows, stay in the store until the
+// next whole-list import, so a pointer another task took from radio_stations
+// never dangles.
+
+// replaces station index, or appends at index == station_count
+static esp_err_t put_station(int index, const station_t *st) {
+  if (index < 0 || index > station_count) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  if (index == station_count) {
+    if (s_store == NULL && (s_store = store_create()) == NULL) {
+      return ESP_ERR_NO_MEM;
+    }
+    if (station_count == s_store->capacity) {
+      station_t *grown = store_stations(
+          s_store, s_store->capacity ? s_store->capacity * 2 : 8);
+      if (grown == NULL) {
+        return ESP_ERR_NO_MEM;
+      }
+      radio_stations = grown;
+    }
+    radio_stations[index] = *st;
+    // a reader that sees the new count must find the entry behind it
+    atomic_thread_fence(memory_order_release);
+    station_count++;
+    return ESP_OK;
+  }
+  radio_stations[index] = *st;
+  return ESP_OK;
+}
+
+static esp_err_t remove_station(int index, int *tracked) {
+  if (index < 0 || index >= station_count) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  if (station_count == 1) {
+    return ESP_ERR_INVALID_STATE; // there is always a station to play
+  }
+  memmove(&radio_stations[index], &radio_stations[index + 1],
+          sizeof(station_t) * (station_count - index - 1));
+  station_count--;
+  if (tracked && *tracked > index) {
+    (*tracked)--;
+  } else if (tracked && *tracked >= station_count) {
+    *tracked = station_count - 1; // it was the last one
+  }
+  return ESP_OK;
+}
+
+static esp_err_t shift_station(int from, int to, int *tracked) {
+  if (from < 0 || from >= station_count || to < 0 || to >= station_count) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  station_t st = radio_stations[from];
+  if (from < to) {
+    memmove(&radio_stations[from], &radio_stations[from + 1],
+            sizeof(station_t) * (to - from));
+  } else {
+    memmove(&radio_stations[to + 1], &radio_stations[to],
+            sizeof(station_t) * (from - to));
+  }
+  radio_stations[to] = st;
+  if (tracked == NULL) {
+    return ESP_OK;
+  }
+  if (*tracked == from) {
+    *tracked = to;
+  } else if (from < *tracked && *tracked <= to) {
+    (*tracked)--;
+  } else if (to <= *tracked && *tracked < from) {
+    (*tracked)++;
+  }
+  return ESP_OK;
+}
+
+// Journal lines are "put <index> <station JSON>", "delete <index>" and
+// "move <from> <to>"; put at index station_count appends. A put stores the
+// whole station, so replaying never depends on what a patch left out.
+
+static esp_err_t count_bytes(const char *buf, size_t len, void *ctx) {
+  *(size_t *)ctx += len;
+  return ESP_OK;
+}
+
+static esp_err_t journal_write(const char *entry, const station_t *st) {
+  if (st) {
+    size_t len = strlen(entry) + 2; // the space and the newline
+    json_out_t count = {.write = count_bytes, .ctx = &len, .err = ESP_OK};
+    out_station(&count, st);
+    out_flush(&count);
+    if (len > JOURNAL_LINE_MAX) {
+      return ESP_ERR_INVALID_SIZE; // could not be read back
+    }
+  }
+
+  FILE *f = fopen(STATION_JOURNAL, "a");
+  if (f == NULL) {
+    return ESP_FAIL;
+  }
+  json_out_t out = {.write = write_to_file, .ctx = f, .err = ESP_OK};
+  out_lit(&out, entry);
+  if (st) {
+    out_raw(&out, " ", 1);
+    out_station(&out, st);
+  }
+  out_raw(&out, "\n", 1);
+  out_flush(&out);
+  long size = ftell(f);
+  if (fclose(f) != 0 && out.err == ESP_OK) {
+    out.err = ESP_FAIL;
+  }
+  if (out.err == ESP_OK && size > JOURNAL_MAX_SIZE) {
+    return ESP_ERR_INVALID_SIZE; // time to fold it into the file
+  }
+  return out.err;
+}
+
+// Saves one edit; the whole list is written instead when the journal is
+// full or cannot take the entry
+static esp_err_t journal_edit(const char *entry, const station_t *st) {
+  esp_err_t err = journal_write(entry, st);
+  if (err == ESP_OK) {
+    return ESP_OK;
+  }
+  if (err != ESP_ERR_INVALID_SIZE) {
+    ESP_LOGW(TAG, "Station journal write failed, saving the whole list");
+  }
+  return save_station_data() == 0 ? ESP_OK : ESP_ERR_NOT_FINISHED;
+}
+
+static esp_err_t journal_put(int index) {
+  char entry[24];
+  snprintf(entry, sizeof(entry), "put %d", index);
+  return journal_edit(entry, &radio_stations[index]);
+}
+
+int save_station(int index) {
+  if (index < 0 || index >= station_count) {
+    return -1;
+  }
+  return journal_put(index) == ESP_OK ? 0 : -1;
+}
+
+esp_err_t patch_station_json(int index, station_read_fn read, void *ctx) {
+  if (index < 0 || index >= station_count) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  station_t st;
+  esp_err_t err = parse_station(read, ctx, &radio_stations[index], false, &st);
+  if (err != ESP_OK) {
+    return err;
+  }
+  radio_stations[index] = st;
+  ESP_LOGI(TAG, "Updated station %d: %s", index, st.call_sign);
+  return journal_put(index);
+}
+
+esp_err_t patch_station_dsp_json(int index, station_read_fn read, void *ctx) {
+  if (index < 0 || index >= station_count) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  station_t st;
+  esp_err_t err = parse_station(read, ctx, &radio_stations[index], true, &st);
+  if (err != ESP_OK) {
+    return err;
+  }
+  radio_stations[index] = st;
+  ESP_LOGI(TAG, "Updated DSP settings of station %d", index);
+  return journal_put(index);
+}
+
+esp_err_t append_station_json(station_read_fn read, void *ctx, int *index) {
+  station_t st;
+  esp_err_t err = parse_station(read, ctx, NULL, false, &st);
+  if (err == ESP_OK) {
+    err = put_station(station_count, &st);
+  }
+  if (err != ESP_OK) {
+    return err;
+  }
+  *index = station_count - 1;
+  ESP_LOGI(TAG, "Added station %d: %s", *index, st.call_sign);
+  return journal_put(*index);
+}
+
+esp_err_t delete_station(int index, int *tracked) {
+  esp_err_t err = remove_station(index, tracked);
+  if (err != ESP_OK) {
+    return err;
+  }
+  ESP_LOGI(TAG, "Deleted station %d", index);
+  char entry[24];
+  snprintf(entry, sizeof(entry), "delete %d", index);
+  return journal_edit(entry, NULL);
+}
+
+esp_err_t move_station(int from, int to, int *tracked) {
+  esp_err_t err = shift_station(from, to, tracked);
+  if (err != ESP_OK || from == to) {
+    return err;
+  }
+  ESP_LOGI(TAG, "Moved station %d to %d", from, to);
+  char entry[32];
+  snprintf(entry, sizeof(entry), "move %d %d", from, to);
+  return journal_edit(entry, NULL);
+}
+
+typedef struct {
+  const char *p;
+  size_t left;
+} mem_reader_t;
+
+static int read_from_mem(char *buf, size_t len, void *ctx) {
+  mem_reader_t *r = ctx;
+  size_t n = len < r->left ? len : r->left;
+  memcpy(buf, r->p, n);
+  r->p += n;
+  r->left -= n;
+  return (int)n;
+}
+
+static esp_err_t replay_entry(const char *line) {
+  int index, to, pos = 0;
+  if (sscanf(line, "put %d %n", &index, &pos) == 1 && pos > 0) {
+    mem_reader_t r = {line + pos, strlen(line + pos)};
+    station_t st;
+    esp_err_t err = parse_station(read_from_mem, &r, NULL, false, &st);
+    return err == ESP_OK ? put_station(index, &st) : err;
+  }
+  if (sscanf(line, "delete %d", &index) == 1) {
+    return remove_station(index, NULL);
+  }
+  if (sscanf(line, "move %d %d", &index, &to) == 2) {
+    return shift_station(index, to, NULL);
+  }
+  return ESP_ERR_INVALID_ARG;
+}
+
+static void replay_journal(void) {
+  FILE *f = fopen(STATION_JOURNAL, "r");
+  if (f == NULL) {
+    return;
+  }
+  char *line = malloc(JOURNAL_LINE_MAX + 1);
+  if (line == NULL) {
+    fclose(f);
+    ESP_LOGE(TAG, "No memory to replay the station journal");
+    return;
+  }
+  int applied = 0;
+  bool intact = true;
+  while (fgets(line, JOURNAL_LINE_MAX + 1, f)) {
+    size_t len = strlen(line);
+    // a line without its newline is the one a reset cut short
+    if (len == 0 || line[len - 1] != '\n' ||
+        replay_entry(line) != ESP_OK) {
+      ESP_LOGW(TAG, "Station journal ends in a bad entry, dropped from %d",
+               applied + 1);
+      intact = false;
+      break;
+    }
+    applied++;
+  }
+  free(line);
+  fclose(f);
+  ESP_LOGI(TAG, "Replayed %d station edits, %d stations", applied,
+           station_count);
+  if (!intact) {
+    save_station_data(); // so new entries do not follow the bad one
+  }
+}
+
+char *get_station_dsp_json(int index) {
+  if (index < 0 || index >= station_count) {
+    return NULL;
+  }
+  cJSON *obj = dsp_to_json(&radio_stations[index].dsp);
+  char *out = cJSON_PrintUnformatted(obj);
+  cJSON_Delete(obj);
+  return out;
+}
@@ -2,12 +2,26 @@
 #define STATION_DATA_H
 
 #include "audio_pipeline_manager.h"
+#include "dsp.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief Service polled for a station's "now playing" text.
+ */
+typedef enum {
+  META_DRIVER_ICECAST_JSON, // status-json.xsl on the stream server, the default
+  META_DRIVER_KEXP_V2,      // KEXP plays API
+  META_DRIVER_SPINITRON,    // public Spinitron playlist page
+  META_DRIVER_NONE,         // in-stream ICY titles only
+} metadata_driver_t;
+
 /**
  * @brief Structure to define a radio station's properties.
  * Note: Members are now non-const to allow dynamic allocation.
@@ -17,8 +31,24 @@ typedef struct {
   char *origin;       // Station's origin (city or school)
   char *uri;          // Stream URI
   codec_type_t codec; // Codec type for the stream
+  metadata_driver_t meta_driver;
+  char *meta_uri; // metadata endpoint, NULL to derive it from uri
+  char *fallback_uri; // played when uri stalls and reconnects fail, or NULL
+  bool has_dsp;       // dsp was set for this station and is saved with it
+  dsp_settings_t dsp; // EQ and limiter, the defaults unless has_dsp
 } station_t;
 
+/**
+ * @brief Largest station list JSON accepted, from the file or the web.
+ */
+#define STATION_LIST_MAX_SIZE (CONFIG_RADIO_STATION_LIST_MAX_KB * 1024)
+
+/**
+ * @brief Largest DSP settings JSON accepted from the web. Five bands take
+ * about 400 bytes.
+ */
+#define STATION_DSP_MAX_SIZE 2048
+
 /**
  * @brief Pointer to the array of station data.
  */
@@ -37,28 +67,116 @@ void init_station_data(void);
 
 /**
  * @brief Save current station list to filesystem.
+ * This also folds in and clears the journal of single-station edits.
  * @return 0 on success, < 0 on failure.
  */
 int save_station_data(void);
 
+/**
+ * @brief Save one station's changes by appending it to the journal, which is
+ * much cheaper than rewriting the whole file.
+ * @param index Station index.
+ * @return 0 on success, < 0 on failure.
+ */
+int save_station(int index);
+
 /**
  * @brief Free all allocated station memory.
  */
 void free_station_data(void);
 
 /**
- * @brief Get the stations list as a JSON string.
- * Caller must free the returned string.
- * @return JSON string or NULL on error.
+ * @brief Receives the station list JSON in pieces.
+ * @return ESP_OK to continue, anything else stops the output.
  */
-char *get_stations_json(void);
+typedef esp_err_t (*station_write_fn)(const char *buf, size_t len, void *ctx);
 
 /**
- * @brief Update stations from a JSON string.
- * @param json_str JSON string containing array of stations.
- * @return 0 on success, < 0 on failure.
+ * @brief Write the stations list as JSON, one station per line.
+ * Stations are formatted into a small fixed buffer that is passed to write
+ * whenever it fills, so nothing is allocated whatever the list length.
+ * @return ESP_OK, or the first error returned by write.
+ */
+esp_err_t write_stations_json(station_write_fn write, void *ctx);
+
+/**
+ * @brief Supplies the station list JSON in pieces.
+ * @return Bytes placed in buf, 0 at the end, or < 0 on failure.
+ */
+typedef int (*station_read_fn)(char *buf, size_t len, void *ctx);
+
+/**
+ * @brief Replace the stations with a JSON array read through read.
+ * The JSON is parsed as it arrives and the stations are built into staging
+ * memory; they replace the list only once the whole document has parsed.
+ * Entries missing call_sign, origin, uri or codec are skipped.
+ * @return ESP_OK; ESP_ERR_INVALID_ARG if it is not valid JSON, not an array
+ * or holds no complete station; ESP_ERR_INVALID_SIZE past STATION_LIST_MAX_SIZE bytes or a string
+ * over JSON_SAX_TOKEN_MAX; ESP_ERR_NO_MEM; ESP_FAIL if read failed. The list
+ * is unchanged on error.
+ */
+esp_err_t read_stations_json(station_read_fn read, void *ctx);
+
+/*
+ * Single-station edits. Each changes the list in place and saves itself by
+ * appending one line to a journal that is replayed over stations.json at
+ * boot; the journal is folded into the file when it reaches 16 KB. They
+ * return ESP_ERR_NOT_FOUND for an index outside the list, and
+ * ESP_ERR_NOT_FINISHED when the change was made but could not be saved.
+ */
+
+/**
+ * @brief Change the fields of one station to those of a JSON object read
+ * through read. Fields the object leaves out keep their values; an empty or
+ * null meta_uri or fallback_uri clears it, and a null dsp resets it.
+ * @return ESP_OK, the errors of read_stations_json(), ESP_ERR_NOT_FOUND or
+ * ESP_ERR_NOT_FINISHED. The station is unchanged if it could not be parsed.
+ */
+esp_err_t patch_station_json(int index, station_read_fn read, void *ctx);
+
+/**
+ * @brief Replace a station's EQ and limiter settings with a JSON object, in
+ * the format of the "dsp" station field, read through read. Missing fields
+ * take their defaults and values are clamped to their ranges. Saved like
+ * patch_station_json(); the caller applies them.
+ * @return As patch_station_json().
+ */
+esp_err_t patch_station_dsp_json(int index, station_read_fn read, void *ctx);
+
+/**
+ * @brief Add the station in a JSON object read through read to the end of
+ * the list. It needs call_sign, origin, uri and codec.
+ * @param index Set to the index of the new station.
+ * @return As patch_station_json(), and ESP_ERR_INVALID_ARG if a required
+ * field is missing.
+ */
+esp_err_t append_station_json(station_read_fn read, void *ctx, int *index);
+
+/**
+ * @brief Remove a station; the ones after it move up by one.
+ * @param tracked An index to keep on the same station, such as the one
+ * playing, or NULL. If that station is deleted it is left on the station
+ * that took its place.
+ * @return ESP_OK, ESP_ERR_NOT_FOUND, ESP_ERR_INVALID_STATE for the last
+ * station left, or ESP_ERR_NOT_FINISHED.
+ */
+esp_err_t delete_station(int index, int *tracked);
+
+/**
+ * @brief Move a station so it ends up at index to, shifting the ones in
+ * between.
+ * @param tracked An index to keep on the same station, or NULL.
+ * @return ESP_OK, ESP_ERR_NOT_FOUND or ESP_ERR_NOT_FINISHED.
+ */
+esp_err_t move_station(int from, int to, int *tracked);
+
+/**
+ * @brief Get a station's EQ and limiter settings as a JSON string.
+ * Caller must free the returned string.
+ * @param index Station index.
+ * @return JSON string or NULL on error.
  */
-int update_stations_from_json(const char *json_str);
+char *get_station_dsp_json(int index);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,337 @@
+#include "station_table.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "STATION_TABLE";
+
+// The "stations" data partition holds two slots. A slot is a header, count
+// fixed-size records and a pool of NUL terminated strings the records refer
+// to by offset. A new table always goes into the slot the live list does not
+// point into, and its header is written last; of two valid slots the higher
+// sequence wins. stations.json stays the source of truth: a table is only
+// used when it was written from a file of the same size and mtime.
+
+#define STATION_TABLE_LABEL "stations"
+#define STATION_TABLE_MAGIC 0x31425453 // "STB1"
+// bump whenever table_record_t changes, and with it station_t or the layout
+// of dsp_settings_t
+#define STATION_TABLE_VERSION 1
+#define NO_STRING UINT32_MAX
+#define SECTOR_SIZE 4096
+#define WRITE_CHUNK 512
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  uint32_t sequence;
+  uint32_t count;
+  uint32_t pool_size;
+  uint32_t source_size;
+  uint32_t source_mtime;
+  uint32_t crc; // of the records and the pool
+} table_header_t;
+
+typedef struct {
+  uint32_t call_sign; // offsets into the pool, or NO_STRING
+  uint32_t origin;
+  uint32_t uri;
+  uint32_t meta_uri;
+  uint32_t fallback_uri;
+  uint8_t codec;
+  uint8_t meta_driver;
+  uint8_t has_dsp;
+  uint8_t reserved;
+  dsp_settings_t dsp;
+} table_record_t;
+
+static const esp_partition_t *s_part = NULL;
+static const uint8_t *s_map = NULL; // the whole partition, mapped for good
+static uint32_t s_slot_size = 0;
+static int s_live_slot = -1; // the slot the loaded list reads strings from
+
+static esp_err_t table_map(void) {
+  if (s_map) {
+    return ESP_OK;
+  }
+  s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                    ESP_PARTITION_SUBTYPE_ANY,
+                                    STATION_TABLE_LABEL);
+  if (s_part == NULL) {
+    ESP_LOGW(TAG, "No \"%s\" partition", STATION_TABLE_LABEL);
+    return ESP_ERR_NOT_FOUND;
+  }
+  const void *map;
+  esp_partition_mmap_handle_t handle;
+  esp_err_t err = esp_partition_mmap(s_part, 0, s_part->size,
+                                     ESP_PARTITION_MMAP_DATA, &map, &handle);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to map the station table (%s)",
+             esp_err_to_name(err));
+    s_part = NULL;
+    return err;
+  }
+  s_map = map;
+  s_slot_size = s_part->size / 2 / SECTOR_SIZE * SECTOR_SIZE;
+  return ESP_OK;
+}
+
+static const table_header_t *slot_header(int slot) {
+  return (const table_header_t *)(s_map + slot * s_slot_size);
+}
+
+// the header describes a table that fits the slot
+static bool slot_sane(int slot) {
+  const table_header_t *h = slot_header(slot);
+  return h->magic == STATION_TABLE_MAGIC &&
+         h->version == STATION_TABLE_VERSION &&
+         h->record_size == sizeof(table_record_t) &&
+         h->count <= s_slot_size / sizeof(table_record_t) &&
+         h->pool_size <= s_slot_size &&
+         sizeof(*h) + h->count * sizeof(table_record_t) + h->pool_size <=
+             s_slot_size;
+}
+
+// the CRC matches; it reads the whole slot, so only once the header is sane
+static bool slot_valid(int slot) {
+  const table_header_t *h = slot_header(slot);
+  const uint8_t *data = (const uint8_t *)(h + 1);
+  uint32_t len = h->count * sizeof(table_record_t) + h->pool_size;
+  // every string must end inside the pool
+  if (h->pool_size > 0 && data[len - 1] != '\0') {
+    return false;
+  }
+  return esp_rom_crc32_le(0, data, len) == h->crc;
+}
+
+// the valid slot with the higher sequence, or -1. The older slot is only
+// checked when the newer one fails.
+static int newest_slot(void) {
+  bool sane[2] = {slot_sane(0), slot_sane(1)};
+  int first = sane[0] && sane[1] &&
+                      slot_header(1)->sequence > slot_header(0)->sequence
+                  ? 1
+                  : (sane[0] ? 0 : 1);
+  if (sane[first] && slot_valid(first)) {
+    return first;
+  }
+  return sane[!first] && slot_valid(!first) ? !first : -1;
+}
+
+static char *pool_string(const table_header_t *h, const char *pool,
+                         uint32_t offset, bool *ok) {
+  if (offset == NO_STRING) {
+    return NULL;
+  }
+  if (offset >= h->pool_size) {
+    *ok = false;
+    return NULL;
+  }
+  // read only: the list never writes into its strings
+  return (char *)pool + offset;
+}
+
+esp_err_t station_table_load(uint32_t source_size, uint32_t source_mtime,
+                             station_alloc_fn alloc, void *ctx,
+                             station_t **stations, int *count) {
+  esp_err_t err = table_map();
+  if (err != ESP_OK) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  int slot = newest_slot();
+  if (slot < 0) {
+    ESP_LOGI(TAG, "No valid station table");
+    return ESP_ERR_NOT_FOUND;
+  }
+  const table_header_t *h = slot_header(slot);
+  if (h->source_size != source_size || h->source_mtime != source_mtime) {
+    ESP_LOGI(TAG, "Station table is out of date");
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  station_t *list = alloc((int)h->count, ctx);
+  if (list == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  const table_record_t *rec = (const table_record_t *)(h + 1);
+  const char *pool = (const char *)(rec + h->count);
+  bool ok = true;
+  for (uint32_t i = 0; i < h->count; i++) {
+    const table_record_t *r = &rec[i];
+    list[i] = (station_t){
+        .call_sign = pool_string(h, pool, r->call_sign, &ok),
+        .origin = pool_string(h, pool, r->origin, &ok),
+        .uri = pool_string(h, pool, r->uri, &ok),
+        .codec = (codec_type_t)r->codec,
+        .meta_driver = (metadata_driver_t)r->meta_driver,
+        .meta_uri = pool_string(h, pool, r->meta_uri, &ok),
+        .fallback_uri = pool_string(h, pool, r->fallback_uri, &ok),
+        .has_dsp = r->has_dsp,
+        .dsp = r->dsp,
+    };
+    ok = ok && list[i].call_sign && list[i].origin && list[i].uri;
+  }
+  if (!ok) {
+    ESP_LOGE(TAG, "Station table slot %d is inconsistent", slot);
+    return ESP_ERR_NOT_FOUND;
+  }
+  s_live_slot = slot;
+  *stations = list;
+  *count = (int)h->count;
+  return ESP_OK;
+}
+
+// Flash bits can be cleared without an erase, so zeroing the magic leaves the
+// strings a list may still be reading as they are.
+void station_table_invalidate(void) {
+  static const uint32_t zero = 0;
+  if (table_map() != ESP_OK) {
+    return;
+  }
+  for (int slot = 0; slot < 2; slot++) {
+    if (slot_header(slot)->magic == STATION_TABLE_MAGIC) {
+      esp_partition_write(s_part, slot * s_slot_size, &zero, sizeof(zero));
+    }
+  }
+}
+
+static uint32_t add_string(const char *s, uint32_t *pool_size) {
+  if (s == NULL) {
+    return NO_STRING;
+  }
+  uint32_t offset = *pool_size;
+  *pool_size += strlen(s) + 1;
+  return offset;
+}
+
+// Sequential writer for one slot; the CRC follows everything written
+typedef struct {
+  size_t offset; // in the partition
+  uint32_t crc;
+  esp_err_t err;
+  size_t len;
+  uint8_t buf[WRITE_CHUNK];
+} slot_writer_t;
+
+static void writer_flush(slot_writer_t *w) {
+  if (w->len > 0 && w->err == ESP_OK) {
+    w->err = esp_partition_write(s_part, w->offset, w->buf, w->len);
+    w->crc = esp_rom_crc32_le(w->crc, w->buf, w->len);
+    w->offset += w->len;
+  }
+  w->len = 0;
+}
+
+static void writer_put(slot_writer_t *w, const void *data, size_t n) {
+  const uint8_t *p = data;
+  while (n > 0 && w->err == ESP_OK) {
+    size_t take = WRITE_CHUNK - w->len;
+    take = n < take ? n : take;
+    memcpy(w->buf + w->len, p, take);
+    w->len += take;
+    p += take;
+    n -= take;
+    if (w->len == WRITE_CHUNK) {
+      writer_flush(w);
+    }
+  }
+}
+
+static esp_err_t write_slot(int slot, const station_t *stations, int count,
+                            table_header_t *h) {
+  uint32_t pool_size = 0;
+  for (int i = 0; i < count; i++) {
+    const station_t *st = &stations[i];
+    pool_size += strlen(st->call_sign) + strlen(st->origin) +
+                 strlen(st->uri) + 3;
+    pool_size += st->meta_uri ? strlen(st->meta_uri) + 1 : 0;
+    pool_size += st->fallback_uri ? strlen(st->fallback_uri) + 1 : 0;
+  }
+  size_t size = sizeof(*h) + count * sizeof(table_record_t) + pool_size;
+  if (size > s_slot_size) {
+    ESP_LOGW(TAG, "%d stations need %u bytes, a slot holds %u", count,
+             (unsigned)size, (unsigned)s_slot_size);
+    return ESP_ERR_INVALID_SIZE;
+  }
+
+  size_t base = slot * s_slot_size;
+  size_t erase = (size + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+  esp_err_t err = esp_partition_erase_range(s_part, base, erase);
+  if (err != ESP_OK) {
+    return err;
+  }
+
+  slot_writer_t *w = malloc(sizeof(slot_writer_t));
+  if (w == NULL) {
+    return ESP_ERR_NO_MEM;
+  }
+  *w = (slot_writer_t){.offset = base + sizeof(*h), .crc = 0, .err = ESP_OK};
+  uint32_t offset = 0;
+  for (int i = 0; i < count; i++) {
+    const station_t *st = &stations[i];
+    table_record_t r = {
+        .call_sign = add_string(st->call_sign, &offset),
+        .origin = add_string(st->origin, &offset),
+        .uri = add_string(st->uri, &offset),
+        .meta_uri = add_string(st->meta_uri, &offset),
+        .fallback_uri = add_string(st->fallback_uri, &offset),
+        .codec = (uint8_t)st->codec,
+        .meta_driver = (uint8_t)st->meta_driver,
+        .has_dsp = st->has_dsp,
+        .dsp = st->dsp,
+    };
+    writer_put(w, &r, sizeof(r));
+  }
+  for (int i = 0; i < count; i++) {
+    const station_t *st = &stations[i];
+    const char *strings[] = {st->call_sign, st->origin, st->uri,
+                             st->meta_uri, st->fallback_uri};
+    for (size_t k = 0; k < sizeof(strings) / sizeof(strings[0]); k++) {
+      if (strings[k]) {
+        writer_put(w, strings[k], strlen(strings[k]) + 1);
+      }
+    }
+  }
+  writer_flush(w);
+  err = w->err;
+  h->count = count;
+  h->pool_size = pool_size;
+  h->crc = w->crc;
+  free(w);
+  if (err != ESP_OK) {
+    return err;
+  }
+  return esp_partition_write(s_part, base, h, sizeof(*h));
+}
+
+esp_err_t station_table_save(const station_t *stations, int count,
+                             uint32_t source_size, uint32_t source_mtime) {
+  esp_err_t err = table_map();
+  if (err != ESP_OK) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  int newest = newest_slot();
+  // never the slot the live strings are in; otherwise keep the newest table
+  int slot = s_live_slot >= 0 ? !s_live_slot : newest != 0 ? 0 : 1;
+  table_header_t h = {
+      .magic = STATION_TABLE_MAGIC,
+      .version = STATION_TABLE_VERSION,
+      .record_size = sizeof(table_record_t),
+      .sequence = newest >= 0 ? slot_header(newest)->sequence + 1 : 1,
+      .source_size = source_size,
+      .source_mtime = source_mtime,
+  };
+
+  err = write_slot(slot, stations, count, &h);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Station table not written (%s)", esp_err_to_name(err));
+    station_table_invalidate();
+    return err;
+  }
+  ESP_LOGI(TAG, "Wrote %d stations to table slot %d", count, slot);
+  return ESP_OK;
+}
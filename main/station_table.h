@@ -0,0 +1,64 @@
+#ifndef STATION_TABLE_H
+#define STATION_TABLE_H
+
+#include "esp_err.h"
+#include "station_data.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Allocates the array a table is loaded into.
+     * @return Room for count stations, or NULL.
+     */
+    typedef station_t* (*station_alloc_fn)(int count, void* ctx);
+
+    /**
+     * @brief Builds a station list from the newest valid binary table in the
+     * "stations" flash partition. The strings are not copied: they are read
+     * in place through a memory mapping of the partition, so only the array
+     * is allocated.
+     * @param source_size Size of stations.json; the table must have been
+     * written from a file of this size and modification time.
+     * @param source_mtime Its modification time.
+     * @param alloc Allocates the array, which stays the caller's to free,
+     * also when the load fails after it.
+     * @param stations Set to the filled array.
+     * @param count Set to the number of stations.
+     * @return ESP_OK; ESP_ERR_NOT_FOUND without the partition, without a
+     * table whose CRC checks out, or when the table is older than the file;
+     * ESP_ERR_NO_MEM.
+     */
+    esp_err_t station_table_load(uint32_t source_size, uint32_t source_mtime,
+                                 station_alloc_fn alloc, void* ctx,
+                                 station_t** stations, int* count);
+
+    /**
+     * @brief Writes the stations as a new table, into the half of the
+     * partition the list loaded last does not read from. The header goes
+     * last, so a table cut short by a reset is never valid.
+     * @param source_size Size of the stations.json the stations were saved to.
+     * @param source_mtime Its modification time.
+     * @return ESP_OK; ESP_ERR_NOT_FOUND without the partition;
+     * ESP_ERR_INVALID_SIZE if the table does not fit; ESP_ERR_NO_MEM or a
+     * flash error. On failure no table is valid any more, so the next boot
+     * reads stations.json.
+     */
+    esp_err_t station_table_save(const station_t* stations, int count,
+                                 uint32_t source_size, uint32_t source_mtime);
+
+    /**
+     * @brief Makes every table invalid without touching the strings a loaded
+     * list reads. Called before stations.json is rewritten, so a reset
+     * before the new table is written cannot leave an old one that looks
+     * current.
+     */
+    void station_table_invalidate(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STATION_TABLE_H
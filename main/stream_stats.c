@@ -0,0 +1,199 @@
+#include "stream_stats.h"
+#include "cJSON.h"
+#include "freertos/FreeRTOS.h" // needed despite linter suggesting otherwise
+#include "freertos/task.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+// Per-second rates go into a log-linear histogram: exact below 16 kbps, then
+// 16 buckets per octave (3% error) up to 64 Mbps. Two of them alternate, each
+// collecting SS_WINDOW_S seconds, so the percentiles cover the last 5 to 10
+// minutes in a fixed 832 bytes.
+#define SS_SUB_BITS 4
+#define SS_SUB (1 << SS_SUB_BITS)
+#define SS_MAX_KBPS 0xFFFF
+#define SS_BUCKETS (SS_SUB + (16 - SS_SUB_BITS) * SS_SUB)
+#define SS_WINDOW_S 300
+#define SS_EWMA_SAMPLES 10
+
+typedef struct {
+  uint16_t count[SS_BUCKETS];
+  uint32_t n;
+  uint32_t min;
+  uint32_t max;
+} rate_window_t;
+
+// the only state touched by the stream tasks; 32-bit atomics are native on
+// the Xtensa cores, the interval deltas are taken modulo 2^32
+static atomic_uint s_bytes = 0;
+
+// owned by the task calling stream_stats_tick()
+static uint32_t s_last_bytes = 0;
+static uint64_t s_total_bytes = 0;
+static rate_window_t s_windows[2];
+static int s_window = 0;
+static int32_t s_ewma_q8 = -1; // -1 until the first sample after a reset
+static uint32_t s_stall_s = 0;
+static uint32_t s_stalls[STREAM_STATS_STALL_BUCKETS];
+static volatile bool s_reset_pending = true;
+
+// published by stream_stats_tick(), read by everyone else
+static stream_stats_t s_snapshot;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static int bucket_of(uint32_t kbps) {
+  if (kbps < SS_SUB) {
+    return kbps;
+  }
+  if (kbps > SS_MAX_KBPS) {
+    kbps = SS_MAX_KBPS;
+  }
+  int shift = 31 - __builtin_clz(kbps) - SS_SUB_BITS;
+  return SS_SUB + shift * SS_SUB + (int)(kbps >> shift) - SS_SUB;
+}
+
+// middle of the bucket's range
+static uint32_t value_of(int bucket) {
+  if (bucket < SS_SUB) {
+    return bucket;
+  }
+  int shift = (bucket - SS_SUB) / SS_SUB;
+  uint32_t lo = (uint32_t)((bucket - SS_SUB) % SS_SUB + SS_SUB) << shift;
+  return lo + ((1u << shift) >> 1);
+}
+
+static void clear_window(rate_window_t *w) {
+  memset(w, 0, sizeof(*w));
+  w->min = UINT32_MAX;
+}
+
+static uint32_t percentile(int pct, uint32_t n, uint32_t lo, uint32_t hi) {
+  uint32_t rank = (n * pct + 99) / 100; // nearest rank
+  uint32_t seen = 0;
+  for (int b = 0; b < SS_BUCKETS; b++) {
+    seen += s_windows[0].count[b] + s_windows[1].count[b];
+    if (seen >= rank) {
+      uint32_t v = value_of(b);
+      return v < lo ? lo : (v > hi ? hi : v);
+    }
+  }
+  return hi;
+}
+
+static int stall_bucket(uint32_t seconds) {
+  int b = seconds <= 1 ? 0 : 32 - __builtin_clz(seconds - 1);
+  return b < STREAM_STATS_STALL_BUCKETS ? b : STREAM_STATS_STALL_BUCKETS - 1;
+}
+
+void stream_stats_count_bytes(size_t len) {
+  atomic_fetch_add_explicit(&s_bytes, (unsigned)len, memory_order_relaxed);
+}
+
+uint32_t stream_stats_tick(uint32_t interval_ms) {
+  uint32_t bytes = atomic_load_explicit(&s_bytes, memory_order_relaxed);
+  uint32_t delta = bytes - s_last_bytes;
+  s_last_bytes = bytes;
+  s_total_bytes += delta;
+  uint32_t kbps = interval_ms ? (uint32_t)((uint64_t)delta * 8 / interval_ms) : 0;
+
+  if (s_reset_pending) {
+    s_reset_pending = false;
+    clear_window(&s_windows[0]);
+    clear_window(&s_windows[1]);
+    s_window = 0;
+    s_ewma_q8 = -1;
+  }
+
+  rate_window_t *w = &s_windows[s_window];
+  if (w->n >= SS_WINDOW_S) {
+    s_window ^= 1;
+    w = &s_windows[s_window];
+    clear_window(w);
+  }
+  w->count[bucket_of(kbps)]++;
+  w->n++;
+  w->min = kbps < w->min ? kbps : w->min;
+  w->max = kbps > w->max ? kbps : w->max;
+
+  int32_t x_q8 = (int32_t)(kbps > SS_MAX_KBPS ? SS_MAX_KBPS : kbps) << 8;
+  s_ewma_q8 = s_ewma_q8 < 0 ? x_q8
+                            : s_ewma_q8 + (x_q8 - s_ewma_q8) / SS_EWMA_SAMPLES;
+
+  // a second under 1 kbps is a stall, as for the watchdog
+  if (kbps == 0) {
+    s_stall_s++;
+  } else if (s_stall_s > 0) {
+    s_stalls[stall_bucket(s_stall_s)]++;
+    s_stall_s = 0;
+  }
+
+  stream_stats_t snap;
+  snap.last_kbps = kbps;
+  snap.ewma_kbps = (uint32_t)(s_ewma_q8 + 128) >> 8;
+  snap.samples = s_windows[0].n + s_windows[1].n;
+  snap.min_kbps = s_windows[0].min < s_windows[1].min ? s_windows[0].min
+                                                      : s_windows[1].min;
+  snap.max_kbps = s_windows[0].max > s_windows[1].max ? s_windows[0].max
+                                                      : s_windows[1].max;
+  snap.p50_kbps = percentile(50, snap.samples, snap.min_kbps, snap.max_kbps);
+  snap.p95_kbps = percentile(95, snap.samples, snap.min_kbps, snap.max_kbps);
+  snap.stall_s = s_stall_s;
+  memcpy(snap.stalls, s_stalls, sizeof(snap.stalls));
+  snap.total_bytes = s_total_bytes;
+
+  taskENTER_CRITICAL(&s_lock);
+  s_snapshot = snap;
+  taskEXIT_CRITICAL(&s_lock);
+  return kbps;
+}
+
+void stream_stats_reset(void) { s_reset_pending = true; }
+
+uint32_t stream_stats_kbps(void) {
+  taskENTER_CRITICAL(&s_lock);
+  uint32_t kbps = s_snapshot.ewma_kbps;
+  taskEXIT_CRITICAL(&s_lock);
+  return kbps;
+}
+
+void stream_stats_get(stream_stats_t *out) {
+  taskENTER_CRITICAL(&s_lock);
+  *out = s_snapshot;
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+char *stream_stats_get_json(void) {
+  stream_stats_t st;
+  stream_stats_get(&st);
+
+  cJSON *root = cJSON_CreateObject();
+  cJSON_AddNumberToObject(root, "kbps", st.last_kbps);
+  cJSON_AddNumberToObject(root, "ewma_kbps", st.ewma_kbps);
+  cJSON_AddNumberToObject(root, "p50_kbps", st.p50_kbps);
+  cJSON_AddNumberToObject(root, "p95_kbps", st.p95_kbps);
+  cJSON_AddNumberToObject(root, "min_kbps", st.min_kbps);
+  cJSON_AddNumberToObject(root, "max_kbps", st.max_kbps);
+  cJSON_AddNumberToObject(root, "samples", st.samples);
+  cJSON_AddNumberToObject(root, "stall_s", st.stall_s);
+  cJSON_AddNumberToObject(root, "total_bytes", (double)st.total_bytes);
+  // stall counts keyed by length in seconds: "1", "2", "3-4", ... "129+"
+  cJSON *stalls = cJSON_CreateObject();
+  for (int b = 0; b < STREAM_STATS_STALL_BUCKETS; b++) {
+    char key[12];
+    uint32_t hi = 1u << b;
+    if (b == STREAM_STATS_STALL_BUCKETS - 1) {
+      snprintf(key, sizeof(key), "%u+", (unsigned)(hi / 2 + 1));
+    } else if (b < 2) {
+      snprintf(key, sizeof(key), "%u", (unsigned)hi);
+    } else {
+      snprintf(key, sizeof(key), "%u-%u", (unsigned)(hi / 2 + 1),
+               (unsigned)hi);
+    }
+    cJSON_AddNumberToObject(stalls, key, st.stalls[b]);
+  }
+  cJSON_AddItemToObject(root, "stalls", stalls);
+  char *out = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+  return out;
+}
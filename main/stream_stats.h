@@ -0,0 +1,72 @@
+#ifndef STREAM_STATS_H
+#define STREAM_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// stall lengths 1 s, 2 s, 3-4 s, 5-8 s, ... 65-128 s and longer
+#define STREAM_STATS_STALL_BUCKETS 9
+
+    /**
+     * @brief Snapshot of the stream throughput statistics. Rates are compressed
+     * kbps per second of wall time.
+     */
+    typedef struct {
+        uint32_t last_kbps;  // the last whole second
+        uint32_t ewma_kbps;  // exponentially weighted, about 10 s
+        uint32_t p50_kbps;   // over the last 5 to 10 minutes
+        uint32_t p95_kbps;
+        uint32_t min_kbps;
+        uint32_t max_kbps;
+        uint32_t samples;    // seconds the percentiles cover
+        uint32_t stall_s;    // length of the stall in progress, 0 while data flows
+        uint32_t stalls[STREAM_STATS_STALL_BUCKETS]; // finished stalls since boot
+        uint64_t total_bytes;
+    } stream_stats_t;
+
+    /**
+     * @brief Counts bytes received from the stream. Lock-free and safe to call
+     * from any task on either core.
+     */
+    void stream_stats_count_bytes(size_t len);
+
+    /**
+     * @brief Closes one interval: turns the bytes counted since the previous call
+     * into a rate and updates every statistic. Call from one task only.
+     * @param interval_ms Time since the previous call.
+     * @return The rate of this interval in kbps.
+     */
+    uint32_t stream_stats_tick(uint32_t interval_ms);
+
+    /**
+     * @brief Forgets the rate history after a tune, so the percentiles and the
+     * average describe the new station. Stall counts are kept.
+     */
+    void stream_stats_reset(void);
+
+    /**
+     * @brief Returns the averaged rate shown on the display.
+     */
+    uint32_t stream_stats_kbps(void);
+
+    /**
+     * @brief Copies a consistent snapshot of the statistics.
+     */
+    void stream_stats_get(stream_stats_t* out);
+
+    /**
+     * @brief Returns the statistics as a JSON string. The caller must free the
+     * string.
+     */
+    char* stream_stats_get_json(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STREAM_STATS_H
@@ -0,0 +1,220 @@
+#include "tune_timing.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h" // needed despite linter suggesting otherwise
+#include "freertos/task.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "TUNE_TIMING";
+
+#define TUNE_HISTORY_SIZE 16
+// standby sources plus the reader of a created pipeline
+#define TUNE_SOURCE_SLOTS 4
+
+static const char *const stage_names[TUNE_STAGE_COUNT] = {
+    "start",       "dns",        "connected",  "first_byte",
+    "prebuffered", "music_info", "first_write"};
+
+typedef struct {
+  const void *source;
+  int64_t at_us[TUNE_STAGE_COUNT]; // only the connection stages are used
+} source_slot_t;
+
+static tune_record_t s_history[TUNE_HISTORY_SIZE];
+static int s_count = 0;   // records in s_history
+static int s_current = 0; // index of the newest record
+static bool s_active = false;
+static const void *s_source = NULL; // NULL until the tune picked its source
+static source_slot_t s_slots[TUNE_SOURCE_SLOTS];
+static int s_next_slot = 0;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static stream_func s_i2s_write = NULL;
+static volatile bool s_awaiting_write = false;
+
+static bool is_connection_stage(tune_stage_t stage) {
+  return stage == TUNE_STAGE_DNS || stage == TUNE_STAGE_CONNECTED ||
+         stage == TUNE_STAGE_FIRST_BYTE;
+}
+
+static source_slot_t *find_slot(const void *source) {
+  for (int i = 0; i < TUNE_SOURCE_SLOTS; i++) {
+    if (s_slots[i].source == source) {
+      return &s_slots[i];
+    }
+  }
+  return NULL;
+}
+
+static void log_record(const tune_record_t *rec) {
+  char line[160];
+  int pos = 0;
+  int64_t start = rec->at_us[TUNE_STAGE_START];
+  for (int i = TUNE_STAGE_DNS; i < TUNE_STAGE_COUNT && pos < sizeof(line);
+       i++) {
+    if (rec->at_us[i]) {
+      pos += snprintf(line + pos, sizeof(line) - pos, " %s %" PRId64,
+                      stage_names[i], (rec->at_us[i] - start) / 1000);
+    } else {
+      pos += snprintf(line + pos, sizeof(line) - pos, " %s -", stage_names[i]);
+    }
+  }
+  ESP_LOGI(TAG, "Tune %s (ms):%s", rec->station, line);
+}
+
+void tune_timing_begin(const char *station) {
+  tune_record_t finished;
+  bool log_previous = false;
+
+  taskENTER_CRITICAL(&s_lock);
+  if (s_active && s_count > 0) {
+    finished = s_history[s_current]; // abandoned before the first write
+    log_previous = true;
+  }
+  s_current = (s_current + 1) % TUNE_HISTORY_SIZE;
+  if (s_count < TUNE_HISTORY_SIZE) {
+    s_count++;
+  }
+  tune_record_t *rec = &s_history[s_current];
+  memset(rec, 0, sizeof(*rec));
+  strncpy(rec->station, station ? station : "", sizeof(rec->station) - 1);
+  rec->at_us[TUNE_STAGE_START] = esp_timer_get_time();
+  s_active = true;
+  s_source = NULL;
+  s_awaiting_write = false;
+  taskEXIT_CRITICAL(&s_lock);
+
+  if (log_previous) {
+    log_record(&finished);
+  }
+}
+
+void tune_timing_mark(tune_stage_t stage) {
+  if (stage >= TUNE_STAGE_COUNT || is_connection_stage(stage)) {
+    return;
+  }
+  int64_t now = esp_timer_get_time();
+  tune_record_t done;
+  bool complete = false;
+
+  taskENTER_CRITICAL(&s_lock);
+  // before the source is chosen the old station is still playing
+  if (s_active && s_source) {
+    tune_record_t *rec = &s_history[s_current];
+    if (rec->at_us[stage] == 0) {
+      rec->at_us[stage] = now;
+    }
+    if (stage == TUNE_STAGE_FIRST_WRITE) {
+      done = *rec;
+      complete = true;
+      s_active = false;
+    }
+  }
+  taskEXIT_CRITICAL(&s_lock);
+
+  if (complete) {
+    log_record(&done);
+  }
+}
+
+void tune_timing_source_reset(const void *source) {
+  taskENTER_CRITICAL(&s_lock);
+  source_slot_t *slot = find_slot(source);
+  if (slot == NULL) {
+    slot = &s_slots[s_next_slot];
+    s_next_slot = (s_next_slot + 1) % TUNE_SOURCE_SLOTS;
+  }
+  memset(slot, 0, sizeof(*slot));
+  slot->source = source;
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+void tune_timing_source_mark(const void *source, tune_stage_t stage) {
+  if (!is_connection_stage(stage)) {
+    return;
+  }
+  int64_t now = esp_timer_get_time();
+  taskENTER_CRITICAL(&s_lock);
+  source_slot_t *slot = find_slot(source);
+  if (slot && slot->at_us[stage] == 0) {
+    slot->at_us[stage] = now;
+    if (s_active && s_source == source &&
+        s_history[s_current].at_us[stage] == 0) {
+      s_history[s_current].at_us[stage] = now;
+    }
+  }
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+void tune_timing_set_source(const void *source) {
+  taskENTER_CRITICAL(&s_lock);
+  if (s_active) {
+    s_source = source;
+    source_slot_t *slot = find_slot(source);
+    for (int i = 0; slot && i < TUNE_STAGE_COUNT; i++) {
+      if (is_connection_stage(i) && slot->at_us[i]) {
+        s_history[s_current].at_us[i] = slot->at_us[i];
+      }
+    }
+    s_awaiting_write = true;
+  }
+  taskEXIT_CRITICAL(&s_lock);
+}
+
+static int timed_i2s_write(audio_element_handle_t self, char *buffer, int len,
+                           TickType_t ticks_to_wait, void *context) {
+  int ret = s_i2s_write(self, buffer, len, ticks_to_wait, NULL);
+  if (s_awaiting_write && ret > 0) {
+    s_awaiting_write = false;
+    tune_timing_mark(TUNE_STAGE_FIRST_WRITE);
+  }
+  return ret;
+}
+
+esp_err_t tune_timing_attach_i2s(audio_element_handle_t i2s_el) {
+  stream_func write = audio_element_get_write_cb(i2s_el);
+  if (write == NULL) {
+    return ESP_FAIL;
+  }
+  if (write != timed_i2s_write) {
+    s_i2s_write = write;
+  }
+  return audio_element_set_write_cb(i2s_el, timed_i2s_write, NULL);
+}
+
+char *tune_timing_get_history_json(void) {
+  tune_record_t history[TUNE_HISTORY_SIZE];
+  int count;
+  int current;
+  taskENTER_CRITICAL(&s_lock);
+  memcpy(history, s_history, sizeof(history));
+  count = s_count;
+  current = s_current;
+  taskEXIT_CRITICAL(&s_lock);
+
+  cJSON *root = cJSON_CreateArray();
+  for (int n = 0; n < count; n++) {
+    const tune_record_t *rec =
+        &history[(current - n + TUNE_HISTORY_SIZE) % TUNE_HISTORY_SIZE];
+    int64_t start = rec->at_us[TUNE_STAGE_START];
+    cJSON *item = cJSON_CreateObject();
+    cJSON_AddStringToObject(item, "station", rec->station);
+    cJSON_AddNumberToObject(item, "start_ms", start / 1000);
+    for (int i = TUNE_STAGE_DNS; i < TUNE_STAGE_COUNT; i++) {
+      if (rec->at_us[i]) {
+        cJSON_AddNumberToObject(item, stage_names[i],
+                                (rec->at_us[i] - start) / 1000);
+      } else {
+        cJSON_AddNullToObject(item, stage_names[i]);
+      }
+    }
+    cJSON_AddItemToArray(root, item);
+  }
+  char *out = cJSON_Print(root);
+  cJSON_Delete(root);
+  return out;
+}
@@ -0,0 +1,79 @@
+#ifndef TUNE_TIMING_H
+#define TUNE_TIMING_H
+
+#include "audio_element.h"
+#include "esp_err.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Stages of a tune, in the order they normally happen.
+     */
+    typedef enum {
+        TUNE_STAGE_START,        // change_station() entry
+        TUNE_STAGE_DNS,          // stream host resolved
+        TUNE_STAGE_CONNECTED,    // TCP and TLS up, request sent
+        TUNE_STAGE_FIRST_BYTE,   // first read of the response body
+        TUNE_STAGE_PREBUFFERED,  // jitter buffer released audio to the decoder
+        TUNE_STAGE_MUSIC_INFO,   // decoder reported the stream format
+        TUNE_STAGE_FIRST_WRITE,  // first I2S write
+        TUNE_STAGE_COUNT
+    } tune_stage_t;
+
+    /**
+     * @brief Timestamps of one tune, from esp_timer_get_time(). A stage that was not
+     * reached is 0. Connection stages of a pre-connected source are earlier than START.
+     */
+    typedef struct {
+        char station[16];
+        int64_t at_us[TUNE_STAGE_COUNT];
+    } tune_record_t;
+
+    /**
+     * @brief Starts a new tune record and pushes it onto the history.
+     * @param station Call sign of the station being tuned.
+     */
+    void tune_timing_begin(const char* station);
+
+    /**
+     * @brief Records a pipeline stage (prebuffered, music info, first write) of the
+     * current tune. Ignored until the tune has chosen its source.
+     */
+    void tune_timing_mark(tune_stage_t stage);
+
+    /**
+     * @brief Clears the connection timestamps of an HTTP source about to connect.
+     */
+    void tune_timing_source_reset(const void* source);
+
+    /**
+     * @brief Records a connection stage (DNS, connected, first byte) of an HTTP
+     * source. Only the first mark of each stage after a reset is kept.
+     */
+    void tune_timing_source_mark(const void* source, tune_stage_t stage);
+
+    /**
+     * @brief Ties the current tune to the source it plays from, copying the connection
+     * stages the source has already reached.
+     */
+    void tune_timing_set_source(const void* source);
+
+    /**
+     * @brief Wraps the write callback of the I2S writer to time the first write.
+     */
+    esp_err_t tune_timing_attach_i2s(audio_element_handle_t i2s_el);
+
+    /**
+     * @brief Returns the tune history, newest first, as a JSON string with stage
+     * offsets in ms from START. The caller must free the string.
+     */
+    char* tune_timing_get_history_json(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TUNE_TIMING_H
@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+"""Minify and gzip a web page for embedding in the firmware.
+
+usage: pack_web_asset.py <input> <output.gz>
+
+The minifier is deliberately simple and only safe for the pages in this
+directory: it drops <!-- --> and /* */ comments, the indentation and blank
+lines. Line breaks are kept so JavaScript without semicolons still parses,
+which also leaves multi-line template literals intact apart from their
+indentation. Do not put "/*" inside a string or a <pre> block in these pages.
+
+The gzip header carries no name and no time stamp, so the same page always
+packs to the same bytes and its ETag only changes when the page does.
+"""
+
+import gzip
+import re
+import sys
+
+
+def minify(text):
+    text = re.sub(r'<!--.*?-->', '', text, flags=re.S)
+    text = re.sub(r'/\*.*?\*/', '', text, flags=re.S)
+    lines = (line.strip() for line in text.splitlines())
+    return '\n'.join(line for line in lines if line)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    src, dst = sys.argv[1], sys.argv[2]
+    with open(src, encoding='utf-8') as f:
+        page = minify(f.read()).encode('utf-8')
+    with open(dst, 'wb') as out:
+        with gzip.GzipFile(filename='', mode='wb', fileobj=out,
+                           compresslevel=9, mtime=0) as gz:
+            gz.write(page)
+
+
+if __name__ == '__main__':
+    main()
@@ -2,16 +2,226 @@
 #include "cJSON.h"
 #include "esp_http_server.h"
 #include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h" // needed despite linter suggesting otherwise
+#include "internet_radio_adf.h"
+#include "metrics.h"
+#include "profiler.h"
+#include "recovery.h"
 #include "station_data.h"
+#include "stream_stats.h"
+#include "tune_timing.h"
+#include "lwip/sockets.h"
+#include <stdarg.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/param.h>
 
 static const char *TAG = "WEB_SERVER";
 static httpd_handle_t server = NULL;
 
-/* Handler for GET /api/stations */
+extern int current_station; // from internet_radio_adf.c
+
+// Server-Sent Events. Every event is a state update, so each kind keeps only
+// its latest text. Producers overwrite it from any task and queue one send
+// job; the web server task writes whatever each client has not seen yet, so
+// the work per client never runs on the producer's core.
+typedef enum {
+  SSE_VOLUME,
+  SSE_MUTE,
+  SSE_STATION,
+  SSE_BITRATE,
+  SSE_NOW_PLAYING,
+  SSE_BUFFER,
+  SSE_EVENT_COUNT
+} sse_event_type_t;
+
+static const char *const sse_event_names[SSE_EVENT_COUNT] = {
+    "volume", "mute", "station", "bitrate", "now_playing", "buffer"};
+
+// leaves one of the 7 sockets for a page or API request at all times
+#define SSE_MAX_CLIENTS 4
+// a 128 character title with every character escaped
+#define SSE_EVENT_MAX 352
+#define SSE_BUFFER_STEP_MS 250
+
+typedef struct {
+  uint32_t seq; // 0 until the first value
+  int len;
+  char text[SSE_EVENT_MAX];
+} sse_event_t;
+
+typedef struct {
+  int fd; // -1 when the slot is free
+  uint32_t seen[SSE_EVENT_COUNT];
+} sse_client_t;
+
+static sse_event_t s_events[SSE_EVENT_COUNT];
+static uint32_t s_event_seq = 0;
+static portMUX_TYPE s_events_lock = portMUX_INITIALIZER_UNLOCKED;
+static atomic_bool s_send_queued = false;
+// only touched by the web server task
+static sse_client_t s_clients[SSE_MAX_CLIENTS] = {
+    [0 ... SSE_MAX_CLIENTS - 1] = {.fd = -1}};
+
+// copies src into dst as the inside of a JSON string
+static void json_escape(char *dst, size_t size, const char *src) {
+  size_t n = 0;
+  for (; src && *src && n + 7 < size; src++) {
+    unsigned char c = (unsigned char)*src;
+    if (c == '"' || c == '\\') {
+      dst[n++] = '\\';
+      dst[n++] = c;
+    } else if (c < 0x20) {
+      n += snprintf(dst + n, size - n, "\\u%04x", c);
+    } else {
+      dst[n++] = c;
+    }
+  }
+  dst[n] = '\0';
+}
+
+static void sse_send_pending(void *arg) {
+  atomic_store(&s_send_queued, false); // later events queue a new job
+  char text[SSE_EVENT_MAX];
+  for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+    sse_client_t *client = &s_clients[i];
+    for (int type = 0; type < SSE_EVENT_COUNT && client->fd >= 0; type++) {
+      taskENTER_CRITICAL(&s_events_lock);
+      uint32_t seq = s_events[type].seq;
+      int len = s_events[type].len;
+      if (seq != client->seen[type]) {
+        memcpy(text, s_events[type].text, len);
+      }
+      taskEXIT_CRITICAL(&s_events_lock);
+      if (seq == client->seen[type]) {
+        continue;
+      }
+      // a client that cannot take an event right away is dropped rather
+      // than holding up the server; the browser reconnects on its own
+      if (httpd_socket_send(server, client->fd, text, len, MSG_DONTWAIT) !=
+          len) {
+        ESP_LOGW(TAG, "Dropping event stream client %d", client->fd);
+        httpd_sess_trigger_close(server, client->fd);
+        client->fd = -1;
+        break;
+      }
+      client->seen[type] = seq;
+    }
+  }
+}
+
+static void sse_publish(sse_event_type_t type, const char *fmt, ...) {
+  char data[SSE_EVENT_MAX];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(data, sizeof(data), fmt, args);
+  va_end(args);
+
+  taskENTER_CRITICAL(&s_events_lock);
+  sse_event_t *ev = &s_events[type];
+  int len = snprintf(ev->text, sizeof(ev->text), "event: %s\ndata: %s\n\n",
+                     sse_event_names[type], data);
+  ev->len = len < (int)sizeof(ev->text) ? len : (int)sizeof(ev->text) - 1;
+  ev->seq = ++s_event_seq;
+  taskEXIT_CRITICAL(&s_events_lock);
+
+  httpd_handle_t hd = server;
+  if (hd && !atomic_exchange(&s_send_queued, true) &&
+      httpd_queue_work(hd, sse_send_pending, NULL) != ESP_OK) {
+    atomic_store(&s_send_queued, false);
+  }
+}
+
+void web_events_volume(int volume) {
+  sse_publish(SSE_VOLUME, "{\"volume\":%d}", volume);
+}
+
+void web_events_mute(bool muted) {
+  sse_publish(SSE_MUTE, "{\"muted\":%s}", muted ? "true" : "false");
+}
+
+void web_events_station(int index, const char *call_sign, const char *origin) {
+  char call_sign_json[40];
+  char origin_json[96];
+  json_escape(call_sign_json, sizeof(call_sign_json), call_sign);
+  json_escape(origin_json, sizeof(origin_json), origin);
+  sse_publish(SSE_STATION,
+              "{\"index\":%d,\"call_sign\":\"%s\",\"origin\":\"%s\"}", index,
+              call_sign_json, origin_json);
+}
+
+void web_events_bitrate(int kbps) {
+  static int last_kbps = -1;
+  if (kbps != last_kbps) {
+    last_kbps = kbps;
+    sse_publish(SSE_BITRATE, "{\"kbps\":%d}", kbps);
+  }
+}
+
+void web_events_now_playing(const char *title) {
+  char title_json[SSE_EVENT_MAX - 48];
+  json_escape(title_json, sizeof(title_json), title);
+  sse_publish(SSE_NOW_PLAYING, "{\"title\":\"%s\"}", title_json);
+}
+
+void web_events_buffer(uint32_t depth_ms, uint32_t target_ms, bool buffering) {
+  // only called from the throughput task
+  static uint32_t last_depth_ms = 0;
+  static uint32_t last_target_ms = 0;
+  static int last_buffering = -1;
+  uint32_t moved = depth_ms > last_depth_ms ? depth_ms - last_depth_ms
+                                            : last_depth_ms - depth_ms;
+  if (moved < SSE_BUFFER_STEP_MS && target_ms == last_target_ms &&
+      (int)buffering == last_buffering) {
+    return;
+  }
+  last_depth_ms = depth_ms;
+  last_target_ms = target_ms;
+  last_buffering = buffering;
+  sse_publish(SSE_BUFFER,
+              "{\"depth_ms\":%" PRIu32 ",\"target_ms\":%" PRIu32
+              ",\"buffering\":%s}",
+              depth_ms, target_ms, buffering ? "true" : "false");
+}
+
+// the session context is the socket, a dropped client's slot may already
+// belong to a new one by the time its session closes
+static void sse_client_closed(void *ctx) {
+  int fd = (int)(intptr_t)ctx - 1;
+  for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+    if (s_clients[i].fd == fd) {
+      s_clients[i].fd = -1;
+    }
+  }
+}
+
+static esp_err_t send_chunk(const char *buf, size_t len, void *ctx) {
+  return httpd_resp_send_chunk((httpd_req_t *)ctx, buf, len);
+}
+
+/* Handler for GET /api/stations - streamed, so the response costs no heap
+ * however long the list is */
 static esp_err_t api_stations_get_handler(httpd_req_t *req) {
-  char *json_str = get_stations_json();
+  httpd_resp_set_type(req, "application/json");
+  esp_err_t err = write_stations_json(send_chunk, req);
+  if (err != ESP_OK) {
+    // the status line may be gone already, dropping the connection is all
+    // that is left
+    ESP_LOGW(TAG, "Station list send failed: %s", esp_err_to_name(err));
+    return ESP_FAIL;
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* Handler for GET /api/tune_timing */
+static esp_err_t api_tune_timing_get_handler(httpd_req_t *req) {
+  char *json_str = tune_timing_get_history_json();
   if (json_str == NULL) {
     httpd_resp_send_500(req);
     return ESP_FAIL;
@@ -23,211 +233,403 @@ static esp_err_t api_stations_get_handler(httpd_req_t *req) {
   return ESP_OK;
 }
 
-/* Handler for POST /api/stations */
-static esp_err_t api_stations_post_handler(httpd_req_t *req) {
-  int total_len = req->content_len;
-  int cur_len = 0;
-  // char *buf = ((server_context_t *)(req->user_ctx))->scratch; // defined in
-  // context
-  // Simple malloc for now to handle arbitrary size
-  char *content = malloc(total_len + 1);
-
-  if (!content) {
+/* Handler for GET /api/recovery */
+static esp_err_t api_recovery_get_handler(httpd_req_t *req) {
+  char *json_str = recovery_get_history_json();
+  if (json_str == NULL) {
     httpd_resp_send_500(req);
     return ESP_FAIL;
   }
 
-  int received = 0;
-  while (cur_len < total_len) {
-    received = httpd_req_recv(req, content + cur_len, total_len - cur_len);
-    if (received <= 0) {
-      if (received == HTTPD_SOCK_ERR_TIMEOUT) {
-        continue;
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_send(req, json_str, HTTPD_RESP_USE_STRLEN);
+  free(json_str);
+  return ESP_OK;
+}
+
+#if CONFIG_RADIO_PROFILER
+/* Handler for GET /api/trace */
+static esp_err_t api_trace_get_handler(httpd_req_t *req) {
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Content-Disposition",
+                     "attachment; filename=\"pipeline_trace.json\"");
+  esp_err_t err = profiler_write_trace(send_chunk, req);
+  if (err != ESP_OK) {
+    // the status line may be gone already, dropping the connection is all
+    // that is left
+    ESP_LOGW(TAG, "Trace export failed: %s", esp_err_to_name(err));
+    return ESP_FAIL;
+  }
+  return httpd_resp_send_chunk(req, NULL, 0);
+}
+#endif
+
+/* Handler for GET /metrics */
+static esp_err_t metrics_get_handler(httpd_req_t *req) {
+  size_t len;
+  const char *text = metrics_render(&len);
+  if (text == NULL) {
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
+  }
+
+  httpd_resp_set_type(req, "text/plain; version=0.0.4; charset=utf-8");
+  httpd_resp_send(req, text, len);
+  return ESP_OK;
+}
+
+/* Handler for GET /api/events */
+static esp_err_t api_events_get_handler(httpd_req_t *req) {
+  sse_client_t *client = NULL;
+  for (int i = 0; i < SSE_MAX_CLIENTS && client == NULL; i++) {
+    if (s_clients[i].fd < 0) {
+      client = &s_clients[i];
+    }
+  }
+  if (client == NULL) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_send(req, "Too many event stream clients",
+                    HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+  }
+
+  // The response never ends, so the headers go out raw: no Content-Length
+  // and no chunked encoding. After the handler returns the session stays
+  // open and sse_send_pending() writes to its socket.
+  static const char headers[] = "HTTP/1.1 200 OK\r\n"
+                                "Content-Type: text/event-stream\r\n"
+                                "Cache-Control: no-cache\r\n"
+                                "Connection: keep-alive\r\n"
+                                "\r\n"
+                                "retry: 3000\n\n";
+  if (httpd_send(req, headers, sizeof(headers) - 1) !=
+      (int)sizeof(headers) - 1) {
+    return ESP_FAIL;
+  }
+  client->fd = httpd_req_to_sockfd(req);
+  memset(client->seen, 0, sizeof(client->seen));
+  req->sess_ctx = (void *)(intptr_t)(client->fd + 1);
+  req->free_ctx = sse_client_closed;
+  sse_send_pending(NULL); // the current state
+  return ESP_OK;
+}
+
+/* Handler for GET /api/stream_stats */
+static esp_err_t api_stream_stats_get_handler(httpd_req_t *req) {
+  char *json_str = stream_stats_get_json();
+  if (json_str == NULL) {
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_send(req, json_str, HTTPD_RESP_USE_STRLEN);
+  free(json_str);
+  return ESP_OK;
+}
+
+static int recv_chunk(char *buf, size_t len, void *ctx) {
+  for (;;) {
+    int received = httpd_req_recv((httpd_req_t *)ctx, buf, len);
+    if (received != HTTPD_SOCK_ERR_TIMEOUT) {
+      return received;
+    }
+  }
+}
+
+/* The body with its first bytes read ahead, to tell a list from a station */
+typedef struct {
+  httpd_req_t *req;
+  char head[32];
+  int head_len;
+  int head_pos;
+} body_reader_t;
+
+/* Reads up to the first non-blank byte of the body and returns it, or 0 at
+ * the end. Blanks before it are dropped. */
+static char peek_body(body_reader_t *r) {
+  for (;;) {
+    for (; r->head_pos < r->head_len; r->head_pos++) {
+      char c = r->head[r->head_pos];
+      if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+        return c;
       }
-      free(content);
-      return ESP_FAIL;
     }
-    cur_len += received;
+    r->head_len = r->head_pos = 0;
+    int n = recv_chunk(r->head, sizeof(r->head), r->req);
+    if (n <= 0) {
+      return 0;
+    }
+    r->head_len = n;
+  }
+}
+
+static int recv_peeked(char *buf, size_t len, void *ctx) {
+  body_reader_t *r = ctx;
+  if (r->head_pos < r->head_len) {
+    int n = MIN((int)len, r->head_len - r->head_pos);
+    memcpy(buf, r->head + r->head_pos, n);
+    r->head_pos += n;
+    return n;
   }
-  content[total_len] = '\0';
+  return recv_chunk(buf, len, r->req);
+}
 
-  if (update_stations_from_json(content) == 0) {
-    save_station_data();
-    httpd_resp_sendstr(req, "{\"status\":\"ok\"}");
-  } else {
+/* Answers a station list or station edit that did not succeed */
+static esp_err_t send_station_error(httpd_req_t *req, esp_err_t err) {
+  switch (err) {
+  case ESP_ERR_INVALID_ARG:
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid station JSON");
+    return ESP_OK;
+  case ESP_ERR_INVALID_SIZE:
+    httpd_resp_set_status(req, "413 Payload Too Large");
+    httpd_resp_sendstr(req, "Station list or one of its strings too large");
+    return ESP_OK;
+  case ESP_ERR_NOT_FOUND:
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown station");
+    return ESP_OK;
+  case ESP_ERR_INVALID_STATE:
+    httpd_resp_set_status(req, "409 Conflict");
+    httpd_resp_sendstr(req, "The last station cannot be deleted");
+    return ESP_OK;
+  case ESP_FAIL:
+    return ESP_FAIL; // the connection failed, nothing can be sent
+  default: // ESP_ERR_NOT_FINISHED: changed, but not saved
     httpd_resp_send_500(req);
+    return ESP_OK;
+  }
+}
+
+/* Handler for POST /api/stations - a JSON array replaces the list, a single
+ * station object is appended to it. Parsed as it is received, the body is
+ * never held whole. */
+static esp_err_t api_stations_post_handler(httpd_req_t *req) {
+  if (req->content_len > STATION_LIST_MAX_SIZE) {
+    httpd_resp_set_status(req, "413 Payload Too Large");
+    httpd_resp_sendstr(req, "Station list too large");
+    return ESP_OK;
+  }
+
+  body_reader_t body = {.req = req};
+  if (peek_body(&body) == '{') {
+    int index;
+    esp_err_t err = append_station_json(recv_peeked, &body, &index);
+    if (err != ESP_OK) {
+      return send_station_error(req, err);
+    }
+    char resp[40];
+    snprintf(resp, sizeof(resp), "{\"status\":\"ok\",\"index\":%d}", index);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, resp);
+    return ESP_OK;
+  }
+
+  esp_err_t err = read_stations_json(recv_peeked, &body);
+  if (err != ESP_OK) {
+    return send_station_error(req, err);
+  }
+  if (current_station >= station_count) {
+    current_station_moved(0);
+  }
+  save_station_data();
+  httpd_resp_sendstr(req, "{\"status\":\"ok\"}");
+  return ESP_OK;
+}
+
+/* Returns the integer query parameter key, or -1 when it is missing */
+static int query_int_param(httpd_req_t *req, const char *key) {
+  char query[32];
+  char value[8];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+      httpd_query_key_value(query, key, value, sizeof(value)) != ESP_OK) {
+    return -1;
+  }
+  return atoi(value);
+}
+
+/* Returns N from /api/stations/N, or -1. rest gets what follows N,
+ * without the query string. */
+static int station_path_index(httpd_req_t *req, char *rest, size_t size) {
+  static const char prefix[] = "/api/stations/";
+  const char *p = req->uri + sizeof(prefix) - 1;
+  if (*p < '0' || *p > '9') {
+    return -1;
+  }
+  char *end;
+  long index = strtol(p, &end, 10);
+  size_t len = strcspn(end, "?");
+  if (index > INT_MAX || len >= size) {
+    return -1;
+  }
+  memcpy(rest, end, len);
+  rest[len] = '\0';
+  return (int)index;
+}
+
+/* Handler for PATCH /api/stations/N - changes the fields given in a JSON
+ * object and leaves the rest */
+static esp_err_t api_station_patch_handler(httpd_req_t *req) {
+  char rest[8];
+  int index = station_path_index(req, rest, sizeof(rest));
+  if (index < 0 || rest[0] != '\0') {
+    return send_station_error(req, ESP_ERR_NOT_FOUND);
+  }
+  if (req->content_len > STATION_LIST_MAX_SIZE) {
+    return send_station_error(req, ESP_ERR_INVALID_SIZE);
+  }
+
+  esp_err_t err = patch_station_json(index, recv_chunk, req);
+  if (err != ESP_OK) {
+    return send_station_error(req, err);
+  }
+  apply_station_dsp(index); // the stream itself changes on the next tune
+  httpd_resp_sendstr(req, "{\"status\":\"ok\"}");
+  return ESP_OK;
+}
+
+/* Handler for DELETE /api/stations/N */
+static esp_err_t api_station_delete_handler(httpd_req_t *req) {
+  char rest[8];
+  int index = station_path_index(req, rest, sizeof(rest));
+  if (index < 0 || rest[0] != '\0') {
+    return send_station_error(req, ESP_ERR_NOT_FOUND);
   }
 
-  free(content);
+  int playing = current_station;
+  esp_err_t err = delete_station(index, &playing);
+  if (err != ESP_OK && err != ESP_ERR_NOT_FINISHED) {
+    return send_station_error(req, err);
+  }
+  current_station_moved(playing);
+  if (err != ESP_OK) {
+    return send_station_error(req, err);
+  }
+  httpd_resp_sendstr(req, "{\"status\":\"ok\"}");
   return ESP_OK;
 }
 
-/* Handler for GET / (Root) - Landing Page */
-static esp_err_t root_get_handler(httpd_req_t *req) {
-  const char *html_response =
-      "<!DOCTYPE html><html><head><meta name='viewport' "
-      "content='width=device-width, initial-scale=1.0'>"
-      "<style>body{font-family:sans-serif;margin:20px;text-align:center;"
-      "background:#f0f2f5;}"
-      ".btn{display:inline-block;padding:15px "
-      "30px;margin:10px;background:#007bff;color:white;text-decoration:none;"
-      "border-radius:5px;font-size:1.2em;}"
-      ".btn:hover{background:#0056b3;}</style>"
-      "<title>Radio Manager</title></head>"
-      "<body><h1>Internet Radio Manager</h1>"
-      "<a href='/stations' class='btn'>Edit Stations</a><br>"
-      "<a href='/config' class='btn'>Configuration</a>"
-      "</body></html>";
-
-  httpd_resp_send(req, html_response, HTTPD_RESP_USE_STRLEN);
+/* Handler for POST /api/stations/N/move?to=M - reorders the list, station N
+ * ends up at index M */
+static esp_err_t api_station_move_handler(httpd_req_t *req) {
+  char rest[8];
+  int index = station_path_index(req, rest, sizeof(rest));
+  if (index < 0 || strcmp(rest, "/move") != 0) {
+    return send_station_error(req, ESP_ERR_NOT_FOUND);
+  }
+  int to = query_int_param(req, "to");
+  if (to < 0) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing to=N");
+    return ESP_OK;
+  }
+
+  int playing = current_station;
+  esp_err_t err = move_station(index, to, &playing);
+  if (err != ESP_OK && err != ESP_ERR_NOT_FINISHED) {
+    return send_station_error(req, err);
+  }
+  current_station_moved(playing);
+  if (err != ESP_OK) {
+    return send_station_error(req, err);
+  }
+  httpd_resp_sendstr(req, "{\"status\":\"ok\"}");
   return ESP_OK;
 }
 
-/* Handler for GET /stations - Station Editor */
-static esp_err_t stations_page_handler(httpd_req_t *req) {
-  const char *html_response =
-      "<!DOCTYPE html><html><head><meta name='viewport' "
-      "content='width=device-width, initial-scale=1.0'>"
-      "<title>Edit Stations</title>"
-      "<style>"
-      "body{font-family:sans-serif;background:#f0f2f5;padding:10px;}"
-      ".grid-container{display:grid;grid-template-columns:2em 5em 12em 1fr 6em "
-      "3em;gap:5px;align-items:center;min-width:650px;}"
-      "@media(max-width: 650px) { "
-      ".grid-container{display:flex;flex-direction:column;min-width:auto;} "
-      ".header-row{display:none;} "
-      ".station-row{display:flex;flex-wrap:wrap;gap:5px;} }"
-      ".header-row{display:contents;font-weight:bold;color:#555;}"
-      ".header-row span{padding:5px 0;border-bottom:2px solid "
-      "#ddd;margin-bottom:5px;text-align:left;}"
-      ".station-row{display:contents;}"
-      "@media(max-width: 650px) { "
-      ".station-row{background:white;padding:10px;border-radius:4px;box-shadow:"
-      "0 1px 2px "
-      "rgba(0,0,0,0.1);display:flex;flex-direction:row;align-items:center;} }"
-      "input,select{width:100%;padding:5px;border:1px solid "
-      "#ccc;border-radius:3px;font-size:0.9em;box-sizing:border-box;}"
-      ".inp-call{width:100%;}"
-      ".inp-orig{width:100%;}"
-      ".inp-uri{width:100%;font-family:monospace;}"
-      ".btn{padding:5px "
-      "10px;background:#28a745;color:white;border:none;border-radius:3px;"
-      "cursor:pointer;font-size:0.9em;}"
-      ".btn-del{background:#dc3545;padding:2px "
-      "8px;font-size:0.8em;height:100%;}"
-      ".homelink{display:inline-block;margin-bottom:10px;color:#007bff;text-"
-      "decoration:none;}"
-      ".controls{margin-top:20px;}"
-      ".handle{cursor:grab;font-size:1.4em;color:#888;user-select:none;text-"
-      "align:center;}"
-      ".handle:active{cursor:grabbing;color:#000;}"
-      "</style></head><body>"
-      "<a href='/' class='homelink'>&larr; Home</a>"
-      "<h3>Edit Stations</h3>"
-      "<div id='wrapper' style='overflow-x:auto;'>"
-      "<div class='grid-container'>"
-      "  <div "
-      "class='header-row'><span></span><span>Call</span><span>Origin</"
-      "span><span>URI</span><span>Type</span><span>Del</span></div>"
-      "  <div id='container' style='display:contents;'></div>"
-      "</div>"
-      "</div>"
-      "<div class='controls'>"
-      "<button class='btn' onclick='addStation()'>+ Add Station</button> "
-      "<button class='btn' onclick='saveStations()'>Save Changes</button>"
-      "</div>"
-      "<script>"
-      "let stations=[];"
-      "let dragSrcIx = null;"
-      "async function fetchStations(){"
-      "  const r=await fetch('/api/stations');stations=await r.json();render();"
-      "}"
-      "function render(){"
-      "  const c=document.getElementById('container');c.innerHTML='';"
-      "  stations.forEach((s,i)=>{"
-      "    const div=document.createElement('div');div.className='station-row';"
-      "    div.innerHTML=`"
-      "      <div class='handle' draggable='true' "
-      "ondragstart='dragStart(event,${i})' ondragover='dragOver(event)' "
-      "ondrop='drop(event,${i})'>&#9776;</div>"
-      "      <div><input class='inp-call' value='${s.call_sign}' "
-      "onchange='stations[${i}].call_sign=this.value' maxlength='4'></div>"
-      "      <div><input class='inp-orig' value='${s.origin}' "
-      "onchange='stations[${i}].origin=this.value' maxlength='20'></div>"
-      "      <div><input class='inp-uri' value='${s.uri}' "
-      "onchange='stations[${i}].uri=this.value'></div>"
-      "      <div><select class='inp-codec' "
-      "onchange='stations[${i}].codec=parseInt(this.value)'>"
-      "        <option value='0' ${s.codec==0?'selected':''}>MP3</option>"
-      "        <option value='1' ${s.codec==1?'selected':''}>AAC</option>"
-      "        <option value='2' ${s.codec==2?'selected':''}>OGG</option>"
-      "        <option value='3' ${s.codec==3?'selected':''}>FLAC</option>"
-      "      </select></div>"
-      "      <div style='text-align:center'><button class='btn btn-del' "
-      "onclick='removeStation(${i})'>X</button></div>`;"
-      "    c.appendChild(div);"
-      "  });"
-      "}"
-      "function "
-      "dragStart(e,i){dragSrcIx=i;e.dataTransfer.effectAllowed='move';e."
-      "dataTransfer.setData('text/plain',i);}"
-      "function "
-      "dragOver(e){e.preventDefault();e.dataTransfer.dropEffect='move';return "
-      "false;}"
-      "function drop(e,i){"
-      "  e.stopPropagation();"
-      "  if(dragSrcIx!==null && dragSrcIx!=i){"
-      "    const item=stations[dragSrcIx];"
-      "    stations.splice(dragSrcIx,1);"
-      "    /* Adjust index if we removed an item before the target */"
-      "    /* Actually, standard splice logic: remove then insert. If removing "
-      "from before, i shifts. */"
-      "    /* But simpler: remove item, then insert at 'i'. However, if "
-      "dragSrc < i, i decreases by 1 after remove. */"
-      "    /* Let's recalculate target index carefully. */"
-      "    /* Simplified swap logic is better for UX usually, but reorder is "
-      "move. */"
-      "    /* Let's just do a move. */"
-      "    let target = i;"
-      "    /* if source was before target, target index has shifted down by 1 "
-      "in the intermediate array (minus source) */"
-      "    if (dragSrcIx < i) target--;"
-      "    stations.splice(target, 0, item);"
-      "    render();"
-      "  }"
-      "  return false;"
-      "}"
-      "function "
-      "addStation(){stations.push({call_sign:'',origin:'',uri:'',codec:1});"
-      "render();}"
-      "function "
-      "removeStation(i){if(confirm('Delete?')){stations.splice(i,1);render();}}"
-      "async function saveStations(){"
-      "  await "
-      "fetch('/api/"
-      "stations',{method:'POST',headers:{'Content-Type':'application/"
-      "json'},body:JSON.stringify(stations)});"
-      "  alert('Saved!');"
-      "}"
-      "fetchStations();"
-      "</script></body></html>";
-
-  httpd_resp_send(req, html_response, HTTPD_RESP_USE_STRLEN);
+/* Handler for GET /api/dsp?station=N */
+static esp_err_t api_dsp_get_handler(httpd_req_t *req) {
+  char *json_str = get_station_dsp_json(query_int_param(req, "station"));
+  if (json_str == NULL) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown station");
+    return ESP_FAIL;
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_send(req, json_str, HTTPD_RESP_USE_STRLEN);
+  free(json_str);
   return ESP_OK;
 }
 
-/* Handler for GET /config - Configuration Placeholder */
-static esp_err_t config_page_handler(httpd_req_t *req) {
-  const char *html_response =
-      "<!DOCTYPE html><html><head><meta name='viewport' "
-      "content='width=device-width, initial-scale=1.0'>"
-      "<title>Configuration</title></head>"
-      "<body><h1>Configuration</h1><p>Not implemented yet.</p>"
-      "<a href='/'>Back to Home</a></body></html>";
-  httpd_resp_send(req, html_response, HTTPD_RESP_USE_STRLEN);
+/* Handler for POST /api/dsp?station=N - saves the station's EQ and limiter
+ * settings and applies them at once if it is playing */
+static esp_err_t api_dsp_post_handler(httpd_req_t *req) {
+  if (req->content_len > STATION_DSP_MAX_SIZE) {
+    httpd_resp_set_status(req, "413 Payload Too Large");
+    httpd_resp_sendstr(req, "DSP settings too large");
+    return ESP_OK;
+  }
+
+  int station = query_int_param(req, "station");
+  esp_err_t err = patch_station_dsp_json(station, recv_chunk, req);
+  if (err != ESP_OK && err != ESP_ERR_NOT_FINISHED) {
+    return send_station_error(req, err);
+  }
+  apply_station_dsp(station);
+  if (err != ESP_OK) {
+    return send_station_error(req, err);
+  }
+  httpd_resp_sendstr(req, "{\"status\":\"ok\"}");
   return ESP_OK;
 }
 
+// The pages live in web/ and are minified and gzipped at build time (see
+// CMakeLists.txt). Every browser in use accepts gzip, so the packed bytes go
+// out as they are. The ETag is the CRC of those bytes; with no-cache the
+// browser revalidates each view and an unchanged page costs a 304 and no body.
+typedef struct {
+  const uint8_t *start;
+  const uint8_t *end;
+  char etag[11]; // "xxxxxxxx" with the quotes, filled in by start_web_server
+} web_asset_t;
+
+extern const uint8_t index_html_gz_start[] asm("_binary_index_html_gz_start");
+extern const uint8_t index_html_gz_end[] asm("_binary_index_html_gz_end");
+extern const uint8_t stations_html_gz_start[] asm(
+    "_binary_stations_html_gz_start");
+extern const uint8_t stations_html_gz_end[] asm("_binary_stations_html_gz_end");
+extern const uint8_t config_html_gz_start[] asm("_binary_config_html_gz_start");
+extern const uint8_t config_html_gz_end[] asm("_binary_config_html_gz_end");
+
+static web_asset_t index_page = {index_html_gz_start, index_html_gz_end, ""};
+static web_asset_t stations_page = {stations_html_gz_start,
+                                    stations_html_gz_end, ""};
+static web_asset_t config_page = {config_html_gz_start, config_html_gz_end,
+                                  ""};
+
+static void web_asset_init(web_asset_t *asset) {
+  uint32_t crc =
+      esp_rom_crc32_le(0, asset->start, (uint32_t)(asset->end - asset->start));
+  snprintf(asset->etag, sizeof(asset->etag), "\"%08" PRIx32 "\"", crc);
+}
+
+// If-None-Match holds a list of tags, possibly weak (W/"..."), or "*"; a
+// match anywhere in it will do
+static bool etag_matches(httpd_req_t *req, const char *etag) {
+  char value[128];
+  size_t len = httpd_req_get_hdr_value_len(req, "If-None-Match");
+  if (len == 0 || len >= sizeof(value) ||
+      httpd_req_get_hdr_value_str(req, "If-None-Match", value,
+                                  sizeof(value)) != ESP_OK) {
+    return false;
+  }
+  return strcmp(value, "*") == 0 || strstr(value, etag) != NULL;
+}
+
+/* Handler for GET /, /stations and /config - pages embedded from web/ */
+static esp_err_t web_asset_get_handler(httpd_req_t *req) {
+  const web_asset_t *asset = req->user_ctx;
+
+  httpd_resp_set_hdr(req, "ETag", asset->etag);
+  httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+  if (etag_matches(req, asset->etag)) {
+    httpd_resp_set_status(req, "304 Not Modified");
+    return httpd_resp_send(req, NULL, 0);
+  }
+  httpd_resp_set_type(req, "text/html");
+  httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+  return httpd_resp_send(req, (const char *)asset->start,
+                         asset->end - asset->start);
+}
+
 static const httpd_uri_t api_stations_get = {.uri = "/api/stations",
                                              .method = HTTP_GET,
                                              .handler =
@@ -240,30 +642,115 @@ static const httpd_uri_t api_stations_post = {.uri = "/api/stations",
                                                   api_stations_post_handler,
                                               .user_ctx = NULL};
 
+// /api/stations/N and /api/stations/N/move, matched by wildcard
+static const httpd_uri_t api_station_patch = {
+    .uri = "/api/stations/*",
+    .method = HTTP_PATCH,
+    .handler = api_station_patch_handler,
+    .user_ctx = NULL};
+
+static const httpd_uri_t api_station_delete = {
+    .uri = "/api/stations/*",
+    .method = HTTP_DELETE,
+    .handler = api_station_delete_handler,
+    .user_ctx = NULL};
+
+static const httpd_uri_t api_station_move = {
+    .uri = "/api/stations/*",
+    .method = HTTP_POST,
+    .handler = api_station_move_handler,
+    .user_ctx = NULL};
+
+static const httpd_uri_t api_tune_timing_get = {
+    .uri = "/api/tune_timing",
+    .method = HTTP_GET,
+    .handler = api_tune_timing_get_handler,
+    .user_ctx = NULL};
+
+static const httpd_uri_t api_recovery_get = {
+    .uri = "/api/recovery",
+    .method = HTTP_GET,
+    .handler = api_recovery_get_handler,
+    .user_ctx = NULL};
+
+static const httpd_uri_t api_stream_stats_get = {
+    .uri = "/api/stream_stats",
+    .method = HTTP_GET,
+    .handler = api_stream_stats_get_handler,
+    .user_ctx = NULL};
+
+#if CONFIG_RADIO_PROFILER
+static const httpd_uri_t api_trace_get = {.uri = "/api/trace",
+                                          .method = HTTP_GET,
+                                          .handler = api_trace_get_handler,
+                                          .user_ctx = NULL};
+#endif
+
+static const httpd_uri_t metrics_get = {.uri = "/metrics",
+                                        .method = HTTP_GET,
+                                        .handler = metrics_get_handler,
+                                        .user_ctx = NULL};
+
+static const httpd_uri_t api_events_get = {.uri = "/api/events",
+                                           .method = HTTP_GET,
+                                           .handler = api_events_get_handler,
+                                           .user_ctx = NULL};
+
+static const httpd_uri_t api_dsp_get = {.uri = "/api/dsp",
+                                        .method = HTTP_GET,
+                                        .handler = api_dsp_get_handler,
+                                        .user_ctx = NULL};
+
+static const httpd_uri_t api_dsp_post = {.uri = "/api/dsp",
+                                         .method = HTTP_POST,
+                                         .handler = api_dsp_post_handler,
+                                         .user_ctx = NULL};
+
 static const httpd_uri_t root_get = {.uri = "/",
                                      .method = HTTP_GET,
-                                     .handler = root_get_handler,
-                                     .user_ctx = NULL};
+                                     .handler = web_asset_get_handler,
+                                     .user_ctx = &index_page};
 
-static const httpd_uri_t stations_page_get = {.uri = "/stations",
-                                              .method = HTTP_GET,
-                                              .handler = stations_page_handler,
-                                              .user_ctx = NULL};
+static const httpd_uri_t stations_page_get = {
+    .uri = "/stations",
+    .method = HTTP_GET,
+    .handler = web_asset_get_handler,
+    .user_ctx = &stations_page};
 
-static const httpd_uri_t config_page_get = {.uri = "/config",
-                                            .method = HTTP_GET,
-                                            .handler = config_page_handler,
-                                            .user_ctx = NULL};
+static const httpd_uri_t config_page_get = {
+    .uri = "/config",
+    .method = HTTP_GET,
+    .handler = web_asset_get_handler,
+    .user_ctx = &config_page};
 
 void start_web_server(void) {
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
   config.stack_size = 8192; // Increase stack size for JSON parsing if needed
+  config.max_uri_handlers = 20; // the default of 8 is used up
+  config.uri_match_fn = httpd_uri_match_wildcard; // for /api/stations/N
+
+  web_asset_init(&index_page);
+  web_asset_init(&stations_page);
+  web_asset_init(&config_page);
 
   ESP_LOGI(TAG, "Starting web server on port: '%d'", config.server_port);
   if (httpd_start(&server, &config) == ESP_OK) {
     ESP_LOGI(TAG, "Registering URI handlers");
     httpd_register_uri_handler(server, &api_stations_get);
     httpd_register_uri_handler(server, &api_stations_post);
+    httpd_register_uri_handler(server, &api_station_patch);
+    httpd_register_uri_handler(server, &api_station_delete);
+    httpd_register_uri_handler(server, &api_station_move);
+    httpd_register_uri_handler(server, &api_tune_timing_get);
+    httpd_register_uri_handler(server, &api_recovery_get);
+    httpd_register_uri_handler(server, &api_stream_stats_get);
+    httpd_register_uri_handler(server, &metrics_get);
+    httpd_register_uri_handler(server, &api_events_get);
+#if CONFIG_RADIO_PROFILER
+    httpd_register_uri_handler(server, &api_trace_get);
+#endif
+    httpd_register_uri_handler(server, &api_dsp_get);
+    httpd_register_uri_handler(server, &api_dsp_post);
     httpd_register_uri_handler(server, &root_get);
     httpd_register_uri_handler(server, &stations_page_get);
     httpd_register_uri_handler(server, &config_page_get);
@@ -274,6 +761,8 @@ void start_web_server(void) {
 
 void stop_web_server(void) {
   if (server) {
-    httpd_stop(server);
+    httpd_handle_t hd = server;
+    server = NULL; // events are no longer sent
+    httpd_stop(hd); // closes the event stream sessions too
   }
 }
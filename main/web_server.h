@@ -1,6 +1,9 @@
 #ifndef WEB_SERVER_H
 #define WEB_SERVER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -8,6 +11,24 @@ extern "C" {
 void start_web_server(void);
 void stop_web_server(void);
 
+/**
+ * @brief Live status for /api/events subscribers. Each call replaces the
+ * last value of its kind, which new subscribers receive first. Safe to call
+ * from any task and before the server runs; the web server task does the
+ * sending.
+ */
+void web_events_volume(int volume);
+void web_events_mute(bool muted);
+void web_events_station(int index, const char *call_sign, const char *origin);
+void web_events_bitrate(int kbps);
+void web_events_now_playing(const char *title);
+/**
+ * @brief Reports the jitter buffer level, call it periodically. Only real
+ * changes are passed on: a move of 250 ms or more, a new target, or
+ * buffering starting or ending.
+ */
+void web_events_buffer(uint32_t depth_ms, uint32_t target_ms, bool buffering);
+
 #ifdef __cplusplus
 }
 #endif